@@ -35,6 +35,7 @@
 #include "config.h"
 
 #include "cmd.h"
+#include "syncdaemon.h"
 
 #include "theme.h"
 #include "netrcparser.h"
@@ -76,6 +77,11 @@ struct CmdOptions
     int restartTimes;
     int downlimit;
     int uplimit;
+    bool watch;
+    int pollInterval;
+    QString statusSocket;
+    bool deltaUploads;
+    bool serverSideCopies;
 };
 
 // we can't use csync_set_userdata because the SyncEngine sets it already.
@@ -186,6 +192,11 @@ void help()
     std::cout << "  --uplimit [n]          Limit the upload speed of files to n KB/s" << std::endl;
     std::cout << "  --downlimit [n]        Limit the download speed of files to n KB/s" << std::endl;
     std::cout << "  -h                     Sync hidden files, do not ignore them" << std::endl;
+    std::cout << "  --watch                Keep running and sync local and remote changes as they happen" << std::endl;
+    std::cout << "  --poll-interval [n]    With --watch, check the server for changes every n seconds (default 30)" << std::endl;
+    std::cout << "  --status-socket [path] With --watch, report status and counters as JSON on this local socket" << std::endl;
+    std::cout << "  --delta-uploads        Only upload the changed parts of big files, if the server supports it" << std::endl;
+    std::cout << "  --server-copies        Copy files on the server when it already has their content" << std::endl;
     std::cout << "  --version, -v          Display version and exit" << std::endl;
     std::cout << "  --logdebug             More verbose logging" << std::endl;
     std::cout << "" << std::endl;
@@ -265,6 +276,16 @@ void parseOptions(const QStringList &app_args, CmdOptions *options)
             options->uplimit = it.next().toInt() * 1000;
         } else if (option == "--downlimit" && !it.peekNext().startsWith("-")) {
             options->downlimit = it.next().toInt() * 1000;
+        } else if (option == "--watch") {
+            options->watch = true;
+        } else if (option == "--poll-interval" && !it.peekNext().startsWith("-")) {
+            options->pollInterval = qMax(1, it.next().toInt());
+        } else if (option == "--status-socket" && !it.peekNext().startsWith("-")) {
+            options->statusSocket = it.next();
+        } else if (option == "--delta-uploads") {
+            options->deltaUploads = true;
+        } else if (option == "--server-copies") {
+            options->serverSideCopies = true;
         } else if (option == "--logdebug") {
             Logger::instance()->setLogFile("-");
             Logger::instance()->setLogDebug(true);
@@ -324,6 +345,10 @@ int main(int argc, char **argv)
     options.restartTimes = 3;
     options.uplimit = 0;
     options.downlimit = 0;
+    options.watch = false;
+    options.pollInterval = 30;
+    options.deltaUploads = false;
+    options.serverSideCopies = false;
 
     parseOptions(app.arguments(), &options);
 
@@ -474,7 +499,9 @@ int main(int argc, char **argv)
     }
 
     // much lower age than the default since this utility is usually made to be run right after a change in the tests
-    SyncEngine::minimumFileAgeForUpload = 0;
+    // In watch mode files are synced while they are being written, keep the default there.
+    if (!options.watch)
+        SyncEngine::minimumFileAgeForUpload = 0;
 
     int restartCount = 0;
 restart_sync:
@@ -509,8 +536,14 @@ restart_sync:
     SyncEngine engine(account, options.source_dir, folder, &db);
     engine.setIgnoreHiddenFiles(options.ignoreHiddenFiles);
     engine.setNetworkLimits(options.uplimit, options.downlimit);
-    QObject::connect(&engine, &SyncEngine::finished,
-        [&app](bool result) { app.exit(result ? EXIT_SUCCESS : EXIT_FAILURE); });
+    SyncOptions syncOptions;
+    syncOptions._deltaUploads = options.deltaUploads;
+    syncOptions._serverSideCopies = options.serverSideCopies;
+    engine.setSyncOptions(syncOptions);
+    if (!options.watch) {
+        QObject::connect(&engine, &SyncEngine::finished,
+            [&app](bool result) { app.exit(result ? EXIT_SUCCESS : EXIT_FAILURE); });
+    }
     QObject::connect(&engine, &SyncEngine::transmissionProgress, &cmd, &Cmd::transmissionProgressSlot);
 
 
@@ -533,6 +566,18 @@ restart_sync:
         return EXIT_FAILURE;
     }
 
+    if (options.watch) {
+        // Runs until the process is stopped, the engine, journal and
+        // exclude lists stay loaded between syncs
+        SyncDaemon daemon(&engine, &db, account, options.source_dir, folder);
+        daemon.setPollInterval(options.pollInterval);
+        if (!options.statusSocket.isEmpty() && !daemon.setStatusSocket(options.statusSocket)) {
+            qCritical() << "Could not listen on the status socket" << options.statusSocket;
+            return EXIT_FAILURE;
+        }
+        daemon.start();
+        return app.exec();
+    }
 
     // Have to be done async, else, an error before exec() does not terminate the event loop.
     QMetaObject::invokeMethod(&engine, "startSync", Qt::QueuedConnection);
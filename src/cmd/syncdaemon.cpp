@@ -0,0 +1,312 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "syncdaemon.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+#include "filesystem.h"
+#include "folderwatcher.h"
+#include "networkjobs.h"
+#include "syncengine.h"
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcSyncDaemon, "nextcloud.cmd.daemon", QtInfoMsg)
+
+// Failing polls and syncs are retried at most this many doublings of the poll interval later
+static const int maxBackoffShift = 4;
+
+// A sync is restarted at most this many times in a row when it asks for a follow-up
+static const int maxFollowUpSyncs = 3;
+
+// No poll or retry waits longer than a day, whatever the interval and backoff
+static const qint64 maxDelay = 24 * 3600 * 1000LL;
+
+SyncDaemon::SyncDaemon(SyncEngine *engine, SyncJournalDb *journal, AccountPtr account,
+    const QString &localPath, const QString &remotePath, QObject *parent)
+    : QObject(parent)
+    , _engine(engine)
+    , _journal(journal)
+    , _account(account)
+    , _localPath(localPath)
+    , _remotePath(remotePath)
+{
+    if (!_localPath.endsWith(QLatin1Char('/')))
+        _localPath.append(QLatin1Char('/'));
+
+    _syncTimer.setSingleShot(true);
+    connect(&_syncTimer, &QTimer::timeout, this, &SyncDaemon::slotStartSync);
+    _pollTimer.setSingleShot(true);
+    connect(&_pollTimer, &QTimer::timeout, this, &SyncDaemon::slotPollEtag);
+
+    connect(_engine, &SyncEngine::rootEtag, this, [this](const QString &etag) { _lastEtag = etag; });
+    connect(_engine, &SyncEngine::itemCompleted, this, &SyncDaemon::slotItemCompleted);
+    connect(_engine, &SyncEngine::syncError, this, &SyncDaemon::slotSyncError);
+    connect(_engine, &SyncEngine::finished, this, &SyncDaemon::slotSyncFinished);
+}
+
+SyncDaemon::~SyncDaemon()
+{
+}
+
+bool SyncDaemon::setStatusSocket(const QString &name)
+{
+    // A socket file left behind by a previous run would make listen() fail
+    QLocalServer::removeServer(name);
+    _statusServer.reset(new QLocalServer);
+    connect(_statusServer.data(), &QLocalServer::newConnection, this, &SyncDaemon::slotStatusConnection);
+    if (!_statusServer->listen(name)) {
+        qCWarning(lcSyncDaemon) << "Could not listen on" << name << _statusServer->errorString();
+        return false;
+    }
+    return true;
+}
+
+void SyncDaemon::start()
+{
+    _watcher.reset(new FolderWatcher);
+    _watcher->setExcludeCheck([this](const QString &path) {
+        return _engine->excludedFiles().isExcluded(path, _localPath, _engine->ignoreHiddenFiles());
+    });
+    connect(_watcher.data(), &FolderWatcher::pathChanged, this, &SyncDaemon::slotPathChanged);
+    connect(_watcher.data(), &FolderWatcher::lostChanges, this, &SyncDaemon::slotNextSyncFullLocalDiscovery);
+    connect(_watcher.data(), &FolderWatcher::becameUnreliable, this, &SyncDaemon::slotWatcherUnreliable);
+    _watcher->init(_localPath);
+
+    scheduleSync(0);
+}
+
+QByteArray SyncDaemon::status() const
+{
+    QJsonObject status;
+    status.insert("state", _syncRunning ? QStringLiteral("syncing") : QStringLiteral("idle"));
+    status.insert("localPath", _localPath);
+    status.insert("remotePath", _remotePath);
+    status.insert("watcherReliable", _watcher && _watcher->isReliable());
+    status.insert("pendingLocalChanges", int(_localDiscoveryPaths.size()));
+    status.insert("syncs", _syncCount);
+    status.insert("failedSyncs", _failedSyncCount);
+    status.insert("consecutiveFailingSyncs", _consecutiveFailingSyncs);
+    status.insert("uploads", _uploadCount);
+    status.insert("downloads", _downloadCount);
+    status.insert("itemErrors", _itemErrorCount);
+    status.insert("localChanges", _localChangeCount);
+    status.insert("remoteChanges", _remoteChangeCount);
+    status.insert("lastSyncStart", _lastSyncStart.toString(Qt::ISODate));
+    status.insert("lastSyncDurationMs", _lastSyncDuration);
+    status.insert("lastSyncSuccess", _lastSyncSuccess);
+    status.insert("lastError", _lastError);
+    status.insert("lastEtag", _lastEtag);
+    status.insert("pollIntervalMs", _pollTimer.interval());
+    return QJsonDocument(status).toJson();
+}
+
+void SyncDaemon::slotPathChanged(const QString &path)
+{
+    if (!path.startsWith(_localPath))
+        return;
+
+    // Like Folder::slotWatchedPathChanged(): remember the path before
+    // filtering out the changes of the sync itself
+    const QByteArray relativePath = path.midRef(_localPath.size()).toUtf8();
+    _localDiscoveryPaths.insert(relativePath);
+
+    if (_engine->wasFileTouched(path))
+        return;
+
+    SyncJournalFileRecord record;
+    if (_journal->getFileRecord(relativePath, &record)
+        && record.isValid()
+        && !FileSystem::fileChanged(path, record._fileSize, record._modtime)) {
+        return;
+    }
+
+    ++_localChangeCount;
+    qCDebug(lcSyncDaemon) << "Local change in" << relativePath;
+    // Files younger than this are not uploaded anyway
+    scheduleSync(SyncEngine::minimumFileAgeForUpload);
+}
+
+void SyncDaemon::slotWatcherUnreliable(const QString &message)
+{
+    qCWarning(lcSyncDaemon) << "The folder watcher is unreliable, every poll runs a full sync:" << message;
+    _lastError = message;
+}
+
+void SyncDaemon::slotNextSyncFullLocalDiscovery()
+{
+    _fullLocalDiscoveryNeeded = true;
+    scheduleSync(SyncEngine::minimumFileAgeForUpload);
+}
+
+void SyncDaemon::slotPollEtag()
+{
+    if (_syncRunning || _etagJob)
+        return;
+
+    _etagJob = new RequestEtagJob(_account, _remotePath, this);
+    connect(_etagJob.data(), &RequestEtagJob::etagRetreived, this, &SyncDaemon::slotEtagRetrieved);
+    connect(_etagJob.data(), &AbstractNetworkJob::networkError, this, &SyncDaemon::slotEtagFailed);
+    // The job deletes itself when it is done, whatever the outcome
+    connect(_etagJob.data(), &QObject::destroyed, this, &SyncDaemon::schedulePoll, Qt::QueuedConnection);
+    _etagJob->start();
+}
+
+void SyncDaemon::slotEtagRetrieved(const QString &etag)
+{
+    _consecutiveFailingPolls = 0;
+    if (etag != _lastEtag) {
+        qCInfo(lcSyncDaemon) << "Remote etag changed from" << _lastEtag << "to" << etag;
+        _lastEtag = etag;
+        ++_remoteChangeCount;
+        scheduleSync(0);
+    } else if (!_watcher->isReliable()) {
+        // Local changes may have been missed
+        scheduleSync(0);
+    }
+}
+
+void SyncDaemon::slotEtagFailed()
+{
+    ++_consecutiveFailingPolls;
+    _lastError = tr("Could not check the remote folder for changes");
+    qCInfo(lcSyncDaemon) << "Etag check failed" << _consecutiveFailingPolls << "times in a row";
+}
+
+void SyncDaemon::slotStartSync()
+{
+    // slotSyncFinished() schedules the next sync if there are pending changes
+    if (_syncRunning)
+        return;
+
+    const bool periodicFullLocalDiscoveryNow = _fullLocalDiscoveryInterval >= 0
+        && _timeSinceLastFullLocalDiscovery.isValid()
+        && _timeSinceLastFullLocalDiscovery.hasExpired(_fullLocalDiscoveryInterval * 1000LL);
+    if (_watcher->isReliable() && !_fullLocalDiscoveryNeeded && !periodicFullLocalDiscoveryNow) {
+        qCInfo(lcSyncDaemon) << "Starting a sync of" << _localDiscoveryPaths.size() << "locally changed paths";
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, _localDiscoveryPaths);
+        _previousLocalDiscoveryPaths = std::move(_localDiscoveryPaths);
+    } else {
+        qCInfo(lcSyncDaemon) << "Starting a sync with full local discovery";
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+        _previousLocalDiscoveryPaths.clear();
+    }
+    _localDiscoveryPaths.clear();
+
+    _pollTimer.stop();
+    _syncRunning = true;
+    _lastSyncStart = QDateTime::currentDateTimeUtc();
+    _syncDuration.start();
+    QMetaObject::invokeMethod(_engine, "startSync", Qt::QueuedConnection);
+}
+
+void SyncDaemon::slotItemCompleted(const SyncFileItemPtr &item)
+{
+    if (item->_instruction == CSYNC_INSTRUCTION_NONE || item->_instruction == CSYNC_INSTRUCTION_UPDATE_METADATA)
+        return;
+
+    // add new directories or remove gone away dirs to the watcher
+    if (item->isDirectory() && item->_instruction == CSYNC_INSTRUCTION_NEW)
+        _watcher->addPath(_localPath + item->_file);
+    if (item->isDirectory() && item->_instruction == CSYNC_INSTRUCTION_REMOVE)
+        _watcher->removePath(_localPath + item->_file);
+
+    if (item->hasErrorStatus()) {
+        ++_itemErrorCount;
+        _lastError = item->_errorString;
+    } else if (item->_direction == SyncFileItem::Up) {
+        ++_uploadCount;
+    } else if (item->_direction == SyncFileItem::Down) {
+        ++_downloadCount;
+    }
+}
+
+void SyncDaemon::slotSyncError(const QString &message)
+{
+    _lastError = message;
+}
+
+void SyncDaemon::slotSyncFinished(bool success)
+{
+    _syncRunning = false;
+    _lastSyncDuration = _syncDuration.elapsed();
+    _lastSyncSuccess = success;
+    ++_syncCount;
+    qCInfo(lcSyncDaemon) << "Sync finished" << (success ? "successfully" : "with errors") << "after" << _lastSyncDuration << "ms";
+
+    if (success) {
+        _consecutiveFailingSyncs = 0;
+        if (_engine->lastLocalDiscoveryStyle() == LocalDiscoveryStyle::FilesystemOnly) {
+            _fullLocalDiscoveryNeeded = false;
+            _timeSinceLastFullLocalDiscovery.start();
+        }
+    } else {
+        ++_failedSyncCount;
+        ++_consecutiveFailingSyncs;
+        // The changed paths were not synced yet, look at them again
+        _localDiscoveryPaths.insert(_previousLocalDiscoveryPaths.begin(), _previousLocalDiscoveryPaths.end());
+    }
+    _previousLocalDiscoveryPaths.clear();
+
+    if (_engine->isAnotherSyncNeeded() == ImmediateFollowUp) {
+        ++_consecutiveFollowUpSyncs;
+    } else {
+        _consecutiveFollowUpSyncs = 0;
+    }
+
+    if (!success) {
+        const int shift = qMin(_consecutiveFailingSyncs - 1, maxBackoffShift);
+        scheduleSync(backoffDelay(shift));
+    } else if (_consecutiveFollowUpSyncs > 0 && _consecutiveFollowUpSyncs <= maxFollowUpSyncs) {
+        // Usually a file was still changing, wait until it is old enough
+        scheduleSync(SyncEngine::minimumFileAgeForUpload);
+    } else if (!_localDiscoveryPaths.empty()) {
+        scheduleSync(SyncEngine::minimumFileAgeForUpload);
+    }
+    schedulePoll();
+}
+
+void SyncDaemon::slotStatusConnection()
+{
+    while (QLocalSocket *socket = _statusServer->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        socket->write(status());
+        socket->disconnectFromServer();
+    }
+}
+
+void SyncDaemon::scheduleSync(int delay)
+{
+    if (!_syncTimer.isActive() || _syncTimer.remainingTime() > delay)
+        _syncTimer.start(delay);
+}
+
+int SyncDaemon::backoffDelay(int shift) const
+{
+    return int(qMin((qint64(_pollInterval) * 1000) << shift, maxDelay));
+}
+
+void SyncDaemon::schedulePoll()
+{
+    if (_syncRunning || _etagJob || _pollTimer.isActive())
+        return;
+    const int shift = qMin(_consecutiveFailingPolls, maxBackoffShift);
+    _pollTimer.start(backoffDelay(shift));
+}
+}
@@ -0,0 +1,136 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef SYNCDAEMON_H
+#define SYNCDAEMON_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QScopedPointer>
+#include <QTimer>
+
+#include <set>
+
+#include "accountfwd.h"
+#include "syncfileitem.h"
+
+class QLocalServer;
+
+namespace OCC {
+
+class FolderWatcher;
+class RequestEtagJob;
+class SyncEngine;
+class SyncJournalDb;
+
+/**
+ * @brief Keeps syncing one folder until the process is stopped
+ * @ingroup cmd
+ *
+ * Used by the --watch mode of the command line client. The engine, the
+ * journal and the exclude lists stay loaded between syncs. Local changes
+ * reported by the folder watcher start a sync that only looks at the
+ * changed paths, remote changes are found by polling the etag of the
+ * remote folder.
+ *
+ * If a status socket is set, every connection to it receives the state
+ * and counters of the daemon as JSON.
+ */
+class SyncDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    SyncDaemon(SyncEngine *engine, SyncJournalDb *journal, AccountPtr account,
+        const QString &localPath, const QString &remotePath, QObject *parent = 0);
+    ~SyncDaemon();
+
+    /// Seconds between etag checks while nothing fails
+    void setPollInterval(int seconds) { _pollInterval = qMax(1, seconds); }
+
+    /// Seconds between two syncs that read the whole local folder, negative for never
+    void setFullLocalDiscoveryInterval(int seconds) { _fullLocalDiscoveryInterval = seconds; }
+
+    /// Listen for status requests on this local socket, returns false on error
+    bool setStatusSocket(const QString &name);
+
+    /// Starts watching and runs the first sync
+    void start();
+
+    QByteArray status() const;
+
+private slots:
+    void slotPathChanged(const QString &path);
+    void slotWatcherUnreliable(const QString &message);
+    void slotNextSyncFullLocalDiscovery();
+    void slotPollEtag();
+    void slotEtagRetrieved(const QString &etag);
+    void slotEtagFailed();
+    void slotStartSync();
+    void slotItemCompleted(const SyncFileItemPtr &item);
+    void slotSyncError(const QString &message);
+    void slotSyncFinished(bool success);
+    void slotStatusConnection();
+
+private:
+    /// Starts a sync after delay ms, unless one is scheduled earlier
+    void scheduleSync(int delay);
+    void schedulePoll();
+    /// The poll interval doubled shift times in ms, capped to a day
+    int backoffDelay(int shift) const;
+
+    SyncEngine *_engine;
+    SyncJournalDb *_journal;
+    AccountPtr _account;
+    QString _localPath;
+    QString _remotePath;
+
+    QScopedPointer<FolderWatcher> _watcher;
+    QScopedPointer<QLocalServer> _statusServer;
+    QPointer<RequestEtagJob> _etagJob;
+
+    QTimer _syncTimer;
+    QTimer _pollTimer;
+    int _pollInterval = 30;
+    int _fullLocalDiscoveryInterval = 3600;
+
+    /// Changed paths relative to the folder, for the next sync
+    std::set<QByteArray> _localDiscoveryPaths;
+    /// The paths the running sync looks at, kept if it fails
+    std::set<QByteArray> _previousLocalDiscoveryPaths;
+    bool _fullLocalDiscoveryNeeded = true;
+    QElapsedTimer _timeSinceLastFullLocalDiscovery;
+
+    bool _syncRunning = false;
+    QString _lastEtag;
+    int _consecutiveFailingPolls = 0;
+    int _consecutiveFailingSyncs = 0;
+    int _consecutiveFollowUpSyncs = 0;
+
+    // Counters reported on the status socket
+    qint64 _syncCount = 0;
+    qint64 _failedSyncCount = 0;
+    qint64 _uploadCount = 0;
+    qint64 _downloadCount = 0;
+    qint64 _itemErrorCount = 0;
+    qint64 _localChangeCount = 0;
+    qint64 _remoteChangeCount = 0;
+    QDateTime _lastSyncStart;
+    qint64 _lastSyncDuration = 0;
+    bool _lastSyncSuccess = false;
+    QString _lastError;
+    QElapsedTimer _syncDuration;
+};
+}
+
+#endif
@@ -3,6 +3,7 @@
 # help keep track of the different code licenses.
 set(common_SOURCES
     ${CMAKE_CURRENT_LIST_DIR}/checksums.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/contentchunker.cpp
     ${CMAKE_CURRENT_LIST_DIR}/filesystembase.cpp
     ${CMAKE_CURRENT_LIST_DIR}/ownsql.cpp
     ${CMAKE_CURRENT_LIST_DIR}/syncjournaldb.cpp
@@ -0,0 +1,149 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "common/contentchunker.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QtEndian>
+
+namespace {
+
+/* A pseudo random value for every byte value, from splitmix64.
+ * The seed must never change, it defines where the boundaries are. */
+struct GearTable
+{
+    quint64 values[256];
+
+    GearTable()
+    {
+        quint64 state = 0x6e65787463646321ULL;
+        for (auto &value : values) {
+            quint64 z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+
+const quint64 *gearTable()
+{
+    static const GearTable table;
+    return table.values;
+}
+
+// Each byte is shifted out of the hash after 64 more, so the top 20 bits
+// depend on the last 64 bytes only and match once per MiB on average
+const quint64 boundaryMask = 0xfffff00000000000ULL;
+const qint64 gearWindow = 64;
+
+const int serializedChunkSize = 4 + 20;
+}
+
+namespace OCC {
+
+bool ContentChunker::chunkDevice(QIODevice *device, QVector<ContentChunk> *chunks)
+{
+    const quint64 *gear = gearTable();
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    const auto data = reinterpret_cast<const uchar *>(buffer.constData());
+
+    qint64 offset = device->pos(); // of the start of the buffer
+    qint64 chunkStart = offset;
+    quint64 hash = 0;
+
+    forever {
+        const qint64 read = device->read(buffer.data(), buffer.size());
+        if (read < 0)
+            return false;
+        if (read == 0)
+            break;
+
+        qint64 sliceStart = 0; // the part of the buffer that is not hashed yet
+        qint64 i = 0;
+        while (i < read) {
+            const qint64 chunkSize = offset + i - chunkStart;
+
+            // There is no boundary before the minimum size and only the
+            // last bytes before it matter for the hash
+            const qint64 skip = contentChunkMinSize - gearWindow - chunkSize;
+            if (skip > 0) {
+                i += qMin(skip, read - i);
+                continue;
+            }
+
+            hash = (hash << 1) + gear[data[i]];
+            ++i;
+            const qint64 size = chunkSize + 1;
+            if ((size >= contentChunkMinSize && (hash & boundaryMask) == 0) || size >= contentChunkMaxSize) {
+                sha1.addData(buffer.constData() + sliceStart, i - sliceStart);
+                chunks->append({ chunkStart, size, sha1.result() });
+                sha1.reset();
+                chunkStart += size;
+                sliceStart = i;
+                hash = 0;
+            }
+        }
+        sha1.addData(buffer.constData() + sliceStart, read - sliceStart);
+        offset += read;
+    }
+
+    if (offset > chunkStart)
+        chunks->append({ chunkStart, offset - chunkStart, sha1.result() });
+    return true;
+}
+
+bool ContentChunker::chunkFile(const QString &path, QVector<ContentChunk> *chunks)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return chunkDevice(&file, chunks);
+}
+
+QByteArray ContentChunker::serialize(const QVector<ContentChunk> &chunks)
+{
+    QByteArray data;
+    data.reserve(chunks.size() * serializedChunkSize);
+    for (const auto &chunk : chunks) {
+        uchar size[4];
+        qToBigEndian<quint32>(chunk.size, size);
+        data.append(reinterpret_cast<const char *>(size), 4);
+        data.append(chunk.hash);
+    }
+    return data;
+}
+
+bool ContentChunker::deserialize(const QByteArray &data, QVector<ContentChunk> *chunks)
+{
+    if (data.size() % serializedChunkSize != 0)
+        return false;
+
+    chunks->clear();
+    chunks->reserve(data.size() / serializedChunkSize);
+    qint64 offset = 0;
+    for (int pos = 0; pos < data.size(); pos += serializedChunkSize) {
+        const qint64 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + pos));
+        if (size == 0 || size > contentChunkMaxSize)
+            return false;
+        chunks->append({ offset, size, data.mid(pos + 4, 20) });
+        offset += size;
+    }
+    return true;
+}
+}
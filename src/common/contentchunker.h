@@ -0,0 +1,66 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "ocsynclib.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+namespace OCC {
+
+/** Bounds of the chunks cut by ContentChunker, about 1.25MiB on average */
+static const qint64 contentChunkMinSize = 256 * 1024;
+static const qint64 contentChunkMaxSize = 4 * 1024 * 1024;
+
+/** A part of a file as cut by ContentChunker */
+struct ContentChunk
+{
+    qint64 offset;
+    qint64 size;
+    QByteArray hash; /// raw SHA1 of the content
+};
+
+/**
+ * @brief Cuts files into content-defined chunks
+ * @ingroup libsync
+ *
+ * The boundaries are placed where a rolling hash of the last 64 bytes
+ * matches a pattern. An insertion or removal therefore only changes the
+ * chunks around the edit, the ones after it keep their content and hash
+ * and only move.
+ *
+ * Chunk lists are kept in the journal, so the boundaries of a content must
+ * never change between client versions.
+ */
+namespace ContentChunker {
+    /// Chunks what is left to read on the device, false on read errors
+    OCSYNC_EXPORT bool chunkDevice(QIODevice *device, QVector<ContentChunk> *chunks);
+
+    /// Chunks a file, false if it can't be read
+    OCSYNC_EXPORT bool chunkFile(const QString &path, QVector<ContentChunk> *chunks);
+
+    /// The sizes and hashes in a compact form, for the journal
+    OCSYNC_EXPORT QByteArray serialize(const QVector<ContentChunk> &chunks);
+
+    /// Reverses serialize(), false if the data is malformed
+    OCSYNC_EXPORT bool deserialize(const QByteArray &data, QVector<ContentChunk> *chunks);
+}
+}
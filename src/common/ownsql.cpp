@@ -52,6 +52,7 @@ SqlDatabase::SqlDatabase()
 SqlDatabase::~SqlDatabase()
 {
     close();
+    qDeleteAll(_cachedQueries);
 }
 
 
@@ -223,6 +224,17 @@ sqlite3 *SqlDatabase::sqliteDb()
     return _db;
 }
 
+SqlQuery *SqlDatabase::cachedQuery(const QByteArray &sql)
+{
+    SqlQuery *&query = _cachedQueries[sql];
+    if (!query)
+        query = new SqlQuery(*this);
+    // close() finishes the statements, they are prepared again here
+    if (!query->initOrReset(sql, *this))
+        return nullptr;
+    return query;
+}
+
 /* =========================================================================================== */
 
 SqlQuery::SqlQuery(SqlDatabase &db)
@@ -19,6 +19,7 @@
 #ifndef OWNSQL_H
 #define OWNSQL_H
 
+#include <QHash>
 #include <QObject>
 #include <QVariant>
 
@@ -51,6 +52,15 @@ public:
     QString error() const;
     sqlite3 *sqliteDb();
 
+    /**
+     * Returns the statement for \a sql, ready to bind values.
+     *
+     * The statement is only compiled on first use after the database was
+     * opened; later calls reset it and clear the bindings. Returns nullptr
+     * if it can't be prepared.
+     */
+    SqlQuery *cachedQuery(const QByteArray &sql);
+
 private:
     enum class CheckDbResult {
         Ok,
@@ -68,6 +78,7 @@ private:
 
     friend class SqlQuery;
     QSet<SqlQuery *> _queries;
+    QHash<QByteArray, SqlQuery *> _cachedQueries;
 };
 
 /**
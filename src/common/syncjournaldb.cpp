@@ -23,7 +23,12 @@
 #include <QElapsedTimer>
 #include <QUrl>
 #include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
 #include <sqlite3.h>
+#include <map>
+#include <vector>
 
 #include "common/syncjournaldb.h"
 #include "version.h"
@@ -44,6 +49,57 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcDb, "nextcloud.sync.database", QtInfoMsg)
 
+namespace {
+    /**
+     * Tells whether a path starts with one of a set of prefixes, in time
+     * proportional to the length of the path instead of the number of prefixes.
+     */
+    class PrefixTrie
+    {
+    public:
+        explicit PrefixTrie(const QSet<QString> &prefixes)
+            : _nodes(1)
+        {
+            for (const auto &prefix : prefixes) {
+                int node = 0;
+                for (char c : prefix.toUtf8()) {
+                    auto it = _nodes[node].children.find(c);
+                    if (it == _nodes[node].children.end()) {
+                        it = _nodes[node].children.emplace(c, int(_nodes.size())).first;
+                        _nodes.emplace_back();
+                    }
+                    node = it->second;
+                }
+                _nodes[node].isPrefix = true;
+            }
+        }
+
+        bool matches(const QByteArray &path) const
+        {
+            int node = 0;
+            for (char c : path) {
+                if (_nodes[node].isPrefix)
+                    return true;
+                auto it = _nodes[node].children.find(c);
+                if (it == _nodes[node].children.end())
+                    return false;
+                node = it->second;
+            }
+            return _nodes[node].isPrefix;
+        }
+
+    private:
+        struct Node
+        {
+            std::map<char, int> children;
+            bool isPrefix = false;
+        };
+        std::vector<Node> _nodes;
+    };
+}
+
+int SyncJournalDb::fileExistenceCheckInterval = 1000;
+
 #define GET_FILE_RECORD_QUERY \
         "SELECT path, inode, modtime, type, md5, fileid, remotePerm, filesize," \
         "  ignoredChildrenRemote, contentchecksumtype.name || ':' || contentChecksum, e2eMangledName " \
@@ -94,6 +150,8 @@ SyncJournalDb::SyncJournalDb(const QString &dbFilePath, QObject *parent)
     , _transaction(0)
     , _metadataTableIsEmpty(false)
 {
+    _walCheckpointPool.setMaxThreadCount(1);
+
     // Allow forcing the journal mode for debugging
     static QByteArray envJournalMode = qgetenv("OWNCLOUD_SQLITE_JOURNAL_MODE");
     _journalMode = envJournalMode;
@@ -226,11 +284,62 @@ QString SyncJournalDb::databaseFilePath() const
     return _dbFile;
 }
 
+#if SQLITE_VERSION_NUMBER >= 3007006
+namespace {
+    /**
+     * Checkpoints the WAL of a journal through a connection of its own.
+     *
+     * The checkpoint is passive: it doesn't wait for readers or writers of the
+     * journal and leaves the frames they still need to the next checkpoint.
+     */
+    class WalCheckpointJob : public QRunnable
+    {
+    public:
+        WalCheckpointJob(const QString &dbFile, QAtomicInt *running)
+            : _dbFile(dbFile)
+            , _running(running)
+        {
+        }
+
+        void run() Q_DECL_OVERRIDE
+        {
+            QThread::currentThread()->setPriority(QThread::IdlePriority);
+            QElapsedTimer t;
+            t.start();
+            sqlite3 *db = nullptr;
+            if (sqlite3_open_v2(_dbFile.toUtf8().constData(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr) == SQLITE_OK) {
+                int walFrames = 0;
+                int checkpointedFrames = 0;
+                if (sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &walFrames, &checkpointedFrames) == SQLITE_OK) {
+                    qCDebug(lcDb) << "WAL checkpoint of" << checkpointedFrames << "of" << walFrames << "frames took" << t.elapsed() << "msec";
+                } else {
+                    qCWarning(lcDb) << "WAL checkpoint failed:" << sqlite3_errmsg(db);
+                }
+            } else {
+                qCWarning(lcDb) << "Could not open" << _dbFile << "for the WAL checkpoint";
+            }
+            sqlite3_close(db);
+            _running->storeRelease(0);
+        }
+
+    private:
+        QString _dbFile;
+        QAtomicInt *_running;
+    };
+}
+#endif
+
 // Note that this does not change the size of the -wal file, but it is supposed to make
 // the normal .db faster since the changes from the wal will be incorporated into it.
 // Then the next sync (and the SocketAPI) will have a faster access.
 void SyncJournalDb::walCheckpoint()
 {
+    if (_journalMode.toUpper() != "WAL" || _dbFile.isEmpty())
+        return;
+#if SQLITE_VERSION_NUMBER >= 3007006
+    if (_walCheckpointRunning.testAndSetOrdered(0, 1))
+        _walCheckpointPool.start(new WalCheckpointJob(_dbFile, &_walCheckpointRunning));
+#else
     QElapsedTimer t;
     t.start();
     SqlQuery pragma1(_db);
@@ -238,6 +347,41 @@ void SyncJournalDb::walCheckpoint()
     if (pragma1.exec()) {
         qCDebug(lcDb) << "took" << t.elapsed() << "msec";
     }
+#endif
+}
+
+/*
+ * Sizes the memory map and the page cache for the journal.
+ *
+ * Journals with millions of entries are a few hundred MB large. The memory map
+ * lets reads of the journal go without a copy per page. It is not used with the
+ * DELETE journal mode, which is the fallback for file systems that have trouble
+ * with the WAL shared memory map.
+ */
+bool SyncJournalDb::setPerformancePragmas(SqlQuery &pragma)
+{
+    static const qint64 mb = 1024 * 1024;
+    const qint64 dbSize = QFileInfo(_dbFile).size();
+
+    if (_journalMode.toUpper() != "DELETE") {
+        const qint64 mmapSize = qBound(16 * mb, 2 * dbSize, 256 * mb);
+        pragma.prepare("PRAGMA mmap_size = " + QByteArray::number(mmapSize) + ";");
+        if (!pragma.exec()) {
+            return sqlFail("Set PRAGMA mmap_size", pragma);
+        }
+        // exec() doesn't step pragmas
+        pragma.next();
+    }
+
+    // a negative cache_size is in KiB instead of pages
+    const qint64 cacheSize = qBound(2 * mb, dbSize / 8, 32 * mb);
+    pragma.prepare("PRAGMA cache_size = " + QByteArray::number(-cacheSize / 1024) + ";");
+    if (!pragma.exec()) {
+        return sqlFail("Set PRAGMA cache_size", pragma);
+    }
+    pragma.next();
+    qCInfo(lcDb) << "sqlite3 with mmap_size and cache_size for a journal of" << dbSize << "bytes";
+    return true;
 }
 
 void SyncJournalDb::startTransaction()
@@ -280,11 +424,16 @@ bool SyncJournalDb::checkConnect()
     if (_db.isOpen()) {
         // Unfortunately the sqlite isOpen check can return true even when the underlying storage
         // has become unavailable - and then some operations may cause crashes. See #6049
+        // A stat() for every query is expensive with millions of queries per sync, the
+        // file is only looked at again after fileExistenceCheckInterval.
+        if (_lastFileExistenceCheck.isValid() && _lastFileExistenceCheck.elapsed() < fileExistenceCheckInterval)
+            return true;
         if (!QFile::exists(_dbFile)) {
             qCWarning(lcDb) << "Database open, but file " + _dbFile + " does not exist";
             close();
             return false;
         }
+        _lastFileExistenceCheck.start();
         return true;
     }
 
@@ -304,6 +453,7 @@ bool SyncJournalDb::checkConnect()
         qCWarning(lcDb) << "Database file" + _dbFile + " does not exist";
         return false;
     }
+    _lastFileExistenceCheck.start();
 
     SqlQuery pragma1(_db);
     pragma1.prepare("SELECT sqlite_version();");
@@ -340,6 +490,9 @@ bool SyncJournalDb::checkConnect()
     if (!pragma1.exec()) {
         return sqlFail("Set PRAGMA case_sensitivity", pragma1);
     }
+    if (!setPerformancePragmas(pragma1)) {
+        return false;
+    }
 
     /* Because insert is so slow, we do everything in a transaction, and only need one call to commit */
     startTransaction();
@@ -363,6 +516,7 @@ bool SyncJournalDb::checkConnect()
                         // ignoredChildrenRemote
                         // contentChecksum
                         // contentChecksumTypeId
+                        // pathSortKey
                         "PRIMARY KEY(phash)"
                         ");");
 
@@ -478,6 +632,17 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("Create table conflicts", createQuery);
     }
 
+    // create the contentchunks table.
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS contentchunks("
+                        "path VARCHAR(4096),"
+                        "etag VARCHAR(32),"
+                        "chunks BLOB,"
+                        "PRIMARY KEY(path)"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail("Create table contentchunks", createQuery);
+    }
+
     createQuery.prepare("CREATE TABLE IF NOT EXISTS version("
                         "major INTEGER(8),"
                         "minor INTEGER(8),"
@@ -559,25 +724,6 @@ bool SyncJournalDb::checkConnect()
         forceRemoteDiscoveryNextSyncLocked();
     }
 
-    if (!_deleteDownloadInfoQuery.initOrReset("DELETE FROM downloadinfo WHERE path=?1", _db)) {
-        return sqlFail("prepare _deleteDownloadInfoQuery", _deleteDownloadInfoQuery);
-    }
-
-    if (!_deleteUploadInfoQuery.initOrReset("DELETE FROM uploadinfo WHERE path=?1", _db)) {
-        return sqlFail("prepare _deleteUploadInfoQuery", _deleteUploadInfoQuery);
-    }
-
-    QByteArray sql("SELECT lastTryEtag, lastTryModtime, retrycount, errorstring, lastTryTime, ignoreDuration, renameTarget, errorCategory "
-                   "FROM blacklist WHERE path=?1");
-    if (Utility::fsCasePreserving()) {
-        // if the file system is case preserving we have to check the blacklist
-        // case insensitively
-        sql += " COLLATE NOCASE";
-    }
-    if (!_getErrorBlacklistQuery.initOrReset(sql, _db)) {
-        return sqlFail("prepare _getErrorBlacklistQuery", _getErrorBlacklistQuery);
-    }
-
     // don't start a new transaction now
     commitInternal(QString("checkConnect End"), false);
 
@@ -599,9 +745,14 @@ void SyncJournalDb::close()
     QMutexLocker locker(&_mutex);
     qCInfo(lcDb) << "Closing DB" << _dbFile;
 
+    flushErrorBlacklistAndConflictsLocked();
     commitTransaction();
 
+    // A running checkpoint has the file open, callers close the journal to
+    // remove or move it
+    _walCheckpointPool.waitForDone();
     _db.close();
+    _lastFileExistenceCheck.invalidate();
     clearEtagStorageFilter();
     _metadataTableIsEmpty = false;
 }
@@ -720,6 +871,54 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal("update database structure: add e2eMangledName col");
     }
 
+    // path||'/' sorts the contents of a directory directly behind it, see
+    // getFilesBelowPath(). Storing it lets the index serve the ORDER BY.
+    if (!columns.contains("pathSortKey")) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE metadata ADD COLUMN pathSortKey TEXT;");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: add pathSortKey column", query);
+            re = false;
+        }
+        commitInternal("update database structure: add pathSortKey col");
+    }
+
+    if (1) {
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_path_sort_key ON metadata(pathSortKey);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index pathSortKey", query);
+            re = false;
+        }
+        // Fills the new column, and records written by older clients that don't know it
+        query.prepare("UPDATE metadata SET pathSortKey = path || '/' WHERE pathSortKey IS NULL;");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: fill pathSortKey", query);
+            re = false;
+        }
+        commitInternal("update database structure: add pathSortKey index");
+    }
+
+    if (1) {
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_content_checksum ON metadata(contentChecksum);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index contentChecksum", query);
+            re = false;
+        }
+        commitInternal("update database structure: add contentChecksum index");
+    }
+
+    if (1) {
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_filesize_modtime ON metadata(filesize, modtime);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index filesize and modtime", query);
+            re = false;
+        }
+        commitInternal("update database structure: add filesize and modtime index");
+    }
+
     if (!tableColumns("uploadinfo").contains("contentChecksum")) {
         SqlQuery query(_db);
         query.prepare("ALTER TABLE uploadinfo ADD COLUMN contentChecksum TEXT;");
@@ -856,32 +1055,33 @@ bool SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
         parseChecksumHeader(record._checksumHeader, &checksumType, &checksum);
         int contentChecksumTypeId = mapChecksumType(checksumType);
 
-        if (!_setFileRecordQuery.initOrReset(QByteArrayLiteral(
+        const auto setFileRecordQuery = _db.cachedQuery(QByteArrayLiteral(
             "INSERT OR REPLACE INTO metadata "
-            "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, e2eMangledName) "
-            "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17);"), _db)) {
+            "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, e2eMangledName, pathSortKey) "
+            "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?3 || '/');"));
+        if (!setFileRecordQuery) {
             return false;
         }
 
-        _setFileRecordQuery.bindValue(1, phash);
-        _setFileRecordQuery.bindValue(2, plen);
-        _setFileRecordQuery.bindValue(3, record._path);
-        _setFileRecordQuery.bindValue(4, record._inode);
-        _setFileRecordQuery.bindValue(5, 0); // uid Not used
-        _setFileRecordQuery.bindValue(6, 0); // gid Not used
-        _setFileRecordQuery.bindValue(7, 0); // mode Not used
-        _setFileRecordQuery.bindValue(8, record._modtime);
-        _setFileRecordQuery.bindValue(9, record._type);
-        _setFileRecordQuery.bindValue(10, etag);
-        _setFileRecordQuery.bindValue(11, fileId);
-        _setFileRecordQuery.bindValue(12, remotePerm);
-        _setFileRecordQuery.bindValue(13, record._fileSize);
-        _setFileRecordQuery.bindValue(14, record._serverHasIgnoredFiles ? 1 : 0);
-        _setFileRecordQuery.bindValue(15, checksum);
-        _setFileRecordQuery.bindValue(16, contentChecksumTypeId);
-        _setFileRecordQuery.bindValue(17, record._e2eMangledName);
-
-        if (!_setFileRecordQuery.exec()) {
+        setFileRecordQuery->bindValue(1, phash);
+        setFileRecordQuery->bindValue(2, plen);
+        setFileRecordQuery->bindValue(3, record._path);
+        setFileRecordQuery->bindValue(4, record._inode);
+        setFileRecordQuery->bindValue(5, 0); // uid Not used
+        setFileRecordQuery->bindValue(6, 0); // gid Not used
+        setFileRecordQuery->bindValue(7, 0); // mode Not used
+        setFileRecordQuery->bindValue(8, record._modtime);
+        setFileRecordQuery->bindValue(9, record._type);
+        setFileRecordQuery->bindValue(10, etag);
+        setFileRecordQuery->bindValue(11, fileId);
+        setFileRecordQuery->bindValue(12, remotePerm);
+        setFileRecordQuery->bindValue(13, record._fileSize);
+        setFileRecordQuery->bindValue(14, record._serverHasIgnoredFiles ? 1 : 0);
+        setFileRecordQuery->bindValue(15, checksum);
+        setFileRecordQuery->bindValue(16, contentChecksumTypeId);
+        setFileRecordQuery->bindValue(17, record._e2eMangledName);
+
+        if (!setFileRecordQuery->exec()) {
             return false;
         }
 
@@ -903,20 +1103,22 @@ bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
         // if (!recursively) {
         // always delete the actual file.
 
-        if (!_deleteFileRecordPhash.initOrReset(QByteArrayLiteral("DELETE FROM metadata WHERE phash=?1"), _db))
+        const auto deleteFileRecordPhash = _db.cachedQuery(QByteArrayLiteral("DELETE FROM metadata WHERE phash=?1"));
+        if (!deleteFileRecordPhash)
             return false;
 
         qlonglong phash = getPHash(filename.toUtf8());
-        _deleteFileRecordPhash.bindValue(1, phash);
+        deleteFileRecordPhash->bindValue(1, phash);
 
-        if (!_deleteFileRecordPhash.exec())
+        if (!deleteFileRecordPhash->exec())
             return false;
 
         if (recursively) {
-            if (!_deleteFileRecordRecursively.initOrReset(QByteArrayLiteral("DELETE FROM metadata WHERE " IS_PREFIX_PATH_OF("?1", "path")), _db))
+            const auto deleteFileRecordRecursively = _db.cachedQuery(QByteArrayLiteral("DELETE FROM metadata WHERE " IS_PREFIX_PATH_OF("?1", "path")));
+            if (!deleteFileRecordRecursively)
                 return false;
-            _deleteFileRecordRecursively.bindValue(1, filename);
-            if (!_deleteFileRecordRecursively.exec()) {
+            deleteFileRecordRecursively->bindValue(1, filename);
+            if (!deleteFileRecordRecursively->exec()) {
                 return false;
             }
         }
@@ -944,22 +1146,23 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
         return false;
 
     if (!filename.isEmpty()) {
-        if (!_getFileRecordQuery.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE phash=?1"), _db))
+        const auto getFileRecordQuery = _db.cachedQuery(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE phash=?1"));
+        if (!getFileRecordQuery)
             return false;
 
-        _getFileRecordQuery.bindValue(1, getPHash(filename));
+        getFileRecordQuery->bindValue(1, getPHash(filename));
 
-        if (!_getFileRecordQuery.exec()) {
+        if (!getFileRecordQuery->exec()) {
             close();
             return false;
         }
 
-        if (_getFileRecordQuery.next()) {
-            fillFileRecordFromGetQuery(*rec, _getFileRecordQuery);
+        if (getFileRecordQuery->next()) {
+            fillFileRecordFromGetQuery(*rec, *getFileRecordQuery);
         } else {
-            int errId = _getFileRecordQuery.errorId();
+            int errId = getFileRecordQuery->errorId();
             if (errId != SQLITE_DONE) { // only do this if the problem is different from SQLITE_DONE
-                QString err = _getFileRecordQuery.error();
+                QString err = getFileRecordQuery->error();
                 qCWarning(lcDb) << "No journal entry found for " << filename << "Error: " << err;
                 close();
             }
@@ -986,23 +1189,24 @@ bool SyncJournalDb::getFileRecordByE2eMangledName(const QString &mangledName, Sy
     }
 
     if (!mangledName.isEmpty()) {
-        if (!_getFileRecordQueryByMangledName.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE e2eMangledName=?1"), _db)) {
+        const auto getFileRecordQueryByMangledName = _db.cachedQuery(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE e2eMangledName=?1"));
+        if (!getFileRecordQueryByMangledName) {
             return false;
         }
 
-        _getFileRecordQueryByMangledName.bindValue(1, mangledName);
+        getFileRecordQueryByMangledName->bindValue(1, mangledName);
 
-        if (!_getFileRecordQueryByMangledName.exec()) {
+        if (!getFileRecordQueryByMangledName->exec()) {
             close();
             return false;
         }
 
-        if (_getFileRecordQueryByMangledName.next()) {
-            fillFileRecordFromGetQuery(*rec, _getFileRecordQueryByMangledName);
+        if (getFileRecordQueryByMangledName->next()) {
+            fillFileRecordFromGetQuery(*rec, *getFileRecordQueryByMangledName);
         } else {
-            int errId = _getFileRecordQueryByMangledName.errorId();
+            int errId = getFileRecordQueryByMangledName->errorId();
             if (errId != SQLITE_DONE) { // only do this if the problem is different from SQLITE_DONE
-                QString err = _getFileRecordQueryByMangledName.error();
+                QString err = getFileRecordQueryByMangledName->error();
                 qCWarning(lcDb) << "No journal entry found for mangled name" << mangledName << "Error: " << err;
                 close();
             }
@@ -1026,16 +1230,17 @@ bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *r
     if (!checkConnect())
         return false;
 
-    if (!_getFileRecordQueryByInode.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE inode=?1"), _db))
+    const auto getFileRecordQueryByInode = _db.cachedQuery(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE inode=?1"));
+    if (!getFileRecordQueryByInode)
         return false;
 
-    _getFileRecordQueryByInode.bindValue(1, inode);
+    getFileRecordQueryByInode->bindValue(1, inode);
 
-    if (!_getFileRecordQueryByInode.exec())
+    if (!getFileRecordQueryByInode->exec())
         return false;
 
-    if (_getFileRecordQueryByInode.next())
-        fillFileRecordFromGetQuery(*rec, _getFileRecordQueryByInode);
+    if (getFileRecordQueryByInode->next())
+        fillFileRecordFromGetQuery(*rec, *getFileRecordQueryByInode);
 
     return true;
 }
@@ -1050,17 +1255,79 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     if (!checkConnect())
         return false;
 
-    if (!_getFileRecordQueryByFileId.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE fileid=?1"), _db))
+    const auto getFileRecordQueryByFileId = _db.cachedQuery(QByteArrayLiteral(GET_FILE_RECORD_QUERY " WHERE fileid=?1"));
+    if (!getFileRecordQueryByFileId)
+        return false;
+
+    getFileRecordQueryByFileId->bindValue(1, fileId);
+
+    if (!getFileRecordQueryByFileId->exec())
+        return false;
+
+    while (getFileRecordQueryByFileId->next()) {
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, *getFileRecordQueryByFileId);
+        rowCallback(rec);
+    }
+
+    return true;
+}
+
+bool SyncJournalDb::getFileRecordsByChecksum(const QByteArray &checksumHeader, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    QByteArray checksumType, checksum;
+    if (!parseChecksumHeader(checksumHeader, &checksumType, &checksum) || checksum.isEmpty() || _metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    const auto getFileRecordQueryByChecksum = _db.cachedQuery(QByteArrayLiteral(GET_FILE_RECORD_QUERY
+        " WHERE contentChecksum=?1 AND contentchecksumtype.name=?2"));
+    if (!getFileRecordQueryByChecksum)
+        return false;
+
+    getFileRecordQueryByChecksum->bindValue(1, checksum);
+    getFileRecordQueryByChecksum->bindValue(2, checksumType);
+
+    if (!getFileRecordQueryByChecksum->exec())
+        return false;
+
+    while (getFileRecordQueryByChecksum->next()) {
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, *getFileRecordQueryByChecksum);
+        rowCallback(rec);
+    }
+
+    return true;
+}
+
+bool SyncJournalDb::getFileRecordsBySizeAndModtime(qint64 size, qint64 modtime, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    const auto getFileRecordQueryBySizeAndModtime = _db.cachedQuery(QByteArrayLiteral(GET_FILE_RECORD_QUERY
+        " WHERE filesize=?1 AND modtime=?2"));
+    if (!getFileRecordQueryBySizeAndModtime)
         return false;
 
-    _getFileRecordQueryByFileId.bindValue(1, fileId);
+    getFileRecordQueryBySizeAndModtime->bindValue(1, size);
+    getFileRecordQueryBySizeAndModtime->bindValue(2, modtime);
 
-    if (!_getFileRecordQueryByFileId.exec())
+    if (!getFileRecordQueryBySizeAndModtime->exec())
         return false;
 
-    while (_getFileRecordQueryByFileId.next()) {
+    while (getFileRecordQueryBySizeAndModtime->next()) {
         SyncJournalFileRecord rec;
-        fillFileRecordFromGetQuery(rec, _getFileRecordQueryByFileId);
+        fillFileRecordFromGetQuery(rec, *getFileRecordQueryBySizeAndModtime);
         rowCallback(rec);
     }
 
@@ -1085,24 +1352,29 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
         // and find nothing. So, unfortunately, we have to use a different query for
         // retrieving the whole tree.
 
-        if (!_getAllFilesQuery.initOrReset(QByteArrayLiteral( GET_FILE_RECORD_QUERY " ORDER BY path||'/' ASC"), _db))
+        const auto getAllFilesQuery = _db.cachedQuery(QByteArrayLiteral( GET_FILE_RECORD_QUERY " ORDER BY pathSortKey ASC"));
+        if (!getAllFilesQuery)
             return false;
-        query = &_getAllFilesQuery;
+        query = getAllFilesQuery;
     } else {
         // This query is used to skip discovery and fill the tree from the
         // database instead
-        if (!_getFilesBelowPathQuery.initOrReset(QByteArrayLiteral(
+        const auto getFilesBelowPathQuery = _db.cachedQuery(QByteArrayLiteral(
                 GET_FILE_RECORD_QUERY
-                " WHERE " IS_PREFIX_PATH_OF("?1", "path")
+                // pathSortKey is path||'/', so this selects the same rows as
+                // IS_PREFIX_PATH_OF("?1", "path") but from the pathSortKey index.
+                " WHERE " IS_PREFIX_PATH_OF("?1", "pathSortKey")
                 // We want to ensure that the contents of a directory are sorted
                 // directly behind the directory itself. Without this ORDER BY
                 // an ordering like foo, foo-2, foo/file would be returned.
                 // With the trailing /, we get foo-2, foo, foo/file. This property
-                // is used in fill_tree_from_db().
-                " ORDER BY path||'/' ASC"), _db)) {
+                // is used in fill_tree_from_db(). The index delivers the rows in
+                // that order, no sorting is needed.
+                " ORDER BY pathSortKey ASC"));
+        if (!getFilesBelowPathQuery) {
             return false;
         }
-        query = &_getFilesBelowPathQuery;
+        query = getFilesBelowPathQuery;
         query->bindValue(1, path);
     }
 
@@ -1128,43 +1400,50 @@ bool SyncJournalDb::postSyncCleanup(const QSet<QString> &filepathsToKeep,
         return false;
     }
 
+    // The paths are compared as stored, without converting every row
+    QSet<QByteArray> pathsToKeep;
+    pathsToKeep.reserve(filepathsToKeep.size());
+    for (const auto &path : filepathsToKeep)
+        pathsToKeep.insert(path.toUtf8());
+    const PrefixTrie keptPrefixes(prefixesToKeep);
+
     SqlQuery query(_db);
-    query.prepare("SELECT phash, path FROM metadata order by path");
+    query.prepare("SELECT phash, path FROM metadata");
 
     if (!query.exec()) {
         return false;
     }
 
-    QByteArrayList superfluousItems;
+    QVector<qint64> superfluousItems;
 
     while (query.next()) {
-        const QString file = query.baValue(1);
-        bool keep = filepathsToKeep.contains(file);
-        if (!keep) {
-            foreach (const QString &prefix, prefixesToKeep) {
-                if (file.startsWith(prefix)) {
-                    keep = true;
-                    break;
-                }
-            }
-        }
-        if (!keep) {
-            superfluousItems.append(query.baValue(0));
+        const QByteArray file = query.baValue(1);
+        if (!pathsToKeep.contains(file) && !keptPrefixes.matches(file)) {
+            qCDebug(lcDb) << "Sync Journal cleanup for" << file;
+            superfluousItems.append(query.int64Value(0));
         }
     }
+    query.finish();
 
-    if (superfluousItems.count()) {
-        QByteArray sql = "DELETE FROM metadata WHERE phash in (" + superfluousItems.join(",") + ")";
-        qCInfo(lcDb) << "Sync Journal cleanup for" << superfluousItems;
-        SqlQuery delQuery(_db);
-        delQuery.prepare(sql);
-        if (!delQuery.exec()) {
+    if (!superfluousItems.isEmpty()) {
+        qCInfo(lcDb) << "Sync Journal cleanup of" << superfluousItems.size() << "entries";
+        // All in the current transaction, the statement is only compiled once
+        const auto deleteFileRecordPhash = _db.cachedQuery(QByteArrayLiteral("DELETE FROM metadata WHERE phash=?1"));
+        if (!deleteFileRecordPhash)
             return false;
+        for (qint64 phash : superfluousItems) {
+            deleteFileRecordPhash->reset_and_clear_bindings();
+            deleteFileRecordPhash->bindValue(1, phash);
+            if (!deleteFileRecordPhash->exec())
+                return false;
         }
-    }
 
-    // Incorporate results back into main DB
-    walCheckpoint();
+        // The chunk lists of the files that are gone
+        SqlQuery deleteChunksQuery(_db);
+        deleteChunksQuery.prepare("DELETE FROM contentchunks WHERE path NOT IN (SELECT path FROM metadata)");
+        if (!deleteChunksQuery.exec())
+            return false;
+    }
 
     return true;
 }
@@ -1204,16 +1483,17 @@ bool SyncJournalDb::updateFileRecordChecksum(const QString &filename,
 
     int checksumTypeId = mapChecksumType(contentChecksumType);
 
-    if (!_setFileRecordChecksumQuery.initOrReset(QByteArrayLiteral(
+    const auto setFileRecordChecksumQuery = _db.cachedQuery(QByteArrayLiteral(
             "UPDATE metadata"
             " SET contentChecksum = ?2, contentChecksumTypeId = ?3"
-            " WHERE phash == ?1;"), _db)) {
+            " WHERE phash == ?1;"));
+    if (!setFileRecordChecksumQuery) {
         return false;
     }
-    _setFileRecordChecksumQuery.bindValue(1, phash);
-    _setFileRecordChecksumQuery.bindValue(2, contentChecksum);
-    _setFileRecordChecksumQuery.bindValue(3, checksumTypeId);
-    return _setFileRecordChecksumQuery.exec();
+    setFileRecordChecksumQuery->bindValue(1, phash);
+    setFileRecordChecksumQuery->bindValue(2, contentChecksum);
+    setFileRecordChecksumQuery->bindValue(3, checksumTypeId);
+    return setFileRecordChecksumQuery->exec();
 }
 
 bool SyncJournalDb::updateLocalMetadata(const QString &filename,
@@ -1231,18 +1511,19 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
     }
 
 
-    if (!_setFileRecordLocalMetadataQuery.initOrReset(QByteArrayLiteral(
+    const auto setFileRecordLocalMetadataQuery = _db.cachedQuery(QByteArrayLiteral(
             "UPDATE metadata"
             " SET inode=?2, modtime=?3, filesize=?4"
-            " WHERE phash == ?1;"), _db)) {
+            " WHERE phash == ?1;"));
+    if (!setFileRecordLocalMetadataQuery) {
         return false;
     }
 
-    _setFileRecordLocalMetadataQuery.bindValue(1, phash);
-    _setFileRecordLocalMetadataQuery.bindValue(2, inode);
-    _setFileRecordLocalMetadataQuery.bindValue(3, modtime);
-    _setFileRecordLocalMetadataQuery.bindValue(4, size);
-    return _setFileRecordLocalMetadataQuery.exec();
+    setFileRecordLocalMetadataQuery->bindValue(1, phash);
+    setFileRecordLocalMetadataQuery->bindValue(2, inode);
+    setFileRecordLocalMetadataQuery->bindValue(3, modtime);
+    setFileRecordLocalMetadataQuery->bindValue(4, size);
+    return setFileRecordLocalMetadataQuery->exec();
 }
 
 bool SyncJournalDb::setFileRecordMetadata(const SyncJournalFileRecord &record)
@@ -1304,19 +1585,20 @@ SyncJournalDb::DownloadInfo SyncJournalDb::getDownloadInfo(const QString &file)
 
     if (checkConnect()) {
 
-        if (!_getDownloadInfoQuery.initOrReset(QByteArrayLiteral(
-                "SELECT tmpfile, etag, errorcount FROM downloadinfo WHERE path=?1"), _db)) {
+        const auto getDownloadInfoQuery = _db.cachedQuery(QByteArrayLiteral(
+                "SELECT tmpfile, etag, errorcount FROM downloadinfo WHERE path=?1"));
+        if (!getDownloadInfoQuery) {
             return res;
         }
 
-        _getDownloadInfoQuery.bindValue(1, file);
+        getDownloadInfoQuery->bindValue(1, file);
 
-        if (!_getDownloadInfoQuery.exec()) {
+        if (!getDownloadInfoQuery->exec()) {
             return res;
         }
 
-        if (_getDownloadInfoQuery.next()) {
-            toDownloadInfo(_getDownloadInfoQuery, &res);
+        if (getDownloadInfoQuery->next()) {
+            toDownloadInfo(*getDownloadInfoQuery, &res);
         } else {
             res._valid = false;
         }
@@ -1334,21 +1616,24 @@ void SyncJournalDb::setDownloadInfo(const QString &file, const SyncJournalDb::Do
 
 
     if (i._valid) {
-        if (!_setDownloadInfoQuery.initOrReset(QByteArrayLiteral(
+        const auto setDownloadInfoQuery = _db.cachedQuery(QByteArrayLiteral(
                 "INSERT OR REPLACE INTO downloadinfo "
                 "(path, tmpfile, etag, errorcount) "
-                "VALUES ( ?1 , ?2, ?3, ?4 )"), _db)) {
+                "VALUES ( ?1 , ?2, ?3, ?4 )"));
+        if (!setDownloadInfoQuery) {
             return;
         }
-        _setDownloadInfoQuery.bindValue(1, file);
-        _setDownloadInfoQuery.bindValue(2, i._tmpfile);
-        _setDownloadInfoQuery.bindValue(3, i._etag);
-        _setDownloadInfoQuery.bindValue(4, i._errorCount);
-        _setDownloadInfoQuery.exec();
+        setDownloadInfoQuery->bindValue(1, file);
+        setDownloadInfoQuery->bindValue(2, i._tmpfile);
+        setDownloadInfoQuery->bindValue(3, i._etag);
+        setDownloadInfoQuery->bindValue(4, i._errorCount);
+        setDownloadInfoQuery->exec();
     } else {
-        _deleteDownloadInfoQuery.reset_and_clear_bindings();
-        _deleteDownloadInfoQuery.bindValue(1, file);
-        _deleteDownloadInfoQuery.exec();
+        const auto deleteDownloadInfoQuery = _db.cachedQuery(QByteArrayLiteral("DELETE FROM downloadinfo WHERE path=?1"));
+        if (!deleteDownloadInfoQuery)
+            return;
+        deleteDownloadInfoQuery->bindValue(1, file);
+        deleteDownloadInfoQuery->exec();
     }
 }
 
@@ -1382,7 +1667,8 @@ QVector<SyncJournalDb::DownloadInfo> SyncJournalDb::getAndDeleteStaleDownloadInf
         }
     }
 
-    if (!deleteBatch(_deleteDownloadInfoQuery, superfluousPaths, "downloadinfo"))
+    const auto deleteDownloadInfoQuery = _db.cachedQuery(QByteArrayLiteral("DELETE FROM downloadinfo WHERE path=?1"));
+    if (!deleteDownloadInfoQuery || !deleteBatch(*deleteDownloadInfoQuery, superfluousPaths, "downloadinfo"))
         return empty_result;
 
     return deleted_entries;
@@ -1413,25 +1699,26 @@ SyncJournalDb::UploadInfo SyncJournalDb::getUploadInfo(const QString &file)
     UploadInfo res;
 
     if (checkConnect()) {
-        if (!_getUploadInfoQuery.initOrReset(QByteArrayLiteral(
+        const auto getUploadInfoQuery = _db.cachedQuery(QByteArrayLiteral(
                 "SELECT chunk, transferid, errorcount, size, modtime, contentChecksum FROM "
-                "uploadinfo WHERE path=?1"), _db)) {
+                "uploadinfo WHERE path=?1"));
+        if (!getUploadInfoQuery) {
             return res;
         }
-        _getUploadInfoQuery.bindValue(1, file);
+        getUploadInfoQuery->bindValue(1, file);
 
-        if (!_getUploadInfoQuery.exec()) {
+        if (!getUploadInfoQuery->exec()) {
             return res;
         }
 
-        if (_getUploadInfoQuery.next()) {
+        if (getUploadInfoQuery->next()) {
             bool ok = true;
-            res._chunk = _getUploadInfoQuery.intValue(0);
-            res._transferid = _getUploadInfoQuery.intValue(1);
-            res._errorCount = _getUploadInfoQuery.intValue(2);
-            res._size = _getUploadInfoQuery.int64Value(3);
-            res._modtime = _getUploadInfoQuery.int64Value(4);
-            res._contentChecksum = _getUploadInfoQuery.baValue(5);
+            res._chunk = getUploadInfoQuery->intValue(0);
+            res._transferid = getUploadInfoQuery->intValue(1);
+            res._errorCount = getUploadInfoQuery->intValue(2);
+            res._size = getUploadInfoQuery->int64Value(3);
+            res._modtime = getUploadInfoQuery->int64Value(4);
+            res._contentChecksum = getUploadInfoQuery->baValue(5);
             res._valid = ok;
         }
     }
@@ -1447,29 +1734,32 @@ void SyncJournalDb::setUploadInfo(const QString &file, const SyncJournalDb::Uplo
     }
 
     if (i._valid) {
-        if (!_setUploadInfoQuery.initOrReset(QByteArrayLiteral(
+        const auto setUploadInfoQuery = _db.cachedQuery(QByteArrayLiteral(
             "INSERT OR REPLACE INTO uploadinfo "
             "(path, chunk, transferid, errorcount, size, modtime, contentChecksum) "
-            "VALUES ( ?1 , ?2, ?3 , ?4 ,  ?5, ?6 , ?7 )"), _db)) {
+            "VALUES ( ?1 , ?2, ?3 , ?4 ,  ?5, ?6 , ?7 )"));
+        if (!setUploadInfoQuery) {
             return;
         }
 
-        _setUploadInfoQuery.bindValue(1, file);
-        _setUploadInfoQuery.bindValue(2, i._chunk);
-        _setUploadInfoQuery.bindValue(3, i._transferid);
-        _setUploadInfoQuery.bindValue(4, i._errorCount);
-        _setUploadInfoQuery.bindValue(5, i._size);
-        _setUploadInfoQuery.bindValue(6, i._modtime);
-        _setUploadInfoQuery.bindValue(7, i._contentChecksum);
+        setUploadInfoQuery->bindValue(1, file);
+        setUploadInfoQuery->bindValue(2, i._chunk);
+        setUploadInfoQuery->bindValue(3, i._transferid);
+        setUploadInfoQuery->bindValue(4, i._errorCount);
+        setUploadInfoQuery->bindValue(5, i._size);
+        setUploadInfoQuery->bindValue(6, i._modtime);
+        setUploadInfoQuery->bindValue(7, i._contentChecksum);
 
-        if (!_setUploadInfoQuery.exec()) {
+        if (!setUploadInfoQuery->exec()) {
             return;
         }
     } else {
-        _deleteUploadInfoQuery.reset_and_clear_bindings();
-        _deleteUploadInfoQuery.bindValue(1, file);
+        const auto deleteUploadInfoQuery = _db.cachedQuery(QByteArrayLiteral("DELETE FROM uploadinfo WHERE path=?1"));
+        if (!deleteUploadInfoQuery)
+            return;
+        deleteUploadInfoQuery->bindValue(1, file);
 
-        if (!_deleteUploadInfoQuery.exec()) {
+        if (!deleteUploadInfoQuery->exec()) {
             return;
         }
     }
@@ -1501,10 +1791,65 @@ QVector<uint> SyncJournalDb::deleteStaleUploadInfos(const QSet<QString> &keep)
         }
     }
 
-    deleteBatch(_deleteUploadInfoQuery, superfluousPaths, "uploadinfo");
+    if (const auto deleteUploadInfoQuery = _db.cachedQuery(QByteArrayLiteral("DELETE FROM uploadinfo WHERE path=?1")))
+        deleteBatch(*deleteUploadInfoQuery, superfluousPaths, "uploadinfo");
     return ids;
 }
 
+SyncJournalDb::ContentChunksInfo SyncJournalDb::getContentChunks(const QString &file)
+{
+    QMutexLocker locker(&_mutex);
+
+    ContentChunksInfo res;
+
+    if (checkConnect()) {
+        const auto query = _db.cachedQuery(QByteArrayLiteral("SELECT etag, chunks FROM contentchunks WHERE path=?1"));
+        if (!query)
+            return res;
+        query->bindValue(1, file);
+        if (!query->exec())
+            return res;
+
+        if (query->next()) {
+            res._etag = query->baValue(0);
+            res._chunks = query->baValue(1);
+            res._valid = true;
+        }
+    }
+    return res;
+}
+
+void SyncJournalDb::setContentChunks(const QString &file, const ContentChunksInfo &info)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!checkConnect())
+        return;
+
+    if (info._valid) {
+        const auto query = _db.cachedQuery(QByteArrayLiteral(
+            "INSERT OR REPLACE INTO contentchunks (path, etag, chunks) VALUES (?1, ?2, ?3)"));
+        if (!query)
+            return;
+        query->bindValue(1, file);
+        query->bindValue(2, info._etag);
+        query->bindValue(3, info._chunks);
+        query->exec();
+    } else {
+        const auto query = _db.cachedQuery(QByteArrayLiteral("DELETE FROM contentchunks WHERE path=?1"));
+        if (!query)
+            return;
+        query->bindValue(1, file);
+        query->exec();
+    }
+}
+
+// The blacklist is queried case insensitively on case preserving file systems
+static QString errorBlacklistKey(const QString &file)
+{
+    return Utility::fsCasePreserving() ? file.toLower() : file;
+}
+
 SyncJournalErrorBlacklistRecord SyncJournalDb::errorBlacklistEntry(const QString &file)
 {
     QMutexLocker locker(&_mutex);
@@ -1513,22 +1858,38 @@ SyncJournalErrorBlacklistRecord SyncJournalDb::errorBlacklistEntry(const QString
     if (file.isEmpty())
         return entry;
 
-    // SELECT lastTryEtag, lastTryModtime, retrycount, errorstring
+    if (_errorBlacklistAndConflictsLoaded) {
+        auto it = _errorBlacklist.constFind(errorBlacklistKey(file));
+        if (it != _errorBlacklist.constEnd()) {
+            entry = *it;
+            entry._file = file;
+        }
+        return entry;
+    }
 
     if (checkConnect()) {
-        _getErrorBlacklistQuery.reset_and_clear_bindings();
-        _getErrorBlacklistQuery.bindValue(1, file);
-        if (_getErrorBlacklistQuery.exec()) {
-            if (_getErrorBlacklistQuery.next()) {
-                entry._lastTryEtag = _getErrorBlacklistQuery.baValue(0);
-                entry._lastTryModtime = _getErrorBlacklistQuery.int64Value(1);
-                entry._retryCount = _getErrorBlacklistQuery.intValue(2);
-                entry._errorString = _getErrorBlacklistQuery.stringValue(3);
-                entry._lastTryTime = _getErrorBlacklistQuery.int64Value(4);
-                entry._ignoreDuration = _getErrorBlacklistQuery.int64Value(5);
-                entry._renameTarget = _getErrorBlacklistQuery.stringValue(6);
+        QByteArray sql("SELECT lastTryEtag, lastTryModtime, retrycount, errorstring, lastTryTime, ignoreDuration, renameTarget, errorCategory "
+                       "FROM blacklist WHERE path=?1");
+        if (Utility::fsCasePreserving()) {
+            // if the file system is case preserving we have to check the blacklist
+            // case insensitively
+            sql += " COLLATE NOCASE";
+        }
+        const auto getErrorBlacklistQuery = _db.cachedQuery(sql);
+        if (!getErrorBlacklistQuery)
+            return entry;
+        getErrorBlacklistQuery->bindValue(1, file);
+        if (getErrorBlacklistQuery->exec()) {
+            if (getErrorBlacklistQuery->next()) {
+                entry._lastTryEtag = getErrorBlacklistQuery->baValue(0);
+                entry._lastTryModtime = getErrorBlacklistQuery->int64Value(1);
+                entry._retryCount = getErrorBlacklistQuery->intValue(2);
+                entry._errorString = getErrorBlacklistQuery->stringValue(3);
+                entry._lastTryTime = getErrorBlacklistQuery->int64Value(4);
+                entry._ignoreDuration = getErrorBlacklistQuery->int64Value(5);
+                entry._renameTarget = getErrorBlacklistQuery->stringValue(6);
                 entry._errorCategory = static_cast<SyncJournalErrorBlacklistRecord::Category>(
-                    _getErrorBlacklistQuery.intValue(7));
+                    getErrorBlacklistQuery->intValue(7));
                 entry._file = file;
             }
         }
@@ -1541,6 +1902,19 @@ bool SyncJournalDb::deleteStaleErrorBlacklistEntries(const QSet<QString> &keep)
 {
     QMutexLocker locker(&_mutex);
 
+    if (_errorBlacklistAndConflictsLoaded) {
+        for (auto it = _errorBlacklist.begin(); it != _errorBlacklist.end();) {
+            if (keep.contains(it->_file)) {
+                ++it;
+                continue;
+            }
+            _removedErrorBlacklistPaths.insert(it->_file);
+            _changedErrorBlacklistEntries.remove(it.key());
+            it = _errorBlacklist.erase(it);
+        }
+        return true;
+    }
+
     if (!checkConnect()) {
         return false;
     }
@@ -1566,11 +1940,144 @@ bool SyncJournalDb::deleteStaleErrorBlacklistEntries(const QSet<QString> &keep)
     return deleteBatch(delQuery, superfluousPaths, "blacklist");
 }
 
+bool SyncJournalDb::preloadErrorBlacklistAndConflicts()
+{
+    QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded)
+        return true;
+    if (!checkConnect())
+        return false;
+
+    SqlQuery query(_db);
+    query.prepare("SELECT path, lastTryEtag, lastTryModtime, retrycount, errorstring, lastTryTime, ignoreDuration, renameTarget, errorCategory "
+                  "FROM blacklist");
+    if (!query.exec()) {
+        sqlFail("preload blacklist", query);
+        return false;
+    }
+    QHash<QString, SyncJournalErrorBlacklistRecord> errorBlacklist;
+    while (query.next()) {
+        SyncJournalErrorBlacklistRecord entry;
+        entry._file = query.stringValue(0);
+        entry._lastTryEtag = query.baValue(1);
+        entry._lastTryModtime = query.int64Value(2);
+        entry._retryCount = query.intValue(3);
+        entry._errorString = query.stringValue(4);
+        entry._lastTryTime = query.int64Value(5);
+        entry._ignoreDuration = query.int64Value(6);
+        entry._renameTarget = query.stringValue(7);
+        entry._errorCategory = static_cast<SyncJournalErrorBlacklistRecord::Category>(query.intValue(8));
+        errorBlacklist.insert(errorBlacklistKey(entry._file), entry);
+    }
+
+    query.prepare("SELECT path, baseFileId, baseModtime, baseEtag FROM conflicts");
+    if (!query.exec()) {
+        sqlFail("preload conflicts", query);
+        return false;
+    }
+    QHash<QByteArray, ConflictRecord> conflictRecords;
+    while (query.next()) {
+        ConflictRecord entry;
+        entry.path = query.baValue(0);
+        entry.baseFileId = query.baValue(1);
+        entry.baseModtime = query.int64Value(2);
+        entry.baseEtag = query.baValue(3);
+        conflictRecords.insert(entry.path, entry);
+    }
+
+    _errorBlacklist = std::move(errorBlacklist);
+    _conflictRecords = std::move(conflictRecords);
+    _errorBlacklistAndConflictsLoaded = true;
+    qCInfo(lcDb) << "Preloaded" << _errorBlacklist.size() << "blacklist entries and"
+                 << _conflictRecords.size() << "conflict records";
+    return true;
+}
+
+void SyncJournalDb::flushErrorBlacklistAndConflicts()
+{
+    QMutexLocker locker(&_mutex);
+    flushErrorBlacklistAndConflictsLocked();
+}
+
+void SyncJournalDb::flushErrorBlacklistAndConflictsLocked()
+{
+    if (!_errorBlacklistAndConflictsLoaded)
+        return;
+
+    const auto errorBlacklist = std::move(_errorBlacklist);
+    const auto changedErrorBlacklistEntries = std::move(_changedErrorBlacklistEntries);
+    const auto removedErrorBlacklistPaths = std::move(_removedErrorBlacklistPaths);
+    const auto conflictRecords = std::move(_conflictRecords);
+    const auto changedConflictRecords = std::move(_changedConflictRecords);
+    _errorBlacklistAndConflictsLoaded = false;
+
+    if (changedErrorBlacklistEntries.isEmpty() && removedErrorBlacklistPaths.isEmpty()
+        && changedConflictRecords.isEmpty()) {
+        return;
+    }
+    if (!checkConnect()) {
+        qCWarning(lcDb) << "Could not write the blacklist and conflict changes";
+        return;
+    }
+    startTransaction();
+
+    if (!removedErrorBlacklistPaths.isEmpty()) {
+        SqlQuery delQuery(_db);
+        delQuery.prepare("DELETE FROM blacklist WHERE path=?1");
+        deleteBatch(delQuery, removedErrorBlacklistPaths.toList(), "blacklist");
+    }
+    const auto setErrorBlacklistQuery = changedErrorBlacklistEntries.isEmpty() ? nullptr : _db.cachedQuery(QByteArrayLiteral(
+        "INSERT OR REPLACE INTO blacklist "
+        "(path, lastTryEtag, lastTryModtime, retrycount, errorstring, lastTryTime, ignoreDuration, renameTarget, errorCategory) "
+        "VALUES ( ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)"));
+    if (setErrorBlacklistQuery) {
+        for (const auto &key : changedErrorBlacklistEntries) {
+            const auto item = errorBlacklist.value(key);
+            setErrorBlacklistQuery->reset_and_clear_bindings();
+            setErrorBlacklistQuery->bindValue(1, item._file);
+            setErrorBlacklistQuery->bindValue(2, item._lastTryEtag);
+            setErrorBlacklistQuery->bindValue(3, item._lastTryModtime);
+            setErrorBlacklistQuery->bindValue(4, item._retryCount);
+            setErrorBlacklistQuery->bindValue(5, item._errorString);
+            setErrorBlacklistQuery->bindValue(6, item._lastTryTime);
+            setErrorBlacklistQuery->bindValue(7, item._ignoreDuration);
+            setErrorBlacklistQuery->bindValue(8, item._renameTarget);
+            setErrorBlacklistQuery->bindValue(9, item._errorCategory);
+            setErrorBlacklistQuery->exec();
+        }
+    }
+
+    for (const auto &path : changedConflictRecords) {
+        auto it = conflictRecords.constFind(path);
+        if (it == conflictRecords.constEnd()) {
+            const auto query = _db.cachedQuery(QByteArrayLiteral("DELETE FROM conflicts WHERE path=?1;"));
+            ASSERT(query);
+            query->bindValue(1, path);
+            ASSERT(query->exec());
+            continue;
+        }
+        const auto query = _db.cachedQuery(QByteArrayLiteral(
+            "INSERT OR REPLACE INTO conflicts "
+            "(path, baseFileId, baseModtime, baseEtag) "
+            "VALUES (?1, ?2, ?3, ?4);"));
+        ASSERT(query);
+        query->bindValue(1, it->path);
+        query->bindValue(2, it->baseFileId);
+        query->bindValue(3, it->baseModtime);
+        query->bindValue(4, it->baseEtag);
+        ASSERT(query->exec());
+    }
+    qCInfo(lcDb) << "Wrote" << changedErrorBlacklistEntries.size() + removedErrorBlacklistPaths.size()
+                 << "blacklist changes and" << changedConflictRecords.size() << "conflict record changes";
+}
+
 int SyncJournalDb::errorBlackListEntryCount()
 {
     int re = 0;
 
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded)
+        return _errorBlacklist.size();
     if (checkConnect()) {
         SqlQuery query("SELECT count(*) FROM blacklist", _db);
 
@@ -1587,6 +2094,11 @@ int SyncJournalDb::errorBlackListEntryCount()
 int SyncJournalDb::wipeErrorBlacklist()
 {
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded) {
+        _errorBlacklist.clear();
+        _changedErrorBlacklistEntries.clear();
+        _removedErrorBlacklistPaths.clear();
+    }
     if (checkConnect()) {
         SqlQuery query(_db);
 
@@ -1608,6 +2120,16 @@ void SyncJournalDb::wipeErrorBlacklistEntry(const QString &file)
     }
 
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded) {
+        const QString key = errorBlacklistKey(file);
+        auto it = _errorBlacklist.find(key);
+        if (it != _errorBlacklist.end()) {
+            _removedErrorBlacklistPaths.insert(it->_file);
+            _changedErrorBlacklistEntries.remove(key);
+            _errorBlacklist.erase(it);
+        }
+        return;
+    }
     if (checkConnect()) {
         SqlQuery query(_db);
 
@@ -1622,6 +2144,18 @@ void SyncJournalDb::wipeErrorBlacklistEntry(const QString &file)
 void SyncJournalDb::wipeErrorBlacklistCategory(SyncJournalErrorBlacklistRecord::Category category)
 {
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded) {
+        for (auto it = _errorBlacklist.begin(); it != _errorBlacklist.end();) {
+            if (it->_errorCategory != category) {
+                ++it;
+                continue;
+            }
+            _removedErrorBlacklistPaths.insert(it->_file);
+            _changedErrorBlacklistEntries.remove(it.key());
+            it = _errorBlacklist.erase(it);
+        }
+        return;
+    }
     if (checkConnect()) {
         SqlQuery query(_db);
 
@@ -1642,27 +2176,40 @@ void SyncJournalDb::setErrorBlacklistEntry(const SyncJournalErrorBlacklistRecord
                  << item._lastTryModtime << item._lastTryEtag << item._renameTarget
                  << item._errorCategory;
 
+    if (_errorBlacklistAndConflictsLoaded) {
+        const QString key = errorBlacklistKey(item._file);
+        auto it = _errorBlacklist.find(key);
+        if (it != _errorBlacklist.end() && it->_file != item._file) {
+            // the stored path differs in case, the entry is replaced
+            _removedErrorBlacklistPaths.insert(it->_file);
+        }
+        _errorBlacklist[key] = item;
+        _changedErrorBlacklistEntries.insert(key);
+        return;
+    }
+
     if (!checkConnect()) {
         return;
     }
 
-    if (!_setErrorBlacklistQuery.initOrReset(QByteArrayLiteral(
+    const auto setErrorBlacklistQuery = _db.cachedQuery(QByteArrayLiteral(
         "INSERT OR REPLACE INTO blacklist "
         "(path, lastTryEtag, lastTryModtime, retrycount, errorstring, lastTryTime, ignoreDuration, renameTarget, errorCategory) "
-        "VALUES ( ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)"), _db)) {
+        "VALUES ( ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)"));
+    if (!setErrorBlacklistQuery) {
         return;
     }
 
-    _setErrorBlacklistQuery.bindValue(1, item._file);
-    _setErrorBlacklistQuery.bindValue(2, item._lastTryEtag);
-    _setErrorBlacklistQuery.bindValue(3, item._lastTryModtime);
-    _setErrorBlacklistQuery.bindValue(4, item._retryCount);
-    _setErrorBlacklistQuery.bindValue(5, item._errorString);
-    _setErrorBlacklistQuery.bindValue(6, item._lastTryTime);
-    _setErrorBlacklistQuery.bindValue(7, item._ignoreDuration);
-    _setErrorBlacklistQuery.bindValue(8, item._renameTarget);
-    _setErrorBlacklistQuery.bindValue(9, item._errorCategory);
-    _setErrorBlacklistQuery.exec();
+    setErrorBlacklistQuery->bindValue(1, item._file);
+    setErrorBlacklistQuery->bindValue(2, item._lastTryEtag);
+    setErrorBlacklistQuery->bindValue(3, item._lastTryModtime);
+    setErrorBlacklistQuery->bindValue(4, item._retryCount);
+    setErrorBlacklistQuery->bindValue(5, item._errorString);
+    setErrorBlacklistQuery->bindValue(6, item._lastTryTime);
+    setErrorBlacklistQuery->bindValue(7, item._ignoreDuration);
+    setErrorBlacklistQuery->bindValue(8, item._renameTarget);
+    setErrorBlacklistQuery->bindValue(9, item._errorCategory);
+    setErrorBlacklistQuery->exec();
 }
 
 QVector<SyncJournalDb::PollInfo> SyncJournalDb::getPollInfos()
@@ -1724,18 +2271,19 @@ QStringList SyncJournalDb::getSelectiveSyncList(SyncJournalDb::SelectiveSyncList
         return result;
     }
 
-    if (!_getSelectiveSyncListQuery.initOrReset(QByteArrayLiteral("SELECT path FROM selectivesync WHERE type=?1"), _db)) {
+    const auto getSelectiveSyncListQuery = _db.cachedQuery(QByteArrayLiteral("SELECT path FROM selectivesync WHERE type=?1"));
+    if (!getSelectiveSyncListQuery) {
         *ok = false;
         return result;
     }
 
-    _getSelectiveSyncListQuery.bindValue(1, int(type));
-    if (!_getSelectiveSyncListQuery.exec()) {
+    getSelectiveSyncListQuery->bindValue(1, int(type));
+    if (!getSelectiveSyncListQuery->exec()) {
         *ok = false;
         return result;
     }
-    while (_getSelectiveSyncListQuery.next()) {
-        auto entry = _getSelectiveSyncListQuery.stringValue(0);
+    while (getSelectiveSyncListQuery->next()) {
+        auto entry = getSelectiveSyncListQuery->stringValue(0);
         if (!entry.endsWith(QLatin1Char('/'))) {
             entry.append(QLatin1Char('/'));
         }
@@ -1843,6 +2391,19 @@ void SyncJournalDb::forceRemoteDiscoveryNextSyncLocked()
     deleteRemoteFolderEtagsQuery.exec();
 }
 
+bool SyncJournalDb::remoteFolderEtagsInvalidated()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect())
+        return false;
+
+    SqlQuery query(_db);
+    query.prepare("SELECT 1 FROM metadata WHERE type=2 AND md5!='_invalid_' LIMIT 1;");
+    if (!query.exec())
+        return false;
+    return !query.next();
+}
+
 
 QByteArray SyncJournalDb::getChecksumType(int checksumTypeId)
 {
@@ -1852,19 +2413,19 @@ QByteArray SyncJournalDb::getChecksumType(int checksumTypeId)
     }
 
     // Retrieve the id
-    auto &query = _getChecksumTypeQuery;
-    if (!query.initOrReset(QByteArrayLiteral("SELECT name FROM checksumtype WHERE id=?1"), _db))
+    const auto query = _db.cachedQuery(QByteArrayLiteral("SELECT name FROM checksumtype WHERE id=?1"));
+    if (!query)
         return {};
-    query.bindValue(1, checksumTypeId);
-    if (!query.exec()) {
+    query->bindValue(1, checksumTypeId);
+    if (!query->exec()) {
         return 0;
     }
 
-    if (!query.next()) {
+    if (!query->next()) {
         qCWarning(lcDb) << "No checksum type mapping found for" << checksumTypeId;
         return 0;
     }
-    return query.baValue(0);
+    return query->baValue(0);
 }
 
 int SyncJournalDb::mapChecksumType(const QByteArray &checksumType)
@@ -1874,26 +2435,28 @@ int SyncJournalDb::mapChecksumType(const QByteArray &checksumType)
     }
 
     // Ensure the checksum type is in the db
-    if (!_insertChecksumTypeQuery.initOrReset(QByteArrayLiteral("INSERT OR IGNORE INTO checksumtype (name) VALUES (?1)"), _db))
+    const auto insertChecksumTypeQuery = _db.cachedQuery(QByteArrayLiteral("INSERT OR IGNORE INTO checksumtype (name) VALUES (?1)"));
+    if (!insertChecksumTypeQuery)
         return 0;
-    _insertChecksumTypeQuery.bindValue(1, checksumType);
-    if (!_insertChecksumTypeQuery.exec()) {
+    insertChecksumTypeQuery->bindValue(1, checksumType);
+    if (!insertChecksumTypeQuery->exec()) {
         return 0;
     }
 
     // Retrieve the id
-    if (!_getChecksumTypeIdQuery.initOrReset(QByteArrayLiteral("SELECT id FROM checksumtype WHERE name=?1"), _db))
+    const auto getChecksumTypeIdQuery = _db.cachedQuery(QByteArrayLiteral("SELECT id FROM checksumtype WHERE name=?1"));
+    if (!getChecksumTypeIdQuery)
         return 0;
-    _getChecksumTypeIdQuery.bindValue(1, checksumType);
-    if (!_getChecksumTypeIdQuery.exec()) {
+    getChecksumTypeIdQuery->bindValue(1, checksumType);
+    if (!getChecksumTypeIdQuery->exec()) {
         return 0;
     }
 
-    if (!_getChecksumTypeIdQuery.next()) {
+    if (!getChecksumTypeIdQuery->next()) {
         qCWarning(lcDb) << "No checksum type mapping found for" << checksumType;
         return 0;
     }
-    return _getChecksumTypeIdQuery.intValue(0);
+    return getChecksumTypeIdQuery->intValue(0);
 }
 
 QByteArray SyncJournalDb::dataFingerprint()
@@ -1903,17 +2466,18 @@ QByteArray SyncJournalDb::dataFingerprint()
         return QByteArray();
     }
 
-    if (!_getDataFingerprintQuery.initOrReset(QByteArrayLiteral("SELECT fingerprint FROM datafingerprint"), _db))
+    const auto getDataFingerprintQuery = _db.cachedQuery(QByteArrayLiteral("SELECT fingerprint FROM datafingerprint"));
+    if (!getDataFingerprintQuery)
         return QByteArray();
 
-    if (!_getDataFingerprintQuery.exec()) {
+    if (!getDataFingerprintQuery->exec()) {
         return QByteArray();
     }
 
-    if (!_getDataFingerprintQuery.next()) {
+    if (!getDataFingerprintQuery->next()) {
         return QByteArray();
     }
-    return _getDataFingerprintQuery.baValue(0);
+    return getDataFingerprintQuery->baValue(0);
 }
 
 void SyncJournalDb::setDataFingerprint(const QByteArray &dataFingerprint)
@@ -1923,34 +2487,39 @@ void SyncJournalDb::setDataFingerprint(const QByteArray &dataFingerprint)
         return;
     }
 
-    if (!_setDataFingerprintQuery1.initOrReset(QByteArrayLiteral("DELETE FROM datafingerprint;"), _db)
-        || !_setDataFingerprintQuery2.initOrReset(QByteArrayLiteral("INSERT INTO datafingerprint (fingerprint) VALUES (?1);"), _db)) {
+    const auto deleteQuery = _db.cachedQuery(QByteArrayLiteral("DELETE FROM datafingerprint;"));
+    const auto insertQuery = _db.cachedQuery(QByteArrayLiteral("INSERT INTO datafingerprint (fingerprint) VALUES (?1);"));
+    if (!deleteQuery || !insertQuery) {
         return;
     }
 
-    _setDataFingerprintQuery1.exec();
+    deleteQuery->exec();
 
-    _setDataFingerprintQuery2.bindValue(1, dataFingerprint);
-    _setDataFingerprintQuery2.exec();
+    insertQuery->bindValue(1, dataFingerprint);
+    insertQuery->exec();
 }
 
 void SyncJournalDb::setConflictRecord(const ConflictRecord &record)
 {
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded) {
+        _conflictRecords[record.path] = record;
+        _changedConflictRecords.insert(record.path);
+        return;
+    }
     if (!checkConnect())
         return;
 
-    auto &query = _setConflictRecordQuery;
-    ASSERT(query.initOrReset(QByteArrayLiteral(
-                          "INSERT OR REPLACE INTO conflicts "
-                          "(path, baseFileId, baseModtime, baseEtag) "
-                          "VALUES (?1, ?2, ?3, ?4);"),
-        _db));
-    query.bindValue(1, record.path);
-    query.bindValue(2, record.baseFileId);
-    query.bindValue(3, record.baseModtime);
-    query.bindValue(4, record.baseEtag);
-    ASSERT(query.exec());
+    const auto query = _db.cachedQuery(QByteArrayLiteral(
+        "INSERT OR REPLACE INTO conflicts "
+        "(path, baseFileId, baseModtime, baseEtag) "
+        "VALUES (?1, ?2, ?3, ?4);"));
+    ASSERT(query);
+    query->bindValue(1, record.path);
+    query->bindValue(2, record.baseFileId);
+    query->bindValue(3, record.baseModtime);
+    query->bindValue(4, record.baseEtag);
+    ASSERT(query->exec());
 }
 
 ConflictRecord SyncJournalDb::conflictRecord(const QByteArray &path)
@@ -1958,36 +2527,46 @@ ConflictRecord SyncJournalDb::conflictRecord(const QByteArray &path)
     ConflictRecord entry;
 
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded)
+        return _conflictRecords.value(path);
     if (!checkConnect())
         return entry;
-    auto &query = _getConflictRecordQuery;
-    ASSERT(query.initOrReset(QByteArrayLiteral("SELECT baseFileId, baseModtime, baseEtag FROM conflicts WHERE path=?1;"), _db));
-    query.bindValue(1, path);
-    ASSERT(query.exec());
-    if (!query.next())
+    const auto query = _db.cachedQuery(QByteArrayLiteral("SELECT baseFileId, baseModtime, baseEtag FROM conflicts WHERE path=?1;"));
+    ASSERT(query);
+    query->bindValue(1, path);
+    ASSERT(query->exec());
+    if (!query->next())
         return entry;
 
     entry.path = path;
-    entry.baseFileId = query.baValue(0);
-    entry.baseModtime = query.int64Value(1);
-    entry.baseEtag = query.baValue(2);
+    entry.baseFileId = query->baValue(0);
+    entry.baseModtime = query->int64Value(1);
+    entry.baseEtag = query->baValue(2);
     return entry;
 }
 
 void SyncJournalDb::deleteConflictRecord(const QByteArray &path)
 {
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded) {
+        if (_conflictRecords.remove(path))
+            _changedConflictRecords.insert(path);
+        return;
+    }
     if (!checkConnect())
         return;
 
-    ASSERT(_deleteConflictRecordQuery.initOrReset("DELETE FROM conflicts WHERE path=?1;", _db));
-    _deleteConflictRecordQuery.bindValue(1, path);
-    ASSERT(_deleteConflictRecordQuery.exec());
+    const auto query = _db.cachedQuery(QByteArrayLiteral("DELETE FROM conflicts WHERE path=?1;"));
+    ASSERT(query);
+    query->bindValue(1, path);
+    ASSERT(query->exec());
 }
 
 QByteArrayList SyncJournalDb::conflictRecordPaths()
 {
     QMutexLocker locker(&_mutex);
+    if (_errorBlacklistAndConflictsLoaded)
+        return _conflictRecords.keys();
     if (!checkConnect())
         return {};
 
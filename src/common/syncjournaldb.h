@@ -23,6 +23,9 @@
 #include <qmutex.h>
 #include <QDateTime>
 #include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include <QElapsedTimer>
 #include <functional>
 
 #include "common/utility.h"
@@ -54,12 +57,22 @@ public:
     /// Migrate a csync_journal to the new path, if necessary. Returns false on error
     static bool maybeMigrateDb(const QString &localPath, const QString &absoluteJournalPath);
 
+    /**
+     * The database file is checked for existence before a query only if the last
+     * check is older than this. The check prevents crashes when the storage of an
+     * open database becomes unavailable, see #6049.
+     */
+    static int fileExistenceCheckInterval; // in ms
+
     // To verify that the record could be found check with SyncJournalFileRecord::isValid()
     bool getFileRecord(const QString &filename, SyncJournalFileRecord *rec) { return getFileRecord(filename.toUtf8(), rec); }
     bool getFileRecord(const QByteArray &filename, SyncJournalFileRecord *rec);
     bool getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec);
     bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    /// Finds the files with this content, @p checksumHeader is "type:checksum"
+    bool getFileRecordsByChecksum(const QByteArray &checksumHeader, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    bool getFileRecordsBySizeAndModtime(qint64 size, qint64 modtime, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     bool setFileRecord(const SyncJournalFileRecord &record);
 
@@ -73,6 +86,14 @@ public:
     bool updateLocalMetadata(const QString &filename,
         qint64 modtime, quint64 size, quint64 inode);
     bool exists();
+
+    /**
+     * Moves the changes from the WAL into the database file.
+     *
+     * Runs passively on a background connection of its own, the caller doesn't
+     * wait. The sync engine does this at the end of each sync, close() waits
+     * for it to finish.
+     */
     void walCheckpoint();
 
     QString databaseFilePath() const;
@@ -122,6 +143,19 @@ public:
         bool isChunked() const { return _transferid != 0; }
     };
 
+    /**
+     * The content-defined chunks of a file as uploaded, see ContentChunker.
+     *
+     * A delta upload only sends the chunks that are not in the version
+     * with this etag on the server.
+     */
+    struct ContentChunksInfo
+    {
+        QByteArray _etag;
+        QByteArray _chunks; /// ContentChunker::serialize()
+        bool _valid = false;
+    };
+
     struct PollInfo
     {
         QString _file;
@@ -139,9 +173,26 @@ public:
     // Return the list of transfer ids that were removed.
     QVector<uint> deleteStaleUploadInfos(const QSet<QString> &keep);
 
+    ContentChunksInfo getContentChunks(const QString &file);
+    /// An invalid info removes the entry
+    void setContentChunks(const QString &file, const ContentChunksInfo &info);
+
     SyncJournalErrorBlacklistRecord errorBlacklistEntry(const QString &);
     bool deleteStaleErrorBlacklistEntries(const QSet<QString> &keep);
 
+    /**
+     * Loads the blacklist and conflicts tables into memory.
+     *
+     * A sync run looks both up for many files. Until close() or
+     * flushErrorBlacklistAndConflicts(), the functions for these tables only
+     * use the copy in memory and remember the changed entries, which are then
+     * written in one go.
+     */
+    bool preloadErrorBlacklistAndConflicts();
+
+    /// Writes the changes to the preloaded tables and drops the copy in memory
+    void flushErrorBlacklistAndConflicts();
+
     void avoidRenamesOnNextSync(const QString &path) { avoidRenamesOnNextSync(path.toUtf8()); }
     void avoidRenamesOnNextSync(const QByteArray &path);
     void setPollInfo(const PollInfo &);
@@ -197,6 +248,12 @@ public:
      */
     void forceRemoteDiscoveryNextSync();
 
+    /**
+     * Whether no folder has a valid etag, as after forceRemoteDiscoveryNextSync()
+     * or before the first sync: the next sync will have to list every remote folder.
+     */
+    bool remoteFolderEtagsInvalidated();
+
     bool postSyncCleanup(const QSet<QString> &filepathsToKeep,
         const QSet<QString> &prefixesToKeep);
 
@@ -253,6 +310,7 @@ private:
     bool updateMetadataTableStructure();
     bool updateErrorBlacklistTableStructure();
     bool sqlFail(const QString &log, const SqlQuery &query);
+    bool setPerformancePragmas(SqlQuery &pragma);
     void commitInternal(const QString &context, bool startTrans = true);
     void startTransaction();
     void commitTransaction();
@@ -262,6 +320,9 @@ private:
     // Same as forceRemoteDiscoveryNextSync but without acquiring the lock
     void forceRemoteDiscoveryNextSyncLocked();
 
+    // Same as flushErrorBlacklistAndConflicts but without acquiring the lock
+    void flushErrorBlacklistAndConflictsLocked();
+
     // Returns the integer id of the checksum type
     //
     // Returns 0 on failure and for empty checksum types.
@@ -269,40 +330,11 @@ private:
 
     SqlDatabase _db;
     QString _dbFile;
+    QElapsedTimer _lastFileExistenceCheck;
     QMutex _mutex; // Public functions are protected with the mutex.
     int _transaction;
     bool _metadataTableIsEmpty;
 
-    SqlQuery _getFileRecordQuery;
-    SqlQuery _getFileRecordQueryByMangledName;
-    SqlQuery _getFileRecordQueryByInode;
-    SqlQuery _getFileRecordQueryByFileId;
-    SqlQuery _getFilesBelowPathQuery;
-    SqlQuery _getAllFilesQuery;
-    SqlQuery _setFileRecordQuery;
-    SqlQuery _setFileRecordChecksumQuery;
-    SqlQuery _setFileRecordLocalMetadataQuery;
-    SqlQuery _getDownloadInfoQuery;
-    SqlQuery _setDownloadInfoQuery;
-    SqlQuery _deleteDownloadInfoQuery;
-    SqlQuery _getUploadInfoQuery;
-    SqlQuery _setUploadInfoQuery;
-    SqlQuery _deleteUploadInfoQuery;
-    SqlQuery _deleteFileRecordPhash;
-    SqlQuery _deleteFileRecordRecursively;
-    SqlQuery _getErrorBlacklistQuery;
-    SqlQuery _setErrorBlacklistQuery;
-    SqlQuery _getSelectiveSyncListQuery;
-    SqlQuery _getChecksumTypeIdQuery;
-    SqlQuery _getChecksumTypeQuery;
-    SqlQuery _insertChecksumTypeQuery;
-    SqlQuery _getDataFingerprintQuery;
-    SqlQuery _setDataFingerprintQuery1;
-    SqlQuery _setDataFingerprintQuery2;
-    SqlQuery _getConflictRecordQuery;
-    SqlQuery _setConflictRecordQuery;
-    SqlQuery _deleteConflictRecordQuery;
-
     /* Storing etags to these folders, or their parent folders, is filtered out.
      *
      * When avoidReadFromDbOnNextSync() is called some etags to _invalid_ in the
@@ -318,12 +350,31 @@ private:
      */
     QList<QByteArray> _etagStorageFilter;
 
+    /* The blacklist and conflicts tables while they are preloaded, see
+     * preloadErrorBlacklistAndConflicts().
+     *
+     * The blacklist is keyed like the table is queried: case insensitively
+     * on case preserving file systems. The changed sets hold the keys that
+     * need to be written, the blacklist paths to delete are kept separately
+     * as their case may differ from the key.
+     */
+    bool _errorBlacklistAndConflictsLoaded = false;
+    QHash<QString, SyncJournalErrorBlacklistRecord> _errorBlacklist;
+    QSet<QString> _changedErrorBlacklistEntries;
+    QSet<QString> _removedErrorBlacklistPaths;
+    QHash<QByteArray, ConflictRecord> _conflictRecords;
+    QSet<QByteArray> _changedConflictRecords;
+
     /** The journal mode to use for the db.
      *
      * Typically WAL initially, but may be set to other modes via environment
      * variable, for specific filesystems, or when WAL fails in a particular way.
      */
     QByteArray _journalMode;
+
+    // The pool is destroyed first and waits for a running checkpoint
+    QAtomicInt _walCheckpointRunning;
+    QThreadPool _walCheckpointPool;
 };
 
 bool OCSYNC_EXPORT
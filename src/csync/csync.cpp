@@ -44,6 +44,7 @@
 #include "csync_reconcile.h"
 
 #include "vio/csync_vio.h"
+#include "vio/csync_vio_local.h"
 
 #include "csync_rename.h"
 #include "common/c_jhash.h"
@@ -88,7 +89,17 @@ int csync_update(CSYNC *ctx) {
 
   qCInfo(lcCSync, "## Starting local discovery ##");
 
+  ctx->local.read_ahead = csync_vio_local_read_ahead_create([ctx](const QByteArray &path) {
+      if (!ctx->should_discover_locally_fn)
+          return true;
+      const char *local_uri = path.constData() + strlen(ctx->local.uri);
+      if (*local_uri == '/')
+          ++local_uri;
+      return ctx->should_discover_locally_fn(QByteArray(local_uri));
+  }, ctx->local_discovery_threads);
   rc = csync_ftw(ctx, ctx->local.uri, csync_walker, MAX_DEPTH);
+  csync_vio_local_read_ahead_free(ctx->local.read_ahead);
+  ctx->local.read_ahead = nullptr;
   if (rc < 0) {
     if(ctx->status_code == CSYNC_STATUS_OK) {
         ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_UPDATE_ERROR);
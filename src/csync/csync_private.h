@@ -109,6 +109,8 @@ public:
 };
 struct ByteArrayRefHash { uint operator()(const ByteArrayRef &a) const { return qHashBits(a.data(), a.size()); } };
 
+struct csync_vio_local_read_ahead_s;
+
 /**
  * @brief csync public structure
  */
@@ -173,6 +175,8 @@ struct OCSYNC_EXPORT csync_s {
   struct {
     char *uri = nullptr;
     FileMap files;
+    /* only set during the local discovery */
+    csync_vio_local_read_ahead_s *read_ahead = nullptr;
   } local;
 
   struct {
@@ -207,6 +211,9 @@ struct OCSYNC_EXPORT csync_s {
 
   bool upload_conflict_files = false;
 
+  /* threads that read local directories ahead of the discovery, 0 for the default */
+  int local_discovery_threads = 0;
+
   csync_s(const char *localUri, OCC::SyncJournalDb *statedb);
   ~csync_s();
   int reinitialize();
@@ -241,6 +241,22 @@ static void _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx)
                     cur->inode);
                 ctx->statedb->getFileRecordByInode(cur->inode, &base);
                 renameCandidateProcessing(base._path);
+
+                // The update phase may have matched the content of a file with a new inode
+                if (!processedRename && cur->type == ItemTypeFile && !cur->checksumHeader.isEmpty()) {
+                    qCInfo(lcReconcile, "Finding rename origin through checksum %s",
+                        cur->checksumHeader.constData());
+                    csync_rename_content_candidates(ctx, cur->size, cur->modtime,
+                        [&](const QByteArray &path, const QByteArray &checksumHeader) {
+#ifdef NO_RENAME_EXTENSION
+                            // Like in the update phase
+                            if (!csync_rename_same_extension(path, cur->path))
+                                return;
+#endif
+                            if (checksumHeader == cur->checksumHeader)
+                                renameCandidateProcessing(path);
+                        });
+                }
             } else {
                 ASSERT(ctx->current == REMOTE_REPLICA);
 
@@ -20,8 +20,12 @@
 
 #include "csync_private.h"
 #include "csync_rename.h"
+#include "common/syncjournalfilerecord.h"
 
 #include <algorithm>
+#include <string.h>
+#include <utility>
+#include <vector>
 
 static ByteArrayRef _parentDir(const ByteArrayRef &path) {
     int len = path.length();
@@ -81,3 +85,40 @@ QByteArray csync_rename_adjust_full_path_source(CSYNC *ctx, const QByteArray &pa
 bool csync_rename_count(CSYNC *ctx) {
     return ctx->renames.folder_renamed_from.size();
 }
+
+bool csync_rename_content_candidates(CSYNC *ctx, int64_t size, int64_t modtime,
+    const std::function<void(const QByteArray &path, const QByteArray &checksumHeader)> &cb)
+{
+    // The callback may hash the local file. The journal is locked while the
+    // query steps, so the candidates are collected first.
+    std::vector<std::pair<QByteArray, QByteArray>> candidates;
+    const bool ok = ctx->statedb->getFileRecordsBySizeAndModtime(size, modtime, [&](const OCC::SyncJournalFileRecord &rec) {
+        if (rec._type == ItemTypeFile && !rec._checksumHeader.isEmpty())
+            candidates.emplace_back(rec._path, rec._checksumHeader);
+    });
+    if (!ok)
+        return false;
+    for (const auto &candidate : candidates)
+        cb(candidate.first, candidate.second);
+    return true;
+}
+
+#ifdef NO_RENAME_EXTENSION
+bool csync_rename_same_extension(const char *p1, const char *p2) {
+    /* Find pointer to the extensions */
+    const char *e1 = strrchr(p1, '.');
+    const char *e2 = strrchr(p2, '.');
+
+    /* If the found extension contains a '/', it is because the . was in the folder name
+     *            => no extensions */
+    if (e1 && strchr(e1, '/')) e1 = NULL;
+    if (e2 && strchr(e2, '/')) e2 = NULL;
+
+    /* If none have extension, it is the same extension */
+    if (!e1 && !e2)
+        return true;
+
+    /* c_streq takes care of the rest */
+    return c_streq(e1, e2);
+}
+#endif
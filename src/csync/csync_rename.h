@@ -38,3 +38,13 @@ QByteArray OCSYNC_EXPORT csync_rename_adjust_full_path_source(CSYNC *ctx, const
 void OCSYNC_EXPORT csync_rename_record(CSYNC *ctx, const QByteArray &from, const QByteArray &to);
 /*  Return the amount of renamed item recorded */
 bool OCSYNC_EXPORT csync_rename_count(CSYNC *ctx);
+
+/* Calls cb for each journal file with this size and modtime that has a checksum,
+ * after the journal query finished. Returns false if the journal could not be read. */
+bool OCSYNC_EXPORT csync_rename_content_candidates(CSYNC *ctx, int64_t size, int64_t modtime,
+    const std::function<void(const QByteArray &path, const QByteArray &checksumHeader)> &cb);
+
+#ifdef NO_RENAME_EXTENSION
+/* Return true if the two path have the same extension. false otherwise. */
+bool OCSYNC_EXPORT csync_rename_same_extension(const char *p1, const char *p2);
+#endif
@@ -45,6 +45,7 @@
 
 #include "common/utility.h"
 #include "common/asserts.h"
+#include "common/checksums.h"
 
 #include <QtCore/QTextCodec>
 
@@ -54,27 +55,6 @@
 
 Q_LOGGING_CATEGORY(lcUpdate, "nextcloud.sync.csync.updater", QtInfoMsg)
 
-#ifdef NO_RENAME_EXTENSION
-/* Return true if the two path have the same extension. false otherwise. */
-static bool _csync_sameextension(const char *p1, const char *p2) {
-    /* Find pointer to the extensions */
-    const char *e1 = strrchr(p1, '.');
-    const char *e2 = strrchr(p2, '.');
-
-    /* If the found extension contains a '/', it is because the . was in the folder name
-     *            => no extensions */
-    if (e1 && strchr(e1, '/')) e1 = NULL;
-    if (e2 && strchr(e2, '/')) e2 = NULL;
-
-    /* If none have extension, it is the same extension */
-    if (!e1 && !e2)
-        return true;
-
-    /* c_streq takes care of the rest */
-    return c_streq(e1, e2);
-}
-#endif
-
 static QByteArray _rel_to_abs(CSYNC* ctx, const QByteArray &relativePath) {
     return QByteArray() % const_cast<const char *>(ctx->local.uri) % '/' % relativePath;
 }
@@ -303,7 +283,7 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
               base.isValid() && base._type == fs->type
                   && ((base._modtime == fs->modtime && base._fileSize == fs->size) || fs->type == ItemTypeDirectory)
 #ifdef NO_RENAME_EXTENSION
-                  && _csync_sameextension(base._path, fs->path)
+                  && csync_rename_same_extension(base._path, fs->path)
 #endif
               ;
 
@@ -327,6 +307,35 @@ static int _csync_detect_update(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> f
               if (fs->type == ItemTypeDirectory) {
                   csync_rename_record(ctx, base._path, fs->path);
               }
+          } else if (fs->type == ItemTypeFile && ctx->callbacks.checksum_hook) {
+              /* Editors that save through a temporary file and tools that unpack
+               * a tree again change the inode. Look for a file of the journal
+               * with the same size, modtime and content instead. */
+              bool found = false;
+              auto contentCandidateProcessing = [&](const QByteArray &path, const QByteArray &checksumHeader) {
+                  if (found)
+                      return;
+#ifdef NO_RENAME_EXTENSION
+                  if (!csync_rename_same_extension(path, fs->path))
+                      return;
+#endif
+                  if (OCC::parseChecksumHeaderType(fs->checksumHeader) != OCC::parseChecksumHeaderType(checksumHeader)) {
+                      fs->checksumHeader = ctx->callbacks.checksum_hook(
+                          _rel_to_abs(ctx, fs->path), checksumHeader,
+                          ctx->callbacks.checksum_userdata);
+                  }
+                  if (!fs->checksumHeader.isEmpty() && fs->checksumHeader == checksumHeader) {
+                      qCInfo(lcUpdate, "pot rename detected based on content %s -> %s", path.constData(), fs->path.constData());
+                      found = true;
+                  }
+              };
+              if (!csync_rename_content_candidates(ctx, fs->size, fs->modtime, contentCandidateProcessing)) {
+                  ctx->status_code = CSYNC_STATUS_UNSUCCESSFUL;
+                  return -1;
+              }
+              if (found) {
+                  fs->instruction = CSYNC_INSTRUCTION_EVAL_RENAME;
+              }
           }
           goto out;
 
@@ -42,7 +42,7 @@ csync_vio_handle_t *csync_vio_opendir(CSYNC *ctx, const char *name) {
 	if( ctx->callbacks.update_callback ) {
         ctx->callbacks.update_callback(/*local=*/true, name, ctx->callbacks.update_callback_userdata);
 	}
-      return csync_vio_local_opendir(name);
+      return csync_vio_local_opendir(name, ctx->local.read_ahead);
       break;
     default:
       ASSERT(false);
@@ -21,7 +21,29 @@
 #ifndef _CSYNC_VIO_LOCAL_H
 #define _CSYNC_VIO_LOCAL_H
 
-csync_vio_handle_t OCSYNC_EXPORT *csync_vio_local_opendir(const char *name);
+#include <functional>
+
+/*
+ * Lists local directories ahead of the discovery on a pool of threads.
+ *
+ * When a directory is opened through it, the listings of its sub
+ * directories are read in the background, so the syscalls of many
+ * directories overlap while the discovery still walks the tree in order.
+ * Listings that were not used by the time their parent is closed are
+ * dropped.
+ *
+ * Only implemented for unix, on Windows directories are read when opened.
+ */
+typedef struct csync_vio_local_read_ahead_s csync_vio_local_read_ahead_t;
+
+/* should_read(path) decides whether a sub directory is worth reading ahead,
+ * max_threads limits the pool, 0 for one thread per core */
+csync_vio_local_read_ahead_t OCSYNC_EXPORT *csync_vio_local_read_ahead_create(
+    std::function<bool(const QByteArray &path)> should_read, int max_threads = 0);
+void OCSYNC_EXPORT csync_vio_local_read_ahead_free(csync_vio_local_read_ahead_t *read_ahead);
+
+csync_vio_handle_t OCSYNC_EXPORT *csync_vio_local_opendir(const char *name,
+    csync_vio_local_read_ahead_t *read_ahead = nullptr);
 int OCSYNC_EXPORT csync_vio_local_closedir(csync_vio_handle_t *dhandle);
 std::unique_ptr<csync_file_stat_t> OCSYNC_EXPORT csync_vio_local_readdir(csync_vio_handle_t *dhandle);
 
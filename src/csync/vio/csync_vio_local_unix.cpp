@@ -26,6 +26,16 @@
 #include <dirent.h>
 #include <stdio.h>
 
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
 #include "c_private.h"
 #include "c_lib.h"
 #include "c_string.h"
@@ -41,103 +51,275 @@ Q_LOGGING_CATEGORY(lcCSyncVIOLocal, "sync.csync.vio_local", QtInfoMsg)
  * directory functions
  */
 
+/* The entries of a directory, read completely when it is opened */
+struct DirListing {
+  int error = 0; /* errno of opendir or readdir */
+  bool opened = false;
+  std::vector<std::unique_ptr<csync_file_stat_t>> entries;
+};
+
 typedef struct dhandle_s {
-  DIR *dh;
-  char *path;
+  QByteArray path;
+  DirListing listing;
+  size_t next = 0;
+  csync_vio_local_read_ahead_t *read_ahead = nullptr;
+  /* sub directories that were handed to the read ahead */
+  std::vector<QByteArray> read_ahead_paths;
 } dhandle_t;
 
 static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf);
+static int _csync_vio_local_fstatat(int dirfd, const char *name, csync_file_stat_t *buf);
 
-csync_vio_handle_t *csync_vio_local_opendir(const char *name) {
-  dhandle_t *handle = NULL;
-  mbchar_t *dirname = NULL;
+static void _csync_vio_local_read_dir(const QByteArray &path, DirListing *listing)
+{
+  mbchar_t *dirname = c_utf8_path_to_locale(path.constData());
+  DIR *dh = _topendir(dirname);
+  c_free_locale_string(dirname);
+  if (dh == NULL) {
+    listing->error = errno;
+    return;
+  }
+  listing->opened = true;
 
-  handle = (dhandle_t*)c_malloc(sizeof(dhandle_t));
+  /* The entries are stat'ed relative to the directory, which spares the
+   * kernel resolving the full path again for every one of them. */
+  const int fd = dirfd(dh);
 
-  dirname = c_utf8_path_to_locale(name);
+  while (true) {
+    errno = 0;
+    struct _tdirent *dirent = _treaddir(dh);
+    if (dirent == NULL) {
+      listing->error = errno;
+      break;
+    }
+    if (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0) {
+      continue;
+    }
 
-  handle->dh = _topendir( dirname );
-  if (handle->dh == NULL) {
-    c_free_locale_string(dirname);
-    SAFE_FREE(handle);
-    return NULL;
+    std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
+    file_stat->path = c_utf8_from_locale(dirent->d_name);
+    if (file_stat->path.isNull()) {
+      file_stat->original_path = QByteArray() % path % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
+      qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << path;
+    }
+
+    /* Check for availability of d_type, see manpage. */
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
+    switch (dirent->d_type) {
+      case DT_FIFO:
+      case DT_SOCK:
+      case DT_CHR:
+      case DT_BLK:
+        break;
+      case DT_DIR:
+      case DT_REG:
+        if (dirent->d_type == DT_DIR) {
+          file_stat->type = ItemTypeDirectory;
+        } else {
+          file_stat->type = ItemTypeFile;
+        }
+        break;
+      default:
+        break;
+    }
+#endif
+
+    if (!file_stat->path.isNull()
+        && _csync_vio_local_fstatat(fd, dirent->d_name, file_stat.get()) < 0) {
+      // Will get excluded by _csync_detect_update.
+      file_stat->type = ItemTypeSkip;
+    }
+    listing->entries.push_back(std::move(file_stat));
   }
 
-  handle->path = c_strdup(name);
-  c_free_locale_string(dirname);
+  _tclosedir(dh);
+}
+
+/*
+ * read ahead
+ */
+
+struct csync_vio_local_read_ahead_s {
+  struct Pending {
+    quint64 serial = 0;
+    bool started = false;
+    bool done = false;
+    DirListing listing;
+  };
+
+  std::function<bool(const QByteArray &)> should_read;
+  QThreadPool pool;
+  QMutex mutex;
+  QWaitCondition listingDone;
+  std::map<QByteArray, Pending> pending;
+  quint64 lastSerial = 0;
+  int lastPriority = 0;
+
+  void schedule(const std::vector<QByteArray> &paths);
+  void run(const QByteArray &path, quint64 serial);
+  bool take(const QByteArray &path, DirListing *listing);
+  void drop(const std::vector<QByteArray> &paths);
+};
+
+namespace {
+class ReadAheadJob : public QRunnable
+{
+public:
+  ReadAheadJob(csync_vio_local_read_ahead_t *read_ahead, const QByteArray &path, quint64 serial)
+    : _readAhead(read_ahead), _path(path), _serial(serial)
+  {
+  }
+
+  void run() override { _readAhead->run(_path, _serial); }
 
-  return (csync_vio_handle_t *) handle;
+private:
+  csync_vio_local_read_ahead_t *_readAhead;
+  QByteArray _path;
+  quint64 _serial;
+};
 }
 
-int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
-  dhandle_t *handle = NULL;
-  int rc = -1;
+void csync_vio_local_read_ahead_s::schedule(const std::vector<QByteArray> &paths)
+{
+  QMutexLocker locker(&mutex);
+  /* The discovery walks depth first: the children of the directory that
+   * was opened last are needed first. */
+  ++lastPriority;
+  for (const auto &path : paths) {
+    auto &entry = pending[path];
+    if (entry.serial != 0)
+      continue;
+    entry.serial = ++lastSerial;
+    pool.start(new ReadAheadJob(this, path, entry.serial), lastPriority);
+  }
+}
 
-  if (dhandle == NULL) {
-    errno = EBADF;
-    return -1;
+void csync_vio_local_read_ahead_s::run(const QByteArray &path, quint64 serial)
+{
+  {
+    QMutexLocker locker(&mutex);
+    auto it = pending.find(path);
+    if (it == pending.end() || it->second.serial != serial || it->second.started)
+      return;
+    it->second.started = true;
   }
 
-  handle = (dhandle_t *) dhandle;
-  rc = _tclosedir(handle->dh);
+  DirListing listing;
+  _csync_vio_local_read_dir(path, &listing);
 
-  SAFE_FREE(handle->path);
-  SAFE_FREE(handle);
+  QMutexLocker locker(&mutex);
+  auto it = pending.find(path);
+  if (it == pending.end() || it->second.serial != serial)
+    return; // dropped in the meantime
+  it->second.listing = std::move(listing);
+  it->second.done = true;
+  listingDone.wakeAll();
+}
 
-  return rc;
+bool csync_vio_local_read_ahead_s::take(const QByteArray &path, DirListing *listing)
+{
+  QMutexLocker locker(&mutex);
+  auto it = pending.find(path);
+  while (it != pending.end() && it->second.started && !it->second.done) {
+    listingDone.wait(&mutex);
+    it = pending.find(path);
+  }
+  if (it == pending.end())
+    return false;
+
+  /* If no thread got to it yet, the caller is faster reading it itself */
+  const bool done = it->second.done;
+  if (done)
+    *listing = std::move(it->second.listing);
+  pending.erase(it);
+  return done;
 }
 
-std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
+void csync_vio_local_read_ahead_s::drop(const std::vector<QByteArray> &paths)
+{
+  QMutexLocker locker(&mutex);
+  for (const auto &path : paths)
+    pending.erase(path);
+}
+
+csync_vio_local_read_ahead_t *csync_vio_local_read_ahead_create(std::function<bool(const QByteArray &)> should_read, int max_threads)
+{
+  auto read_ahead = new csync_vio_local_read_ahead_t;
+  read_ahead->should_read = std::move(should_read);
+  if (max_threads <= 0)
+    max_threads = qBound(2, QThread::idealThreadCount(), 16);
+  read_ahead->pool.setMaxThreadCount(max_threads);
+  return read_ahead;
+}
+
+void csync_vio_local_read_ahead_free(csync_vio_local_read_ahead_t *read_ahead)
+{
+  if (read_ahead == NULL)
+    return;
+  {
+    QMutexLocker locker(&read_ahead->mutex);
+    read_ahead->pending.clear();
+  }
+  read_ahead->pool.clear();
+  read_ahead->pool.waitForDone();
+  delete read_ahead;
+}
+
+csync_vio_handle_t *csync_vio_local_opendir(const char *name, csync_vio_local_read_ahead_t *read_ahead) {
+  std::unique_ptr<dhandle_t> handle(new dhandle_t);
+  handle->path = name;
+
+  if (!read_ahead || !read_ahead->take(handle->path, &handle->listing)) {
+    _csync_vio_local_read_dir(handle->path, &handle->listing);
+  }
+  if (!handle->listing.opened) {
+    errno = handle->listing.error;
+    return NULL;
+  }
+
+  if (read_ahead) {
+    for (const auto &entry : handle->listing.entries) {
+      if (entry->type != ItemTypeDirectory || entry->path.isNull())
+        continue;
+      QByteArray childPath = handle->path % '/' % entry->path;
+      if (!read_ahead->should_read || read_ahead->should_read(childPath))
+        handle->read_ahead_paths.push_back(std::move(childPath));
+    }
+    if (!handle->read_ahead_paths.empty()) {
+      handle->read_ahead = read_ahead;
+      read_ahead->schedule(handle->read_ahead_paths);
+    }
+  }
+
+  return (csync_vio_handle_t *) handle.release();
+}
 
+int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
   dhandle_t *handle = NULL;
 
-  handle = (dhandle_t *) dhandle;
-  struct _tdirent *dirent = NULL;
-  std::unique_ptr<csync_file_stat_t> file_stat;
-
-  do {
-      dirent = _treaddir(handle->dh);
-      if (dirent == NULL)
-          return {};
-  } while (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0);
-
-  file_stat.reset(new csync_file_stat_t);
-  file_stat->path = c_utf8_from_locale(dirent->d_name);
-  QByteArray fullPath = QByteArray() % const_cast<const char *>(handle->path) % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
-  if (file_stat->path.isNull()) {
-      file_stat->original_path = fullPath;
-      qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << handle->path;
+  if (dhandle == NULL) {
+    errno = EBADF;
+    return -1;
   }
 
-  /* Check for availability of d_type, see manpage. */
-#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
-  switch (dirent->d_type) {
-    case DT_FIFO:
-    case DT_SOCK:
-    case DT_CHR:
-    case DT_BLK:
-      break;
-    case DT_DIR:
-    case DT_REG:
-      if (dirent->d_type == DT_DIR) {
-        file_stat->type = ItemTypeDirectory;
-      } else {
-        file_stat->type = ItemTypeFile;
-      }
-      break;
-    default:
-      break;
+  handle = (dhandle_t *) dhandle;
+  if (handle->read_ahead) {
+    /* what the walk did not descend into is not needed any more */
+    handle->read_ahead->drop(handle->read_ahead_paths);
   }
-#endif
+  delete handle;
 
-  if (file_stat->path.isNull())
-      return file_stat;
+  return 0;
+}
 
-  if (_csync_vio_local_stat_mb(fullPath.constData(), file_stat.get()) < 0) {
-      // Will get excluded by _csync_detect_update.
-      file_stat->type = ItemTypeSkip;
+std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
+  dhandle_t *handle = (dhandle_t *) dhandle;
+
+  if (handle->next >= handle->listing.entries.size()) {
+    errno = handle->listing.error;
+    return {};
   }
-  return file_stat;
+  return std::move(handle->listing.entries[handle->next++]);
 }
 
 
@@ -150,29 +332,24 @@ int csync_vio_local_stat(const char *uri, csync_file_stat_t *buf)
     return rc;
 }
 
-static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf)
+static ItemType _csync_vio_local_item_type(mode_t mode)
 {
-    csync_stat_t sb;
-
-    if (_tstat(wuri, &sb) < 0) {
-        return -1;
-    }
-
-    switch (sb.st_mode & S_IFMT) {
+    switch (mode & S_IFMT) {
     case S_IFDIR:
-      buf->type = ItemTypeDirectory;
-      break;
+      return ItemTypeDirectory;
     case S_IFREG:
-      buf->type = ItemTypeFile;
-      break;
+      return ItemTypeFile;
     case S_IFLNK:
     case S_IFSOCK:
-      buf->type = ItemTypeSoftLink;
-      break;
+      return ItemTypeSoftLink;
     default:
-      buf->type = ItemTypeSkip;
-      break;
+      return ItemTypeSkip;
   }
+}
+
+static void _csync_vio_local_fill_stat(const csync_stat_t &sb, csync_file_stat_t *buf)
+{
+  buf->type = _csync_vio_local_item_type(sb.st_mode);
 
 #ifdef __APPLE__
   if (sb.st_flags & UF_HIDDEN) {
@@ -183,5 +360,49 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
   buf->inode = sb.st_ino;
   buf->modtime = sb.st_mtime;
   buf->size = sb.st_size;
-  return 0;
+}
+
+static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf)
+{
+    csync_stat_t sb;
+
+    if (_tstat(wuri, &sb) < 0) {
+        return -1;
+    }
+
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
+}
+
+static int _csync_vio_local_fstatat(int dirfd, const char *name, csync_file_stat_t *buf)
+{
+#if defined(__linux__) && defined(STATX_TYPE)
+    /* statx only fetches the fields that are asked for, and doesn't
+     * trigger automounts for directories that are just listed. */
+    static std::atomic<bool> statxUnavailable(false);
+    if (!statxUnavailable) {
+        struct statx sx;
+        if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                STATX_TYPE | STATX_INO | STATX_MTIME | STATX_SIZE, &sx) == 0) {
+            buf->type = _csync_vio_local_item_type(sx.stx_mode);
+            buf->inode = sx.stx_ino;
+            buf->modtime = sx.stx_mtime.tv_sec;
+            buf->size = sx.stx_size;
+            return 0;
+        }
+        if (errno != ENOSYS) {
+            return -1;
+        }
+        // Kernel older than 4.11
+        statxUnavailable = true;
+    }
+#endif
+
+    csync_stat_t sb;
+    if (fstatat(dirfd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
+        return -1;
+    }
+
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
 }
@@ -50,7 +50,15 @@ typedef struct dhandle_s {
 
 static int _csync_vio_local_stat_mb(const mbchar_t *uri, csync_file_stat_t *buf);
 
-csync_vio_handle_t *csync_vio_local_opendir(const char *name) {
+/* Directories are read when they are opened on Windows, no read ahead */
+csync_vio_local_read_ahead_t *csync_vio_local_read_ahead_create(std::function<bool(const QByteArray &)>, int) {
+  return NULL;
+}
+
+void csync_vio_local_read_ahead_free(csync_vio_local_read_ahead_t *) {
+}
+
+csync_vio_handle_t *csync_vio_local_opendir(const char *name, csync_vio_local_read_ahead_t *) {
   dhandle_t *handle = NULL;
   mbchar_t *dirname = NULL;
 
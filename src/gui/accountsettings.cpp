@@ -587,7 +587,7 @@ void AccountSettings::slotCustomContextMenuRequested(const QPoint &pos)
 
     if (!folderPaused) {
         ac = menu->addAction(tr("Force sync now"));
-        if (folderMan->currentSyncFolder() == folderMan->folder(alias)) {
+        if (folderMan->currentSyncFolders().contains(folderMan->folder(alias))) {
             ac->setText(tr("Restart sync"));
         }
         ac->setEnabled(folderConnected);
@@ -859,9 +859,17 @@ void AccountSettings::slotForceSyncCurrentFolder()
 {
     FolderMan *folderMan = FolderMan::instance();
     if (auto selectedFolder = folderMan->folder(selectedFolderAlias())) {
-        // Terminate and reschedule any running sync
-        if (Folder *current = folderMan->currentSyncFolder()) {
-            folderMan->terminateSyncProcess();
+        // Terminate and reschedule the running sync of the folder, or one other
+        // running sync if no slot is free for it
+        const auto running = folderMan->currentSyncFolders();
+        Folder *current = nullptr;
+        if (running.contains(selectedFolder)) {
+            current = selectedFolder;
+        } else if (running.size() >= folderMan->maximumConcurrentSyncs()) {
+            current = running.first();
+        }
+        if (current) {
+            folderMan->terminateSyncProcess(current);
             folderMan->scheduleFolder(current);
         }
 
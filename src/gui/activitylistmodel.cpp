@@ -37,10 +37,19 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcActivity, "nextcloud.gui.activity", QtInfoMsg)
 
+// Activities added within this time are inserted together
+static const int flushIntervalMsecs = 100;
+// Only the newest synced files are shown
+static const int maxSyncFileItems = 1000;
+static const int activityPageSize = 100;
+
 ActivityListModel::ActivityListModel(AccountState *accountState, QWidget *parent)
     : QAbstractListModel(parent)
     , _accountState(accountState)
 {
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(flushIntervalMsecs);
+    connect(&_flushTimer, &QTimer::timeout, this, &ActivityListModel::slotFlushPendingActivities);
 }
 
 QVariant ActivityListModel::data(const QModelIndex &index, int role) const
@@ -54,7 +63,7 @@ QVariant ActivityListModel::data(const QModelIndex &index, int role) const
     if (!index.isValid())
         return QVariant();
 
-    a = _finalList.at(index.row());
+    a = activityAt(index.row());
     AccountStatePtr ast = AccountManager::instance()->account(a._accName);
     if (!ast && _accountState != ast.data())
         return QVariant();
@@ -147,42 +156,61 @@ QVariant ActivityListModel::data(const QModelIndex &index, int role) const
 
 int ActivityListModel::rowCount(const QModelIndex &) const
 {
-    return _finalList.count();
+    return sectionOffset(SectionCount);
 }
 
-// current strategy: Fetch 100 items per Account
-// ATTENTION: This method is const and thus it is not possible to modify
-// the _activityLists hash or so. Doesn't make it easier...
-bool ActivityListModel::canFetchMore(const QModelIndex &) const
+int ActivityListModel::sectionOffset(Section section) const
 {
-    if (_activityLists.count() == 0)
-        return true;
+    int offset = 0;
+    for (int i = 0; i < section; ++i)
+        offset += _sections[i].count();
+    return offset;
+}
 
-    if (_accountState && _accountState->isConnected()) {
-        if (_activityLists.count() == 0 && !_currentlyFetching) {
-            return true;
-        }
+const Activity &ActivityListModel::activityAt(int row) const
+{
+    int i = 0;
+    while (row >= _sections[i].count()) {
+        row -= _sections[i].count();
+        ++i;
     }
+    return _sections[i].at(row);
+}
 
-    return false;
+bool ActivityListModel::canFetchMore(const QModelIndex &) const
+{
+    return _accountState && _accountState->isConnected()
+        && !_activityJob && _moreActivitiesAvailable;
 }
 
-void ActivityListModel::startFetchJob()
+void ActivityListModel::fetchMore(const QModelIndex &)
+{
+    if (_accountState->isConnected()) {
+        startFetchJob(_activityPage + 1);
+    }
+}
+
+void ActivityListModel::startFetchJob(int page)
 {
     if (!_accountState->isConnected()) {
         return;
     }
+    if (_activityJob) {
+        // a refresh replaces a fetch that is still running
+        disconnect(_activityJob.data(), &JsonApiJob::jsonReceived, this, &ActivityListModel::slotActivitiesReceived);
+    }
     JsonApiJob *job = new JsonApiJob(_accountState->account(), QLatin1String("ocs/v2.php/cloud/activity"), this);
     QObject::connect(job, &JsonApiJob::jsonReceived,
         this, &ActivityListModel::slotActivitiesReceived);
 
     QUrlQuery params;
-    params.addQueryItem(QLatin1String("page"), QLatin1String("0"));
-    params.addQueryItem(QLatin1String("pagesize"), QLatin1String("100"));
+    params.addQueryItem(QLatin1String("page"), QString::number(page));
+    params.addQueryItem(QLatin1String("pagesize"), QString::number(activityPageSize));
     job->addQueryParams(params);
 
-    _currentlyFetching = true;
-    qCInfo(lcActivity) << "Start fetching activities for " << _accountState->account()->displayName();
+    _activityJob = job;
+    _fetchingPage = page;
+    qCInfo(lcActivity) << "Start fetching activities for " << _accountState->account()->displayName() << "page" << page;
     job->start();
 }
 
@@ -195,7 +223,7 @@ void ActivityListModel::slotActivitiesReceived(const QJsonDocument &json, int st
     if (!ast)
         return;
 
-    _currentlyFetching = 0;
+    _activityJob.clear();
 
     foreach (auto activ, activities) {
         auto json = activ.toObject();
@@ -212,103 +240,171 @@ void ActivityListModel::slotActivitiesReceived(const QJsonDocument &json, int st
         list.append(a);
     }
 
-    _activityLists = list;
+    // A short page is the last one
+    _moreActivitiesAvailable = activities.count() >= activityPageSize;
+    _activityPage = _fetchingPage;
 
     emit activityJobStatusCode(statusCode);
 
-    combineActivityLists();
+    if (_activityPage == 0)
+        clearSection(ActivitySection);
+    // Further pages are older than what is shown already
+    insertSorted(ActivitySection, list, false);
+}
+
+void ActivityListModel::addPendingActivity(Section section, const Activity &activity)
+{
+    _pending[section].append(activity);
+    if (!_flushTimer.isActive())
+        _flushTimer.start();
+}
+
+void ActivityListModel::slotFlushPendingActivities()
+{
+    _flushTimer.stop();
+    for (int i = 0; i < SectionCount; ++i)
+        flushPendingActivities(static_cast<Section>(i));
+}
+
+void ActivityListModel::flushPendingActivities(Section section)
+{
+    if (_pending[section].isEmpty())
+        return;
+    ActivityList activities;
+    activities.swap(_pending[section]);
+    // Later additions are newer, list them first among equal timestamps
+    std::reverse(activities.begin(), activities.end());
+    qCInfo(lcActivity) << "Adding" << activities.count() << "entries to the activity list";
+    insertSorted(section, activities, true);
+}
+
+void ActivityListModel::insertSorted(Section section, ActivityList activities, bool newerThanExisting)
+{
+    std::stable_sort(activities.begin(), activities.end());
+
+    auto belongsBefore = [newerThanExisting](const Activity &activity, const Activity &existing) {
+        return newerThanExisting ? !(existing < activity) : activity < existing;
+    };
+
+    ActivityList &list = _sections[section];
+    const int offset = sectionOffset(section);
+    int pos = 0;
+    int i = 0;
+    while (i < activities.count()) {
+        const Activity &activity = activities.at(i);
+        auto it = newerThanExisting
+            ? std::lower_bound(list.begin() + pos, list.end(), activity)
+            : std::upper_bound(list.begin() + pos, list.end(), activity);
+        pos = it - list.begin();
+
+        // All following activities that belong before list[pos] go to the same place
+        int end = i + 1;
+        while (end < activities.count() && (pos == list.count() || belongsBefore(activities.at(end), list.at(pos))))
+            ++end;
+
+        beginInsertRows(QModelIndex(), offset + pos, offset + pos + end - i - 1);
+        for (int j = i; j < end; ++j)
+            list.insert(pos++, activities.at(j));
+        endInsertRows();
+        i = end;
+    }
+
+    if (section == SyncFileItemSection && list.count() > maxSyncFileItems) {
+        beginRemoveRows(QModelIndex(), offset + maxSyncFileItems, offset + list.count() - 1);
+        list.erase(list.begin() + maxSyncFileItems, list.end());
+        endRemoveRows();
+    }
+}
+
+void ActivityListModel::clearSection(Section section)
+{
+    ActivityList &list = _sections[section];
+    if (list.isEmpty())
+        return;
+    const int offset = sectionOffset(section);
+    beginRemoveRows(QModelIndex(), offset, offset + list.count() - 1);
+    list.clear();
+    endRemoveRows();
+}
+
+ActivityList ActivityListModel::activityList()
+{
+    slotFlushPendingActivities();
+    ActivityList result;
+    for (const auto &list : _sections)
+        result.append(list);
+    return result;
+}
+
+ActivityList ActivityListModel::errorsList()
+{
+    flushPendingActivities(ErrorSection);
+    return _sections[ErrorSection];
 }
 
 void ActivityListModel::addErrorToActivityList(Activity activity) {
-    qCInfo(lcActivity) << "Error successfully added to the notification list: " << activity._subject;
-    _notificationErrorsLists.prepend(activity);
-    combineActivityLists();
+    addPendingActivity(ErrorSection, activity);
 }
 
 void ActivityListModel::addNotificationToActivityList(Activity activity) {
-    qCInfo(lcActivity) << "Notification successfully added to the notification list: " << activity._subject;
-    _notificationLists.prepend(activity);
-    combineActivityLists();
+    addPendingActivity(NotificationSection, activity);
 }
 
 void ActivityListModel::removeActivityFromActivityList(int row) {
-    Activity activity =  _finalList.at(row);
+    Activity activity = activityAt(row);
     removeActivityFromActivityList(activity);
 }
 
 void ActivityListModel::addSyncFileItemToActivityList(Activity activity) {
-    qCInfo(lcActivity) << "Successfully added to the activity list: " << activity._subject;
-    _syncFileItemLists.prepend(activity);
-    combineActivityLists();
+    addPendingActivity(SyncFileItemSection, activity);
 }
 
 void ActivityListModel::removeActivityFromActivityList(Activity activity) {
     qCInfo(lcActivity) << "Activity/Notification/Error successfully dismissed: " << activity._subject;
     qCInfo(lcActivity) << "Trying to remove Activity/Notification/Error from view... ";
 
-    int index = -1;
+    Section section = ErrorSection;
     if(activity._type == Activity::ActivityType){
-        index = _activityLists.indexOf(activity);
-        if(index != -1) _activityLists.removeAt(index);
+        section = ActivitySection;
     } else if(activity._type == Activity::NotificationType){
-        index = _notificationLists.indexOf(activity);
-        if(index != -1) _notificationLists.removeAt(index);
-    } else {
-        index = _notificationErrorsLists.indexOf(activity);
-        if(index != -1) _notificationErrorsLists.removeAt(index);
+        section = NotificationSection;
     }
 
-    if(index != -1){
-        qCInfo(lcActivity) << "Activity/Notification/Error successfully removed from the list.";
-        qCInfo(lcActivity) << "Updating Activity/Notification/Error view.";
-        combineActivityLists();
+    // the activity may still wait to be inserted
+    if (_pending[section].removeOne(activity)) {
+        qCInfo(lcActivity) << "Activity/Notification/Error removed before it was shown.";
+        return;
     }
-}
-
-
-void ActivityListModel::combineActivityLists()
-{
-    ActivityList resultList;
-
-    std::sort(_notificationErrorsLists.begin(), _notificationErrorsLists.end());
-    resultList.append(_notificationErrorsLists);
 
-    std::sort(_notificationLists.begin(), _notificationLists.end());
-    resultList.append(_notificationLists);
-
-    std::sort(_syncFileItemLists.begin(), _syncFileItemLists.end());
-    resultList.append(_syncFileItemLists);
-
-    std::sort(_activityLists.begin(), _activityLists.end());
-    resultList.append(_activityLists);
-
-    beginResetModel();
-    _finalList.clear();
-    endResetModel();
-
-    beginInsertRows(QModelIndex(), 0, resultList.count());
-    _finalList = resultList;
-    endInsertRows();
-}
-
-void ActivityListModel::fetchMore(const QModelIndex &)
-{
-    if (_accountState->isConnected()) {
-        _activityLists = ActivityList();
-        startFetchJob();
+    int index = _sections[section].indexOf(activity);
+    if(index != -1){
+        const int row = sectionOffset(section) + index;
+        beginRemoveRows(QModelIndex(), row, row);
+        _sections[section].removeAt(index);
+        endRemoveRows();
+        qCInfo(lcActivity) << "Activity/Notification/Error successfully removed from the list.";
     }
 }
 
 void ActivityListModel::slotRefreshActivity()
 {
-    _activityLists.clear();
-    startFetchJob();
+    _moreActivitiesAvailable = true;
+    startFetchJob(0);
 }
 
 void ActivityListModel::slotRemoveAccount()
 {
-    _finalList.clear();
-    _activityLists.clear();
-    _currentlyFetching = false;
+    beginResetModel();
+    for (int i = 0; i < SectionCount; ++i) {
+        _sections[i].clear();
+        _pending[i].clear();
+    }
+    _flushTimer.stop();
+    if (_activityJob)
+        disconnect(_activityJob.data(), &JsonApiJob::jsonReceived, this, &ActivityListModel::slotActivitiesReceived);
+    _activityJob.clear();
+    _activityPage = -1;
+    _moreActivitiesAvailable = true;
+    endResetModel();
 }
 }
@@ -26,12 +26,19 @@ namespace OCC {
 Q_DECLARE_LOGGING_CATEGORY(lcActivity)
 
 class AccountState;
+class JsonApiJob;
 
 /**
  * @brief The ActivityListModel
  * @ingroup gui
  *
  * Simple list model to provide the list view with data.
+ *
+ * The rows are made of four sections, each sorted youngest first: errors,
+ * notifications, synced files and the server activities. Added activities
+ * are collected and inserted in batches, so a big sync doesn't update the
+ * view for every file. The synced files section keeps only the newest
+ * entries, the server activities are fetched page by page.
  */
 
 class ActivityListModel : public QAbstractListModel
@@ -46,8 +53,8 @@ public:
     bool canFetchMore(const QModelIndex &) const Q_DECL_OVERRIDE;
     void fetchMore(const QModelIndex &) Q_DECL_OVERRIDE;
 
-    ActivityList activityList() { return _finalList; }
-    ActivityList errorsList() { return _notificationErrorsLists; }
+    ActivityList activityList();
+    ActivityList errorsList();
     void addNotificationToActivityList(Activity activity);
     void addErrorToActivityList(Activity activity);
     void addSyncFileItemToActivityList(Activity activity);
@@ -60,21 +67,42 @@ public slots:
 
 private slots:
     void slotActivitiesReceived(const QJsonDocument &json, int statusCode);
+    void slotFlushPendingActivities();
 
 signals:
     void activityJobStatusCode(int statusCode);
 
 private:
-    void startFetchJob();
-    void combineActivityLists();
-
-    ActivityList _activityLists;
-    ActivityList _syncFileItemLists;
-    ActivityList _notificationLists;
-    ActivityList _notificationErrorsLists;
-    ActivityList _finalList;
+    enum Section {
+        ErrorSection,
+        NotificationSection,
+        SyncFileItemSection,
+        ActivitySection,
+        SectionCount
+    };
+
+    void startFetchJob(int page);
+    void addPendingActivity(Section section, const Activity &activity);
+    void flushPendingActivities(Section section);
+    /**
+     * Inserts the activities at their sorted positions, in as few row ranges as possible.
+     * Activities with the same time as existing ones go in front of them if they are
+     * newer than the existing ones, behind them otherwise.
+     */
+    void insertSorted(Section section, ActivityList activities, bool newerThanExisting);
+    void clearSection(Section section);
+    int sectionOffset(Section section) const;
+    const Activity &activityAt(int row) const;
+
+    ActivityList _sections[SectionCount];
+    ActivityList _pending[SectionCount];
+    QTimer _flushTimer;
+
     AccountState *_accountState;
-    bool _currentlyFetching = true;
+    QPointer<JsonApiJob> _activityJob;
+    int _activityPage = -1; // the last page that was received
+    int _fetchingPage = 0;
+    bool _moreActivitiesAvailable = true;
 };
 }
 #endif // ACTIVITYLISTMODEL_H
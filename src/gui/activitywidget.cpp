@@ -170,7 +170,7 @@ void ActivityWidget::slotItemCompleted(const QString &folder, const SyncFileItem
         Activity activity;
         activity._type = Activity::SyncFileItemType; //client activity
         activity._status = item->_status;
-        activity._dateTime = QDateTime::fromString(QDateTime::currentDateTime().toString(), Qt::ISODate);
+        activity._dateTime = QDateTime::currentDateTime();
         activity._message = item->_originalFile;
         activity._link = folderInstance->accountState()->account()->url();
         activity._accName = folderInstance->accountState()->account()->displayName();
@@ -204,7 +204,7 @@ void ActivityWidget::addError(const QString &folderAlias, const QString &message
         Activity activity;
         activity._type = Activity::SyncResultType;
         activity._status = SyncResult::Error;
-        activity._dateTime = QDateTime::fromString(QDateTime::currentDateTime().toString(), Qt::ISODate);
+        activity._dateTime = QDateTime::currentDateTime();
         activity._subject = message;
         activity._message = folderInstance->shortGuiLocalPath();
         activity._link = folderInstance->shortGuiLocalPath();
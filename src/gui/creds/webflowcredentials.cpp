@@ -5,7 +5,6 @@
 #include <QAuthenticator>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
-#include <QPointer>
 #include <QTimer>
 #include <keychain.h>
 #include <QDialog>
@@ -27,7 +26,7 @@ Q_LOGGING_CATEGORY(lcWebFlowCredentials, "sync.credentials.webflow", QtInfoMsg)
 class WebFlowCredentialsAccessManager : public AccessManager
 {
 public:
-    WebFlowCredentialsAccessManager(const WebFlowCredentials *cred, QObject *parent = nullptr)
+    WebFlowCredentialsAccessManager(const QSharedPointer<AccessManagerCredentials> &cred, QObject *parent = nullptr)
         : AccessManager(parent)
         , _cred(cred)
     {
@@ -36,10 +35,13 @@ public:
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) Q_DECL_OVERRIDE
     {
+        // Might run in a sync thread, never touch the credentials object here
+        const auto cred = _cred->values();
+
         QNetworkRequest req(request);
         if (!req.attribute(HttpCredentials::DontAddCredentialsAttribute).toBool()) {
-            if (_cred && !_cred->password().isEmpty()) {
-                QByteArray credHash = QByteArray(_cred->user().toUtf8() + ":" + _cred->password().toUtf8()).toBase64();
+            if (!cred.password.isEmpty()) {
+                QByteArray credHash = QByteArray(cred.user.toUtf8() + ":" + cred.password.toUtf8()).toBase64();
                 req.setRawHeader("Authorization", "Basic " + credHash);
             }
         }
@@ -48,17 +50,17 @@ protected:
     }
 
 private:
-    // The credentials object dies along with the account, while the QNAM might
-    // outlive both.
-    QPointer<const WebFlowCredentials> _cred;
+    QSharedPointer<AccessManagerCredentials> _cred;
 };
 
 WebFlowCredentials::WebFlowCredentials()
     : _ready(false)
     , _credentialsValid(false)
     , _keychainMigration(false)
+    , _accessManagerCredentials(new AccessManagerCredentials)
 {
-
+    connect(this, &AbstractCredentials::fetched, this, &WebFlowCredentials::updateAccessManagerCredentials);
+    connect(this, &AbstractCredentials::asked, this, &WebFlowCredentials::updateAccessManagerCredentials);
 }
 
 WebFlowCredentials::WebFlowCredentials(const QString &user, const QString &password, const QSslCertificate &certificate, const QSslKey &key)
@@ -69,8 +71,25 @@ WebFlowCredentials::WebFlowCredentials(const QString &user, const QString &passw
     , _ready(true)
     , _credentialsValid(true)
     , _keychainMigration(false)
+    , _accessManagerCredentials(new AccessManagerCredentials)
 {
+    updateAccessManagerCredentials();
+    connect(this, &AbstractCredentials::fetched, this, &WebFlowCredentials::updateAccessManagerCredentials);
+    connect(this, &AbstractCredentials::asked, this, &WebFlowCredentials::updateAccessManagerCredentials);
+}
 
+WebFlowCredentials::~WebFlowCredentials()
+{
+    // Access managers that outlive the credentials don't send them anymore
+    _accessManagerCredentials->setValues(AccessManagerCredentials::Values());
+}
+
+void WebFlowCredentials::updateAccessManagerCredentials()
+{
+    AccessManagerCredentials::Values values;
+    values.user = _user;
+    values.password = _password;
+    _accessManagerCredentials->setValues(values);
 }
 
 QString WebFlowCredentials::authType() const {
@@ -87,7 +106,7 @@ QString WebFlowCredentials::password() const {
 
 QNetworkAccessManager *WebFlowCredentials::createQNAM() const {
     qCInfo(lcWebFlowCredentials()) << "Get QNAM";
-    AccessManager *qnam = new WebFlowCredentialsAccessManager(this);
+    AccessManager *qnam = new WebFlowCredentialsAccessManager(_accessManagerCredentials);
 
     connect(qnam, &AccessManager::authenticationRequired, this, &WebFlowCredentials::slotAuthentication);
     connect(qnam, &AccessManager::finished, this, &WebFlowCredentials::slotFinished);
@@ -205,6 +224,7 @@ void WebFlowCredentials::forgetSensitiveData(){
     _ready = false;
 
     fetchUser();
+    updateAccessManagerCredentials();
 
     const QString kck = keychainKey(_account->url().toString(), _user, _account->id());
     if (kck.isEmpty()) {
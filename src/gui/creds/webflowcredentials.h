@@ -1,6 +1,7 @@
 #ifndef WEBFLOWCREDENTIALS_H
 #define WEBFLOWCREDENTIALS_H
 
+#include <QSharedPointer>
 #include <QSslCertificate>
 #include <QSslKey>
 
@@ -18,6 +19,7 @@ namespace QKeychain {
 namespace OCC {
 
 class WebFlowCredentialsDialog;
+class AccessManagerCredentials;
 
 class WebFlowCredentials : public AbstractCredentials
 {
@@ -25,6 +27,7 @@ class WebFlowCredentials : public AbstractCredentials
 public:
     explicit WebFlowCredentials();
     WebFlowCredentials(const QString &user, const QString &password, const QSslCertificate &certificate = QSslCertificate(), const QSslKey &key = QSslKey());
+    ~WebFlowCredentials();
 
     QString authType() const override;
     QString user() const override;
@@ -57,6 +60,9 @@ private:
 
     QString fetchUser();
 
+    /// Copies the credentials for the access managers, called whenever they change
+    void updateAccessManagerCredentials();
+
     QString _user;
     QString _password;
     QSslKey _clientSslKey;
@@ -67,6 +73,9 @@ private:
     bool _keychainMigration;
 
     WebFlowCredentialsDialog *_askDialog;
+
+    // Shared with the access managers, which might outlive the credentials
+    QSharedPointer<AccessManagerCredentials> _accessManagerCredentials;
 };
 
 }
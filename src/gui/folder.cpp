@@ -33,6 +33,8 @@
 
 #include "creds/abstractcredentials.h"
 
+#include <QCoreApplication>
+#include <QThread>
 #include <QTimer>
 #include <QUrl>
 #include <QDir>
@@ -55,6 +57,9 @@ Folder::Folder(const FolderDefinition &definition,
     , _lastSyncDuration(0)
     , _consecutiveFailingSyncs(0)
     , _consecutiveFollowUpSyncs(0)
+    , _maximumActiveJobs(0)
+    , _discoveryThreads(0)
+    , _engineStopping(false)
     , _journal(_definition.absoluteJournalPath())
     , _fileLog(new SyncRunFileLog)
     , _saveBackwardsCompatible(false)
@@ -88,20 +93,39 @@ Folder::Folder(const FolderDefinition &definition,
     connect(_engine.data(), &SyncEngine::finished, this, &Folder::slotSyncFinished, Qt::QueuedConnection);
     connect(_engine.data(), &SyncEngine::csyncUnavailable, this, &Folder::slotCsyncUnavailable, Qt::QueuedConnection);
 
-    //direct connection so the message box is blocking the sync.
+    if (ConfigFile().syncInWorkerThread()) {
+        // The engine, its propagator and its network jobs live in a thread
+        // of their own, everything else reaches them through queued calls.
+        _engineThread.reset(new QThread);
+        _engineThread->setObjectName(QLatin1String("SyncEngine_Folder_Thread"));
+        _accountState->account()->addNetworkAccessManagerForThread(_engineThread.data());
+        _engine->moveToThread(_engineThread.data());
+        _engineThread->start();
+    }
+
+    // blocking connection so the message box is blocking the sync.
+    const auto blockingConnection = _engineThread ? Qt::BlockingQueuedConnection : Qt::DirectConnection;
     connect(_engine.data(), &SyncEngine::aboutToRemoveAllFiles,
-        this, &Folder::slotAboutToRemoveAllFiles);
+        this, &Folder::slotAboutToRemoveAllFiles, blockingConnection);
     connect(_engine.data(), &SyncEngine::aboutToRestoreBackup,
-        this, &Folder::slotAboutToRestoreBackup);
-    connect(_engine.data(), &SyncEngine::transmissionProgress, this, &Folder::slotTransmissionProgress);
+        this, &Folder::slotAboutToRestoreBackup, blockingConnection);
     connect(_engine.data(), &SyncEngine::itemCompleted,
         this, &Folder::slotItemCompleted);
     connect(_engine.data(), &SyncEngine::newBigFolder,
         this, &Folder::slotNewBigFolderDiscovered);
     connect(_engine.data(), &SyncEngine::seenLockedFile, FolderMan::instance(), &FolderMan::slotSyncOnceFileUnlocks);
-    connect(_engine.data(), &SyncEngine::aboutToPropagate,
-        this, &Folder::slotLogPropagationStart);
     connect(_engine.data(), &SyncEngine::syncError, this, &Folder::slotSyncError);
+    if (_engineThread) {
+        // Neither signal can be queued as it is
+        connect(_engine.data(), &SyncEngine::transmissionProgress, this, &Folder::postProgressSnapshot, Qt::DirectConnection);
+        connect(_engine.data(), &SyncEngine::aboutToPropagate, this, [this]() {
+            QMetaObject::invokeMethod(this, "slotLogPropagationStart", Qt::QueuedConnection);
+        }, Qt::DirectConnection);
+    } else {
+        connect(_engine.data(), &SyncEngine::transmissionProgress, this, &Folder::slotTransmissionProgress);
+        connect(_engine.data(), &SyncEngine::aboutToPropagate,
+            this, &Folder::slotLogPropagationStart);
+    }
 
     _scheduleSelfTimer.setSingleShot(true);
     _scheduleSelfTimer.setInterval(SyncEngine::minimumFileAgeForUpload);
@@ -115,6 +139,21 @@ Folder::Folder(const FolderDefinition &definition,
 Folder::~Folder()
 {
     // Reset then engine first as it will abort and try to access members of the Folder
+    if (_engineThread) {
+        _engineStopping = true;
+        QMetaObject::invokeMethod(_engine.data(), "abort", Qt::QueuedConnection);
+        // Deleted in its thread, before the thread's QNAM
+        _engine.take()->deleteLater();
+        _accountState->account()->removeNetworkAccessManagerForThread(_engineThread.data());
+        _engineThread->quit();
+
+        // The thread might be blocked until the main thread answers a question
+        // of the sync, about ssl errors or a proxy authentication
+        while (!_engineThread->wait(100)) {
+            QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+            QCoreApplication::sendPostedEvents(_accountState->account().data(), QEvent::MetaCall);
+        }
+    }
     _engine.reset();
 }
 
@@ -563,7 +602,7 @@ void Folder::slotTerminateSync()
     qCInfo(lcFolder) << "folder " << alias() << " Terminating!";
 
     if (_engine->isSyncRunning()) {
-        _engine->abort();
+        QMetaObject::invokeMethod(_engine.data(), "abort", Qt::AutoConnection);
 
         setSyncState(SyncResult::SyncAbortRequested);
     }
@@ -720,6 +759,11 @@ void Folder::setSyncOptions()
         opt._targetChunkUploadDuration = cfgFile.targetChunkUploadDuration();
     }
 
+    opt._bulkRemoteListing = cfgFile.bulkRemoteListing();
+    opt._deltaUploads = cfgFile.deltaUploads();
+    opt._serverSideCopies = cfgFile.serverSideCopies();
+    opt._discoveryThreads = _discoveryThreads;
+
     _engine->setSyncOptions(opt);
 }
 
@@ -742,7 +786,17 @@ void Folder::setDirtyNetworkLimits()
         uploadLimit = 0;
     }
 
-    _engine->setNetworkLimits(uploadLimit, downloadLimit);
+    QMetaObject::invokeMethod(_engine.data(), "setNetworkLimits", Qt::AutoConnection,
+        Q_ARG(int, uploadLimit), Q_ARG(int, downloadLimit));
+}
+
+void Folder::setSyncBudget(int networkJobs, int discoveryThreads)
+{
+    _maximumActiveJobs = networkJobs;
+    _discoveryThreads = discoveryThreads;
+
+    QMetaObject::invokeMethod(_engine.data(), "setMaximumActiveJobs", Qt::AutoConnection,
+        Q_ARG(int, networkJobs));
 }
 
 void Folder::slotSyncError(const QString &message, ErrorCategory category)
@@ -882,6 +936,36 @@ void Folder::slotTransmissionProgress(const ProgressInfo &pi)
     ProgressDispatcher::instance()->setProgressInfo(alias(), pi);
 }
 
+void Folder::postProgressSnapshot(const ProgressInfo &pi)
+{
+    // Called in the engine's thread. Updates the gui didn't pick up yet are
+    // replaced, except the last one of each status.
+    QSharedPointer<ProgressInfo> snapshot(new ProgressInfo);
+    snapshot->copyFrom(pi);
+    snapshot->moveToThread(thread());
+
+    QMutexLocker locker(&_progressSnapshotsMutex);
+    const bool deliveryPending = !_progressSnapshots.isEmpty();
+    if (deliveryPending && _progressSnapshots.last()->status() == pi.status()) {
+        _progressSnapshots.last() = snapshot;
+    } else {
+        _progressSnapshots.append(snapshot);
+    }
+    if (!deliveryPending)
+        QMetaObject::invokeMethod(this, "slotDeliverProgressSnapshots", Qt::QueuedConnection);
+}
+
+void Folder::slotDeliverProgressSnapshots()
+{
+    QVector<QSharedPointer<ProgressInfo>> snapshots;
+    {
+        QMutexLocker locker(&_progressSnapshotsMutex);
+        snapshots.swap(_progressSnapshots);
+    }
+    for (const auto &snapshot : snapshots)
+        slotTransmissionProgress(*snapshot);
+}
+
 // a item is completed: count the errors and forward to the ProgressDispatcher
 void Folder::slotItemCompleted(const SyncFileItemPtr &item)
 {
@@ -1053,6 +1137,7 @@ void Folder::registerFolderWatcher()
         return;
 
     _folderWatcher.reset(new FolderWatcher(this));
+    _folderWatcher->setExcludeCheck([this](const QString &path) { return isFileExcludedAbsolute(path); });
     connect(_folderWatcher.data(), &FolderWatcher::pathChanged,
         this, &Folder::slotWatchedPathChanged);
     connect(_folderWatcher.data(), &FolderWatcher::lostChanges,
@@ -1064,6 +1149,12 @@ void Folder::registerFolderWatcher()
 
 void Folder::slotAboutToRemoveAllFiles(SyncFileItem::Direction dir, bool *cancel)
 {
+    // The folder is going away, nobody can be asked
+    if (_engineStopping) {
+        *cancel = true;
+        return;
+    }
+
     ConfigFile cfgFile;
     if (!cfgFile.promptDeleteFiles())
         return;
@@ -1097,6 +1188,9 @@ void Folder::slotAboutToRemoveAllFiles(SyncFileItem::Direction dir, bool *cancel
 
 void Folder::slotAboutToRestoreBackup(bool *restore)
 {
+    if (_engineStopping)
+        return;
+
     QString msg =
         tr("This sync would reset the files to an earlier time in the sync folder '%1'.\n"
            "This might be because a backup was restored on the server.\n"
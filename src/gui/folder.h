@@ -24,8 +24,12 @@
 
 #include <csync.h>
 
+#include <QMutex>
 #include <QObject>
+#include <QSharedPointer>
 #include <QStringList>
+#include <QThread>
+#include <QVector>
 #include <QUuid>
 #include <set>
 #include <chrono>
@@ -182,6 +186,15 @@ public:
 
     void setDirtyNetworkLimits();
 
+    /**
+      * Sets the share of this folder in the budgets of all running folders.
+      * The network jobs apply to a running sync right away, the discovery
+      * threads to the next one. 0 means no limit besides the account's.
+      */
+    void setSyncBudget(int networkJobs, int discoveryThreads);
+    int maximumActiveJobs() const { return _maximumActiveJobs; }
+    int discoveryThreads() const { return _discoveryThreads; }
+
     /**
       * Ignore syncing of hidden files or not. This is defined in the
       * folder definition
@@ -199,6 +212,9 @@ public:
     int consecutiveFollowUpSyncs() const { return _consecutiveFollowUpSyncs; }
     int consecutiveFailingSyncs() const { return _consecutiveFailingSyncs; }
 
+    /** True if the file watcher reported local changes that were not synced yet */
+    bool hasPendingLocalChanges() const { return !_localDiscoveryPaths.empty(); }
+
     /// Saves the folder data in the account's settings.
     void saveToSettings() const;
     /// Removes the folder from the account's settings.
@@ -284,6 +300,12 @@ public slots:
        */
     void slotWatchedPathChanged(const QString &path);
 
+    /**
+     * The etag of the remote folder was queried, by our own RequestEtagJob
+     * or by a BatchEtagJob of the FolderMan. Schedules a sync if it changed.
+     */
+    void etagRetreived(const QString &);
+
 private slots:
     void slotSyncStarted();
     void slotSyncFinished(bool);
@@ -295,10 +317,10 @@ private slots:
     void slotCsyncUnavailable();
 
     void slotTransmissionProgress(const ProgressInfo &pi);
+    void slotDeliverProgressSnapshots();
     void slotItemCompleted(const SyncFileItemPtr &);
 
     void slotRunEtagJob();
-    void etagRetreived(const QString &);
     void etagRetreivedFromSyncEngine(const QString &);
 
     void slotEmitFinishedDelayed();
@@ -337,6 +359,9 @@ private:
 
     void setSyncOptions();
 
+    /// Hands a copy of the engine's progress to the gui thread
+    void postProgressSnapshot(const ProgressInfo &pi);
+
     enum LogStatus {
         LogStatusRemove,
         LogStatusRename,
@@ -356,6 +381,10 @@ private:
 
     SyncResult _syncResult;
     QScopedPointer<SyncEngine> _engine;
+    /// Set when the engine runs in a thread of its own, see ConfigFile::syncInWorkerThread()
+    QScopedPointer<QThread> _engineThread;
+    QMutex _progressSnapshotsMutex;
+    QVector<QSharedPointer<ProgressInfo>> _progressSnapshots;
     bool _csyncUnavail;
     QPointer<RequestEtagJob> _requestEtagJob;
     QString _lastEtag;
@@ -372,6 +401,13 @@ private:
     /// Reset when no follow-up is requested.
     int _consecutiveFollowUpSyncs;
 
+    /// The share of the folder in the budgets of FolderMan, see setSyncBudget()
+    int _maximumActiveJobs;
+    int _discoveryThreads;
+
+    /// Set while the engine thread shuts down, the engine gets no more answers
+    bool _engineStopping;
+
     SyncJournalDb _journal;
 
     QScopedPointer<SyncRunFileLog> _fileLog;
@@ -43,11 +43,13 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcFolderMan, "nextcloud.gui.folder.manager", QtInfoMsg)
 
+// Qt doesn't open more than six connections per host anyway
+static const int maxEtagJobsPerAccount = 6;
+
 FolderMan *FolderMan::_instance = 0;
 
 FolderMan::FolderMan(QObject *parent)
     : QObject(parent)
-    , _currentSyncFolder(0)
     , _syncEnabled(true)
     , _lockWatcher(new LockWatcher)
     , _navigationPaneHelper(this)
@@ -59,6 +61,9 @@ FolderMan::FolderMan(QObject *parent)
     _socketApi.reset(new SocketApi);
 
     ConfigFile cfg;
+    _maxConcurrentSyncs = cfg.maxConcurrentSyncs();
+    _maxNetworkJobs = cfg.maxParallelNetworkJobs();
+    _maxDiscoveryThreads = cfg.maxDiscoveryThreads();
     std::chrono::milliseconds polltime = cfg.remotePollInterval();
     qCInfo(lcFolderMan) << "setting remote poll timer interval to" << polltime.count() << "msec";
     _etagPollTimer.setInterval(polltime.count());
@@ -138,7 +143,8 @@ int FolderMan::unloadAndDeleteAllFolders()
     ASSERT(_folderMap.isEmpty());
 
     _lastSyncFolder = 0;
-    _currentSyncFolder = 0;
+    _nextSyncFolder = 0;
+    _currentSyncFolders.clear();
     _scheduledFolders.clear();
     emit folderListChanged(_folderMap);
     emit scheduleQueueChanged();
@@ -454,12 +460,15 @@ void FolderMan::slotFolderCanSyncChanged()
 // this really terminates the current sync process
 // ie. no questions, no prisoners
 // csync still remains in a stable state, regardless of that.
-void FolderMan::terminateSyncProcess()
+void FolderMan::terminateSyncProcess(Folder *folder)
 {
-    Folder *f = _currentSyncFolder;
-    if (f) {
+    // copy, terminating may finish the sync synchronously
+    const auto running = _currentSyncFolders;
+    for (Folder *f : running) {
+        if (folder && folder != f)
+            continue;
         // This will, indirectly and eventually, call slotFolderSyncFinished
-        // and thereby clear _currentSyncFolder.
+        // and thereby remove f from _currentSyncFolders.
         f->slotTerminateSync();
     }
 }
@@ -540,6 +549,7 @@ void FolderMan::scheduleFolderNext(Folder *f)
     f->prepareToSync();
     emit folderSyncStateChange(f);
     _scheduledFolders.prepend(f);
+    _nextSyncFolder = f;
     emit scheduleQueueChanged();
 
     startScheduledSyncSoon();
@@ -548,39 +558,131 @@ void FolderMan::scheduleFolderNext(Folder *f)
 void FolderMan::slotScheduleETagJob(const QString & /*alias*/, RequestEtagJob *job)
 {
     QObject::connect(job, &QObject::destroyed, this, &FolderMan::slotEtagJobDestroyed);
-    QMetaObject::invokeMethod(this, "slotRunOneEtagJob", Qt::QueuedConnection);
-    // maybe: add to queue
+    QMetaObject::invokeMethod(this, "slotRunEtagJobs", Qt::QueuedConnection);
 }
 
 void FolderMan::slotEtagJobDestroyed(QObject * /*o*/)
 {
-    // _currentEtagJob is automatically cleared
-    // maybe: remove from queue
-    QMetaObject::invokeMethod(this, "slotRunOneEtagJob", Qt::QueuedConnection);
+    // the QPointer in _runningEtagJobs is automatically cleared
+    QMetaObject::invokeMethod(this, "slotRunEtagJobs", Qt::QueuedConnection);
 }
 
-void FolderMan::slotRunOneEtagJob()
+int FolderMan::runningEtagJobCount(const Account *account) const
 {
-    if (_currentEtagJob.isNull()) {
-        Folder *folder;
-        foreach (Folder *f, _folderMap) {
-            if (f->etagJob()) {
-                // Caveat: always grabs the first folder with a job, but we think this is Ok for now and avoids us having a seperate queue.
-                _currentEtagJob = f->etagJob();
-                folder = f;
-                break;
-            }
+    int count = 0;
+    for (const auto &job : _runningEtagJobs) {
+        if (job && job->account().data() == account)
+            ++count;
+    }
+    return count;
+}
+
+void FolderMan::slotRunEtagJobs()
+{
+    _runningEtagJobs.removeAll(QPointer<AbstractNetworkJob>());
+    _queuedBatchEtagJobs.removeAll(QPointer<BatchEtagJob>());
+
+    // The etag queries of an account are cheap and run in parallel, like the
+    // propagator jobs they are limited to what the access manager can run at once.
+    bool pending = false;
+    QMutableListIterator<QPointer<BatchEtagJob>> it(_queuedBatchEtagJobs);
+    while (it.hasNext()) {
+        BatchEtagJob *job = it.next();
+        if (runningEtagJobCount(job->account().data()) >= maxEtagJobsPerAccount) {
+            pending = true;
+            continue;
         }
-        if (_currentEtagJob.isNull()) {
-            //qCDebug(lcFolderMan) << "No more remote ETag check jobs to schedule.";
+        it.remove();
+        _runningEtagJobs.append(job);
+        job->start();
+    }
+    foreach (Folder *f, _folderMap) {
+        RequestEtagJob *job = f->etagJob();
+        if (!job || _runningEtagJobs.contains(job))
+            continue;
+        if (runningEtagJobCount(job->account().data()) >= maxEtagJobsPerAccount) {
+            pending = true;
+            continue;
+        }
+        qCDebug(lcFolderMan) << "Scheduling" << f->remoteUrl().toString() << "to check remote ETag";
+        _runningEtagJobs.append(job);
+        job->start(); // on destroy/end it will continue the queue via slotEtagJobDestroyed
+    }
 
-            /* now it might be a good time to check for restarting... */
-            if (_currentSyncFolder == NULL && _appRestartRequired) {
-                restartApplication();
-            }
+    if (!pending && _runningEtagJobs.isEmpty()) {
+        //qCDebug(lcFolderMan) << "No more remote ETag check jobs to schedule.";
+
+        /* now it might be a good time to check for restarting... */
+        if (_currentSyncFolders.isEmpty() && _appRestartRequired) {
+            restartApplication();
+        }
+    }
+}
+
+QList<Folder *> FolderMan::startBatchEtagJobs(const QList<Folder *> &folders)
+{
+    QList<Folder *> single;
+    QMap<QPair<QString, QString>, QList<Folder *>> siblings;
+    foreach (Folder *f, folders) {
+        AccountPtr account = f->accountState()->account();
+        // Older servers don't update the etag of a folder when its contents change,
+        // the etag in the listing of the parent is not enough there.
+        const bool isRoot = f->remotePath().split(QLatin1Char('/'), QString::SkipEmptyParts).isEmpty();
+        if (isRoot || !account->rootEtagChangesNotOnlySubFolderEtags()) {
+            single.append(f);
+            continue;
+        }
+        siblings[qMakePair(account->id(), BatchEtagJob::parentPath(f->remotePath()))].append(f);
+    }
+
+    for (auto it = siblings.constBegin(); it != siblings.constEnd(); ++it) {
+        const QList<Folder *> &group = it.value();
+        if (group.size() < 2) {
+            single += group;
+            continue;
+        }
+
+        QStringList paths;
+        QStringList aliases;
+        foreach (Folder *f, group) {
+            paths.append(f->remotePath());
+            aliases.append(f->alias());
+        }
+        qCInfo(lcFolderMan) << "Checking" << aliases << "for changes via one ETag check of" << it.key().second;
+
+        auto job = new BatchEtagJob(group.first()->accountState()->account(), paths, this);
+        job->setTimeout(60 * 1000);
+        connect(job, &BatchEtagJob::etagsRetreived, this, [this, aliases](const QHash<QString, QString> &etags) {
+            slotBatchEtagsRetreived(aliases, etags);
+        });
+        connect(job, &BatchEtagJob::finishedWithError, this, [this, aliases]() {
+            slotBatchEtagsRetreived(aliases, QHash<QString, QString>());
+        });
+        connect(job, &QObject::destroyed, this, [this, aliases]() {
+            foreach (const QString &alias, aliases)
+                _batchedEtagFolders.remove(alias);
+        });
+        connect(job, &QObject::destroyed, this, &FolderMan::slotEtagJobDestroyed);
+        _batchedEtagFolders += aliases.toSet();
+        _queuedBatchEtagJobs.append(job);
+    }
+    if (!_queuedBatchEtagJobs.isEmpty())
+        slotRunEtagJobs();
+    return single;
+}
+
+void FolderMan::slotBatchEtagsRetreived(const QStringList &aliases, const QHash<QString, QString> &etags)
+{
+    foreach (const QString &alias, aliases) {
+        Folder *f = _folderMap.value(alias);
+        if (!f)
+            continue;
+        auto it = etags.constFind(f->remotePath());
+        if (it != etags.constEnd()) {
+            f->etagRetreived(it.value());
         } else {
-            qCDebug(lcFolderMan) << "Scheduling" << folder->remoteUrl().toString() << "to check remote ETag";
-            _currentEtagJob->start(); // on destroy/end it will continue the queue via slotEtagJobDestroyed
+            // not in the listing of the parent (or the listing failed), ask for the folder itself
+            QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
         }
     }
 }
@@ -607,9 +709,11 @@ void FolderMan::slotAccountStateChanged()
         qCInfo(lcFolderMan) << "Account" << accountName << "disconnected or paused, "
                                                            "terminating or descheduling sync folders";
 
-        if (_currentSyncFolder
-            && _currentSyncFolder->accountState() == accountState) {
-            _currentSyncFolder->slotTerminateSync();
+        const auto running = _currentSyncFolders;
+        for (Folder *f : running) {
+            if (f->accountState() == accountState) {
+                f->slotTerminateSync();
+            }
         }
 
         QMutableListIterator<Folder *> it(_scheduledFolders);
@@ -644,7 +748,7 @@ void FolderMan::startScheduledSyncSoon()
     if (_scheduledFolders.empty()) {
         return;
     }
-    if (_currentSyncFolder) {
+    if (_currentSyncFolders.size() >= _maxConcurrentSyncs) {
         return;
     }
 
@@ -682,8 +786,8 @@ void FolderMan::startScheduledSyncSoon()
   */
 void FolderMan::slotStartScheduledFolderSync()
 {
-    if (_currentSyncFolder) {
-        qCInfo(lcFolderMan) << "Currently folder " << _currentSyncFolder->remoteUrl().toString() << " is running, wait for finish!";
+    if (_currentSyncFolders.size() >= _maxConcurrentSyncs) {
+        qCInfo(lcFolderMan) << "Currently" << _currentSyncFolders.size() << "folders are running, wait for finish!";
         return;
     }
 
@@ -697,28 +801,97 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
-    // Find the first folder in the queue that can be synced.
-    Folder *folder = 0;
-    while (!_scheduledFolders.isEmpty()) {
-        Folder *g = _scheduledFolders.dequeue();
-        if (g->canSync()) {
-            folder = g;
+    // Start syncing as many folders as the budget allows.
+    QList<Folder *> startingFolders;
+    while (_currentSyncFolders.size() < _maxConcurrentSyncs) {
+        Folder *folder = takeNextScheduledFolder();
+        if (!folder)
             break;
-        }
-    }
-
-    emit scheduleQueueChanged();
 
-    // Start syncing this folder!
-    if (folder) {
         // Safe to call several times, and necessary to try again if
         // the folder path didn't exist previously.
         folder->registerFolderWatcher();
         registerFolderWithSocketApi(folder);
 
-        _currentSyncFolder = folder;
+        _currentSyncFolders.append(folder);
+        startingFolders.append(folder);
+    }
+
+    // The new folders need their share before their discovery starts
+    updateSyncBudgets();
+    for (Folder *folder : startingFolders)
         folder->startSync(QStringList());
+
+    emit scheduleQueueChanged();
+}
+
+Folder *FolderMan::takeNextScheduledFolder()
+{
+    // Folders that can't sync are dropped from the queue, they get
+    // rescheduled once they can.
+    QMutableListIterator<Folder *> it(_scheduledFolders);
+    while (it.hasNext()) {
+        if (!it.next()->canSync())
+            it.remove();
+    }
+
+    QHash<AccountState *, int> runningPerAccount;
+    for (Folder *f : _currentSyncFolders)
+        runningPerAccount[f->accountState()]++;
+
+    // Two sync runs must never work on overlapping local trees,
+    // which is possible with folders of different accounts.
+    const Qt::CaseSensitivity cs = Utility::fsCasePreserving() ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    auto overlapsRunningSync = [this, cs](Folder *f) {
+        const QString folderDir = QDir::cleanPath(f->path()) + '/';
+        for (Folder *running : _currentSyncFolders) {
+            const QString runningDir = QDir::cleanPath(running->path()) + '/';
+            if (folderDir.startsWith(runningDir, cs) || runningDir.startsWith(folderDir, cs)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    int best = -1;
+    int bestRunning = 0;
+    bool bestHasChanges = false;
+    for (int i = 0; i < _scheduledFolders.size(); ++i) {
+        Folder *f = _scheduledFolders.at(i);
+        if (overlapsRunningSync(f))
+            continue;
+        if (f == _nextSyncFolder) {
+            best = i;
+            break;
+        }
+        const int running = runningPerAccount.value(f->accountState());
+        const bool hasChanges = f->hasPendingLocalChanges();
+        if (best == -1
+            || running < bestRunning
+            || (running == bestRunning && hasChanges && !bestHasChanges)) {
+            best = i;
+            bestRunning = running;
+            bestHasChanges = hasChanges;
+        }
     }
+
+    if (best == -1)
+        return 0;
+    Folder *folder = _scheduledFolders.takeAt(best);
+    if (folder == _nextSyncFolder)
+        _nextSyncFolder = 0;
+    return folder;
+}
+
+void FolderMan::updateSyncBudgets()
+{
+    if (_currentSyncFolders.isEmpty())
+        return;
+
+    const int networkJobs = qMax(1, _maxNetworkJobs / _currentSyncFolders.size());
+    const int discoveryThreads = qMax(1, _maxDiscoveryThreads / _currentSyncFolders.size());
+    for (Folder *f : _currentSyncFolders)
+        f->setSyncBudget(networkJobs, discoveryThreads);
 }
 
 void FolderMan::slotEtagPollTimerTimeout()
@@ -726,11 +899,12 @@ void FolderMan::slotEtagPollTimerTimeout()
     ConfigFile cfg;
     auto polltime = cfg.remotePollInterval();
 
+    QList<Folder *> folders;
     foreach (Folder *f, _folderMap) {
         if (!f) {
             continue;
         }
-        if (_currentSyncFolder == f) {
+        if (_currentSyncFolders.contains(f)) {
             continue;
         }
         if (_scheduledFolders.contains(f)) {
@@ -742,9 +916,16 @@ void FolderMan::slotEtagPollTimerTimeout()
         if (f->etagJob() || f->isBusy() || !f->canSync()) {
             continue;
         }
+        if (_batchedEtagFolders.contains(f->alias())) {
+            continue;
+        }
         if (f->msecSinceLastSync() < polltime) {
             continue;
         }
+        folders.append(f);
+    }
+
+    foreach (Folder *f, startBatchEtagJobs(folders)) {
         QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
     }
 }
@@ -842,10 +1023,12 @@ void FolderMan::slotScheduleFolderByTime()
 
 void FolderMan::slotFolderSyncStarted()
 {
+    Folder *f = qobject_cast<Folder *>(sender());
+    ASSERT(f);
     qCInfo(lcFolderMan, ">========== Sync started for folder [%s] of account [%s] with remote [%s]",
-        qPrintable(_currentSyncFolder->shortGuiLocalPath()),
-        qPrintable(_currentSyncFolder->accountState()->account()->displayName()),
-        qPrintable(_currentSyncFolder->remoteUrl().toString()));
+        qPrintable(f->shortGuiLocalPath()),
+        qPrintable(f->accountState()->account()->displayName()),
+        qPrintable(f->remoteUrl().toString()));
 }
 
 /*
@@ -856,13 +1039,16 @@ void FolderMan::slotFolderSyncStarted()
   */
 void FolderMan::slotFolderSyncFinished(const SyncResult &)
 {
+    Folder *f = qobject_cast<Folder *>(sender());
+    ASSERT(f);
     qCInfo(lcFolderMan, "<========== Sync finished for folder [%s] of account [%s] with remote [%s]",
-        qPrintable(_currentSyncFolder->shortGuiLocalPath()),
-        qPrintable(_currentSyncFolder->accountState()->account()->displayName()),
-        qPrintable(_currentSyncFolder->remoteUrl().toString()));
+        qPrintable(f->shortGuiLocalPath()),
+        qPrintable(f->accountState()->account()->displayName()),
+        qPrintable(f->remoteUrl().toString()));
 
-    _lastSyncFolder = _currentSyncFolder;
-    _currentSyncFolder = 0;
+    _lastSyncFolder = f;
+    _currentSyncFolders.removeAll(f);
+    updateSyncBudgets();
 
     startScheduledSyncSoon();
 }
@@ -980,10 +1166,10 @@ void FolderMan::removeFolder(Folder *f)
 
     qCInfo(lcFolderMan) << "Removing " << f->alias();
 
-    const bool currentlyRunning = (_currentSyncFolder == f);
+    const bool currentlyRunning = _currentSyncFolders.contains(f);
     if (currentlyRunning) {
         // abort the sync now
-        terminateSyncProcess();
+        terminateSyncProcess(f);
     }
 
     if (_scheduledFolders.removeAll(f) > 0) {
@@ -1385,9 +1571,14 @@ QQueue<Folder *> FolderMan::scheduleQueue() const
     return _scheduledFolders;
 }
 
-Folder *FolderMan::currentSyncFolder() const
+QList<Folder *> FolderMan::currentSyncFolders() const
+{
+    return _currentSyncFolders;
+}
+
+int FolderMan::maximumConcurrentSyncs() const
 {
-    return _currentSyncFolder;
+    return _maxConcurrentSyncs;
 }
 
 void FolderMan::restartApplication()
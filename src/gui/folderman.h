@@ -157,16 +157,24 @@ public:
     QQueue<Folder *> scheduleQueue() const;
 
     /**
-     * Access to the currently syncing folder.
+     * Access to the currently syncing folders.
      */
-    Folder *currentSyncFolder() const;
+    QList<Folder *> currentSyncFolders() const;
+
+    /**
+     * How many folders may sync at the same time.
+     *
+     * Every folder has its own journal and sync engine, the limit protects the
+     * shared resources: discovery threads and the connections of the accounts.
+     */
+    int maximumConcurrentSyncs() const;
 
     /** Removes all folders */
     int unloadAndDeleteAllFolders();
 
     /**
      * If enabled is set to false, no new folders will start to sync.
-     * The current one will finish.
+     * The current ones will finish.
      */
     void setSyncEnabled(bool);
 
@@ -183,11 +191,11 @@ public:
     void setDirtyNetworkLimits();
 
     /**
-     * Terminates the current folder sync.
+     * Terminates the sync of @a folder, or all current syncs if it is null.
      *
      * It does not switch the folder to paused state.
      */
-    void terminateSyncProcess();
+    void terminateSyncProcess(Folder *folder = 0);
 
 signals:
     /**
@@ -237,8 +245,9 @@ private slots:
     void slotFolderSyncStarted();
     void slotFolderSyncFinished(const SyncResult &);
 
-    void slotRunOneEtagJob();
+    void slotRunEtagJobs();
     void slotEtagJobDestroyed(QObject *);
+    void slotBatchEtagsRetreived(const QStringList &aliases, const QHash<QString, QString> &etags);
 
     // slot to take the next folder from queue and start syncing.
     void slotStartScheduledFolderSync();
@@ -281,6 +290,27 @@ private:
     /** Will start a sync after a bit of delay. */
     void startScheduledSyncSoon();
 
+    /**
+     * Removes the folder that should sync next from the schedule queue.
+     *
+     * A folder explicitly requested by the user comes first. Otherwise folders of
+     * accounts with fewer running syncs are preferred, so one account can't starve
+     * the others, then folders with local changes, then the queue order.
+     * Returns null if no scheduled folder can start now.
+     */
+    Folder *takeNextScheduledFolder();
+
+    /**
+     * Splits the network jobs and discovery threads of all folders evenly
+     * across the running ones.
+     */
+    void updateSyncBudgets();
+
+    // queries the etags of sibling folders of one account with a single BatchEtagJob,
+    // returns the folders that still need their own RequestEtagJob
+    QList<Folder *> startBatchEtagJobs(const QList<Folder *> &folders);
+    int runningEtagJobCount(const Account *account) const;
+
     // finds all folder configuration files
     // and create the folders
     QString getBackupName(QString fullPathName) const;
@@ -296,14 +326,24 @@ private:
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
-    Folder *_currentSyncFolder;
+    QList<Folder *> _currentSyncFolders;
     QPointer<Folder> _lastSyncFolder;
+    /// Folder put in front of the queue by scheduleFolderNext()
+    QPointer<Folder> _nextSyncFolder;
     bool _syncEnabled;
+    int _maxConcurrentSyncs;
+    /// Budgets shared by all running folders, see updateSyncBudgets()
+    int _maxNetworkJobs;
+    int _maxDiscoveryThreads;
 
     /// Starts regular etag query jobs
     QTimer _etagPollTimer;
-    /// The currently running etag query
-    QPointer<RequestEtagJob> _currentEtagJob;
+    /// The running etag queries, at most maxEtagJobsPerAccount per account
+    QList<QPointer<AbstractNetworkJob>> _runningEtagJobs;
+    /// Batched etag queries waiting for a free slot of their account
+    QList<QPointer<BatchEtagJob>> _queuedBatchEtagJobs;
+    /// Aliases of the folders whose etag is queried by a running BatchEtagJob
+    QSet<QString> _batchedEtagFolders;
 
     /// Watches files that couldn't be synced due to locks
     QScopedPointer<LockWatcher> _lockWatcher;
@@ -1091,8 +1091,9 @@ void FolderStatusModel::slotFolderSyncStateChange(Folder *f)
     } else if (state == SyncResult::NotYetStarted) {
         FolderMan *folderMan = FolderMan::instance();
         int pos = folderMan->scheduleQueue().indexOf(f);
-        if (folderMan->currentSyncFolder()
-            && folderMan->currentSyncFolder() != f) {
+        const auto running = folderMan->currentSyncFolders();
+        if (running.size() >= folderMan->maximumConcurrentSyncs()
+            && !running.contains(f)) {
             pos += 1;
         }
         QString message;
@@ -32,15 +32,12 @@
 #include "folderwatcher_linux.h"
 #endif
 
-#include "folder.h"
-
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcFolderWatcher, "nextcloud.gui.folderwatcher", QtInfoMsg)
 
-FolderWatcher::FolderWatcher(Folder *folder)
-    : QObject(folder)
-    , _folder(folder)
+FolderWatcher::FolderWatcher(QObject *parent)
+    : QObject(parent)
 {
 }
 
@@ -58,15 +55,10 @@ bool FolderWatcher::pathIsIgnored(const QString &path)
 {
     if (path.isEmpty())
         return true;
-    if (!_folder)
-        return false;
-
-#ifndef OWNCLOUD_TEST
-    if (_folder->isFileExcludedAbsolute(path)) {
+    if (_isExcluded && _isExcluded(path)) {
         qCDebug(lcFolderWatcher) << "* Ignoring file" << path;
         return true;
     }
-#endif
     return false;
 }
 
@@ -27,6 +27,8 @@
 #include <QScopedPointer>
 #include <QSet>
 
+#include <functional>
+
 class QTimer;
 
 namespace OCC {
@@ -34,7 +36,6 @@ namespace OCC {
 Q_DECLARE_LOGGING_CATEGORY(lcFolderWatcher)
 
 class FolderWatcherPrivate;
-class Folder;
 
 /**
  * @brief Monitors a directory recursively for changes
@@ -56,7 +57,7 @@ class FolderWatcher : public QObject
     Q_OBJECT
 public:
     // Construct, connect signals, call init()
-    explicit FolderWatcher(Folder *folder = 0L);
+    explicit FolderWatcher(QObject *parent = 0L);
     virtual ~FolderWatcher();
 
     /**
@@ -72,6 +73,12 @@ public:
     void addPath(const QString &);
     void removePath(const QString &);
 
+    /**
+     * Sets the check for paths that are excluded from syncing, changes
+     * to them are not reported.
+     */
+    void setExcludeCheck(const std::function<bool(const QString &)> &isExcluded) { _isExcluded = isExcluded; }
+
     /* Check if the path is ignored. */
     bool pathIsIgnored(const QString &path);
 
@@ -117,7 +124,7 @@ private:
     QScopedPointer<FolderWatcherPrivate> _d;
     QTime _timer;
     QSet<QString> _lastPaths;
-    Folder *_folder;
+    std::function<bool(const QString &)> _isExcluded;
     bool _isReliable = true;
 
     friend class FolderWatcherPrivate;
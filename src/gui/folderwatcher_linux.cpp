@@ -16,10 +16,11 @@
 
 #include <sys/inotify.h>
 
-#include "folder.h"
 #include "folderwatcher_linux.h"
 
 #include <cerrno>
+#include <cstring>
+#include <unistd.h>
 #include <QStringList>
 #include <QObject>
 #include <QVarLengthArray>
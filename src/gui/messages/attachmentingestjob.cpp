@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) by Michael Albert <michael.albert@awesome-technologies.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "attachmentingestjob.h"
+#include "common/filesystembase.h"
+
+#include <cstdio>
+#include <functional>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMultiHash>
+#include <qtconcurrentrun.h>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#elif defined(Q_OS_UNIX) && !defined(Q_OS_LINUX)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcAttachmentIngest, "nextcloud.gui.messages.ingest", QtInfoMsg)
+
+namespace {
+    const qint64 COPY_CHUNK_SIZE = 8 * 1024 * 1024;
+
+    using ProgressFunction = std::function<void(qint64)>;
+
+#ifdef Q_OS_LINUX
+    /**
+     * Lets the kernel copy the file, returns false if nothing could be copied
+     * this way and the caller should fall back to a plain copy.
+     */
+    bool kernelCopy(const QString &source, const QString &target, qint64 size, const ProgressFunction &onCopied)
+    {
+        const int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            return false;
+        const int out = ::open(QFile::encodeName(target).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0) {
+            ::close(in);
+            return false;
+        }
+
+        bool ok = false;
+#ifdef FICLONE
+        // a reflink shares the extents of the source, no data is copied at all
+        if (::ioctl(out, FICLONE, in) == 0) {
+            onCopied(size);
+            ok = true;
+        }
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        if (!ok) {
+            qint64 remaining = size;
+            while (remaining > 0) {
+                const ssize_t copied = ::copy_file_range(in, nullptr, out, nullptr, qMin(remaining, COPY_CHUNK_SIZE), 0);
+                if (copied <= 0)
+                    break;
+                remaining -= copied;
+                onCopied(copied);
+            }
+            ok = remaining == 0;
+        }
+#endif
+        ::close(in);
+        if (::close(out) != 0)
+            ok = false;
+        return ok;
+    }
+#endif
+
+    bool plainCopy(const QString &source, const QString &target, const ProgressFunction &onCopied)
+    {
+        QFile in(source);
+        QFile out(target);
+        if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        QByteArray buffer(qMin(COPY_CHUNK_SIZE, in.size() + 1), Qt::Uninitialized);
+        qint64 read;
+        while ((read = in.read(buffer.data(), buffer.size())) > 0) {
+            if (out.write(buffer.constData(), read) != read)
+                return false;
+            onCopied(read);
+        }
+        return read == 0;
+    }
+
+    /**
+     * creates @p path as an empty file unless it exists, in one step: two jobs
+     * writing into the same folder never get the same name. @p existed tells
+     * whether a failure was because of an existing file.
+     */
+    bool createNew(const QString &path, bool *existed)
+    {
+        *existed = false;
+#ifdef Q_OS_WIN
+        const HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(path).utf16()),
+            GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            *existed = GetLastError() == ERROR_FILE_EXISTS;
+            return false;
+        }
+        CloseHandle(handle);
+        return true;
+#else
+        const int fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            *existed = errno == EEXIST;
+            return false;
+        }
+        ::close(fd);
+        return true;
+#endif
+    }
+
+    /** renames @p source to @p target, which may exist */
+    bool renameReplace(const QString &source, const QString &target)
+    {
+#ifdef Q_OS_WIN
+        QString error;
+        return FileSystem::uncheckedRenameReplace(source, target, &error);
+#else
+        // FileSystem::uncheckedRenameReplace() removes the target first, which
+        // would give the reserved name to another job for a moment
+        return ::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#endif
+    }
+
+    /**
+     * makes @p target a second name of @p existing without copying any data,
+     * returns false if the filesystem does not support hard links
+     */
+    bool hardLink(const QString &existing, const QString &target)
+    {
+        // the link can't replace the reserved name, it is renamed over it
+        const QString tmpTarget = target + ".part";
+#ifdef Q_OS_WIN
+        bool ok = CreateHardLinkW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(tmpTarget).utf16()),
+            reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(existing).utf16()), nullptr);
+#else
+        bool ok = ::link(QFile::encodeName(existing).constData(), QFile::encodeName(tmpTarget).constData()) == 0;
+#endif
+        if (ok && !renameReplace(tmpTarget, target)) {
+            QFile::remove(tmpTarget);
+            ok = false;
+        }
+        return ok;
+    }
+
+    /** copies @p source to @p target through a temporary file, replacing @p target */
+    bool copyFile(const QString &source, const QString &target, qint64 size, const ProgressFunction &onCopied)
+    {
+        // *.part files are excluded from the sync, a half written asset never gets uploaded
+        const QString tmpTarget = target + ".part";
+        qint64 copied = 0;
+        const auto countCopied = [&](qint64 bytes) {
+            copied += bytes;
+            onCopied(bytes);
+        };
+
+        bool ok = false;
+#ifdef Q_OS_LINUX
+        ok = kernelCopy(source, tmpTarget, size, countCopied);
+#else
+        Q_UNUSED(size);
+#endif
+        if (!ok) {
+            // undo partial progress of a failed fast path
+            onCopied(-copied);
+            copied = 0;
+            ok = plainCopy(source, tmpTarget, countCopied);
+        }
+        if (!ok || !renameReplace(tmpTarget, target)) {
+            QFile::remove(tmpTarget);
+            onCopied(-copied);
+            return false;
+        }
+        return true;
+    }
+}
+
+AttachmentIngestJob::AttachmentIngestJob(const MessageObject &message, const QString &assetsPath, bool move, QObject *parent)
+    : QObject(parent)
+    , _message(message)
+    , _assetsPath(assetsPath)
+    , _move(move)
+{
+    connect(&_watcher, &QFutureWatcherBase::finished, this, &AttachmentIngestJob::finished);
+}
+
+AttachmentIngestJob::~AttachmentIngestJob()
+{
+    // the worker reports progress through this object
+    _watcher.waitForFinished();
+}
+
+void AttachmentIngestJob::start()
+{
+    qCInfo(lcAttachmentIngest) << "Ingest attachments of" << _message.messageId << "into" << _assetsPath;
+    _watcher.setFuture(QtConcurrent::run(&AttachmentIngestJob::ingestNow, _message, _assetsPath, _move, this));
+}
+
+AttachmentIngestJob::Result AttachmentIngestJob::ingestNow(MessageObject message, const QString &assetsPath, bool move, AttachmentIngestJob *job)
+{
+    Result result;
+    const QDir assetsDir(assetsPath);
+
+    qint64 total = 0;
+    for (const auto *list : { &message.newImagesList, &message.newDocumentsList }) {
+        for (const MessageObject::AttachmentDetails &attachment : *list) {
+            if (!attachment.path.isEmpty())
+                total += QFileInfo(attachment.path).size();
+        }
+    }
+    qint64 done = 0;
+    const ProgressFunction onCopied = [&](qint64 bytes) {
+        done += bytes;
+        if (job)
+            emit job->progress(done, total);
+    };
+
+    // Files can only have the same content if they have the same size, the
+    // checksums are computed lazily for these candidates only.
+    QMultiHash<qint64, QString> assetsBySize;
+    for (const QFileInfo &info : assetsDir.entryInfoList(QDir::Files)) {
+        if (info.suffix() != QLatin1String("part"))
+            assetsBySize.insert(info.size(), info.fileName());
+    }
+    QHash<QString, QByteArray> checksums;
+    const auto checksum = [&](const QString &filePath) {
+        auto it = checksums.find(filePath);
+        if (it == checksums.end())
+            it = checksums.insert(filePath, FileSystem::calcSha1(filePath));
+        return it.value();
+    };
+
+    const auto ingest = [&](MessageObject::AttachmentDetails &attachment) {
+        const QString source = attachment.path;
+        const qint64 size = QFileInfo(source).size();
+
+        // assure filename is unique, other jobs may write into the same folder
+        bool existed = false;
+        while (!createNew(assetsDir.filePath(attachment.name), &existed)) {
+            if (!existed)
+                return false;
+            attachment.name = QUuid::createUuid().toString() + attachment.name;
+        }
+        const QString target = assetsDir.filePath(attachment.name);
+        attachment.path = target;
+
+        // Every message owns its asset file, deleting a message or moving a draft
+        // removes it. Identical content is shared through a hard link instead.
+        const QList<QString> candidates = assetsBySize.values(size);
+        if (!candidates.isEmpty()) {
+            const QByteArray sourceChecksum = checksum(source);
+            for (const QString &candidate : candidates) {
+                if (!sourceChecksum.isEmpty() && checksum(assetsDir.filePath(candidate)) == sourceChecksum
+                    && hardLink(assetsDir.filePath(candidate), target)) {
+                    qCInfo(lcAttachmentIngest) << "Attachment" << source << "shares the content of" << candidate;
+                    if (move)
+                        QFile::remove(source);
+                    onCopied(size);
+                    return true;
+                }
+            }
+        }
+
+        if (move && renameReplace(source, target)) {
+            onCopied(size);
+        } else if (!copyFile(source, target, size, onCopied)) {
+            // give the reserved name back
+            QFile::remove(target);
+            return false;
+        } else if (move) {
+            QFile::remove(source);
+        }
+        assetsBySize.insert(size, attachment.name);
+        return true;
+    };
+
+    for (auto lists : { qMakePair(&message.newImagesList, &message.imagesList),
+             qMakePair(&message.newDocumentsList, &message.documentsList) }) {
+        for (MessageObject::AttachmentDetails &attachment : *lists.first) {
+            if (!attachment.path.isEmpty() && !ingest(attachment)) {
+                result.errorString = move ? QObject::tr("Error on moving assets!") : QObject::tr("Error on copying assets!");
+                return result;
+            }
+            lists.second->append(attachment);
+        }
+        lists.first->clear();
+    }
+
+    result.message = message;
+    return result;
+}
+
+} // end namespace OCC
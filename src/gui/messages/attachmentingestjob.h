@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) by Michael Albert <michael.albert@awesome-technologies.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef ATTACHMENTINGESTJOB_H
+#define ATTACHMENTINGESTJOB_H
+
+#include <QFutureWatcher>
+#include <QObject>
+
+#include "messageobject.h"
+
+namespace OCC {
+
+/**
+ * @brief The AttachmentIngestJob class copies or moves the new attachments of a message into its assets folder
+ *
+ * The files are processed in a worker thread. Files are copied with a reflink or
+ * copy_file_range() where the filesystem supports it. A file whose content already
+ * exists in the assets folder is not copied again, it gets a hard link to the existing
+ * asset. Every message still has files of its own that can be deleted independently.
+ * Every file is written under a temporary name and renamed once complete.
+ *
+ * @ingroup gui
+ */
+class AttachmentIngestJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result
+    {
+        MessageObject message;
+        QString errorString;
+    };
+
+    /**
+     * @p assetsPath is the existing target folder, with @p move the attachments
+     * are renamed instead of copied (used for the assets of drafts)
+     */
+    AttachmentIngestJob(const MessageObject &message, const QString &assetsPath, bool move, QObject *parent = 0);
+    ~AttachmentIngestJob() override;
+
+    void start();
+
+    /** path of a draft the message replaces, removed once the message is written */
+    void setDraftPath(const QString &path) { _draftPath = path; }
+    QString draftPath() const { return _draftPath; }
+
+    /** valid after finished() was emitted, the new attachments are moved to the attachment lists */
+    MessageObject message() const { return _watcher.result().message; }
+    QString errorString() const { return _watcher.result().errorString; }
+
+    /** processes the attachments synchronously, @p job may be null */
+    static Result ingestNow(MessageObject message, const QString &assetsPath, bool move, AttachmentIngestJob *job);
+
+signals:
+    void progress(qint64 done, qint64 total);
+    void finished();
+
+private:
+    MessageObject _message;
+    QString _assetsPath;
+    QString _draftPath;
+    bool _move;
+
+    QFutureWatcher<Result> _watcher;
+};
+
+} // end namespace
+
+#endif // ATTACHMENTINGESTJOB_H
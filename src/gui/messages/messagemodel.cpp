@@ -13,12 +13,14 @@
  */
 
 #include "messagemodel.h"
+#include "attachmentingestjob.h"
+#include "common/asserts.h"
 
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
 #include <QJsonDocument>
-#include <QMessageBox>
+#include <QSaveFile>
 
 namespace OCC {
 
@@ -133,7 +135,7 @@ QVariant MessageModel::data(const QModelIndex &index, int role) const
 
     // data for detailView (html)
     case DetailRole:
-        return QVariant(_messageItem.details());
+        return QVariant(_messageItem.details(_vitalSigns.trendSummaryHtml(_messageItem.patientKey())));
 
     // current status of message
     case StatusRole:
@@ -195,35 +197,24 @@ bool MessageModel::setData(const QModelIndex &index, const QVariant &value, int
         return false;
     }
 
-    if (writeMessage(_messageItem)) {
-        if (index.isValid()) {
-            _messageList.replace(index.row(), _messageItem);
-            emit dataChanged(index, index);
-        } else {
-            emit layoutAboutToBeChanged();
-            _messageList.insert(0, _messageItem);
-            emit layoutChanged();
-        }
-        return true;
-    }
-
-    return false;
+    return writeMessage(_messageItem);
 }
 
 bool MessageModel::writeMessage(MessageObject &msg)
 {
     QString dirPath;
+    QString draftPath;
     bool isDraft = (msg.status == MessageObject::DraftStatus);
     bool wasDraft = false;
     // create new uuid if none is set
     if (msg.messageId.isNull()) {
         msg.messageId = QUuid::createUuid();
     } else {
-        // if the message was a draft, delete it
+        // if the message was a draft, it gets deleted once the message is written
         if (!isDraft) {
             QString filePath = _rootPath + "/drafts/messages/" + msg.messageId.toString() + ".json";
             if (QFileInfo::exists(filePath) && QFileInfo(filePath).isFile()) {
-                QFile::remove(filePath);
+                draftPath = filePath;
                 wasDraft = true;
             }
         }
@@ -242,10 +233,7 @@ bool MessageModel::writeMessage(MessageObject &msg)
         QDir dir(dirPath + "/messages/");
         if (!dir.exists(dirPath + "/messages/")) {
             if (!dir.mkpath(dirPath + "/messages/")) {
-                // display error
-                QMessageBox msgBox;
-                msgBox.setText(QObject::tr("Error on creating folder for messages!"));
-                msgBox.exec();
+                emit messageWriteFailed(QObject::tr("Error on creating folder for messages!"));
                 return false;
             }
         }
@@ -256,106 +244,78 @@ bool MessageModel::writeMessage(MessageObject &msg)
         dirPath = _rootPath + QString("/" + _userFolder);
     }
 
-    // process attachment list
-    if (!msg.newImagesList.isEmpty() || !msg.newDocumentsList.isEmpty()) {
-        // create assets directory if it doesn't exist
-        QDir dir(dirPath + "/assets/");
-        if (!dir.exists(dirPath + "/assets/")) {
-            if (!dir.mkpath(dirPath + "/assets/")) {
-                // display error
-                QMessageBox msgBox;
-                msgBox.setText(QObject::tr("Error on creating folder for assets!"));
-                msgBox.exec();
-                return false;
-            }
-        }
+    if (msg.newImagesList.isEmpty() && msg.newDocumentsList.isEmpty()) {
+        return commitMessage(msg, draftPath);
+    }
 
-        // process images list
-        for (MessageObject::AttachmentDetails &image : msg.newImagesList) {
-            // get full file path
-            if (!image.path.isEmpty()) {
-                QString fullFilePath = image.path;
-
-                if (wasDraft) { // move assets belonging to draft to new assets folder
-                    // assure filename is unique
-                    while (QFileInfo::exists(dirPath + "/assets/" + image.name)) {
-                        image.name = QUuid::createUuid().toString() + image.name;
-                    }
-                    if (!QFile::rename(fullFilePath, dirPath + "/assets/" + image.name)) {
-                        // display error
-                        QMessageBox msgBox;
-                        msgBox.setText(QObject::tr("Error on moving assets!"));
-                        msgBox.exec();
-                        return false;
-                    }
-                } else { // copy file to assets folder
-                    // assure filename is unique
-                    while (QFileInfo::exists(dirPath + "/assets/" + image.name)) {
-                        image.name = QUuid::createUuid().toString() + image.name;
-                    }
-                    if (!QFile::copy(fullFilePath, dirPath + "/assets/" + image.name)) {
-                        // display error
-                        QMessageBox msgBox;
-                        msgBox.setText(QObject::tr("Error on copying assets!"));
-                        msgBox.exec();
-                        return false;
-                    }
-                }
-            }
-            msg.imagesList.append(image);
-        }
-        msg.newImagesList.clear();
-
-        // process documents list
-        for (MessageObject::AttachmentDetails &document : msg.newDocumentsList) {
-            // get full file path
-            if (!document.path.isEmpty()) {
-                QString fullFilePath = document.path;
-
-                if (wasDraft) { // move assets belonging to draft to new assets folder
-                    // assure filename is unique
-                    while (QFileInfo::exists(dirPath + "/assets/" + document.name)) {
-                        document.name = QUuid::createUuid().toString() + document.name;
-                    }
-                    if (!QFile::rename(fullFilePath, dirPath + "/assets/" + document.name)) {
-                        // display error
-                        QMessageBox msgBox;
-                        msgBox.setText(QObject::tr("Error on moving assets!"));
-                        msgBox.exec();
-                        return false;
-                    }
-                } else { // copy file to assets folder
-                    // assure filename is unique
-                    while (QFileInfo::exists(dirPath + "/assets/" + document.name)) {
-                        document.name = QUuid::createUuid().toString() + document.name;
-                    }
-                    if (!QFile::copy(fullFilePath, dirPath + "/assets/" + document.name)) {
-                        // display error
-                        QMessageBox msgBox;
-                        msgBox.setText(QObject::tr("Error on copying assets!"));
-                        msgBox.exec();
-                        return false;
-                    }
-                }
-            }
-            msg.documentsList.append(document);
+    // create assets directory if it doesn't exist
+    QDir dir(dirPath + "/assets/");
+    if (!dir.exists(dirPath + "/assets/")) {
+        if (!dir.mkpath(dirPath + "/assets/")) {
+            emit messageWriteFailed(QObject::tr("Error on creating folder for assets!"));
+            return false;
         }
-        msg.newDocumentsList.clear();
     }
 
+    // copy the attachments in the background, the message is written once they are complete
+    // assets belonging to a draft are moved to the new assets folder
+    auto job = new AttachmentIngestJob(msg, dirPath + "/assets", wasDraft, this);
+    job->setDraftPath(draftPath);
+    connect(job, &AttachmentIngestJob::progress, this, &MessageModel::attachmentProgress);
+    connect(job, &AttachmentIngestJob::finished, this, &MessageModel::slotAttachmentsIngested);
+    job->start();
+    return true;
+}
+
+void MessageModel::slotAttachmentsIngested()
+{
+    auto job = qobject_cast<AttachmentIngestJob *>(sender());
+    ASSERT(job);
+    job->deleteLater();
+
+    if (!job->errorString().isEmpty()) {
+        emit messageWriteFailed(job->errorString());
+        return;
+    }
+    MessageObject msg = job->message();
+    commitMessage(msg, job->draftPath());
+}
 
+bool MessageModel::commitMessage(const MessageObject &msg, const QString &draftPath)
+{
     // write contents to file
     QJsonObject content;
-    msg.buildJson(content, isDraft);
+    msg.buildJson(content, msg.status == MessageObject::DraftStatus);
 
     qInfo() << "Write JSON to" << msg.path;
-    QFile file(msg.path);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QJsonDocument saveDoc(content);
-        file.write(saveDoc.toJson());
-        return true;
+    // the message file is replaced atomically, a half written message is never synced
+    QSaveFile file(msg.path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        emit messageWriteFailed(QObject::tr("Error on writing message!"));
+        return false;
+    }
+    file.write(QJsonDocument(content).toJson());
+    if (!file.commit()) {
+        emit messageWriteFailed(QObject::tr("Error on writing message!"));
+        return false;
+    }
+
+    if (!draftPath.isEmpty())
+        QFile::remove(draftPath);
+
+    _vitalSigns.addMessage(msg);
+
+    for (int row = 0; row < _messageList.size(); ++row) {
+        if (_messageList.at(row).messageId == msg.messageId) {
+            _messageList.replace(row, msg);
+            emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+            return true;
+        }
     }
-    return false;
+    emit layoutAboutToBeChanged();
+    _messageList.insert(0, msg);
+    emit layoutChanged();
+    return true;
 }
 
 void MessageModel::addEntities()
@@ -380,6 +340,7 @@ void MessageModel::addMessages(const QString &path)
         file.open(QIODevice::ReadOnly);
         messageObject.path = info.absoluteFilePath();
         messageObject.setJson(QJsonDocument::fromJson(file.readAll()).object());
+        _vitalSigns.addMessage(messageObject);
         _messageList << messageObject;
     }
 }
@@ -408,6 +369,7 @@ void MessageModel::onDirectoryChanged(const QString &path)
 
     _watcher.removePaths(_watcher.directories());
     _messageList.clear();
+    _vitalSigns.clear();
     addEntities();
     emit layoutChanged();
 }
@@ -20,6 +20,7 @@
 #include <sharee.h>
 
 #include "messageobject.h"
+#include "vitalsignsindex.h"
 
 namespace OCC {
 class Sharee;
@@ -60,6 +61,9 @@ public:
     QString rootPath() const { return _rootPath; }
     const Sharee &currentUser() const { return _currentUser; }
 
+    /** time series of the vital data of all loaded messages */
+    const VitalSignsIndex &vitalSigns() const { return _vitalSigns; }
+
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
 
@@ -75,8 +79,15 @@ public:
 signals:
     void newMessageReceived(QString messagePath);
 
+    /** attachments of a message are being copied, @p done of @p total bytes are processed */
+    void attachmentProgress(qint64 done, qint64 total);
+
+    /** writing a message failed with the translated @p error */
+    void messageWriteFailed(const QString &error);
+
 private slots:
     void onDirectoryChanged(const QString &path);
+    void slotAttachmentsIngested();
 
 private:
     QString _rootPath;
@@ -84,10 +95,19 @@ private:
     QFileSystemWatcher _watcher;
     QStringList _filters;
     QList<MessageObject> _messageList;
-
-    /** writes message to file */
+    VitalSignsIndex _vitalSigns;
+
+    /**
+     * writes message to file
+     *
+     * If the message has new attachments they are copied in the background and
+     * the message file is written once they are complete.
+     */
     bool writeMessage(MessageObject &msg);
 
+    /** writes the message file and updates the model */
+    bool commitMessage(const MessageObject &msg, const QString &draftPath);
+
     void addEntities();
     void addMessages(const QString &path);
 };
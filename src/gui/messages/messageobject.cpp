@@ -140,7 +140,12 @@ QString MessageObject::getRecipient() const
     return recipientName;
 }
 
-QString MessageObject::details() const
+QString MessageObject::patientKey() const
+{
+    return patientName + QLatin1Char('|') + birthday.toString(Qt::ISODate);
+}
+
+QString MessageObject::details(const QString &trendsHtml) const
 {
     static const char *GREEN = "#27AE60";
     static const char *RED = "#E74C3C";
@@ -296,6 +301,7 @@ QString MessageObject::details() const
     if ((bpSys && bpDia) || pulse || !std::isnan(temp) || !std::isnan(sugar) || !std::isnan(weight) || !std::isnan(oxygen) || response != "" || pain != "" || !dtDefac.isNull() || misc != "") {
         html += vitalDataHtml;
     }
+    html += trendsHtml;
 
     // add medications
     if (medicationList.size() > 0) {
@@ -332,174 +338,248 @@ QString MessageObject::details() const
     return html;
 }
 
+namespace {
+    const char DATETIMEFORMAT[] = "yyyy-MM-ddThh:mm:ss"; //example: 2018-04-03T15:30:10+01:00
+
+    /** reads @p count decimal digits, returns -1 if any of them is not a digit */
+    int parseDigits(const QChar *c, int count)
+    {
+        int result = 0;
+        for (int i = 0; i < count; ++i) {
+            const int digit = c[i].unicode() - '0';
+            if (digit < 0 || digit > 9)
+                return -1;
+            result = result * 10 + digit;
+        }
+        return result;
+    }
+
+    /** parses DATETIMEFORMAT without going through the generic QDateTime format parser */
+    QDateTime parseDateTime(const QJsonValue &value)
+    {
+        const QString str = value.toString();
+        if (str.size() == 19 && str.at(4) == '-' && str.at(7) == '-' && str.at(10) == 'T'
+            && str.at(13) == ':' && str.at(16) == ':') {
+            const QChar *c = str.constData();
+            const int year = parseDigits(c, 4);
+            const int month = parseDigits(c + 5, 2);
+            const int day = parseDigits(c + 8, 2);
+            const int hour = parseDigits(c + 11, 2);
+            const int minute = parseDigits(c + 14, 2);
+            const int second = parseDigits(c + 17, 2);
+            if (year >= 0 && month >= 0 && day >= 0 && hour >= 0 && minute >= 0 && second >= 0) {
+                const QDate date(year, month, day);
+                const QTime time(hour, minute, second);
+                return date.isValid() && time.isValid() ? QDateTime(date, time) : QDateTime();
+            }
+        }
+        // anything else gets the exact semantics of the generic parser
+        return QDateTime::fromString(str, DATETIMEFORMAT);
+    }
+
+    QJsonValue quantityValue(const QJsonObject &observation)
+    {
+        return observation.value(QLatin1String("valueQuantity")).toObject().value(QLatin1String("value"));
+    }
+}
+
 void MessageObject::setJson(const QJsonObject &json)
 {
     // TODO sanitize inputs
-    static const char *DATETIMEFORMAT = "yyyy-MM-ddThh:mm:ss"; //example: 2018-04-03T15:30:10+01:00
-
-    // message meta data
-    if (json.contains("id") && json["id"].isString())
-        messageId = QUuid(json["id"].toString());
-
-    if (json.contains("title") && json["title"].isString())
-        title = json["title"].toString();
 
-    if (json.contains("note") && json["note"].isString())
-        note = json["note"].toString();
+    // Every nested object is converted exactly once and every key is looked up
+    // exactly once, bulk imports of messages are dominated by this function.
+    const auto end = json.constEnd();
 
-    if (json.contains("status") && json["status"].isString()) {
-        QString _status = json["status"].toString();
-        if (_status == "preparation") {
+    // message meta data
+    auto it = json.constFind(QLatin1String("id"));
+    if (it != end && it.value().isString())
+        messageId = QUuid(it.value().toString());
+
+    it = json.constFind(QLatin1String("title"));
+    if (it != end && it.value().isString())
+        title = it.value().toString();
+
+    it = json.constFind(QLatin1String("note"));
+    if (it != end && it.value().isString())
+        note = it.value().toString();
+
+    it = json.constFind(QLatin1String("status"));
+    if (it != end && it.value().isString()) {
+        const QString _status = it.value().toString();
+        if (_status == QLatin1String("preparation")) {
             status = DraftStatus;
             statusText = QObject::tr("Preparation");
-        } else if (_status == "sent") {
+        } else if (_status == QLatin1String("sent")) {
             status = SentStatus;
             statusText = QObject::tr("Sent");
-        } else if (_status == "read") {
+        } else if (_status == QLatin1String("read")) {
             status = ReadStatus;
             statusText = QObject::tr("Read");
-        } else if (_status == "resent") {
+        } else if (_status == QLatin1String("resent")) {
             status = ResentStatus;
             statusText = QObject::tr("Resent");
-        } else if (_status == "reread") {
+        } else if (_status == QLatin1String("reread")) {
             status = RereadStatus;
             statusText = QObject::tr("Reread");
-        } else if (_status == "resolved") {
+        } else if (_status == QLatin1String("resolved")) {
             status = ResolvedStatus;
             statusText = QObject::tr("Resolved");
         }
     }
 
-    if (json.contains("archivedFor") && json["archivedFor"].isArray()) {
-        foreach (const QJsonValue &v, json["archivedFor"].toArray()) {
-            archivedFor.append({ v.toObject().value("user").toString(), v.toObject().value("date").toString() });
+    it = json.constFind(QLatin1String("archivedFor"));
+    if (it != end && it.value().isArray()) {
+        const QJsonArray _archivedFor = it.value().toArray();
+        for (const QJsonValue &v : _archivedFor) {
+            const QJsonObject archived = v.toObject();
+            archivedFor.append({ archived.value(QLatin1String("user")).toString(), archived.value(QLatin1String("date")).toString() });
         }
     }
 
-    if (json.contains("authoredOn") && json["authoredOn"].isString())
-        authoredOn = QDateTime::fromString(json["authoredOn"].toString(), DATETIMEFORMAT);
+    it = json.constFind(QLatin1String("authoredOn"));
+    if (it != end && it.value().isString())
+        authoredOn = parseDateTime(it.value());
 
     // TODO check range
-    if (json.contains("priority") && json["priority"].isDouble())
-        priority = Priority(json["priority"].toInt());
-
-    if (json.contains("requester")) {
-        sender = json["requester"].toObject().value("agent").toObject().value("reference").toString();
-        QStringList requester = json["requester"].toObject().value("agent").toObject().value("display").toString().split("/");
-        initials = requester.value(1);
-        senderName = requester.value(0);
-        recipient = json["requester"].toObject().value("onBehalfOf").toObject().value("reference").toString();
-        recipientName = json["requester"].toObject().value("onBehalfOf").toObject().value("display").toString();
+    it = json.constFind(QLatin1String("priority"));
+    if (it != end && it.value().isDouble())
+        priority = Priority(it.value().toInt());
+
+    it = json.constFind(QLatin1String("requester"));
+    if (it != end) {
+        const QJsonObject requester = it.value().toObject();
+        const QJsonObject agent = requester.value(QLatin1String("agent")).toObject();
+        const QJsonObject onBehalfOf = requester.value(QLatin1String("onBehalfOf")).toObject();
+        sender = agent.value(QLatin1String("reference")).toString();
+        const QString display = agent.value(QLatin1String("display")).toString();
+        const int separator = display.indexOf(QLatin1Char('/'));
+        senderName = display.left(separator);
+        initials = separator < 0 ? QString() : display.section(QLatin1Char('/'), 1, 1);
+        recipient = onBehalfOf.value(QLatin1String("reference")).toString();
+        recipientName = onBehalfOf.value(QLatin1String("display")).toString();
     }
 
     // message payload
-    if (json.contains("payload")) {
-        QJsonObject payload = json["payload"].toObject();
-
-        // patient data
-        if (payload.contains("patient")) {
-            patientName = payload.value("patient").toObject().value("name").toObject().value("text").toString();
-            gender = payload.value("patient").toObject().value("gender").toString() == "male" ? MALE : FEMALE;
-            birthday = QDate::fromString(payload.value("patient").toObject().value("birthDate").toString(), "yyyy-MM-dd");
-        }
+    it = json.constFind(QLatin1String("payload"));
+    if (it == end)
+        return;
+
+    const QJsonObject payload = it.value().toObject();
+    const auto payloadEnd = payload.constEnd();
+
+    // patient data
+    it = payload.constFind(QLatin1String("patient"));
+    if (it != payloadEnd) {
+        const QJsonObject patient = it.value().toObject();
+        patientName = patient.value(QLatin1String("name")).toObject().value(QLatin1String("text")).toString();
+        gender = patient.value(QLatin1String("gender")).toString() == QLatin1String("male") ? MALE : FEMALE;
+        birthday = QDate::fromString(patient.value(QLatin1String("birthDate")).toString(), "yyyy-MM-dd");
+    }
 
-        // patients vital data
-        if (payload.contains("observations")) {
-            for (const QJsonValue &v : payload.value("observations").toArray()) {
-                QString payloadId = v.toObject().value("id").toString();
-                if (payloadId == "heart-rate") {
-                    pulse = v.toObject().value("valueQuantity").toObject().value("value").toInt();
-                    dtPulse = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "glucose") {
-                    sugar = v.toObject().value("valueQuantity").toObject().value("value").toDouble();
-                    dtSugar = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "body-temperature") {
-                    temp = v.toObject().value("valueQuantity").toObject().value("value").toDouble();
-                    dtTemp = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "blood-pressure") {
-                    bpSys = v.toObject().value("component").toArray()[0].toObject().value("valueQuantity").toObject().value("value").toInt();
-                    bpDia = v.toObject().value("component").toArray()[1].toObject().value("valueQuantity").toObject().value("value").toInt();
-                    dtBp = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "body-weight") {
-                    weight = v.toObject().value("valueQuantity").toObject().value("value").toDouble();
-                    dtWeight = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "satO2") {
-                    oxygen = v.toObject().value("valueQuantity").toObject().value("value").toDouble();
-                    dtOxygen = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "last-defecation") {
-                    dtDefac = (QDateTime::fromString(v.toObject().value("effectiveDateTime").toString(), DATETIMEFORMAT));
-                } else if (payloadId == "pain") {
-                    pain = (v.toObject().value("valueQuantity").toObject().value("value").toString());
-                } else if (payloadId == "responsiveness") {
-                    response = (v.toObject().value("valueQuantity").toObject().value("value").toString());
-                } else if (payloadId == "misc") {
-                    misc = (v.toObject().value("valueQuantity").toObject().value("value").toString());
-                }
+    // patients vital data
+    it = payload.constFind(QLatin1String("observations"));
+    if (it != payloadEnd) {
+        const QJsonArray observations = it.value().toArray();
+        for (const QJsonValue &v : observations) {
+            const QJsonObject observation = v.toObject();
+            const QString payloadId = observation.value(QLatin1String("id")).toString();
+            const QJsonValue effective = observation.value(QLatin1String("effectiveDateTime"));
+            if (payloadId == QLatin1String("heart-rate")) {
+                pulse = quantityValue(observation).toInt();
+                dtPulse = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("glucose")) {
+                sugar = quantityValue(observation).toDouble();
+                dtSugar = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("body-temperature")) {
+                temp = quantityValue(observation).toDouble();
+                dtTemp = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("blood-pressure")) {
+                const QJsonArray component = observation.value(QLatin1String("component")).toArray();
+                bpSys = quantityValue(component.at(0).toObject()).toInt();
+                bpDia = quantityValue(component.at(1).toObject()).toInt();
+                dtBp = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("body-weight")) {
+                weight = quantityValue(observation).toDouble();
+                dtWeight = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("satO2")) {
+                oxygen = quantityValue(observation).toDouble();
+                dtOxygen = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("last-defecation")) {
+                dtDefac = parseDateTime(effective);
+            } else if (payloadId == QLatin1String("pain")) {
+                pain = quantityValue(observation).toString();
+            } else if (payloadId == QLatin1String("responsiveness")) {
+                response = quantityValue(observation).toString();
+            } else if (payloadId == QLatin1String("misc")) {
+                misc = quantityValue(observation).toString();
             }
         }
+    }
 
-        // medication
-        if (payload.contains("medicationRequests")) {
-            for (const QJsonValue &v : payload.value("medicationRequests").toArray()) {
-                QStringList medicationItem;
-                medicationItem << v.toObject().value("medication").toObject().value("ingredient").toObject().value("itemCodeableConcept").toString();
-                medicationItem << v.toObject().value("medication").toObject().value("manufacturer").toString();
-                medicationItem << v.toObject().value("medication").toObject().value("ingredient").toObject().value("amount").toString();
-                medicationItem << v.toObject().value("medication").toObject().value("form").toString();
-
-                int mo = 0;
-                int mi = 0;
-                int ab = 0;
-                int na = 0;
-                for (const QJsonValue &w : v.toObject().value("dosageInstruction").toArray()) {
-                    const int doseQuantity = w.toObject().value("doseQuantity").toInt();
-                    switch (w.toObject().value("sequence").toInt()) {
-                    case 1:
-                        mo = doseQuantity;
-                        break;
-                    case 2:
-                        mi = doseQuantity;
-                        break;
-                    case 3:
-                        ab = doseQuantity;
-                        break;
-                    case 4:
-                        na = doseQuantity;
-                        break;
-                    }
-                }
-
-                medicationItem << QString::number(mo);
-                medicationItem << QString::number(mi);
-                medicationItem << QString::number(ab);
-                medicationItem << QString::number(na);
-
-                medicationItem << v.toObject().value("unit").toString();
-                medicationItem << v.toObject().value("note").toString();
-                medicationItem << v.toObject().value("patientInstruction").toString();
-
-                medicationList << medicationItem;
+    // medication
+    it = payload.constFind(QLatin1String("medicationRequests"));
+    if (it != payloadEnd) {
+        const QJsonArray medicationRequests = it.value().toArray();
+        for (const QJsonValue &v : medicationRequests) {
+            const QJsonObject request = v.toObject();
+            const QJsonObject medication = request.value(QLatin1String("medication")).toObject();
+            const QJsonObject ingredient = medication.value(QLatin1String("ingredient")).toObject();
+
+            QStringList medicationItem;
+            medicationItem.reserve(11);
+            medicationItem << ingredient.value(QLatin1String("itemCodeableConcept")).toString();
+            medicationItem << medication.value(QLatin1String("manufacturer")).toString();
+            medicationItem << ingredient.value(QLatin1String("amount")).toString();
+            medicationItem << medication.value(QLatin1String("form")).toString();
+
+            int doses[4] = { 0, 0, 0, 0 }; // morning, noon, evening, night
+            const QJsonArray dosageInstruction = request.value(QLatin1String("dosageInstruction")).toArray();
+            for (const QJsonValue &w : dosageInstruction) {
+                const QJsonObject dosage = w.toObject();
+                const int sequence = dosage.value(QLatin1String("sequence")).toInt();
+                if (sequence >= 1 && sequence <= 4)
+                    doses[sequence - 1] = dosage.value(QLatin1String("doseQuantity")).toInt();
             }
+            for (int dose : doses)
+                medicationItem << QString::number(dose);
+
+            medicationItem << request.value(QLatin1String("unit")).toString();
+            medicationItem << request.value(QLatin1String("note")).toString();
+            medicationItem << request.value(QLatin1String("patientInstruction")).toString();
+
+            medicationList << medicationItem;
         }
+    }
 
-        // images
-        if (payload.contains("media")) {
-            QDir imgPath = QDir(path);
-            imgPath.cdUp();
-            imgPath.cdUp();
-            for (const QJsonValue &v : payload.value("media").toArray()) {
-                imagesList.append({ v.toObject().value("content").toString(), imgPath.absolutePath() + "/assets/" + v.toObject().value("content").toString(), v.toObject().value("operator").toString() });
-            }
+    const auto assetsPath = [this]() {
+        QDir dir = QDir(path);
+        dir.cdUp();
+        dir.cdUp();
+        return dir.absolutePath() + "/assets/";
+    };
+
+    // images
+    it = payload.constFind(QLatin1String("media"));
+    if (it != payloadEnd) {
+        const QString imgPath = assetsPath();
+        const QJsonArray media = it.value().toArray();
+        for (const QJsonValue &v : media) {
+            const QJsonObject image = v.toObject();
+            const QString content = image.value(QLatin1String("content")).toString();
+            imagesList.append({ content, imgPath + content, image.value(QLatin1String("operator")).toString() });
         }
+    }
 
-        // documents
-        if (payload.contains("documentReference")) {
-            QDir documentPath = QDir(path);
-            documentPath.cdUp();
-            documentPath.cdUp();
-            for (const QJsonValue &v : payload.value("documentReference").toArray()) {
-                documentsList.append({ v.toObject().value("content").toObject().value("attachment").toString(), documentPath.absolutePath() + "/assets/" + v.toObject().value("content").toObject().value("attachment").toString(), v.toObject().value("author").toString() });
-            }
+    // documents
+    it = payload.constFind(QLatin1String("documentReference"));
+    if (it != payloadEnd) {
+        const QString documentPath = assetsPath();
+        const QJsonArray documentReference = it.value().toArray();
+        for (const QJsonValue &v : documentReference) {
+            const QJsonObject document = v.toObject();
+            const QString attachment = document.value(QLatin1String("content")).toObject().value(QLatin1String("attachment")).toString();
+            documentsList.append({ attachment, documentPath + attachment, document.value(QLatin1String("author")).toString() });
         }
     }
 }
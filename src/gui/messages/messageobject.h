@@ -134,8 +134,11 @@ public:
     /** returns HTML to display the recipient of the message */
     QString getRecipient() const;
 
-    /** returns HTML of content of the message */
-    QString details() const;
+    /** returns HTML of content of the message, @p trendsHtml is shown below the vital data */
+    QString details(const QString &trendsHtml = QString()) const;
+
+    /** returns a key identifying the patient across messages */
+    QString patientKey() const;
 
     /** parses json of the message file */
     void setJson(const QJsonObject &json);
@@ -73,6 +73,8 @@ MessagesWindow::MessagesWindow(const Sharee &_currentUser,
     connect(ui->detailView, SIGNAL(urlChanged(QUrl)), this, SLOT(slotUrlChanged(QUrl)));
 
     connect(messageModel, SIGNAL(newMessageReceived(QString)), this, SLOT(slotMessageReceived(QString)));
+    connect(messageModel, SIGNAL(attachmentProgress(qint64, qint64)), this, SLOT(slotAttachmentProgress(qint64, qint64)));
+    connect(messageModel, SIGNAL(messageWriteFailed(QString)), this, SLOT(slotMessageWriteFailed(QString)));
 
     // connect slot for showing details of message on click on the message item in the listView
     connect(ui->messageList->selectionModel(), SIGNAL(currentChanged(QModelIndex, QModelIndex)), this, SLOT(slotShowDetails(QModelIndex, QModelIndex)));
@@ -286,6 +288,21 @@ void MessagesWindow::slotUrlChanged(QUrl url)
     }
 }
 
+void MessagesWindow::slotAttachmentProgress(qint64 done, qint64 total)
+{
+    if (done >= total) {
+        ui->statusbar->clearMessage();
+        return;
+    }
+    ui->statusbar->showMessage(tr("Copying attachments: %1%").arg(total > 0 ? done * 100 / total : 0));
+}
+
+void MessagesWindow::slotMessageWriteFailed(const QString &error)
+{
+    ui->statusbar->clearMessage();
+    QMessageBox::warning(this, windowTitle(), error);
+}
+
 void MessagesWindow::slotMessageReceived(QString messagePath)
 {
     // notify about new message
@@ -73,6 +73,9 @@ private slots:
     void on_videocallButton_clicked();
 
     void slotMessageReceived(QString messagePath);
+    /** shows the progress of copying attachments in the status bar */
+    void slotAttachmentProgress(qint64 done, qint64 total);
+    void slotMessageWriteFailed(const QString &error);
     void slotUrlChanged(QUrl url);
 
 signals:
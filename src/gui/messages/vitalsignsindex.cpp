@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) by Michael Albert <michael.albert@awesome-technologies.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "vitalsignsindex.h"
+#include "messageobject.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <QObject>
+
+namespace OCC {
+
+void VitalSignsIndex::addMessage(const MessageObject &msg)
+{
+    if (_messagePatients.contains(msg.messageId))
+        removeMessage(msg.messageId);
+
+    const QString key = msg.patientKey();
+    PatientSeries &patient = _patients[key];
+    _messagePatients.insert(msg.messageId, key);
+
+    // unset values are 0 for integers and NaN for doubles, see MessageObject
+    if (msg.bpSys && msg.bpDia) {
+        insert(patient, BloodPressureSystolic, msg.dtBp, msg.bpSys, msg.messageId);
+        insert(patient, BloodPressureDiastolic, msg.dtBp, msg.bpDia, msg.messageId);
+    }
+    if (msg.pulse)
+        insert(patient, Pulse, msg.dtPulse, msg.pulse, msg.messageId);
+    if (!std::isnan(msg.temp))
+        insert(patient, BodyTemperature, msg.dtTemp, msg.temp, msg.messageId);
+    if (!std::isnan(msg.sugar))
+        insert(patient, BloodSugar, msg.dtSugar, msg.sugar, msg.messageId);
+    if (!std::isnan(msg.weight))
+        insert(patient, BodyWeight, msg.dtWeight, msg.weight, msg.messageId);
+    if (!std::isnan(msg.oxygen))
+        insert(patient, OxygenSaturation, msg.dtOxygen, msg.oxygen, msg.messageId);
+}
+
+void VitalSignsIndex::insert(PatientSeries &patient, Code code, const QDateTime &time, double value, const QUuid &messageId)
+{
+    if (!time.isValid())
+        return;
+
+    Series &series = patient.series[code];
+    const qint64 msecs = time.toMSecsSinceEpoch();
+
+    // messages mostly arrive in chronological order, so this is usually an append
+    const int pos = std::upper_bound(series.timestamps.constBegin(), series.timestamps.constEnd(), msecs)
+        - series.timestamps.constBegin();
+    series.timestamps.insert(pos, msecs);
+    series.values.insert(pos, value);
+    series.messageIds.insert(pos, messageId);
+}
+
+void VitalSignsIndex::removeMessage(const QUuid &messageId)
+{
+    auto it = _messagePatients.find(messageId);
+    if (it == _messagePatients.end())
+        return;
+
+    PatientSeries &patient = _patients[it.value()];
+    for (Series &series : patient.series) {
+        int out = 0;
+        for (int in = 0; in < series.size(); ++in) {
+            if (series.messageIds.at(in) == messageId)
+                continue;
+            if (out != in) {
+                series.timestamps[out] = series.timestamps.at(in);
+                series.values[out] = series.values.at(in);
+                series.messageIds[out] = series.messageIds.at(in);
+            }
+            ++out;
+        }
+        series.timestamps.resize(out);
+        series.values.resize(out);
+        series.messageIds.resize(out);
+    }
+    _messagePatients.erase(it);
+}
+
+void VitalSignsIndex::clear()
+{
+    _patients.clear();
+    _messagePatients.clear();
+}
+
+VitalSignsIndex::Range VitalSignsIndex::range(const QString &patientKey, Code code,
+    const QDateTime &from, const QDateTime &to) const
+{
+    Range result;
+    auto it = _patients.constFind(patientKey);
+    if (it == _patients.constEnd())
+        return result;
+
+    const Series &series = it.value().series[code];
+    const auto begin = series.timestamps.constBegin();
+    const auto end = series.timestamps.constEnd();
+
+    result.series = &series;
+    result.begin = from.isValid() ? std::lower_bound(begin, end, from.toMSecsSinceEpoch()) - begin : 0;
+    result.end = to.isValid() ? std::upper_bound(begin, end, to.toMSecsSinceEpoch()) - begin : series.size();
+    return result;
+}
+
+VitalSignsIndex::Summary VitalSignsIndex::summarize(const Range &range)
+{
+    Summary summary;
+    if (range.isEmpty())
+        return summary;
+
+    summary.count = range.size();
+    summary.min = std::numeric_limits<double>::max();
+    summary.max = std::numeric_limits<double>::lowest();
+    double sum = 0;
+    for (int i = 0; i < range.size(); ++i) {
+        const double value = range.value(i);
+        summary.min = std::min(summary.min, value);
+        summary.max = std::max(summary.max, value);
+        sum += value;
+    }
+    summary.mean = sum / summary.count;
+    summary.first = range.value(0);
+    summary.last = range.value(range.size() - 1);
+    summary.lastTime = range.time(range.size() - 1);
+    return summary;
+}
+
+QString VitalSignsIndex::codeName(Code code)
+{
+    switch (code) {
+    case BloodPressureSystolic:
+        return QObject::tr("Bloodpressure (systolic)");
+    case BloodPressureDiastolic:
+        return QObject::tr("Bloodpressure (diastolic)");
+    case Pulse:
+        return QObject::tr("Pulse");
+    case BodyTemperature:
+        return QObject::tr("Body temperature");
+    case BloodSugar:
+        return QObject::tr("Blood sugar");
+    case BodyWeight:
+        return QObject::tr("Weight");
+    case OxygenSaturation:
+        return QObject::tr("Oxygen saturation");
+    case CodeCount:
+        break;
+    }
+    return QString();
+}
+
+QString VitalSignsIndex::codeUnit(Code code)
+{
+    switch (code) {
+    case BloodPressureSystolic:
+    case BloodPressureDiastolic:
+        return "mmHg";
+    case Pulse:
+        return "bpm";
+    case BodyTemperature:
+        return "°C";
+    case BloodSugar:
+        return "mg/dl";
+    case BodyWeight:
+        return "kg";
+    case OxygenSaturation:
+        return "%";
+    case CodeCount:
+        break;
+    }
+    return QString();
+}
+
+QString VitalSignsIndex::trendSummaryHtml(const QString &patientKey) const
+{
+    QString rows;
+    for (int code = 0; code < CodeCount; ++code) {
+        const Summary summary = summarize(range(patientKey, Code(code)));
+        // a single value has no trend, it is already shown in the vital parameters
+        if (summary.count < 2)
+            continue;
+
+        const QString unit = codeUnit(Code(code));
+        QString trend = "&rarr;";
+        if (summary.last > summary.first)
+            trend = "&uarr;";
+        else if (summary.last < summary.first)
+            trend = "&darr;";
+
+        rows += QString("<tr><td>%1</td><td>%2</td><td>%3 %7</td><td>%4 %7</td><td>%5 %7</td><td>%6</td></tr>")
+                    .arg(codeName(Code(code)), QString::number(summary.count), QString::number(summary.min),
+                        QString::number(summary.max), QString::number(summary.mean, 'f', 1), trend, unit);
+    }
+
+    if (rows.isEmpty())
+        return QString();
+
+    QString html = "<h1>" + QObject::tr("Trend") + "</h1>";
+    html += "<div class='segmentBodyColoredBorder'><div class='segmentBody'><table class='basicTable'><tbody>";
+    html += QString("<tr><td>%1</td><td>%2</td><td>%3</td><td>%4</td><td>%5</td><td>%6</td></tr>")
+                .arg(QObject::tr("Parameter"), QObject::tr("Count"), QObject::tr("Minimum"),
+                    QObject::tr("Maximum"), QObject::tr("Mean"), QObject::tr("Trend"));
+    html += rows;
+    html += "</tbody></table></div></div>";
+    return html;
+}
+
+} // end namespace OCC
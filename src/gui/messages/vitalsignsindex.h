@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) by Michael Albert <michael.albert@awesome-technologies.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef VITALSIGNSINDEX_H
+#define VITALSIGNSINDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <QUuid>
+#include <QVector>
+
+namespace OCC {
+
+class MessageObject;
+
+/**
+ * @brief The VitalSignsIndex class keeps a per-patient time series of the vital data of all messages
+ *
+ * Every patient owns one column set per observation code. Each column set is kept
+ * sorted by the effective time of the observation, so range queries are two binary
+ * searches. The index is fed message by message, historical message files never
+ * need to be parsed again to build a trend.
+ *
+ * @ingroup gui
+ */
+class VitalSignsIndex
+{
+public:
+    enum Code {
+        BloodPressureSystolic,
+        BloodPressureDiastolic,
+        Pulse,
+        BodyTemperature,
+        BloodSugar,
+        BodyWeight,
+        OxygenSaturation,
+        CodeCount,
+    };
+
+    /** columnar storage of the observations of one patient for one code */
+    struct Series
+    {
+        QVector<qint64> timestamps; // msecs since epoch, ascending
+        QVector<double> values;
+        QVector<QUuid> messageIds;
+
+        int size() const { return timestamps.size(); }
+    };
+
+    /** half open index range [begin, end) into a Series */
+    struct Range
+    {
+        const Series *series = nullptr;
+        int begin = 0;
+        int end = 0;
+
+        int size() const { return end - begin; }
+        bool isEmpty() const { return begin >= end; }
+        QDateTime time(int i) const { return QDateTime::fromMSecsSinceEpoch(series->timestamps.at(begin + i)); }
+        double value(int i) const { return series->values.at(begin + i); }
+    };
+
+    /** aggregated values of a Range */
+    struct Summary
+    {
+        int count = 0;
+        double min = 0;
+        double max = 0;
+        double mean = 0;
+        double first = 0;
+        double last = 0;
+        QDateTime lastTime;
+    };
+
+    /** adds the observations of @p msg, replaces earlier data of the same message */
+    void addMessage(const MessageObject &msg);
+
+    /** removes all observations taken from message @p messageId */
+    void removeMessage(const QUuid &messageId);
+
+    void clear();
+
+    /** returns the observations of @p patientKey with @p code in [from, to], invalid bounds are open */
+    Range range(const QString &patientKey, Code code,
+        const QDateTime &from = QDateTime(), const QDateTime &to = QDateTime()) const;
+
+    static Summary summarize(const Range &range);
+
+    /** returns a HTML table with the trend of all vital data of @p patientKey */
+    QString trendSummaryHtml(const QString &patientKey) const;
+
+    /** returns the translated name of @p code */
+    static QString codeName(Code code);
+
+    /** returns the unit of @p code */
+    static QString codeUnit(Code code);
+
+private:
+    struct PatientSeries
+    {
+        Series series[CodeCount];
+    };
+
+    void insert(PatientSeries &patient, Code code, const QDateTime &time, double value, const QUuid &messageId);
+
+    QHash<QString, PatientSeries> _patients;
+    QHash<QUuid, QString> _messagePatients;
+};
+
+} // end namespace
+
+#endif // VITALSIGNSINDEX_H
@@ -29,12 +29,14 @@
 #include <QNetworkAccessManager>
 #include <QSslSocket>
 #include <QNetworkCookieJar>
+#include <QNetworkProxy>
 
 #include <QFileInfo>
 #include <QDir>
 #include <QSslKey>
 #include <QAuthenticator>
 #include <QStandardPaths>
+#include <QThread>
 
 namespace OCC {
 
@@ -181,6 +183,9 @@ void Account::setCredentials(AbstractCredentials *cred)
         this, &Account::slotCredentialsFetched);
     connect(_credentials.data(), &AbstractCredentials::asked,
         this, &Account::slotCredentialsAsked);
+
+    // They refer to the old credentials
+    resetThreadNetworkAccessManagers();
 }
 
 QUrl Account::davUrl() const
@@ -239,34 +244,88 @@ void Account::resetNetworkAccessManager()
         SLOT(slotHandleSslErrors(QNetworkReply *, QList<QSslError>)));
     connect(_am.data(), &QNetworkAccessManager::proxyAuthenticationRequired,
         this, &Account::proxyAuthenticationRequired);
+    resetThreadNetworkAccessManagers();
+}
+
+void Account::resetThreadNetworkAccessManagers()
+{
+    QMutexLocker locker(&_threadAccessManagersMutex);
+    for (auto it = _threadAccessManagers.begin(); it != _threadAccessManagers.end(); ++it)
+        it.value() = createNetworkAccessManagerForThread(it.key());
 }
 
 QNetworkAccessManager *Account::networkAccessManager()
 {
-    return _am.data();
+    return sharedNetworkAccessManager().data();
 }
 
 QSharedPointer<QNetworkAccessManager> Account::sharedNetworkAccessManager()
 {
+    if (QThread::currentThread() != thread()) {
+        QMutexLocker locker(&_threadAccessManagersMutex);
+        auto am = _threadAccessManagers.value(QThread::currentThread());
+        if (am)
+            return am;
+    }
     return _am;
 }
 
+void Account::addNetworkAccessManagerForThread(QThread *thread)
+{
+    ASSERT(QThread::currentThread() == this->thread() && thread != this->thread());
+    if (!_credentials || !_am)
+        return;
+
+    auto am = createNetworkAccessManagerForThread(thread);
+    QMutexLocker locker(&_threadAccessManagersMutex);
+    _threadAccessManagers.insert(thread, am);
+}
+
+void Account::removeNetworkAccessManagerForThread(QThread *thread)
+{
+    QMutexLocker locker(&_threadAccessManagersMutex);
+    _threadAccessManagers.remove(thread);
+}
+
+QSharedPointer<QNetworkAccessManager> Account::createNetworkAccessManagerForThread(QThread *thread)
+{
+    qRegisterMetaType<QList<QSslError>>();
+    qRegisterMetaType<QNetworkProxy>("QNetworkProxy");
+
+    QSharedPointer<QNetworkAccessManager> am(_credentials->createQNAM(), &QObject::deleteLater);
+
+    auto jar = new CookieJar;
+    if (auto accountJar = qobject_cast<CookieJar *>(_am->cookieJar()))
+        jar->setAllCookies(accountJar->allCookies());
+    am->setCookieJar(jar);
+
+    // The handlers need the reply before it continues, the thread waits for them
+    connect(am.data(), &QNetworkAccessManager::sslErrors,
+        this, &Account::slotHandleSslErrors, Qt::BlockingQueuedConnection);
+    connect(am.data(), &QNetworkAccessManager::proxyAuthenticationRequired,
+        this, &Account::proxyAuthenticationRequired, Qt::BlockingQueuedConnection);
+
+    am->moveToThread(thread);
+    return am;
+}
+
 QNetworkReply *Account::sendRawRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
 {
     req.setUrl(url);
     req.setSslConfiguration(this->getOrCreateSslConfig());
+    auto am = sharedNetworkAccessManager();
     if (verb == "HEAD" && !data) {
-        return _am->head(req);
+        return am->head(req);
     } else if (verb == "GET" && !data) {
-        return _am->get(req);
+        return am->get(req);
     } else if (verb == "POST") {
-        return _am->post(req, data);
+        return am->post(req, data);
     } else if (verb == "PUT") {
-        return _am->put(req, data);
+        return am->put(req, data);
     } else if (verb == "DELETE" && !data) {
-        return _am->deleteResource(req);
+        return am->deleteResource(req);
     }
-    return _am->sendCustomRequest(req, verb, data);
+    return am->sendCustomRequest(req, verb, data);
 }
 
 SimpleNetworkJob *Account::sendRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
@@ -276,17 +335,25 @@ SimpleNetworkJob *Account::sendRequest(const QByteArray &verb, const QUrl &url,
     return job;
 }
 
+QSslConfiguration Account::sslConfiguration() const
+{
+    QMutexLocker locker(&_sslConfigurationMutex);
+    return _sslConfiguration;
+}
+
 void Account::setSslConfiguration(const QSslConfiguration &config)
 {
+    QMutexLocker locker(&_sslConfigurationMutex);
     _sslConfiguration = config;
 }
 
 QSslConfiguration Account::getOrCreateSslConfig()
 {
-    if (!_sslConfiguration.isNull()) {
+    const QSslConfiguration sslConfiguration = this->sslConfiguration();
+    if (!sslConfiguration.isNull()) {
         // Will be set by CheckServerJob::finished()
         // We need to use a central shared config to get SSL session tickets
-        return _sslConfiguration;
+        return sslConfiguration;
     }
 
     // if setting the client certificate fails, you will probably get an error similar to this:
@@ -355,6 +422,15 @@ void Account::setCredentialSetting(const QString &key, const QVariant &value)
 
 void Account::slotHandleSslErrors(QNetworkReply *reply, QList<QSslError> errors)
 {
+    // The thread of the reply waits for this while it shuts down, don't ask the user
+    if (reply->thread() != thread()) {
+        QMutexLocker locker(&_threadAccessManagersMutex);
+        if (!_threadAccessManagers.contains(reply->thread())) {
+            qCInfo(lcAccount) << "Ignoring SSL errors of a stopping thread for url" << reply->url().toString();
+            return;
+        }
+    }
+
     NetworkJobTimeoutPauser pauser(reply);
     QString out;
     QDebug(&out) << "SSL-Errors happened for url " << reply->url().toString();
@@ -26,6 +26,8 @@
 #include <QSslCipher>
 #include <QSslError>
 #include <QSharedPointer>
+#include <QHash>
+#include <QMutex>
 
 #ifndef TOKEN_AUTH_ONLY
 #include <QPixmap>
@@ -40,6 +42,7 @@ class QSettings;
 class QNetworkReply;
 class QUrl;
 class QNetworkAccessManager;
+class QThread;
 
 namespace OCC {
 
@@ -151,9 +154,12 @@ public:
         QNetworkRequest req = QNetworkRequest(),
         QIODevice *data = 0);
 
-    /** The ssl configuration during the first connection */
+    /** The ssl configuration during the first connection
+     *
+     * Network jobs of sync threads read it while the main thread sets it.
+     */
     QSslConfiguration getOrCreateSslConfig();
-    QSslConfiguration sslConfiguration() const { return _sslConfiguration; }
+    QSslConfiguration sslConfiguration() const;
     void setSslConfiguration(const QSslConfiguration &config);
     // Because of bugs in Qt, we use this to store info needed for the SSL Button
     QSslCipher _sessionCipher;
@@ -228,9 +234,24 @@ public:
     QString cookieJarPath();
 
     void resetNetworkAccessManager();
+    /// The QNAM for the calling thread, see addNetworkAccessManagerForThread()
     QNetworkAccessManager *networkAccessManager();
     QSharedPointer<QNetworkAccessManager> sharedNetworkAccessManager();
 
+    /**
+     * Creates a QNAM for network jobs that run in @a thread
+     *
+     * A QNAM can only be used from the thread it lives in. Requests sent
+     * from @a thread use the new QNAM until removeNetworkAccessManagerForThread()
+     * is called. It starts with a copy of the account's cookies, ssl errors
+     * and proxy authentication are handled in the main thread while the
+     * thread waits.
+     *
+     * Must be called from the main thread.
+     */
+    void addNetworkAccessManagerForThread(QThread *thread);
+    void removeNetworkAccessManagerForThread(QThread *thread);
+
     /// Called by network jobs on credential errors, emits invalidCredentials()
     void handleInvalidCredentials();
 
@@ -290,11 +311,16 @@ private:
 
     QList<QSslCertificate> _approvedCerts;
     QSslConfiguration _sslConfiguration;
+    mutable QMutex _sslConfigurationMutex;
     Capabilities _capabilities;
     QString _serverVersion;
     QScopedPointer<AbstractSslErrorHandler> _sslErrorHandler;
     QuotaInfo *_quotaInfo;
     QSharedPointer<QNetworkAccessManager> _am;
+    QSharedPointer<QNetworkAccessManager> createNetworkAccessManagerForThread(QThread *thread);
+    void resetThreadNetworkAccessManagers();
+    QHash<QThread *, QSharedPointer<QNetworkAccessManager>> _threadAccessManagers;
+    mutable QMutex _threadAccessManagersMutex;
     QScopedPointer<AbstractCredentials> _credentials;
     bool _http2Supported = false;
 
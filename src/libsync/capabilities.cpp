@@ -143,6 +143,11 @@ bool Capabilities::chunkingParallelUploadDisabled() const
     return _capabilities["dav"].toMap()["chunkingParallelUploadDisabled"].toBool();
 }
 
+bool Capabilities::chunkingDelta() const
+{
+    return chunkingNg() && _capabilities["dav"].toMap()["chunkingDelta"].toBool();
+}
+
 bool Capabilities::privateLinkPropertyAvailable() const
 {
     return _capabilities["files"].toMap()["privateLinks"].toBool();
@@ -80,6 +80,43 @@ namespace {
         BIO_free_all(bioErrors);
         return errors;
     }
+
+    // Amount of file data encrypted or decrypted at once
+    const int streamingBufferSize = 1024 * 1024;
+
+    // AES-128-GCM as used for file contents, nullptr on error
+    EVP_CIPHER_CTX *newFileCipherContext(const QByteArray &key, const QByteArray &iv, bool encrypt)
+    {
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        if (!ctx) {
+            qCInfo(lcCse()) << "Could not create context";
+            return nullptr;
+        }
+
+        /* Initialise the operation. */
+        if(!EVP_CipherInit_ex(ctx, EVP_aes_128_gcm(), NULL, NULL, NULL, encrypt)) {
+            qCInfo(lcCse()) << "Could not init cipher";
+            EVP_CIPHER_CTX_free(ctx);
+            return nullptr;
+        }
+
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+        /* Set IV length. */
+        if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), NULL)) {
+            qCInfo(lcCse()) << "Could not set iv length";
+            EVP_CIPHER_CTX_free(ctx);
+            return nullptr;
+        }
+
+        /* Initialise key and IV */
+        if(!EVP_CipherInit_ex(ctx, NULL, NULL, (const unsigned char *)key.constData(), (const unsigned char *)iv.constData(), encrypt)) {
+            qCInfo(lcCse()) << "Could not set key and iv";
+            EVP_CIPHER_CTX_free(ctx);
+            return nullptr;
+        }
+        return ctx;
+    }
 }
 
 namespace EncryptionHelper {
@@ -1367,171 +1404,225 @@ bool EncryptionHelper::fileEncryption(const QByteArray &key, const QByteArray &i
 {
     if (!input->open(QIODevice::ReadOnly)) {
       qCDebug(lcCse) << "Could not open input file for reading" << input->errorString();
+      return false;
     }
     if (!output->open(QIODevice::WriteOnly)) {
       qCDebug(lcCse) << "Could not oppen output file for writting" << output->errorString();
+      return false;
     }
 
-    // Init
-    EVP_CIPHER_CTX *ctx;
-
-    /* Create and initialise the context */
-    if(!(ctx = EVP_CIPHER_CTX_new())) {
-        qCInfo(lcCse()) << "Could not create context";
+    StreamingEncryptor encryptor(key, iv);
+    if (!encryptor.isValid()) {
         return false;
     }
 
-    /* Initialise the decryption operation. */
-    if(!EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, NULL, NULL)) {
-        qCInfo(lcCse()) << "Could not init cipher";
+    QByteArray buffer(streamingBufferSize, Qt::Uninitialized);
+
+    qCDebug(lcCse) << "Starting to encrypt the file" << input->fileName() << input->atEnd();
+    while(!input->atEnd()) {
+        const qint64 read = input->read(buffer.data(), buffer.size());
+        if (read <= 0) {
+            qCInfo(lcCse()) << "Could not read data from file";
+            return false;
+        }
+
+        if (!encryptor.update(buffer.data(), read)) {
+            return false;
+        }
+        if (output->write(buffer.constData(), read) != read) {
+            qCInfo(lcCse()) << "Could not write the encrypted data" << output->errorString();
+            return false;
+        }
+    }
+
+    returnTag = encryptor.finalize();
+    if (returnTag.isEmpty()) {
+        return false;
+    }
+    if (output->write(returnTag) != returnTag.size()) {
+        qCInfo(lcCse()) << "Could not write the tag" << output->errorString();
         return false;
     }
 
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    input->close();
+    output->close();
+    qCDebug(lcCse) << "File Encrypted Successfully";
+    return true;
+}
 
-    /* Set IV length. */
-    if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), NULL)) {
-        qCInfo(lcCse()) << "Could not set iv length";
-        return false;
+bool EncryptionHelper::fileDecryption(const QByteArray &key, const QByteArray& iv,
+                               QFile *input, QFile *output)
+{
+    if (!input->open(QIODevice::ReadOnly)) {
+      qCDebug(lcCse) << "Could not open input file for reading" << input->errorString();
+      return false;
+    }
+    if (!output->open(QIODevice::WriteOnly)) {
+      qCDebug(lcCse) << "Could not oppen output file for writting" << output->errorString();
+      return false;
     }
 
-    /* Initialise key and IV */
-    if(!EVP_EncryptInit_ex(ctx, NULL, NULL, (const unsigned char *)key.constData(), (const unsigned char *)iv.constData())) {
-        qCInfo(lcCse()) << "Could not set key and iv";
+    StreamingDecryptor decryptor(key, iv);
+    if (!decryptor.isValid()) {
         return false;
     }
 
-    unsigned char *out = (unsigned char *)malloc(sizeof(unsigned char) * (1024 + 16 -1));
-    int len = 0;
-    int total_len = 0;
+    QByteArray buffer(streamingBufferSize, Qt::Uninitialized);
 
-    qCDebug(lcCse) << "Starting to encrypt the file" << input->fileName() << input->atEnd();
     while(!input->atEnd()) {
-        QByteArray data = input->read(1024);
-
-        if (data.size() == 0) {
+        const qint64 read = input->read(buffer.data(), buffer.size());
+        if (read <= 0) {
             qCInfo(lcCse()) << "Could not read data from file";
             return false;
         }
 
-        qCDebug(lcCse) << "Encrypting " << data;
-        if(!EVP_EncryptUpdate(ctx, out, &len, (unsigned char *)data.constData(), data.size())) {
-            qCInfo(lcCse()) << "Could not encrypt";
+        if (!decryptor.update(buffer.constData(), read, output)) {
             return false;
         }
-
-        output->write((char *)out, len);
-        total_len += len;
     }
 
-    if(1 != EVP_EncryptFinal_ex(ctx, out, &len)) {
-        qCInfo(lcCse()) << "Could finalize encryption";
+    if (!decryptor.finalize()) {
         return false;
     }
-    output->write((char *)out, len);
-    total_len += len;
-
-    /* Get the tag */
-    unsigned char *tag = (unsigned char *)malloc(sizeof(unsigned char) * 16);
-    if(1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, tag)) {
-        qCInfo(lcCse()) << "Could not get tag";
-        return false;
-    }
-
-    returnTag = QByteArray((const char*) tag, 16);
-    output->write((char *)tag, 16);
-
-    free(out);
-    free(tag);
-    EVP_CIPHER_CTX_free(ctx);
 
     input->close();
     output->close();
-    qCDebug(lcCse) << "File Encrypted Successfully";
     return true;
 }
 
-bool EncryptionHelper::fileDecryption(const QByteArray &key, const QByteArray& iv,
-                               QFile *input, QFile *output)
+StreamingEncryptor::StreamingEncryptor(const QByteArray &key, const QByteArray &iv)
+    : _ctx(newFileCipherContext(key, iv, true))
 {
-    input->open(QIODevice::ReadOnly);
-    output->open(QIODevice::WriteOnly);
+}
 
-    // Init
-    EVP_CIPHER_CTX *ctx;
+StreamingEncryptor::~StreamingEncryptor()
+{
+    if (_ctx)
+        EVP_CIPHER_CTX_free(_ctx);
+}
 
-    /* Create and initialise the context */
-    if(!(ctx = EVP_CIPHER_CTX_new())) {
-        qCInfo(lcCse()) << "Could not create context";
+bool StreamingEncryptor::update(char *data, qint64 size)
+{
+    if (!_ctx)
         return false;
-    }
 
-    /* Initialise the decryption operation. */
-    if(!EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, NULL, NULL)) {
-        qCInfo(lcCse()) << "Could not init cipher";
-        return false;
+    auto out = reinterpret_cast<unsigned char *>(data);
+    while (size > 0) {
+        // GCM doesn't buffer, the output is as long as the input
+        int len = int(qMin<qint64>(size, streamingBufferSize));
+        if (!EVP_EncryptUpdate(_ctx, out, &len, out, len)) {
+            qCInfo(lcCse()) << "Could not encrypt";
+            return false;
+        }
+        out += len;
+        size -= len;
     }
+    return true;
+}
 
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
+QByteArray StreamingEncryptor::finalize()
+{
+    if (!_ctx)
+        return QByteArray();
 
-    /* Set IV length. */
-    if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN,  iv.size(), NULL)) {
-        qCInfo(lcCse()) << "Could not set iv length";
-        return false;
+    unsigned char out[EncryptionHelper::fileTagLength];
+    int len = 0;
+    if(1 != EVP_EncryptFinal_ex(_ctx, out, &len)) {
+        qCInfo(lcCse()) << "Could finalize encryption";
+        return QByteArray();
     }
 
-    /* Initialise key and IV */
-    if(!EVP_DecryptInit_ex(ctx, NULL, NULL, (const unsigned char *) key.constData(), (const unsigned char *) iv.constData())) {
-        qCInfo(lcCse()) << "Could not set key and iv";
-        return false;
+    QByteArray tag(EncryptionHelper::fileTagLength, Qt::Uninitialized);
+    if(1 != EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_GET_TAG, tag.size(), tag.data())) {
+        qCInfo(lcCse()) << "Could not get tag";
+        return QByteArray();
     }
+    return tag;
+}
 
-    qint64 size = input->size() - 16;
+StreamingDecryptor::StreamingDecryptor(const QByteArray &key, const QByteArray &iv)
+    : _ctx(newFileCipherContext(key, iv, false))
+{
+}
 
-    unsigned char *out = (unsigned char *)malloc(sizeof(unsigned char) * (1024 + 16 -1));
-    int len = 0;
+StreamingDecryptor::~StreamingDecryptor()
+{
+    if (_ctx)
+        EVP_CIPHER_CTX_free(_ctx);
+}
 
-    while(input->pos() < size) {
+bool StreamingDecryptor::update(const char *data, qint64 size, QIODevice *output)
+{
+    if (!_ctx)
+        return false;
 
-        int toRead = size - input->pos();
-        if (toRead > 1024) {
-            toRead = 1024;
-        }
+    _received += size;
 
-        QByteArray data = input->read(toRead);
+    qint64 toDecrypt = _pending.size() + size - EncryptionHelper::fileTagLength;
+    if (toDecrypt <= 0) {
+        _pending.append(data, size);
+        return true;
+    }
 
-        if (data.size() == 0) {
-            qCInfo(lcCse()) << "Could not read data from file";
-            return false;
-        }
+    // Held back bytes that turned out not to be the tag go first
+    const int fromPending = int(qMin<qint64>(toDecrypt, _pending.size()));
+    if (!decrypt(_pending.constData(), fromPending, output)) {
+        return false;
+    }
+    _pending.remove(0, fromPending);
+    toDecrypt -= fromPending;
+
+    if (!decrypt(data, toDecrypt, output)) {
+        return false;
+    }
+    _pending.append(data + toDecrypt, size - toDecrypt);
+    return true;
+}
+
+bool StreamingDecryptor::decrypt(const char *data, qint64 size, QIODevice *output)
+{
+    while (size > 0) {
+        const int chunk = int(qMin<qint64>(size, streamingBufferSize));
+        _buffer.resize(chunk);
 
-        if(!EVP_DecryptUpdate(ctx, out, &len, (unsigned char *)data.constData(), data.size())) {
+        int len = 0;
+        if(!EVP_DecryptUpdate(_ctx, reinterpret_cast<unsigned char *>(_buffer.data()), &len,
+               reinterpret_cast<const unsigned char *>(data), chunk)) {
             qCInfo(lcCse()) << "Could not decrypt";
             return false;
         }
-
-        output->write((char *)out, len);
+        if (output->write(_buffer.constData(), len) != len) {
+            qCInfo(lcCse()) << "Could not write the decrypted data" << output->errorString();
+            return false;
+        }
+        data += chunk;
+        size -= chunk;
     }
+    return true;
+}
 
-    QByteArray tag = input->read(16);
+bool StreamingDecryptor::finalize()
+{
+    if (!_ctx)
+        return false;
+
+    if (_pending.size() != EncryptionHelper::fileTagLength) {
+        qCInfo(lcCse()) << "The encrypted data is too short to contain a tag";
+        return false;
+    }
 
     /* Set expected tag value. Works in OpenSSL 1.0.1d and later */
-    if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag.size(), (unsigned char *)tag.constData())) {
+    if(!EVP_CIPHER_CTX_ctrl(_ctx, EVP_CTRL_GCM_SET_TAG, _pending.size(), _pending.data())) {
         qCInfo(lcCse()) << "Could not set expected tag";
         return false;
     }
 
-    if(1 != EVP_DecryptFinal_ex(ctx, out, &len)) {
+    unsigned char out[EncryptionHelper::fileTagLength];
+    int len = 0;
+    if(1 != EVP_DecryptFinal_ex(_ctx, out, &len)) {
         qCInfo(lcCse()) << "Could finalize decryption";
         return false;
     }
-    output->write((char *)out, len);
-
-    free(out);
-    EVP_CIPHER_CTX_free(ctx);
-
-    input->close();
-    output->close();
     return true;
 }
 
@@ -64,8 +64,69 @@ namespace EncryptionHelper {
 
     bool fileDecryption(const QByteArray &key, const QByteArray& iv,
                                QFile *input, QFile *output);
+
+    /* Length of the authentication tag that follows the encrypted file contents */
+    const int fileTagLength = 16;
 }
 
+/* Encrypts file contents with AES-128-GCM piece by piece, so a file
+ * doesn't need to be in memory or on disk a second time.
+ *
+ * The tag returned by finalize() follows the encrypted contents.
+ */
+class OWNCLOUDSYNC_EXPORT StreamingEncryptor
+{
+public:
+    StreamingEncryptor(const QByteArray &key, const QByteArray &iv);
+    ~StreamingEncryptor();
+
+    bool isValid() const { return _ctx; }
+
+    /* Encrypts the next @a size bytes of the file in place */
+    bool update(char *data, qint64 size);
+
+    /* The tag, once all data went through update(). Empty on error. */
+    QByteArray finalize();
+
+private:
+    Q_DISABLE_COPY(StreamingEncryptor)
+    EVP_CIPHER_CTX *_ctx;
+};
+
+/* Decrypts file contents encrypted by StreamingEncryptor while they
+ * are received.
+ *
+ * The input is the encrypted contents followed by the tag. Since the
+ * end is not known in advance, the last bytes seen are held back until
+ * finalize() checks them as the tag.
+ */
+class OWNCLOUDSYNC_EXPORT StreamingDecryptor
+{
+public:
+    StreamingDecryptor(const QByteArray &key, const QByteArray &iv);
+    ~StreamingDecryptor();
+
+    bool isValid() const { return _ctx; }
+
+    /* Decrypts the next @a size bytes of input and writes the result to @a output */
+    bool update(const char *data, qint64 size, QIODevice *output);
+
+    /* True if the held back bytes are the tag of the decrypted data */
+    bool finalize();
+
+    /* The number of bytes passed to update(), tag included */
+    qint64 received() const { return _received; }
+
+private:
+    Q_DISABLE_COPY(StreamingDecryptor)
+    bool decrypt(const char *data, qint64 size, QIODevice *output);
+
+    EVP_CIPHER_CTX *_ctx;
+    QByteArray _pending; // the last bytes seen, maybe the tag
+    QByteArray _buffer;
+    qint64 _received = 0;
+};
+
 class OWNCLOUDSYNC_EXPORT ClientSideEncryption : public QObject {
     Q_OBJECT
 public:
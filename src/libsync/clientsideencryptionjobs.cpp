@@ -184,6 +184,7 @@ bool StoreMetaDataApiJob::finished()
 		if (retCode != 200) {
 			qCInfo(lcCseJob()) << "error sending the metadata" << path() << errorString() << retCode;
 			emit error(_fileId, retCode);
+			return true;
 		}
 
 		qCInfo(lcCseJob()) << "Metadata submited to the server successfully";
@@ -235,6 +236,7 @@ bool UpdateMetadataApiJob::finished()
 		if (retCode != 200) {
 			qCInfo(lcCseJob()) << "error updating the metadata" << path() << errorString() << retCode;
 			emit error(_fileId, retCode);
+			return true;
 		}
 
 		qCInfo(lcCseJob()) << "Metadata submited to the server successfully";
@@ -36,6 +36,7 @@
 #include <QSettings>
 #include <QNetworkProxy>
 #include <QStandardPaths>
+#include <QThread>
 
 #define DEFAULT_REMOTE_POLL_INTERVAL 30000 // default remote poll time in milliseconds
 #define DEFAULT_MAX_LOG_LINES 20000
@@ -60,6 +61,13 @@ static const char skipUpdateCheckC[] = "skipUpdateCheck";
 static const char updateCheckIntervalC[] = "updateCheckInterval";
 static const char geometryC[] = "geometry";
 static const char timeoutC[] = "timeout";
+static const char maxConcurrentSyncsC[] = "maxConcurrentSyncs";
+static const char maxParallelNetworkJobsC[] = "maxParallelNetworkJobs";
+static const char maxDiscoveryThreadsC[] = "maxDiscoveryThreads";
+static const char bulkRemoteListingC[] = "bulkRemoteListing";
+static const char syncInWorkerThreadC[] = "syncInWorkerThread";
+static const char deltaUploadsC[] = "deltaUploads";
+static const char serverSideCopiesC[] = "serverSideCopies";
 static const char chunkSizeC[] = "chunkSize";
 static const char minChunkSizeC[] = "minChunkSize";
 static const char maxChunkSizeC[] = "maxChunkSize";
@@ -196,6 +204,54 @@ int ConfigFile::timeout() const
     return settings.value(QLatin1String(timeoutC), 300).toInt(); // default to 5 min
 }
 
+int ConfigFile::maxConcurrentSyncs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxConcurrentSyncsC), 3).toInt());
+}
+
+int ConfigFile::maxParallelNetworkJobs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return qMax(1, settings.value(QLatin1String(maxParallelNetworkJobsC), 20).toInt());
+}
+
+int ConfigFile::maxDiscoveryThreads() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    const int defaultThreads = qBound(2, QThread::idealThreadCount(), 16);
+    return qMax(1, settings.value(QLatin1String(maxDiscoveryThreadsC), defaultThreads).toInt());
+}
+
+bool ConfigFile::bulkRemoteListing() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(bulkRemoteListingC), true).toBool();
+}
+
+bool ConfigFile::syncInWorkerThread() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(syncInWorkerThreadC), false).toBool();
+}
+
+void ConfigFile::setSyncInWorkerThread(bool enabled)
+{
+    setValue(syncInWorkerThreadC, enabled);
+}
+
+bool ConfigFile::deltaUploads() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(deltaUploadsC), false).toBool();
+}
+
+bool ConfigFile::serverSideCopies() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(serverSideCopiesC), false).toBool();
+}
+
 quint64 ConfigFile::chunkSize() const
 {
     QSettings settings(configFile(), QSettings::IniFormat);
@@ -135,6 +135,22 @@ public:
     void setShowInExplorerNavigationPane(bool show);
 
     int timeout() const;
+
+    /** How many folders may sync at the same time */
+    int maxConcurrentSyncs() const;
+    /** How many network jobs all running folders may have together */
+    int maxParallelNetworkJobs() const;
+    /** How many threads all running local discoveries may use together */
+    int maxDiscoveryThreads() const;
+    /** Whether full remote discoveries may list the server tree with one request */
+    bool bulkRemoteListing() const;
+    /** Whether each folder runs its sync engine and network jobs in a thread of its own */
+    bool syncInWorkerThread() const;
+    void setSyncInWorkerThread(bool enabled);
+    /** Whether uploads of changed big files only send the changed parts */
+    bool deltaUploads() const;
+    /** Whether copies of synced files are made on the server instead of being uploaded */
+    bool serverSideCopies() const;
     quint64 chunkSize() const;
     quint64 maxChunkSize() const;
     quint64 minChunkSize() const;
@@ -50,7 +50,7 @@ namespace {
 class HttpCredentialsAccessManager : public AccessManager
 {
 public:
-    HttpCredentialsAccessManager(const HttpCredentials *cred, QObject *parent = 0)
+    HttpCredentialsAccessManager(const QSharedPointer<AccessManagerCredentials> &cred, QObject *parent = 0)
         : AccessManager(parent)
         , _cred(cred)
     {
@@ -59,13 +59,16 @@ public:
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) Q_DECL_OVERRIDE
     {
+        // Might run in a sync thread, never touch the credentials object here
+        const auto cred = _cred->values();
+
         QNetworkRequest req(request);
         if (!req.attribute(HttpCredentials::DontAddCredentialsAttribute).toBool()) {
-            if (_cred && !_cred->password().isEmpty()) {
-                if (_cred->isUsingOAuth()) {
-                    req.setRawHeader("Authorization", "Bearer " + _cred->password().toUtf8());
+            if (!cred.password.isEmpty()) {
+                if (cred.oauth) {
+                    req.setRawHeader("Authorization", "Bearer " + cred.password.toUtf8());
                 } else {
-                    QByteArray credHash = QByteArray(_cred->user().toUtf8() + ":" + _cred->password().toUtf8()).toBase64();
+                    QByteArray credHash = QByteArray(cred.user.toUtf8() + ":" + cred.password.toUtf8()).toBase64();
                     req.setRawHeader("Authorization", "Basic " + credHash);
                 }
             } else if (!request.url().password().isEmpty()) {
@@ -76,11 +79,11 @@ protected:
             }
         }
 
-        if (_cred && !_cred->_clientSslKey.isNull() && !_cred->_clientSslCertificate.isNull()) {
+        if (!cred.clientSslKey.isNull() && !cred.clientSslCertificate.isNull()) {
             // SSL configuration
             QSslConfiguration sslConfiguration = req.sslConfiguration();
-            sslConfiguration.setLocalCertificate(_cred->_clientSslCertificate);
-            sslConfiguration.setPrivateKey(_cred->_clientSslKey);
+            sslConfiguration.setLocalCertificate(cred.clientSslCertificate);
+            sslConfiguration.setPrivateKey(cred.clientSslKey);
             req.setSslConfiguration(sslConfiguration);
         }
 
@@ -89,9 +92,7 @@ protected:
     }
 
 private:
-    // The credentials object dies along with the account, while the QNAM might
-    // outlive both.
-    QPointer<const HttpCredentials> _cred;
+    QSharedPointer<AccessManagerCredentials> _cred;
 };
 
 
@@ -106,7 +107,10 @@ static void addSettingsToJob(Account *account, QKeychain::Job *job)
 HttpCredentials::HttpCredentials()
     : _ready(false)
     , _keychainMigration(false)
+    , _accessManagerCredentials(new AccessManagerCredentials)
 {
+    connect(this, &AbstractCredentials::fetched, this, &HttpCredentials::updateAccessManagerCredentials);
+    connect(this, &AbstractCredentials::asked, this, &HttpCredentials::updateAccessManagerCredentials);
 }
 
 // From wizard
@@ -118,7 +122,28 @@ HttpCredentials::HttpCredentials(const QString &user, const QString &password, c
     , _clientSslCertificate(certificate)
     , _keychainMigration(false)
     , _retryOnKeyChainError(false)
+    , _accessManagerCredentials(new AccessManagerCredentials)
+{
+    updateAccessManagerCredentials();
+    connect(this, &AbstractCredentials::fetched, this, &HttpCredentials::updateAccessManagerCredentials);
+    connect(this, &AbstractCredentials::asked, this, &HttpCredentials::updateAccessManagerCredentials);
+}
+
+HttpCredentials::~HttpCredentials()
+{
+    // Access managers that outlive the credentials don't send them anymore
+    _accessManagerCredentials->setValues(AccessManagerCredentials::Values());
+}
+
+void HttpCredentials::updateAccessManagerCredentials()
 {
+    AccessManagerCredentials::Values values;
+    values.user = _user;
+    values.password = _password;
+    values.oauth = isUsingOAuth();
+    values.clientSslCertificate = _clientSslCertificate;
+    values.clientSslKey = _clientSslKey;
+    _accessManagerCredentials->setValues(values);
 }
 
 QString HttpCredentials::authType() const
@@ -146,7 +171,7 @@ void HttpCredentials::setAccount(Account *account)
 
 QNetworkAccessManager *HttpCredentials::createQNAM() const
 {
-    AccessManager *qnam = new HttpCredentialsAccessManager(this);
+    AccessManager *qnam = new HttpCredentialsAccessManager(_accessManagerCredentials);
 
     connect(qnam, &QNetworkAccessManager::authenticationRequired,
         this, &HttpCredentials::slotAuthentication);
@@ -409,6 +434,7 @@ void HttpCredentials::invalidateToken()
 
     // User must be fetched from config file to generate a valid key
     fetchUser();
+    updateAccessManagerCredentials();
 
     const QString kck = keychainKey(_account->url().toString(), _user, _account->id());
     if (kck.isEmpty()) {
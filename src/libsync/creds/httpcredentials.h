@@ -17,6 +17,8 @@
 #define MIRALL_CREDS_HTTP_CREDENTIALS_H
 
 #include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
 #include <QSslCertificate>
 #include <QSslKey>
 #include <QNetworkRequest>
@@ -33,6 +35,41 @@ class ReadPasswordJob;
 
 namespace OCC {
 
+/**
+ * @brief The credentials an access manager adds to its requests
+ *
+ * Access managers of sync threads create requests while the credentials
+ * change in the main thread. They read this copy, which the credentials
+ * update whenever they change.
+ */
+class OWNCLOUDSYNC_EXPORT AccessManagerCredentials
+{
+public:
+    struct Values
+    {
+        QString user;
+        QString password; // password, or access_token for OAuth
+        bool oauth = false;
+        QSslCertificate clientSslCertificate;
+        QSslKey clientSslKey;
+    };
+
+    Values values() const
+    {
+        QMutexLocker locker(&_mutex);
+        return _values;
+    }
+    void setValues(const Values &values)
+    {
+        QMutexLocker locker(&_mutex);
+        _values = values;
+    }
+
+private:
+    mutable QMutex _mutex;
+    Values _values;
+};
+
 /*
    The authentication system is this way because of Shibboleth.
    There used to be two different ways to authenticate: Shibboleth and HTTP Basic Auth.
@@ -73,7 +110,6 @@ namespace OCC {
 class OWNCLOUDSYNC_EXPORT HttpCredentials : public AbstractCredentials
 {
     Q_OBJECT
-    friend class HttpCredentialsAccessManager;
 
 public:
     /// Don't add credentials if this is set on a QNetworkRequest
@@ -81,6 +117,7 @@ public:
 
     explicit HttpCredentials();
     HttpCredentials(const QString &user, const QString &password, const QSslCertificate &certificate = QSslCertificate(), const QSslKey &key = QSslKey());
+    ~HttpCredentials();
 
     QString authType() const Q_DECL_OVERRIDE;
     QNetworkAccessManager *createQNAM() const Q_DECL_OVERRIDE;
@@ -131,6 +168,9 @@ protected:
     /// Wipes legacy keychain locations
     void deleteOldKeychainEntries();
 
+    /// Copies the credentials for the access managers, called whenever they change
+    void updateAccessManagerCredentials();
+
     QString _user;
     QString _password; // user's password, or access_token for OAuth
     QString _refreshToken; // OAuth _refreshToken, set if OAuth is used.
@@ -142,6 +182,9 @@ protected:
     QSslCertificate _clientSslCertificate;
     bool _keychainMigration;
     bool _retryOnKeyChainError = true; // true if we haven't done yet any reading from keychain
+
+    // Shared with the access managers, which might outlive the credentials
+    QSharedPointer<AccessManagerCredentials> _accessManagerCredentials;
 };
 
 
@@ -283,9 +283,11 @@ void DiscoverySingleDirectoryJob::start()
     }
 
     lsColJob->setProperties(props);
+    if (_recursive)
+        lsColJob->setDepth("infinity");
 
-    QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
-        this, &DiscoverySingleDirectoryJob::directoryListingIteratedSlot);
+    QObject::connect(lsColJob, &LsColJob::directoryListingEntry,
+        this, &DiscoverySingleDirectoryJob::directoryListingEntrySlot);
     QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot);
     QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot);
     lsColJob->start();
@@ -300,88 +302,79 @@ void DiscoverySingleDirectoryJob::abort()
     }
 }
 
-static void propertyMapToFileStat(const QMap<QString, QString> &map, csync_file_stat_t *file_stat)
+static void entryToFileStat(const LsColEntry &entry, csync_file_stat_t *file_stat)
 {
-    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
-        QString property = it.key();
-        QString value = it.value();
-        if (property == "resourcetype") {
-            if (value.contains("collection")) {
-                file_stat->type = ItemTypeDirectory;
-            } else {
-                file_stat->type = ItemTypeFile;
-            }
-        } else if (property == "getlastmodified") {
-            file_stat->modtime = oc_httpdate_parse(value.toUtf8());
-        } else if (property == "getcontentlength") {
-            // See #4573, sometimes negative size values are returned
-            bool ok = false;
-            qlonglong ll = value.toLongLong(&ok);
-            if (ok && ll >= 0) {
-                file_stat->size = ll;
-            } else {
-                file_stat->size = 0;
-            }
-        } else if (property == "getetag") {
-            file_stat->etag = Utility::normalizeEtag(value.toUtf8());
-        } else if (property == "id") {
-            file_stat->file_id = value.toUtf8();
-        } else if (property == "downloadURL") {
-            file_stat->directDownloadUrl = value.toUtf8();
-        } else if (property == "dDC") {
-            file_stat->directDownloadCookies = value.toUtf8();
-        } else if (property == "permissions") {
-            file_stat->remotePerm = RemotePermissions(value);
-        } else if (property == "checksums") {
-            file_stat->checksumHeader = findBestChecksum(value.toUtf8());
-        } else if (property == "share-types" && !value.isEmpty()) {
-            // Since QMap is sorted, "share-types" is always after "permissions".
-            if (file_stat->remotePerm.isNull()) {
-                qWarning() << "Server returned a share type, but no permissions?";
-            } else {
-                // S means shared with me.
-                // But for our purpose, we want to know if the file is shared. It does not matter
-                // if we are the owner or not.
-                // Piggy back on the persmission field
-                file_stat->remotePerm.setPermission(RemotePermissions::IsShared);
-            }
+    if (entry.hasResourceType)
+        file_stat->type = entry.isCollection ? ItemTypeDirectory : ItemTypeFile;
+    file_stat->modtime = entry.lastModified;
+    file_stat->size = entry.contentLength;
+    file_stat->etag = Utility::normalizeEtag(entry.etag);
+    file_stat->file_id = entry.fileId;
+    file_stat->directDownloadUrl = entry.directDownloadUrl;
+    file_stat->directDownloadCookies = entry.directDownloadCookies;
+    file_stat->remotePerm = entry.remotePerm;
+    if (!entry.checksums.isEmpty())
+        file_stat->checksumHeader = findBestChecksum(entry.checksums);
+    if (entry.isShared) {
+        if (file_stat->remotePerm.isNull()) {
+            qWarning() << "Server returned a share type, but no permissions?";
+        } else {
+            // S means shared with me.
+            // But for our purpose, we want to know if the file is shared. It does not matter
+            // if we are the owner or not.
+            // Piggy back on the persmission field
+            file_stat->remotePerm.setPermission(RemotePermissions::IsShared);
         }
     }
 }
 
-void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, const QMap<QString, QString> &map)
+void DiscoverySingleDirectoryJob::directoryListingEntrySlot(const LsColEntry &entry)
 {
+    // Entries below the direct children, only in recursive listings
+    bool nested = false;
+
     if (!_ignoredFirst) {
         // The first entry is for the folder itself, we should process it differently.
         _ignoredFirst = true;
-        if (map.contains("permissions")) {
-            RemotePermissions perm(map.value("permissions"));
-            emit firstDirectoryPermissions(perm);
-            _isExternalStorage = perm.hasPermission(RemotePermissions::IsMounted);
+        if (!entry.remotePerm.isNull()) {
+            emit firstDirectoryPermissions(entry.remotePerm);
+            _isExternalStorage = entry.remotePerm.hasPermission(RemotePermissions::IsMounted);
         }
-        if (map.contains("data-fingerprint")) {
-            _dataFingerprint = map.value("data-fingerprint").toUtf8();
+        if (entry.hasDataFingerprint) {
+            _dataFingerprint = entry.dataFingerprint;
             if (_dataFingerprint.isEmpty()) {
                 // Placeholder that means that the server supports the feature even if it did not set one.
                 _dataFingerprint = "[empty]";
             }
         }
+        _listingPathLength = _lsColJob->reply()->request().url().path().length();
     } else {
         // Remove <webDAV-Url>/folder/ from <webDAV-Url>/folder/subfile.txt
-        file.remove(0, _lsColJob->reply()->request().url().path().length());
+        QStringRef file = entry.href.midRef(_listingPathLength);
         // remove trailing slash
         while (file.endsWith('/')) {
             file.chop(1);
         }
         // remove leading slash
         while (file.startsWith('/')) {
-            file = file.remove(0, 1);
+            file = file.mid(1);
+        }
+
+        QString parent;
+        QStringRef name = file;
+        if (_recursive) {
+            const int slash = file.lastIndexOf('/');
+            if (slash != -1) {
+                parent = file.left(slash).toString();
+                name = file.mid(slash + 1);
+                nested = true;
+                _hasNestedEntries = true;
+            }
         }
 
         std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
-        file_stat->path = file.toUtf8();
-        file_stat->size = -1;
-        propertyMapToFileStat(map, file_stat.get());
+        file_stat->path = name.toUtf8();
+        entryToFileStat(entry, file_stat.get());
         if (file_stat->type == ItemTypeDirectory)
             file_stat->size = 0;
         if (file_stat->type == ItemTypeSkip
@@ -389,14 +382,29 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
             || file_stat->remotePerm.isNull()
             || file_stat->etag.isEmpty()
             || file_stat->file_id.isEmpty()) {
-            _error = tr("The server file discovery reply is missing data.");
+            // Only the listing of the directory containing the entry fails
+            const QString error = tr("The server file discovery reply is missing data.");
+            if (nested) {
+                _subdirErrors.insert(parent, error);
+            } else {
+                _error = error;
+            }
             qCWarning(lcDiscovery)
                 << "Missing properties:" << file << file_stat->type << file_stat->size
                 << file_stat->modtime << file_stat->remotePerm.toString()
                 << file_stat->etag << file_stat->file_id;
         }
 
-        if (_isExternalStorage && file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+        const bool inExternalStorage = nested ? _externalStorageSubdirs.contains(parent) : _isExternalStorage;
+        if (_recursive && file_stat->type == ItemTypeDirectory) {
+            // Same as _isExternalStorage when the directory is listed on its own
+            if (file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted))
+                _externalStorageSubdirs.insert(file.toString());
+            // an empty directory still has a listing
+            _subdirResults[file.toString()];
+        }
+
+        if (inExternalStorage && file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
             /* All the entries in a external storage have 'M' in their permission. However, for all
                purposes in the desktop client, we only need to know about the mount points.
                So replace the 'M' by a 'm' for every sub entries in an external storage */
@@ -404,26 +412,34 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
             file_stat->remotePerm.setPermission(RemotePermissions::IsMountedSub);
         }
 
-        QStringRef fileRef(&file);
-        int slashPos = file.lastIndexOf(QLatin1Char('/'));
-        if (slashPos > -1) {
-            fileRef = file.midRef(slashPos + 1);
+        if (nested) {
+            _subdirResults[parent].push_back(std::move(file_stat));
+        } else {
+            _results.push_back(std::move(file_stat));
         }
-        _results.push_back(std::move(file_stat));
     }
 
     //This works in concerto with the RequestEtagJob and the Folder object to check if the remote folder changed.
-    if (map.contains("getetag")) {
-        _etagConcatenation += map.value("getetag");
+    if (!entry.etag.isEmpty() && !nested) {
+        const QString etag = QString::fromUtf8(entry.etag);
+        _etagConcatenation += etag;
 
         if (_firstEtag.isEmpty()) {
-            _firstEtag = map.value("getetag"); // for directory itself
+            _firstEtag = etag; // for directory itself
         }
     }
 }
 
 void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
 {
+    if (_recursive && !_hasNestedEntries) {
+        // Either there is nothing below the children or the server treated the
+        // request like Depth: 1. The subdirectories must be listed on their own.
+        qCInfo(lcDiscovery) << "The recursive listing of" << _subPath << "only contains its direct children";
+        _subdirResults.clear();
+        _subdirErrors.clear();
+    }
+
     if (!_ignoredFirst) {
         // This is a sanity check, if we haven't _ignoredFirst then it means we never received any directoryListingIteratedSlot
         // which means somehow the server XML was bogus
@@ -492,10 +508,37 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
 
     _discoveryJob->update_job_update_callback(/*local=*/false, subPath.toUtf8(), _discoveryJob);
 
+    if (_firstFolderProcessed) {
+        // Already part of the recursive listing of the root?
+        auto error = _subdirErrors.constFind(subPath);
+        auto listing = _subdirListings.find(subPath);
+        if (error != _subdirErrors.constEnd() || listing != _subdirListings.end()) {
+            r->path = fullPath;
+            if (error != _subdirErrors.constEnd()) {
+                r->code = ERRNO_WRONG_CONTENT;
+                r->msg = *error;
+            } else {
+                r->list = std::move(listing->second);
+                r->code = 0;
+            }
+            if (listing != _subdirListings.end())
+                _subdirListings.erase(listing);
+
+            QMutexLocker locker(&_discoveryJob->_vioMutex);
+            _discoveryJob->_vioWaitCondition.wakeAll();
+            return;
+        }
+    }
+
     // Result gets written in there
     _currentDiscoveryDirectoryResult = r;
     _currentDiscoveryDirectoryResult->path = fullPath;
 
+    startSingleDirectoryJob(fullPath);
+}
+
+void DiscoveryMainThread::startSingleDirectoryJob(const QString &fullPath)
+{
     // Schedule the DiscoverySingleDirectoryJob
     _singleDirJob = new DiscoverySingleDirectoryJob(_account, fullPath, this);
     QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithResult,
@@ -511,6 +554,8 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
 
     if (!_firstFolderProcessed) {
         _singleDirJob->setIsRootPath();
+        if (_bulkListing)
+            _singleDirJob->setRecursive();
     }
 
     _singleDirJob->start();
@@ -533,6 +578,11 @@ void DiscoveryMainThread::singleDirectoryJobResultSlot()
     if (!_firstFolderProcessed) {
         _firstFolderProcessed = true;
         _dataFingerprint = _singleDirJob->_dataFingerprint;
+        if (_bulkListing) {
+            _subdirListings = _singleDirJob->takeSubdirectoryResults();
+            _subdirErrors = _singleDirJob->subdirectoryErrors();
+            qCInfo(lcDiscovery) << "Listed" << _subdirListings.size() << "subdirectories with the root";
+        }
     }
 
     _discoveryJob->_vioMutex.lock();
@@ -547,6 +597,14 @@ void DiscoveryMainThread::singleDirectoryJobFinishedWithErrorSlot(int csyncErrno
     }
     qCDebug(lcDiscovery) << csyncErrnoCode << msg;
 
+    if (!_firstFolderProcessed && _bulkListing) {
+        // The server may refuse Depth: infinity, list the root on its own
+        qCInfo(lcDiscovery) << "Recursive listing failed, listing directories one by one";
+        _bulkListing = false;
+        startSingleDirectoryJob(_currentDiscoveryDirectoryResult->path);
+        return;
+    }
+
     _currentDiscoveryDirectoryResult->code = csyncErrnoCode;
     _currentDiscoveryDirectoryResult->msg = msg;
     _currentDiscoveryDirectoryResult = 0; // the sync thread owns it now
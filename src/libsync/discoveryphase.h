@@ -23,7 +23,9 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QLinkedList>
+#include <QSet>
 #include <deque>
+#include <map>
 #include "syncoptions.h"
 
 namespace OCC {
@@ -62,10 +64,28 @@ public:
     explicit DiscoverySingleDirectoryJob(const AccountPtr &account, const QString &path, QObject *parent = 0);
     // Specify thgat this is the root and we need to check the data-fingerprint
     void setIsRootPath() { _isRootPath = true; }
+    /**
+     * List the whole subtree with a Depth: infinity PROPFIND.
+     *
+     * takeResults() still only has the direct children, the listings of the
+     * subdirectories are in takeSubdirectoryResults().
+     */
+    void setRecursive() { _recursive = true; }
     void start();
     void abort();
     std::deque<std::unique_ptr<csync_file_stat_t>> &&takeResults() { return std::move(_results); }
 
+    /**
+     * Listings of the subdirectories of a recursive job, by path relative to
+     * the listed directory.
+     *
+     * Empty if the server answered the recursive request with the direct
+     * children only.
+     */
+    std::map<QString, std::deque<std::unique_ptr<csync_file_stat_t>>> &&takeSubdirectoryResults() { return std::move(_subdirResults); }
+    /// Subdirectories whose listing is unusable, with the error message
+    QHash<QString, QString> subdirectoryErrors() const { return _subdirErrors; }
+
     // This is not actually a network job, it is just a job
 signals:
     void firstDirectoryPermissions(RemotePermissions);
@@ -74,7 +94,7 @@ signals:
     void finishedWithResult();
     void finishedWithError(int csyncErrnoCode, const QString &msg);
 private slots:
-    void directoryListingIteratedSlot(QString, const QMap<QString, QString> &);
+    void directoryListingEntrySlot(const LsColEntry &entry);
     void lsJobFinishedWithoutErrorSlot();
     void lsJobFinishedWithErrorSlot(QNetworkReply *);
 
@@ -91,6 +111,16 @@ private:
     bool _isRootPath;
     // If this directory is an external storage (The first item has 'M' in its permission)
     bool _isExternalStorage;
+    // Set by setRecursive()
+    bool _recursive = false;
+    // Subdirectories that are external storages, for recursive jobs
+    QSet<QString> _externalStorageSubdirs;
+    std::map<QString, std::deque<std::unique_ptr<csync_file_stat_t>>> _subdirResults;
+    QHash<QString, QString> _subdirErrors;
+    // Whether the reply of a recursive job contained anything below the direct children
+    bool _hasNestedEntries = false;
+    // Length of the path of the listed folder in the hrefs of the reply
+    int _listingPathLength = 0;
     // If set, the discovery will finish with an error
     QString _error;
     QPointer<LsColJob> _lsColJob;
@@ -112,6 +142,12 @@ class DiscoveryMainThread : public QObject
     DiscoveryDirectoryResult *_currentDiscoveryDirectoryResult;
     qint64 *_currentGetSizeResult;
     bool _firstFolderProcessed;
+    bool _bulkListing = false;
+    // Filled by the recursive listing of the root, consumed by doOpendirSlot()
+    std::map<QString, std::deque<std::unique_ptr<csync_file_stat_t>>> _subdirListings;
+    QHash<QString, QString> _subdirErrors;
+
+    void startSingleDirectoryJob(const QString &fullPath);
 
 public:
     DiscoveryMainThread(AccountPtr account)
@@ -124,6 +160,14 @@ public:
     }
     void abort();
 
+    /**
+     * List the whole remote tree with one request when the root is opened
+     * and answer the opendir of the subdirectories from that listing.
+     *
+     * If the server refuses, the root is listed again the usual way.
+     */
+    void setBulkListing(bool bulk) { _bulkListing = bulk; }
+
     QByteArray _dataFingerprint;
 
 
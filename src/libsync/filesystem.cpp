@@ -15,8 +15,30 @@
 #include "filesystem.h"
 
 #include "common/utility.h"
+#include <QDir>
+#include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <deque>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/falloc.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#endif
 
 // We use some internals of csync:
 extern "C" int c_utimes(const char *, const struct timeval *);
@@ -139,4 +161,355 @@ qint64 FileSystem::getSize(const QString &filename)
 }
 
 
+namespace {
+
+    /// Passes the results of removeRecursively() on, one at a time
+    class RemoveReporter
+    {
+    public:
+        RemoveReporter(const std::function<void(const QString &, bool)> &onDeleted,
+            const std::function<void(const QString &, bool, const QString &)> &onError)
+            : _onDeleted(onDeleted)
+            , _onError(onError)
+        {
+        }
+
+        void deleted(const QString &path, bool isDir)
+        {
+            if (!_onDeleted)
+                return;
+            QMutexLocker locker(&_mutex);
+            _onDeleted(path, isDir);
+        }
+
+        void failed(const QString &path, bool isDir, const QString &error)
+        {
+            qCWarning(lcFileSystem) << "Error removing" << path << ':' << error;
+            if (!_onError)
+                return;
+            QMutexLocker locker(&_mutex);
+            _onError(path, isDir, error);
+        }
+
+    private:
+        const std::function<void(const QString &, bool)> &_onDeleted;
+        const std::function<void(const QString &, bool, const QString &)> &_onError;
+        QMutex _mutex;
+    };
+
+    QString childPath(const QString &path, const QString &name)
+    {
+        return path.isEmpty() ? name : path + QLatin1Char('/') + name;
+    }
+
+#ifdef Q_OS_UNIX
+
+    class RemoveRunnable : public QRunnable
+    {
+    public:
+        explicit RemoveRunnable(const std::function<void()> &function)
+            : _function(function)
+        {
+        }
+        void run() Q_DECL_OVERRIDE { _function(); }
+
+    private:
+        std::function<void()> _function;
+    };
+
+    struct RemovedEntry
+    {
+        QByteArray name;
+        bool isDir;
+    };
+
+    /**
+     * Removes a tree with unlinkat() relative to the file descriptors of its
+     * directories.
+     *
+     * The calling thread opens the top levels of the tree until it has found
+     * enough subdirectories to keep the thread pool busy. Each of them is
+     * removed by one thread of the pool, the top levels are then removed
+     * bottom up by the calling thread.
+     */
+    class TreeRemover
+    {
+    public:
+        explicit TreeRemover(RemoveReporter *reporter)
+            : _reporter(reporter)
+        {
+        }
+
+        bool removeTree(const QString &path)
+        {
+            // Directories of the top levels, kept open until their subdirectories are gone
+            struct OpenDirectory
+            {
+                OpenDirectory *parent;
+                QByteArray name; // the full path for the root
+                QString path;
+                int fd;
+                bool ok;
+                QVector<RemovedEntry> removed;
+            };
+            std::deque<OpenDirectory> opened;
+            QVector<QPair<OpenDirectory *, QByteArray>> pending;
+            pending.append(qMakePair(static_cast<OpenDirectory *>(nullptr), QFile::encodeName(path)));
+
+            QThreadPool pool;
+            pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 8));
+
+            for (int depth = 0; !pending.isEmpty() && pending.size() < pool.maxThreadCount() && depth < 4; ++depth) {
+                const auto level = pending;
+                pending.clear();
+                for (const auto &entry : level) {
+                    OpenDirectory *parent = entry.first;
+                    opened.push_back(OpenDirectory{ parent, entry.second,
+                        parent ? childPath(parent->path, QFile::decodeName(entry.second)) : QString(), -1, false, {} });
+                    OpenDirectory &dir = opened.back();
+                    dir.fd = openDirectory(parent ? parent->fd : AT_FDCWD, dir.name, dir.path, parent != nullptr);
+                    if (dir.fd == -1)
+                        continue;
+                    QVector<QByteArray> subdirs;
+                    dir.ok = removeEntries(dir.fd, dir.path, &dir.removed, &subdirs);
+                    for (const auto &subdir : subdirs)
+                        pending.append(qMakePair(&dir, subdir));
+                }
+            }
+
+            for (const auto &entry : pending) {
+                OpenDirectory *parent = entry.first;
+                const QByteArray name = entry.second;
+                pool.start(new RemoveRunnable([this, parent, name] {
+                    bool ok = removeDirectory(parent->fd, name, childPath(parent->path, QFile::decodeName(name)));
+                    QMutexLocker locker(&_mutex);
+                    if (ok) {
+                        parent->removed.append(RemovedEntry{ name, true });
+                    } else {
+                        parent->ok = false;
+                    }
+                }));
+            }
+            pool.waitForDone();
+
+            // Children were opened after their parents
+            bool success = false;
+            for (auto it = opened.rbegin(); it != opened.rend(); ++it) {
+                bool ok = false;
+                if (it->fd != -1) {
+                    ::close(it->fd);
+                    ok = finishDirectory(it->parent ? it->parent->fd : AT_FDCWD, it->name, it->path, it->ok, it->removed);
+                }
+                if (!it->parent) {
+                    success = ok;
+                } else if (ok) {
+                    it->parent->removed.append(RemovedEntry{ it->name, true });
+                } else {
+                    it->parent->ok = false;
+                }
+            }
+            return success;
+        }
+
+    private:
+        /// Removes the directory \a name in \a parentFd with everything in it
+        bool removeDirectory(int parentFd, const QByteArray &name, const QString &path)
+        {
+            int fd = openDirectory(parentFd, name, path, true);
+            if (fd == -1)
+                return false;
+            QVector<RemovedEntry> removed;
+            bool ok = removeEntries(fd, path, &removed, nullptr);
+            ::close(fd);
+            return finishDirectory(parentFd, name, path, ok, removed);
+        }
+
+        int openDirectory(int parentFd, const QByteArray &name, const QString &path, bool noFollow)
+        {
+            int fd = ::openat(parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (noFollow ? O_NOFOLLOW : 0));
+            if (fd == -1)
+                _reporter->failed(path, true, qt_error_string(errno));
+            return fd;
+        }
+
+        /**
+         * Unlinks the entries of the directory \a fd. Subdirectories are appended
+         * to \a subdirs if it is set, otherwise they are removed as well.
+         */
+        bool removeEntries(int fd, const QString &path, QVector<RemovedEntry> *removed, QVector<QByteArray> *subdirs)
+        {
+            // fdopendir() takes over the descriptor, \a fd stays open for unlinkat()
+            int dirFd = ::dup(fd);
+            DIR *dir = dirFd != -1 ? ::fdopendir(dirFd) : nullptr;
+            if (!dir) {
+                _reporter->failed(path, true, qt_error_string(errno));
+                if (dirFd != -1)
+                    ::close(dirFd);
+                return false;
+            }
+
+            // Read the whole listing first, the directory changes while we remove
+            QVector<RemovedEntry> entries;
+            errno = 0;
+            while (struct dirent *dirent = ::readdir(dir)) {
+                if (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0)
+                    continue;
+                bool isDir = dirent->d_type == DT_DIR;
+                if (dirent->d_type == DT_UNKNOWN) {
+                    struct stat sb;
+                    isDir = ::fstatat(fd, dirent->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sb.st_mode);
+                }
+                entries.append(RemovedEntry{ QByteArray(dirent->d_name), isDir });
+            }
+            bool ok = true;
+            if (errno != 0) {
+                _reporter->failed(path, true, qt_error_string(errno));
+                ok = false;
+            }
+            ::closedir(dir);
+
+            for (const auto &entry : entries) {
+                const QString entryPath = childPath(path, QFile::decodeName(entry.name));
+                if (entry.isDir) {
+                    if (subdirs) {
+                        subdirs->append(entry.name);
+                        continue;
+                    }
+                    if (!removeDirectory(fd, entry.name, entryPath)) {
+                        ok = false;
+                        continue;
+                    }
+                } else if (::unlinkat(fd, entry.name.constData(), 0) != 0) {
+                    _reporter->failed(entryPath, false, qt_error_string(errno));
+                    ok = false;
+                    continue;
+                }
+                removed->append(entry);
+            }
+            return ok;
+        }
+
+        /**
+         * Removes the emptied directory \a name. If it stays, the entries
+         * that were removed from it are reported.
+         */
+        bool finishDirectory(int parentFd, const QByteArray &name, const QString &path, bool ok, const QVector<RemovedEntry> &removed)
+        {
+            if (ok && ::unlinkat(parentFd, name.constData(), AT_REMOVEDIR) != 0) {
+                _reporter->failed(path, true, qt_error_string(errno));
+                ok = false;
+            }
+            if (!ok) {
+                for (const auto &entry : removed)
+                    _reporter->deleted(childPath(path, QFile::decodeName(entry.name)), entry.isDir);
+            }
+            return ok;
+        }
+
+        RemoveReporter *_reporter;
+        QMutex _mutex;
+    };
+
+#else
+
+    /**
+     * Code inspired from Qt5's QDir::removeRecursively
+     *
+     * \a path is the path of \a absolute relative to the removed tree.
+     */
+    bool removeDirectoryWithIterator(const QString &absolute, const QString &path, RemoveReporter *reporter)
+    {
+        QDirIterator di(absolute, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+        QVector<QPair<QString, bool>> removed;
+        bool ok = true;
+
+        while (di.hasNext()) {
+            di.next();
+            const QFileInfo &fi = di.fileInfo();
+            const QString entryPath = childPath(path, di.fileName());
+            // The use of isSymLink here is okay:
+            // we never want to go into this branch for .lnk files
+            bool isDir = fi.isDir() && !fi.isSymLink() && !FileSystem::isJunction(fi.absoluteFilePath());
+            if (isDir) {
+                if (!removeDirectoryWithIterator(di.filePath(), entryPath, reporter)) {
+                    ok = false;
+                    continue;
+                }
+            } else {
+                QString removeError;
+                if (!FileSystem::remove(di.filePath(), &removeError)) {
+                    reporter->failed(entryPath, false, removeError);
+                    ok = false;
+                    continue;
+                }
+            }
+            removed.append(qMakePair(entryPath, isDir));
+        }
+        if (ok && !QDir().rmdir(absolute)) {
+            reporter->failed(path, true, QString());
+            ok = false;
+        }
+        if (!ok) {
+            for (const auto &entry : removed)
+                reporter->deleted(entry.first, entry.second);
+        }
+        return ok;
+    }
+
+#endif
+
+} // anonymous namespace
+
+bool FileSystem::removeRecursively(const QString &path,
+    const std::function<void(const QString &path, bool isDir)> &onDeleted,
+    const std::function<void(const QString &path, bool isDir, const QString &error)> &onError)
+{
+    RemoveReporter reporter(onDeleted, onError);
+#ifdef Q_OS_UNIX
+    return TreeRemover(&reporter).removeTree(path);
+#else
+    return removeDirectoryWithIterator(path, QString(), &reporter);
+#endif
+}
+
+void FileSystem::preallocate(QFile &file, qint64 size)
+{
+    const qint64 current = file.size();
+    if (size <= current || file.handle() < 0)
+        return;
+
+#if defined(Q_OS_LINUX)
+    if (fallocate(file.handle(), FALLOC_FL_KEEP_SIZE, current, size - current) != 0) {
+        qCDebug(lcFileSystem) << "Could not preallocate" << file.fileName() << qt_error_string(errno);
+    }
+#elif defined(Q_OS_MAC)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, size - current, 0 };
+    if (fcntl(file.handle(), F_PREALLOCATE, &store) == -1) {
+        // Contiguous space is only preferred
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(file.handle(), F_PREALLOCATE, &store) == -1)
+            qCDebug(lcFileSystem) << "Could not preallocate" << file.fileName() << qt_error_string(errno);
+    }
+#elif defined(Q_OS_WIN)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+    if (!SetFileInformationByHandle(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle())),
+            FileAllocationInfo, &info, sizeof(info))) {
+        qCDebug(lcFileSystem) << "Could not preallocate" << file.fileName() << qt_error_string(GetLastError());
+    }
+#endif
+}
+
+void FileSystem::startWriteBack(QFile &file, qint64 offset, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    if (file.handle() >= 0)
+        sync_file_range(file.handle(), offset, size, SYNC_FILE_RANGE_WRITE);
+#else
+    Q_UNUSED(file)
+    Q_UNUSED(offset)
+    Q_UNUSED(size)
+#endif
+}
+
 } // namespace OCC
@@ -18,6 +18,7 @@
 
 #include <QString>
 #include <ctime>
+#include <functional>
 
 #include <owncloudlib.h>
 // Chain in the base include and extend the namespace
@@ -77,6 +78,39 @@ namespace FileSystem {
     bool verifyFileUnchanged(const QString &fileName,
         qint64 previousSize,
         time_t previousMtime);
+
+    /**
+ * @brief Removes the directory \a path and everything below it
+ *
+ * On unix the entries are removed relative to directory file descriptors and
+ * the subdirectories are spread over a few threads.
+ *
+ * Removal goes on after an error. \a onDeleted is called with the path relative
+ * to \a path of every entry that was removed while its parent directory stays,
+ * so a subtree that is gone completely is reported once. \a onError is called for
+ * every entry that could not be removed, a directory that still has children is
+ * not reported. The callbacks may come from other threads, but one at a time.
+ *
+ * @return true if \a path is gone.
+ */
+    bool OWNCLOUDSYNC_EXPORT removeRecursively(const QString &path,
+        const std::function<void(const QString &path, bool isDir)> &onDeleted,
+        const std::function<void(const QString &path, bool isDir, const QString &error)> &onError);
+
+    /**
+ * @brief Reserves disk space for the open \a file to grow to \a size bytes
+ *
+ * The size of the file doesn't change, appending fills the reserved space.
+ * Only a hint: does nothing where it isn't supported.
+ */
+    void OWNCLOUDSYNC_EXPORT preallocate(QFile &file, qint64 size);
+
+    /**
+ * @brief Starts writing a range of the open \a file to disk, without waiting
+ *
+ * Only does something on Linux.
+ */
+    void OWNCLOUDSYNC_EXPORT startWriteBack(QFile &file, qint64 offset, qint64 size);
 }
 
 /** @} */
@@ -30,12 +30,15 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QPainter>
+#include <QMetaMethod>
 
 #include "networkjobs.h"
 #include "account.h"
 #include "owncloudpropagator.h"
 #include "clientsideencryption.h"
 
+#include "csync.h"
+
 #include "creds/abstractcredentials.h"
 #include "creds/httpcredentials.h"
 
@@ -115,6 +118,93 @@ bool RequestEtagJob::finished()
 
 /*********************************************************************************************/
 
+static QString stripSlashes(const QString &path)
+{
+    int begin = 0;
+    int end = path.size();
+    while (begin < end && path.at(begin) == QLatin1Char('/'))
+        ++begin;
+    while (end > begin && path.at(end - 1) == QLatin1Char('/'))
+        --end;
+    return path.mid(begin, end - begin);
+}
+
+BatchEtagJob::BatchEtagJob(AccountPtr account, const QStringList &paths, QObject *parent)
+    : AbstractNetworkJob(account, parentPath(paths.value(0)), parent)
+    , _paths(paths)
+{
+}
+
+QString BatchEtagJob::parentPath(const QString &path)
+{
+    const QString stripped = stripSlashes(path);
+    const int slash = stripped.lastIndexOf(QLatin1Char('/'));
+    return slash < 0 ? QString() : stripped.left(slash);
+}
+
+void BatchEtagJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("Depth", "1");
+
+    QByteArray xml("<?xml version=\"1.0\" ?>\n"
+                   "<d:propfind xmlns:d=\"DAV:\">\n"
+                   "  <d:prop>\n"
+                   "    <d:getetag/>\n"
+                   "  </d:prop>\n"
+                   "</d:propfind>\n");
+    QBuffer *buf = new QBuffer(this);
+    buf->setData(xml);
+    buf->open(QIODevice::ReadOnly);
+    // assumes ownership
+    sendRequest("PROPFIND", makeDavUrl(path()), req, buf);
+
+    if (reply()->error() != QNetworkReply::NoError) {
+        qCWarning(lcEtagJob) << "request network error: " << reply()->errorString();
+    }
+    AbstractNetworkJob::start();
+}
+
+bool BatchEtagJob::finished()
+{
+    qCInfo(lcEtagJob) << "Request Etags of" << _paths.size() << "folders in" << reply()->request().url()
+                      << "FINISHED WITH STATUS" << replyStatusString();
+
+    if (reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute) != 207) {
+        emit finishedWithError(reply());
+        return true;
+    }
+
+    // the hrefs in the listing are relative to the parent, map them back to the requested paths
+    QHash<QString, QString> pathsByName;
+    for (const QString &path : _paths) {
+        const QString stripped = stripSlashes(path);
+        pathsByName.insert(stripped.mid(stripped.lastIndexOf(QLatin1Char('/')) + 1), path);
+    }
+
+    QString expectedPath = reply()->request().url().path();
+    if (!expectedPath.endsWith(QLatin1Char('/')))
+        expectedPath += QLatin1Char('/');
+
+    QHash<QString, QString> etags;
+    LsColXMLParser parser;
+    connect(&parser, &LsColXMLParser::directoryListingIterated,
+        [&](const QString &href, const QMap<QString, QString> &properties) {
+            // the entry of the parent itself has no name and is skipped
+            auto it = pathsByName.constFind(href.mid(expectedPath.size()));
+            if (it != pathsByName.constEnd() && properties.contains(QLatin1String("getetag")))
+                etags.insert(it.value(), properties.value(QLatin1String("getetag")));
+        });
+    if (!parser.parse(reply()->readAll(), nullptr, expectedPath.left(expectedPath.size() - 1))) {
+        emit finishedWithError(reply());
+        return true;
+    }
+    emit etagsRetreived(etags);
+    return true;
+}
+
+/*********************************************************************************************/
+
 MkColJob::MkColJob(AccountPtr account, const QString &path, QObject *parent)
     : AbstractNetworkJob(account, path, parent)
 {
@@ -156,136 +246,271 @@ bool MkColJob::finished()
 }
 
 /*********************************************************************************************/
-// supposed to read <D:collection> when pointing to <D:resourcetype><D:collection></D:resourcetype>..
-static QString readContentsAsString(QXmlStreamReader &reader)
-{
-    QString result;
-    int level = 0;
-    do {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        if (type == QXmlStreamReader::StartElement) {
-            level++;
-            result += "<" + reader.name().toString() + ">";
-        } else if (type == QXmlStreamReader::Characters) {
-            result += reader.text();
-        } else if (type == QXmlStreamReader::EndElement) {
-            level--;
-            if (level < 0) {
-                break;
-            }
-            result += "</" + reader.name().toString() + ">";
-        }
 
-    } while (!reader.atEnd());
-    return result;
+LsColXMLParser::LsColXMLParser()
+{
 }
 
+bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
+{
+    start(fileInfo, expectedPath);
+    return addData(xml) && finish();
+}
 
-LsColXMLParser::LsColXMLParser()
+void LsColXMLParser::start(QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
 {
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _fileInfo = fileInfo;
+    _expectedPath = expectedPath;
+    _folders.clear();
+    _insideMultiStatus = false;
+    // Building a QMap per entry is expensive, skip it if nobody is interested
+    _emitPropertyMaps = isSignalConnected(QMetaMethod::fromSignal(&LsColXMLParser::directoryListingIterated));
 }
 
-bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
+bool LsColXMLParser::addData(const QByteArray &data)
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
-
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
-
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
-        // Start elements with DAV:
-        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
-            if (name == QLatin1String("href")) {
-                // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
-                // but the result will have URL encoding..
-                QString hrefString = QString::fromUtf8(QByteArray::fromPercentEncoding(reader.readElementText().toUtf8()));
-                if (!hrefString.startsWith(expectedPath)) {
-                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
-                    return false;
-                }
-                currentHref = hrefString;
-            } else if (name == QLatin1String("response")) {
-            } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
-                if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
-                } else {
-                    currentPropsHaveHttp200 = false;
-                }
-            } else if (name == QLatin1String("prop")) {
-                insideProp = true;
-                continue;
-            } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
-                continue;
-            }
+    _reader.addData(data);
+    return parseAvailable();
+}
+
+bool LsColXMLParser::finish()
+{
+    if (_reader.hasError()) {
+        // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString() << "at line" << _reader.lineNumber();
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcLsColJob) << "ERROR no WebDAV response?";
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
+}
+
+bool LsColXMLParser::parseAvailable()
+{
+    while (!_reader.atEnd()) {
+        switch (_reader.readNext()) {
+        case QXmlStreamReader::StartElement:
+            startElement();
+            break;
+        case QXmlStreamReader::Characters:
+            if (_insideHref || _insideStatus || _propertyDepth > 0)
+                _text += _reader.text();
+            break;
+        case QXmlStreamReader::EndElement:
+            endElement();
+            break;
+        default:
+            break;
         }
+        if (_reader.hasError() && _reader.error() != QXmlStreamReader::PrematureEndOfDocumentError)
+            return false;
+    }
+    // PrematureEndOfDocumentError only means that more data is needed
+    return !_reader.hasError() || _reader.error() == QXmlStreamReader::PrematureEndOfDocumentError;
+}
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
-            // All those elements are properties
-            QString propertyContent = readContentsAsString(reader);
-            if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
-            } else if (name == QLatin1String("size")) {
-                bool ok = false;
-                auto s = propertyContent.toLongLong(&ok);
-                if (ok && fileInfo) {
-                    (*fileInfo)[currentHref].size = s;
-                }
-            } else if (name == QLatin1String("fileid")) {
-                (*fileInfo)[currentHref].fileId = propertyContent.toUtf8();
-            }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
+QString LsColXMLParser::internedName(const QStringRef &name)
+{
+    for (const QString &known : _propertyNames) {
+        if (known == name)
+            return known;
+    }
+    _propertyNames.append(name.toString());
+    return _propertyNames.last();
+}
+
+void LsColXMLParser::startElement()
+{
+    const QStringRef name = _reader.name();
+
+    if (_propertyDepth > 0) {
+        // supposed to read <D:collection> when pointing to <D:resourcetype><D:collection></D:resourcetype>..
+        ++_propertyDepth;
+        _text += QLatin1Char('<');
+        _text += name;
+        _text += QLatin1Char('>');
+        return;
+    }
+
+    // Start elements with DAV:
+    if (_reader.namespaceUri() == QLatin1String("DAV:")) {
+        if (name == QLatin1String("href")) {
+            _insideHref = true;
+            _text.clear();
+            return;
+        } else if (name == QLatin1String("response")) {
+        } else if (name == QLatin1String("propstat")) {
+            _insidePropstat = true;
+        } else if (name == QLatin1String("status") && _insidePropstat) {
+            _insideStatus = true;
+            _text.clear();
+            return;
+        } else if (name == QLatin1String("prop")) {
+            _insideProp = true;
+            return;
+        } else if (name == QLatin1String("multistatus")) {
+            _insideMultiStatus = true;
+            return;
         }
+    }
 
-        // End elements with DAV:
-        if (type == QXmlStreamReader::EndElement) {
-            if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
-                    }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString, QString>(currentTmpProperties);
-                    }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
-                }
+    if (_insidePropstat && _insideProp) {
+        // All those elements are properties
+        static const struct
+        {
+            const char *name;
+            Property property;
+        } knownProperties[] = {
+            { "resourcetype", ResourceType },
+            { "getlastmodified", GetLastModified },
+            { "getcontentlength", GetContentLength },
+            { "getetag", GetEtag },
+            { "id", Id },
+            { "downloadURL", DownloadUrl },
+            { "dDC", DDC },
+            { "permissions", Permissions },
+            { "checksums", Checksums },
+            { "share-types", ShareTypes },
+            { "data-fingerprint", DataFingerprint },
+            { "size", Size },
+            { "fileid", FileId },
+        };
+        _property = OtherProperty;
+        for (const auto &known : knownProperties) {
+            if (name == QLatin1String(known.name)) {
+                _property = known.property;
+                break;
             }
         }
+        if (_emitPropertyMaps)
+            _propertyName = internedName(name);
+        _propertyDepth = 1;
+        _text.clear();
     }
+}
 
-    if (reader.hasError()) {
-        // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qCWarning(lcLsColJob) << "ERROR" << reader.errorString() << xml;
-        return false;
-    } else if (!insideMultiStatus) {
-        qCWarning(lcLsColJob) << "ERROR no WebDAV response?" << xml;
-        return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
+void LsColXMLParser::endElement()
+{
+    if (_propertyDepth > 0) {
+        if (--_propertyDepth > 0) {
+            _text += QLatin1String("</");
+            _text += _reader.name();
+            _text += QLatin1Char('>');
+        } else {
+            endProperty();
+        }
+        return;
+    }
+
+    // End elements with DAV:
+    if (_reader.namespaceUri() != QLatin1String("DAV:"))
+        return;
+    const QStringRef name = _reader.name();
+    if (name == QLatin1String("href") && _insideHref) {
+        _insideHref = false;
+        // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
+        // but the result will have URL encoding..
+        _currentHref = QString::fromUtf8(QByteArray::fromPercentEncoding(_text.toUtf8()));
+        if (!_currentHref.startsWith(_expectedPath)) {
+            qCWarning(lcLsColJob) << "Invalid href" << _currentHref << "expected starting with" << _expectedPath;
+            _reader.raiseError(QStringLiteral("Invalid href"));
+        }
+    } else if (name == QLatin1String("status") && _insideStatus) {
+        _insideStatus = false;
+        _currentPropsHaveHttp200 = _text.startsWith(QLatin1String("HTTP/1.1 200"));
+    } else if (name == QLatin1String("response")) {
+        if (_currentHref.endsWith(QLatin1Char('/'))) {
+            _currentHref.chop(1);
+        }
+        _entry.href = _currentHref;
+        emit directoryListingEntry(_entry);
+        if (_emitPropertyMaps)
+            emit directoryListingIterated(_currentHref, _propertyMap);
+        _currentHref.clear();
+        _entry = LsColEntry();
+        _propertyMap.clear();
+    } else if (name == QLatin1String("propstat")) {
+        _insidePropstat = false;
+        if (_currentPropsHaveHttp200) {
+            _entry = std::move(_pendingEntry);
+            _propertyMap = std::move(_pendingPropertyMap);
+        }
+        _pendingEntry = LsColEntry();
+        _pendingPropertyMap.clear();
+        _currentPropsHaveHttp200 = false;
+    } else if (name == QLatin1String("prop")) {
+        _insideProp = false;
     }
-    return true;
+}
+
+void LsColXMLParser::endProperty()
+{
+    LsColEntry &entry = _pendingEntry;
+    switch (_property) {
+    case ResourceType:
+        entry.hasResourceType = true;
+        entry.isCollection = _text.contains(QLatin1String("collection"));
+        if (entry.isCollection)
+            _folders.append(_currentHref);
+        break;
+    case GetLastModified:
+        entry.lastModified = oc_httpdate_parse(_text.toUtf8().constData());
+        break;
+    case GetContentLength: {
+        // See #4573, sometimes negative size values are returned
+        bool ok = false;
+        const qlonglong size = _text.toLongLong(&ok);
+        entry.contentLength = ok && size >= 0 ? size : 0;
+        break;
+    }
+    case GetEtag:
+        entry.etag = _text.toUtf8();
+        break;
+    case Id:
+        entry.fileId = _text.toUtf8();
+        break;
+    case DownloadUrl:
+        entry.directDownloadUrl = _text.toUtf8();
+        break;
+    case DDC:
+        entry.directDownloadCookies = _text.toUtf8();
+        break;
+    case Permissions:
+        entry.remotePerm = RemotePermissions(_text);
+        break;
+    case Checksums:
+        entry.checksums = _text.toUtf8();
+        break;
+    case ShareTypes:
+        entry.isShared = !_text.isEmpty();
+        break;
+    case DataFingerprint:
+        entry.hasDataFingerprint = true;
+        entry.dataFingerprint = _text.toUtf8();
+        break;
+    case Size: {
+        bool ok = false;
+        auto s = _text.toLongLong(&ok);
+        if (ok && _fileInfo) {
+            (*_fileInfo)[_currentHref].size = s;
+        }
+        break;
+    }
+    case FileId:
+        if (_fileInfo)
+            (*_fileInfo)[_currentHref].fileId = _text.toUtf8();
+        break;
+    case OtherProperty:
+        break;
+    }
+
+    if (_emitPropertyMaps)
+        _pendingPropertyMap.insert(_propertyName, _text);
 }
 
 /*********************************************************************************************/
@@ -334,7 +559,7 @@ void LsColJob::start()
     }
 
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", _depth);
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -351,9 +576,48 @@ void LsColJob::start()
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
+void LsColJob::newReplyHook(QNetworkReply *reply)
+{
+    // a redirect sends a new request, the listing is parsed from the last reply only
+    _parser.reset();
+    _parseError = false;
+    connect(reply, &QNetworkReply::readyRead, this, &LsColJob::slotReadyRead);
+}
+
+void LsColJob::slotReadyRead()
+{
+    if (_parseError)
+        return;
+
+    if (!_parser) {
+        QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
+        int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpCode != 207 || !contentType.contains("application/xml; charset=utf-8"))
+            return; // not a listing, handled in finished()
+
+        _parser.reset(new LsColXMLParser);
+        connect(_parser.data(), &LsColXMLParser::directoryListingSubfolders,
+            this, &LsColJob::directoryListingSubfolders);
+        connect(_parser.data(), &LsColXMLParser::directoryListingEntry,
+            this, &LsColJob::directoryListingEntry);
+        if (isSignalConnected(QMetaMethod::fromSignal(&LsColJob::directoryListingIterated))) {
+            connect(_parser.data(), &LsColXMLParser::directoryListingIterated,
+                this, &LsColJob::directoryListingIterated);
+        }
+        connect(_parser.data(), &LsColXMLParser::finishedWithError,
+            this, &LsColJob::finishedWithError);
+        connect(_parser.data(), &LsColXMLParser::finishedWithoutError,
+            this, &LsColJob::finishedWithoutError);
+
+        QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
+        _parser->start(&_folderInfos, expectedPath);
+    }
+
+    // the entries are parsed and emitted while the rest of the reply is still being received
+    if (!_parser->addData(reply()->readAll()))
+        _parseError = true;
+}
+
 bool LsColJob::finished()
 {
     qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
@@ -362,18 +626,9 @@ bool LsColJob::finished()
     QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
     int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
-        LsColXMLParser parser;
-        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
-            this, &LsColJob::directoryListingSubfolders);
-        connect(&parser, &LsColXMLParser::directoryListingIterated,
-            this, &LsColJob::directoryListingIterated);
-        connect(&parser, &LsColXMLParser::finishedWithError,
-            this, &LsColJob::finishedWithError);
-        connect(&parser, &LsColXMLParser::finishedWithoutError,
-            this, &LsColJob::finishedWithoutError);
-
-        QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
-        if (!parser.parse(reply()->readAll(), &_folderInfos, expectedPath)) {
+        // parse what has not been parsed yet
+        slotReadyRead();
+        if (_parseError || !_parser || !_parser->finish()) {
             // XML parse error
             emit finishedWithError(reply());
         }
@@ -18,8 +18,11 @@
 
 #include "abstractnetworkjob.h"
 
+#include "common/remotepermissions.h"
+
 #include <QBuffer>
 #include <QUrlQuery>
+#include <QXmlStreamReader>
 #include <functional>
 
 class QUrl;
@@ -72,7 +75,37 @@ struct ExtraFolderInfo {
 };
 
 /**
- * @brief The LsColJob class
+ * @brief One <d:response> of a PROPFIND reply, see LsColXMLParser
+ *
+ * Only the properties received with a "200 OK" status are set, the
+ * others keep their default value.
+ * @ingroup libsync
+ */
+struct OWNCLOUDSYNC_EXPORT LsColEntry
+{
+    QString href; // decoded, without trailing slash
+    bool hasResourceType = false;
+    bool isCollection = false;
+    qint64 contentLength = -1; // getcontentlength, 0 for a negative value (#4573)
+    time_t lastModified = 0;
+    QByteArray etag; // as sent by the server, not normalized
+    QByteArray fileId; // oc:id
+    RemotePermissions remotePerm;
+    QByteArray checksums; // oc:checksums, all checksums the server sent
+    bool isShared = false; // oc:share-types is not empty
+    QByteArray directDownloadUrl;
+    QByteArray directDownloadCookies;
+    bool hasDataFingerprint = false;
+    QByteArray dataFingerprint;
+};
+
+/**
+ * @brief The LsColXMLParser class parses a PROPFIND reply
+ *
+ * The reply can be passed in pieces as it arrives from the network with
+ * addData(), every complete <d:response> is emitted right away as a
+ * LsColEntry. The QMap of all properties emitted by directoryListingIterated
+ * is only built if that signal is connected.
  * @ingroup libsync
  */
 class OWNCLOUDSYNC_EXPORT LsColXMLParser : public QObject
@@ -81,15 +114,70 @@ class OWNCLOUDSYNC_EXPORT LsColXMLParser : public QObject
 public:
     explicit LsColXMLParser();
 
+    /** parses the complete reply @p xml, same as start(), addData() and finish() */
     bool parse(const QByteArray &xml,
                QHash<QString, ExtraFolderInfo> *sizes,
                const QString &expectedPath);
 
+    void start(QHash<QString, ExtraFolderInfo> *sizes, const QString &expectedPath);
+    /** returns false on a parse error, the parser must not be used anymore then */
+    bool addData(const QByteArray &data);
+    /** returns false if the reply was not a complete multistatus document */
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
+    void directoryListingEntry(const LsColEntry &entry);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
+
+private:
+    enum Property {
+        ResourceType,
+        GetLastModified,
+        GetContentLength,
+        GetEtag,
+        Id,
+        DownloadUrl,
+        DDC,
+        Permissions,
+        Checksums,
+        ShareTypes,
+        DataFingerprint,
+        Size,
+        FileId,
+        OtherProperty
+    };
+
+    bool parseAvailable();
+    void startElement();
+    void endElement();
+    void endProperty();
+    QString internedName(const QStringRef &name);
+
+    QXmlStreamReader _reader;
+    QHash<QString, ExtraFolderInfo> *_fileInfo = nullptr;
+    QString _expectedPath;
+    bool _emitPropertyMaps = false;
+    QVector<QString> _propertyNames; // interned keys of _propertyMap
+
+    QStringList _folders;
+    QString _currentHref;
+    QString _text; // text of the current href, status or property
+    LsColEntry _entry; // properties with a 200 status of the current response
+    LsColEntry _pendingEntry; // properties of the current propstat
+    QMap<QString, QString> _propertyMap;
+    QMap<QString, QString> _pendingPropertyMap;
+    Property _property = OtherProperty;
+    QString _propertyName; // only set if the property maps are emitted
+    int _propertyDepth = 0;
+    bool _insideHref = false;
+    bool _insideStatus = false;
+    bool _currentPropsHaveHttp200 = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _insideMultiStatus = false;
 };
 
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob
@@ -112,18 +200,36 @@ public:
     void setProperties(QList<QByteArray> properties);
     QList<QByteArray> properties() const;
 
+    /**
+     * The Depth header of the request, "1" by default.
+     *
+     * With "infinity" the whole subtree is listed in one reply, in the order
+     * the server walks it. Servers are free to refuse that or to silently
+     * treat it like "1".
+     */
+    void setDepth(const QByteArray &depth) { _depth = depth; }
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
+    void directoryListingEntry(const LsColEntry &entry);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
 
+protected:
+    void newReplyHook(QNetworkReply *reply) Q_DECL_OVERRIDE;
+
 private slots:
     virtual bool finished() Q_DECL_OVERRIDE;
+    void slotReadyRead();
 
 private:
     QList<QByteArray> _properties;
+    QByteArray _depth = "1";
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+    // parses the reply while it is received, created once the reply is known to be a listing
+    QScopedPointer<LsColXMLParser> _parser;
+    bool _parseError = false;
 };
 
 /**
@@ -339,6 +445,38 @@ private slots:
     virtual bool finished() Q_DECL_OVERRIDE;
 };
 
+/**
+ * @brief Queries the etags of several sibling folders with one request
+ *
+ * Does a Depth:1 PROPFIND on the common parent folder. For a server where the
+ * root etag changes with its contents (see Account::rootEtagChangesNotOnlySubFolderEtags())
+ * the etag of an entry in that listing equals the one a RequestEtagJob reports.
+ * Paths that are not in the listing are left out of the result, the caller
+ * should fall back to a RequestEtagJob for them.
+ */
+class OWNCLOUDSYNC_EXPORT BatchEtagJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    /** all @p paths must have the same parent folder */
+    explicit BatchEtagJob(AccountPtr account, const QStringList &paths, QObject *parent = 0);
+    void start() Q_DECL_OVERRIDE;
+
+    /** the parent folder of @p path, empty for the root */
+    static QString parentPath(const QString &path);
+
+signals:
+    /** etags keyed by the paths as passed to the constructor */
+    void etagsRetreived(const QHash<QString, QString> &etags);
+    void finishedWithError(QNetworkReply *reply);
+
+private slots:
+    virtual bool finished() Q_DECL_OVERRIDE;
+
+private:
+    QStringList _paths;
+};
+
 /**
  * @brief Job to check an API that return JSON
  *
@@ -471,4 +609,6 @@ void OWNCLOUDSYNC_EXPORT fetchPrivateLinkUrl(
 
 } // namespace OCC
 
+Q_DECLARE_METATYPE(OCC::LsColEntry)
+
 #endif // NETWORKJOBS_H
@@ -18,6 +18,7 @@
 #include "common/syncjournalfilerecord.h"
 #include "propagatedownload.h"
 #include "propagateupload.h"
+#include "propagateuploadencrypted.h"
 #include "propagateremotedelete.h"
 #include "propagateremotemove.h"
 #include "propagateremotemkdir.h"
@@ -73,8 +74,25 @@ qint64 freeSpaceLimit()
     return value;
 }
 
+/* Number of propagators per account between start() and destruction.
+ * Propagators of engines in worker threads use it from those threads. */
+static QHash<const Account *, int> runningPropagators;
+static QMutex runningPropagatorsMutex;
+
 OwncloudPropagator::~OwncloudPropagator()
 {
+    if (_countedAsRunning) {
+        QMutexLocker locker(&runningPropagatorsMutex);
+        auto it = runningPropagators.find(_account.data());
+        if (it != runningPropagators.end() && --it.value() <= 0)
+            runningPropagators.erase(it);
+    }
+}
+
+int OwncloudPropagator::runningPropagatorCount(const Account *account)
+{
+    QMutexLocker locker(&runningPropagatorsMutex);
+    return runningPropagators.value(account, 0);
 }
 
 
@@ -89,17 +107,51 @@ int OwncloudPropagator::maximumActiveTransferJob()
     return qMin(3, qCeil(hardMaximumActiveJob() / 2.));
 }
 
+bool OwncloudPropagator::serverCopySource(const QByteArray &checksumHeader, qint64 size, SyncJournalFileRecord *record)
+{
+    if (checksumHeader.isEmpty() || size < qint64(smallFileSize()))
+        return false;
+
+    // Files the propagator uploaded are in the journal too, later files of
+    // the same sync can be copied from them.
+    bool found = false;
+    _journal->getFileRecordsByChecksum(checksumHeader, [&](const SyncJournalFileRecord &rec) {
+        // The server has encrypted files in a different form
+        if (!found && rec._type == ItemTypeFile && rec._fileSize == size && !rec._fileId.isEmpty()
+            && !rec._etag.isEmpty() && rec._e2eMangledName.isEmpty()) {
+            *record = rec;
+            found = true;
+        }
+    });
+    return found;
+}
+
 /* The maximum number of active jobs in parallel  */
 int OwncloudPropagator::hardMaximumActiveJob()
 {
     if (!_syncOptions._parallelNetworkJobs)
         return 1;
     static int max = qgetenv("OWNCLOUD_MAX_PARALLEL").toUInt();
-    if (max)
-        return max;
-    if (_account->isHttp2Supported())
-        return 20;
-    return 6; // (Qt cannot do more anyway)
+    int budget = max;
+    if (!budget)
+        budget = _account->isHttp2Supported() ? 20 : 6; // (Qt cannot do more anyway)
+
+    // Folders of the same account share the connections of its access manager
+    int share = qMax(1, budget / qMax(1, runningPropagatorCount(_account.data())));
+
+    // and all folders share the budget of the process
+    int maximum = _maximumActiveJobs.load();
+    if (maximum > 0)
+        share = qMin(share, maximum);
+    return share;
+}
+
+EncryptedFolderBatch *OwncloudPropagator::encryptedFolderBatch(const QString &folder)
+{
+    auto &batch = _encryptedFolderBatches[folder];
+    if (!batch)
+        batch = new EncryptedFolderBatch(this, folder);
+    return batch;
 }
 
 PropagateItemJob::~PropagateItemJob()
@@ -369,6 +421,12 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
 {
     Q_ASSERT(std::is_sorted(items.begin(), items.end()));
 
+    if (!_countedAsRunning) {
+        _countedAsRunning = true;
+        QMutexLocker locker(&runningPropagatorsMutex);
+        ++runningPropagators[_account.data()];
+    }
+
     /* This builds all the jobs needed for the propagation.
      * Each directory is a PropagateDirectory job, which contains the files in it.
      * In order to do that we loop over the items. (which are sorted by destination)
@@ -380,6 +438,8 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
     QVector<PropagatorJob *> directoriesToRemove;
     QString removedDirectory;
     QString maybeConflictDirectory;
+    // Uploads into an encrypted folder share one metadata update, see uploadCount()
+    const bool countUploads = _account->capabilities().clientSideEncryptionAvaliable();
     foreach (const SyncFileItemPtr &item, items) {
         if (!removedDirectory.isEmpty() && item->_file.startsWith(removedDirectory)) {
             // this is an item in a directory which is going to be removed.
@@ -469,6 +529,15 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
             }
             directories.push(qMakePair(item->destination() + "/", dir));
         } else {
+            if (countUploads && item->_direction == SyncFileItem::Up
+                && (item->_instruction == CSYNC_INSTRUCTION_NEW
+                       || item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE
+                       || item->_instruction == CSYNC_INSTRUCTION_CONFLICT
+                       || item->_instruction == CSYNC_INSTRUCTION_SYNC)) {
+                // createJob() makes an upload of these
+                ++_uploadsPerFolder[QFileInfo(item->_file).path()];
+            }
+
             if (item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE) {
                 // will delete directories, so defer execution
                 directoriesToRemove.prepend(createJob(item));
@@ -50,6 +50,7 @@ qint64 freeSpaceLimit();
 class SyncJournalDb;
 class OwncloudPropagator;
 class PropagatorCompositeJob;
+class EncryptedFolderBatch;
 
 /**
  * @brief the base class of propagator jobs
@@ -391,6 +392,8 @@ public:
 
     QAtomicInt _downloadLimit;
     QAtomicInt _uploadLimit;
+    /** The share of this sync in the job budget of all folders, 0 for no limit */
+    QAtomicInt _maximumActiveJobs;
     BandwidthManager _bandwidthManager;
 
     QAtomicInt _abortRequested; // boolean set by the main thread to abort.
@@ -419,6 +422,27 @@ public:
      */
     QHash<QString, quint64> _folderQuota;
 
+    /** The end to end encryption state shared by all uploads into @a folder
+     *
+     * Created on first use, see EncryptedFolderBatch.
+     */
+    EncryptedFolderBatch *encryptedFolderBatch(const QString &folder);
+
+    /** The number of uploads into @a folder in this sync
+     *
+     * Only counted when the server supports end to end encryption, the
+     * EncryptedFolderBatch of the folder waits for all of them.
+     */
+    int uploadCount(const QString &folder) const { return _uploadsPerFolder.value(folder); }
+
+    /** Finds a synced file with this content, to create a copy of it with a
+     * server side COPY instead of an upload.
+     *
+     * Looks up the content checksum in the journal. Files below smallFileSize()
+     * are not copied, they are cheaper to upload than to copy and verify.
+     */
+    bool serverCopySource(const QByteArray &checksumHeader, qint64 size, SyncJournalFileRecord *record);
+
     /* the maximum number of jobs using bandwidth (uploads or downloads, in parallel) */
     int maximumActiveTransferJob();
 
@@ -431,9 +455,16 @@ public:
     quint64 _chunkSize;
     quint64 smallFileSize();
 
-    /* The maximum number of active jobs in parallel  */
+    /* The maximum number of active jobs in parallel
+     *
+     * The budget is shared by all propagators of the same account that
+     * run at the same time, see runningPropagatorCount().
+     */
     int hardMaximumActiveJob();
 
+    /** The number of propagators of @a account that are currently propagating */
+    static int runningPropagatorCount(const Account *account);
+
     /** Check whether a download would clash with an existing file
      * in filesystems that are only case-preserving.
      */
@@ -548,6 +579,16 @@ private:
     AccountPtr _account;
     QScopedPointer<PropagateDirectory> _rootJob;
     SyncOptions _syncOptions;
+
+    /** Whether this propagator is counted in runningPropagatorCount() */
+    bool _countedAsRunning = false;
+
+    /** See encryptedFolderBatch(), children of the propagator */
+    QHash<QString, EncryptedFolderBatch *> _encryptedFolderBatches;
+
+    /** See uploadCount(), filled in start() */
+    QHash<QString, int> _uploadsPerFolder;
+
 };
 
 
@@ -130,6 +130,8 @@ void ProgressDispatcher::setProgressInfo(const QString &folder, const ProgressIn
 
 ProgressInfo::ProgressInfo()
 {
+    // So it moves along with the ProgressInfo
+    _updateEstimatesTimer.setParent(this);
     connect(&_updateEstimatesTimer, &QTimer::timeout, this, &ProgressInfo::updateEstimates);
     reset();
 }
@@ -144,6 +146,7 @@ void ProgressInfo::reset()
     _sizeProgress = Progress();
     _fileProgress = Progress();
     _totalSizeOfCompletedJobs = 0;
+    _currentItemsCompletedSize = 0;
 
     // Historically, these starting estimates were way lower, but that lead
     // to gross overestimation of ETA when a good estimate wasn't available.
@@ -151,9 +154,26 @@ void ProgressInfo::reset()
     _maxFilesPerSecond = 10.0;
 
     _updateEstimatesTimer.stop();
+    _updatingEstimates = false;
     _lastCompletedItem = SyncFileItem();
 }
 
+void ProgressInfo::copyFrom(const ProgressInfo &other)
+{
+    _status = other._status;
+    _currentItems = other._currentItems;
+    _lastCompletedItem = other._lastCompletedItem;
+    _currentDiscoveredRemoteFolder = other._currentDiscoveredRemoteFolder;
+    _currentDiscoveredLocalFolder = other._currentDiscoveredLocalFolder;
+    _updatingEstimates = other._updatingEstimates;
+    _sizeProgress = other._sizeProgress;
+    _fileProgress = other._fileProgress;
+    _totalSizeOfCompletedJobs = other._totalSizeOfCompletedJobs;
+    _currentItemsCompletedSize = other._currentItemsCompletedSize;
+    _maxFilesPerSecond = other._maxFilesPerSecond;
+    _maxBytesPerSecond = other._maxBytesPerSecond;
+}
+
 ProgressInfo::Status ProgressInfo::status() const
 {
     return _status;
@@ -162,11 +182,12 @@ ProgressInfo::Status ProgressInfo::status() const
 void ProgressInfo::startEstimateUpdates()
 {
     _updateEstimatesTimer.start(1000);
+    _updatingEstimates = true;
 }
 
 bool ProgressInfo::isUpdatingEstimates() const
 {
-    return _updateEstimatesTimer.isActive();
+    return _updatingEstimates;
 }
 
 static bool shouldCountProgress(const SyncFileItem &item)
@@ -227,7 +248,12 @@ void ProgressInfo::setProgressComplete(const SyncFileItem &item)
         return;
     }
 
-    _currentItems.remove(item._file);
+    auto it = _currentItems.find(item._file);
+    if (it != _currentItems.end()) {
+        if (isSizeDependent(it->_item))
+            _currentItemsCompletedSize -= it->_progress._completed;
+        _currentItems.erase(it);
+    }
     _fileProgress.setCompleted(_fileProgress._completed + item._affectedItems);
     if (ProgressInfo::isSizeDependent(item)) {
         _totalSizeOfCompletedJobs += item._size;
@@ -242,13 +268,24 @@ void ProgressInfo::setProgressItem(const SyncFileItem &item, quint64 completed)
         return;
     }
 
-    _currentItems[item._file]._item = item;
-    _currentItems[item._file]._progress._total = item._size;
-    _currentItems[item._file]._progress.setCompleted(completed);
+    // Called for every chunk of data that is transferred: the item is only
+    // copied the first time and the completed size is updated incrementally.
+    auto it = _currentItems.find(item._file);
+    if (it == _currentItems.end()) {
+        it = _currentItems.insert(item._file, ProgressItem());
+        it->_item = item;
+    }
+    auto &progress = it->_progress;
+    const quint64 previousCompleted = progress._completed;
+    progress._total = item._size;
+    progress.setCompleted(completed);
+    if (isSizeDependent(it->_item))
+        _currentItemsCompletedSize += progress._completed - previousCompleted;
     recomputeCompletedSize();
 
     // This seems dubious!
-    _lastCompletedItem = SyncFileItem();
+    if (!_lastCompletedItem.isEmpty())
+        _lastCompletedItem = SyncFileItem();
 }
 
 ProgressInfo::Estimates ProgressInfo::totalProgress() const
@@ -351,12 +388,7 @@ void ProgressInfo::updateEstimates()
 
 void ProgressInfo::recomputeCompletedSize()
 {
-    quint64 r = _totalSizeOfCompletedJobs;
-    foreach (const ProgressItem &i, _currentItems) {
-        if (isSizeDependent(i._item))
-            r += i._progress._completed;
-    }
-    _sizeProgress.setCompleted(r);
+    _sizeProgress.setCompleted(_totalSizeOfCompletedJobs + _currentItemsCompletedSize);
 }
 
 ProgressInfo::Estimates ProgressInfo::Progress::estimates() const
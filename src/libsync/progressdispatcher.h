@@ -41,6 +41,12 @@ public:
      */
     void reset();
 
+    /** Copies the state of @a other, for handing progress to another thread.
+     *
+     * The copy doesn't update its estimates by itself.
+     */
+    void copyFrom(const ProgressInfo &other);
+
     /** Records the status of the sync run
      */
     enum Status {
@@ -222,12 +228,13 @@ private slots:
     void updateEstimates();
 
 private:
-    // Sets the completed size by summing finished jobs with the progress
+    // Sets the completed size from the finished jobs and the progress
     // of active ones.
     void recomputeCompletedSize();
 
     // Triggers the update() slot every second once propagation started.
     QTimer _updateEstimatesTimer;
+    bool _updatingEstimates = false;
 
     Progress _sizeProgress;
     Progress _fileProgress;
@@ -235,6 +242,9 @@ private:
     // All size from completed jobs only.
     quint64 _totalSizeOfCompletedJobs;
 
+    // The sum of the completed sizes of the size dependent _currentItems.
+    quint64 _currentItemsCompletedSize = 0;
+
     // The fastest observed rate of files per second in this sync.
     double _maxFilesPerSecond;
     double _maxBytesPerSecond;
@@ -208,6 +208,7 @@ void GETFileJob::slotMetaDataChanged()
         qCWarning(lcGetJob) << "Wrong content-range: " << ranges << " while expecting start was" << _resumeStart;
         if (ranges.isEmpty()) {
             // device doesn't support range, just try again from scratch
+            _writeBuffer.clear();
             _device->close();
             if (!_device->open(QIODevice::WriteOnly)) {
                 _errorString = _device->errorString();
@@ -258,12 +259,51 @@ void GETFileJob::giveBandwidthQuota(qint64 q)
 
 qint64 GETFileJob::currentDownloadPosition()
 {
-    if (_device && _device->pos() > 0 && _device->pos() > qint64(_resumeStart)) {
-        return _device->pos();
+    const qint64 pos = _device ? _device->pos() + _writeBuffer.size() : 0;
+    if (pos > 0 && pos > qint64(_resumeStart)) {
+        return pos;
     }
     return _resumeStart;
 }
 
+// The body is written in large blocks that end at multiples of this
+static const qint64 writeBlockSize = 64 * 1024;
+static const int writeBufferSize = 1024 * 1024;
+
+bool GETFileJob::writeToDevice(const char *data, qint64 size)
+{
+    if (_writeBuffer.isEmpty())
+        _writeBuffer.reserve(writeBufferSize + 16 * 1024);
+    _writeBuffer.append(data, size);
+    if (_writeBuffer.size() < writeBufferSize)
+        return true;
+
+    // What is after the last block boundary waits for the next write
+    const qint64 end = _device->pos() + _writeBuffer.size();
+    return flushWriteBuffer(_writeBuffer.size() - end % writeBlockSize);
+}
+
+bool GETFileJob::flushWriteBuffer(qint64 size)
+{
+    if (size <= 0 || !_device->isOpen())
+        return true;
+
+    const qint64 start = _device->pos();
+    const qint64 w = _device->write(_writeBuffer.constData(), size);
+    if (w != size) {
+        _errorString = _device->errorString();
+        _errorStatus = SyncFileItem::NormalError;
+        qCWarning(lcGetJob) << "Error while writing to file" << w << size << _errorString;
+        _writeBuffer.clear();
+        return false;
+    }
+    _writeBuffer.remove(0, size);
+
+    // Otherwise the kernel writes all of a big download back at once, late
+    FileSystem::startWriteBack(*_device, start, size);
+    return true;
+}
+
 void GETFileJob::slotReadyRead()
 {
     if (!reply())
@@ -295,12 +335,16 @@ void GETFileJob::slotReadyRead()
             return;
         }
 
-        if (_device->isOpen() && _saveBodyToFile) {
-            qint64 w = _device->write(buffer.constData(), r);
-            if (w != r) {
-                _errorString = _device->errorString();
+        if (_device->isOpen() && _saveBodyToFile && _decryptor) {
+            if (!_decryptor->update(buffer.constData(), r, _device)) {
+                _errorString = tr("Error while decrypting the downloaded file");
                 _errorStatus = SyncFileItem::NormalError;
-                qCWarning(lcGetJob) << "Error while writing to file" << w << r << _errorString;
+                qCWarning(lcGetJob) << "Error while decrypting to file" << _device->errorString();
+                reply()->abort();
+                return;
+            }
+        } else if (_device->isOpen() && _saveBodyToFile) {
+            if (!writeToDevice(buffer.constData(), r)) {
                 reply()->abort();
                 return;
             }
@@ -317,6 +361,8 @@ void GETFileJob::slotReadyRead()
                              << replyStatusString()
                              << reply()->rawHeader("Content-Range") << reply()->rawHeader("Content-Length");
 
+            // Also after errors: what was received is kept for resuming
+            flushWriteBuffer(_writeBuffer.size());
             emit finishedSignal();
         }
         _hasEmittedFinishedSignal = true;
@@ -464,6 +510,15 @@ void PropagateDownloadFile::startDownload()
     FileSystem::setFileHidden(_tmpFile.fileName(), true);
 
     _resumeStart = _tmpFile.size();
+
+    // Encrypted files are decrypted while they are downloaded, that
+    // can only start at the beginning
+    if (_isEncrypted && _resumeStart > 0) {
+        _tmpFile.resize(0);
+        _resumeStart = 0;
+        expectedEtagForResume.clear();
+    }
+
     if (_resumeStart > 0) {
         if (_resumeStart == _item->_size) {
             qCInfo(lcPropagateDownload) << "File is already complete, no need to download";
@@ -496,6 +551,11 @@ void PropagateDownloadFile::startDownload()
         return;
     }
 
+    // Keeps big files from fragmenting. The size stays what was received,
+    // the resume start is still found from it.
+    if (_item->_size > 1024 * 1024)
+        FileSystem::preallocate(_tmpFile, _item->_size);
+
     {
         SyncJournalDb::DownloadInfo pi;
         pi._etag = _item->_etag;
@@ -525,6 +585,9 @@ void PropagateDownloadFile::startDownload()
             url,
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     }
+    if (_isEncrypted) {
+        _job->setDecryptor(_downloadEncryptedHelper->startDecryption());
+    }
     _job->setBandwidthManager(&propagator()->_bandwidthManager);
     connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(_job.data(), &GETFileJob::downloadProgress, this, &PropagateDownloadFile::slotDownloadProgress);
@@ -618,6 +681,12 @@ void PropagateDownloadFile::slotGetFinished()
         return;
     }
 
+    // Writing the rest of the body to the file can fail after the reply finished
+    if (job->errorStatus() != SyncFileItem::NoStatus) {
+        done(job->errorStatus(), job->errorString());
+        return;
+    }
+
     if (!job->etag().isEmpty()) {
         // The etag will be empty if we used a direct download URL.
         // (If it was really empty by the server, the GETFileJob will have errored
@@ -633,6 +702,18 @@ void PropagateDownloadFile::slotGetFinished()
     _tmpFile.close();
     _tmpFile.flush();
 
+    // The body was decrypted while it was written, check it against its tag
+    if (_isEncrypted && !_downloadEncryptedHelper->finishDecryption()) {
+        FileSystem::remove(_tmpFile.fileName());
+        done(SyncFileItem::NormalError, _downloadEncryptedHelper->errorString());
+        return;
+    }
+
+    // The tag of encrypted files was received but is not in the file
+    qint64 downloadedSize = _tmpFile.size();
+    if (_isEncrypted)
+        downloadedSize += EncryptionHelper::fileTagLength;
+
     /* Check that the size of the GET reply matches the file size. There have been cases
      * reported that if a server breaks behind a proxy, the GET is still a 200 but is
      * truncated, as described here: https://github.com/owncloud/mirall/issues/2528
@@ -640,7 +721,7 @@ void PropagateDownloadFile::slotGetFinished()
     const QByteArray sizeHeader("Content-Length");
     quint64 bodySize = job->reply()->rawHeader(sizeHeader).toULongLong();
 
-    if (!job->reply()->rawHeader(sizeHeader).isEmpty() && _tmpFile.size() > 0 && bodySize == 0) {
+    if (!job->reply()->rawHeader(sizeHeader).isEmpty() && downloadedSize > 0 && bodySize == 0) {
         // Strange bug with broken webserver or webfirewall https://github.com/owncloud/client/issues/3373#issuecomment-122672322
         // This happened when trying to resume a file. The Content-Range header was files, Content-Length was == 0
         qCDebug(lcPropagateDownload) << bodySize << _item->_size << _tmpFile.size() << job->resumeStart();
@@ -649,14 +730,14 @@ void PropagateDownloadFile::slotGetFinished()
         return;
     }
 
-    if (bodySize > 0 && bodySize != _tmpFile.size() - job->resumeStart()) {
-        qCDebug(lcPropagateDownload) << bodySize << _tmpFile.size() << job->resumeStart();
+    if (bodySize > 0 && bodySize != downloadedSize - job->resumeStart()) {
+        qCDebug(lcPropagateDownload) << bodySize << downloadedSize << job->resumeStart();
         propagator()->_anotherSyncNeeded = true;
         done(SyncFileItem::SoftError, tr("The file could not be downloaded completely."));
         return;
     }
 
-    if (_tmpFile.size() == 0 && _item->_size > 0) {
+    if (downloadedSize == 0 && _item->_size > 0) {
         FileSystem::remove(_tmpFile.fileName());
         done(SyncFileItem::NormalError,
             tr("The downloaded file is empty despite the server announced it should have been %1.")
@@ -826,15 +907,10 @@ void PropagateDownloadFile::contentChecksumComputed(const QByteArray &checksumTy
     _item->_checksumHeader = makeChecksumHeader(checksumType, checksum);
 
     if (_isEncrypted) {
-        if (_downloadEncryptedHelper->decryptFile(_tmpFile)) {
-          downloadFinished();
-        } else {
-          done(SyncFileItem::NormalError, _downloadEncryptedHelper->errorString());
-        }
-
-    } else {
-        downloadFinished();
+        // The file was decrypted while it was downloaded
+        _downloadEncryptedHelper->useOriginalFileName();
     }
+    downloadFinished();
 }
 
 void PropagateDownloadFile::downloadFinished()
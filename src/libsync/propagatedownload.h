@@ -48,6 +48,14 @@ class GETFileJob : public AbstractNetworkJob
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
 
+    StreamingDecryptor *_decryptor = nullptr;
+
+    /// Body data that is not written yet, see writeToDevice()
+    QByteArray _writeBuffer;
+
+    bool writeToDevice(const char *data, qint64 size);
+    bool flushWriteBuffer(qint64 size);
+
 public:
     // DOES NOT take ownership of the device.
     explicit GETFileJob(AccountPtr account, const QString &path, QFile *device,
@@ -74,6 +82,7 @@ public:
                 _bandwidthManager->unregisterDownloadJob(this);
             }
             if (!_hasEmittedFinishedSignal) {
+                flushWriteBuffer(_writeBuffer.size());
                 emit finishedSignal();
             }
             _hasEmittedFinishedSignal = true;
@@ -99,6 +108,12 @@ public:
 
     QByteArray &etag() { return _etag; }
     quint64 resumeStart() { return _resumeStart; }
+
+    /** Decrypts the body before it is written to the device.
+     *
+     * DOES NOT take ownership of the decryptor.
+     */
+    void setDecryptor(StreamingDecryptor *decryptor) { _decryptor = decryptor; }
     time_t lastModified() { return _lastModified; }
 
 
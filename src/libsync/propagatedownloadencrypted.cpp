@@ -1,5 +1,6 @@
 #include "propagatedownloadencrypted.h"
 #include "clientsideencryptionjobs.h"
+#include <QDir>
 
 Q_LOGGING_CATEGORY(lcPropagateDownloadEncrypted, "nextcloud.sync.propagator.download.encrypted", QtInfoMsg)
 
@@ -96,44 +97,32 @@ void PropagateDownloadEncrypted::checkFolderEncryptedMetadata(const QJsonDocumen
   qCCritical(lcPropagateDownloadEncrypted) << "Failed to find encrypted metadata information of remote file" << filename;
 }
 
-// TODO: Fix this. Exported in the wrong place.
-QString createDownloadTmpFileName(const QString &previous);
-
-bool PropagateDownloadEncrypted::decryptFile(QFile& tmpFile)
+StreamingDecryptor *PropagateDownloadEncrypted::startDecryption()
 {
-    const QString tmpFileName = createDownloadTmpFileName(_item->_file + QLatin1String("_dec"));
-    qCDebug(lcPropagateDownloadEncrypted) << "Content Checksum Computed starting decryption" << tmpFileName;
-
-    tmpFile.close();
-    QFile _tmpOutput(_propagator->getFilePath(tmpFileName), this);
-    EncryptionHelper::fileDecryption(_encryptedInfo.encryptionKey,
-                                     _encryptedInfo.initializationVector,
-                                     &tmpFile,
-                                     &_tmpOutput);
-
-    qCDebug(lcPropagateDownloadEncrypted) << "Decryption finished" << tmpFile.fileName() << _tmpOutput.fileName();
-
-    tmpFile.close();
-    _tmpOutput.close();
+    qCDebug(lcPropagateDownloadEncrypted) << "Decrypting while downloading" << _item->_file;
+    _decryptor.reset(new StreamingDecryptor(_encryptedInfo.encryptionKey,
+                                            _encryptedInfo.initializationVector));
+    return _decryptor.data();
+}
 
-    // we decripted the temporary into another temporary, so good bye old one
-    if (!tmpFile.remove()) {
-        qCDebug(lcPropagateDownloadEncrypted) << "Failed to remove temporary file" << tmpFile.errorString();
-        _errorString = tmpFile.errorString();
+bool PropagateDownloadEncrypted::finishDecryption()
+{
+    if (!_decryptor || !_decryptor->finalize()) {
+        qCDebug(lcPropagateDownloadEncrypted) << "Decryption failed" << _item->_file;
+        _errorString = tr("File %1 could not be decrypted.").arg(QDir::toNativeSeparators(_item->_file));
         return false;
     }
+    qCDebug(lcPropagateDownloadEncrypted) << "Decryption finished" << _item->_file;
+    return true;
+}
 
-    // Let's fool the rest of the logic into thinking this was the actual download
-    tmpFile.setFileName(_tmpOutput.fileName());
-
+void PropagateDownloadEncrypted::useOriginalFileName()
+{
     //TODO: This seems what's breaking the logic.
     // Let's fool the rest of the logic into thinking this is the right name of the DAV file
     _item->_encryptedFileName = _item->_file;
     _item->_file = _item->_file.section(QLatin1Char('/'), 0, -2)
             + QLatin1Char('/') + _encryptedInfo.originalFilename;
-
-
-    return true;
 }
 
 QString PropagateDownloadEncrypted::errorString() const
@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QFileInfo>
+#include <QScopedPointer>
 
 #include "syncfileitem.h"
 #include "owncloudpropagator.h"
@@ -18,9 +19,17 @@ public:
   PropagateDownloadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item);
   void start();
   void checkFolderId(const QStringList &list);
-  bool decryptFile(QFile& tmpFile);
   QString errorString() const;
 
+  /* A decryptor for the download of the file, owned by this */
+  StreamingDecryptor *startDecryption();
+
+  /* Checks the tag once the download is complete */
+  bool finishDecryption();
+
+  /* Points the item to the decrypted file name */
+  void useOriginalFileName();
+
 public slots:
   void checkFolderEncryptedStatus();
 
@@ -41,6 +50,7 @@ private:
   QFileInfo _info;
   EncryptedFile _encryptedInfo;
   QString _errorString;
+  QScopedPointer<StreamingDecryptor> _decryptor;
 };
 
 }
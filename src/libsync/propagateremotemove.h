@@ -41,6 +41,27 @@ signals:
     void finishedSignal();
 };
 
+/**
+ * @brief Copies a file or folder on the server
+ * @ingroup libsync
+ */
+class CopyJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+    const QString _destination;
+    QMap<QByteArray, QByteArray> _extraHeaders;
+
+public:
+    explicit CopyJob(AccountPtr account, const QString &path, const QString &destination,
+        QMap<QByteArray, QByteArray> extraHeaders, QObject *parent = 0);
+
+    void start() Q_DECL_OVERRIDE;
+    bool finished() Q_DECL_OVERRIDE;
+
+signals:
+    void finishedSignal();
+};
+
 /**
  * @brief The PropagateRemoteMove class
  * @ingroup libsync
@@ -26,6 +26,7 @@
 #include "common/checksums.h"
 #include "syncengine.h"
 #include "propagateremotedelete.h"
+#include "propagateremotemove.h"
 #include "common/asserts.h"
 #include "networkjobs.h"
 #include "clientsideencryption.h"
@@ -172,13 +173,21 @@ void PropagateUploadFileCommon::setDeleteExisting(bool enabled)
 void PropagateUploadFileCommon::start()
 {
     if (propagator()->account()->capabilities().clientSideEncryptionAvaliable()) {
-      _uploadEncryptedHelper = new PropagateUploadEncrypted(propagator(), _item);
+      _uploadEncryptedHelper = new PropagateUploadEncrypted(propagator(), _item, this);
       connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::folerNotEncrypted,
         this, &PropagateUploadFileCommon::setupUnencryptedFile);
       connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::finalized,
         this, &PropagateUploadFileCommon::setupEncryptedFile);
       connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::error,
-        []{ qCDebug(lcPropagateUpload) << "Error setting up encryption."; });
+        this, [this](const QString &message) {
+          qCDebug(lcPropagateUpload) << "Error setting up encryption." << message;
+          done(SyncFileItem::NormalError, message);
+        });
+      connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::metadataCommitted,
+        this, [this] {
+          _encryptedMetadataCommitted = true;
+          finalize();
+        });
       _uploadEncryptedHelper->start();
    } else {
       setupUnencryptedFile();
@@ -328,10 +337,7 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
     const QString originalFilePath = propagator()->getFilePath(_item->_file);
 
     if (!FileSystem::fileExists(fullFilePath)) {
-      if (_uploadingEncrypted) {
-        _uploadEncryptedHelper->unlockFolder();
-      }
-    done(SyncFileItem::SoftError, tr("File Removed (start upload) %1").arg(fullFilePath));
+        done(SyncFileItem::SoftError, tr("File Removed (start upload) %1").arg(fullFilePath));
         return;
     }
     time_t prevModtime = _item->_modtime; // the _item value was set in PropagateUploadFile::start()
@@ -341,14 +347,15 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
     _item->_modtime = FileSystem::getModTime(originalFilePath);
     if (prevModtime != _item->_modtime) {
         propagator()->_anotherSyncNeeded = true;
-        if (_uploadingEncrypted) {
-          _uploadEncryptedHelper->unlockFolder();
-        }
         qDebug() << "prevModtime" << prevModtime << "Curr" << _item->_modtime;
         done(SyncFileItem::SoftError, tr("Local file changed during syncing. It will be resumed."));
+        return;
     }
 
     quint64 fileSize = FileSystem::getSize(fullFilePath);
+    // Encrypted files are encrypted from the local file while they are uploaded
+    if (_uploadingEncrypted)
+        fileSize += EncryptionHelper::fileTagLength;
     _fileToUpload._size = fileSize;
 
     // But skip the file if the mtime is too close to 'now'!
@@ -356,13 +363,139 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
     // or not yet fully copied to the destination.
     if (fileIsStillChanging(*_item)) {
         propagator()->_anotherSyncNeeded = true;
-        if (_uploadingEncrypted) {
-          _uploadEncryptedHelper->unlockFolder();
-        }
         done(SyncFileItem::SoftError, tr("Local file changed during sync."));
         return;
     }
 
+    if (startServerCopy())
+        return;
+    doStartUpload();
+}
+
+bool PropagateUploadFileCommon::startServerCopy()
+{
+    if (!propagator()->syncOptions()._serverSideCopies || _uploadingEncrypted || _deleteExisting
+        || _item->_instruction != CSYNC_INSTRUCTION_NEW) {
+        return false;
+    }
+
+    SyncJournalFileRecord source;
+    if (!propagator()->serverCopySource(_item->_checksumHeader, _fileToUpload._size, &source))
+        return false;
+
+    qCInfo(lcPropagateUpload) << "Copying" << source._path << "to" << _item->_file
+                              << "on the server, it has the same content";
+
+    // Overwrite: F, the file is new. If-Match makes sure the source still
+    // has the content the journal knows.
+    QMap<QByteArray, QByteArray> copyHeaders;
+    copyHeaders["Overwrite"] = "F";
+    copyHeaders["If-Match"] = '"' + source._etag + '"';
+    const QString destination = QDir::cleanPath(propagator()->account()->url().path() + QLatin1Char('/')
+        + propagator()->account()->davPath() + propagator()->_remoteFolder + _item->_file);
+    auto job = new CopyJob(propagator()->account(),
+        propagator()->_remoteFolder + QString::fromUtf8(source._path),
+        destination, copyHeaders, this);
+    _jobs.append(job);
+    connect(job, &CopyJob::finishedSignal, this, &PropagateUploadFileCommon::slotCopyFinished);
+    connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    propagator()->_activeJobList.append(this);
+    job->start();
+    return true;
+}
+
+void PropagateUploadFileCommon::slotCopyFinished()
+{
+    propagator()->_activeJobList.removeOne(this);
+    auto job = qobject_cast<CopyJob *>(sender());
+    ASSERT(job);
+    slotJobDestroyed(job); // remove it from the _jobs list
+
+    if (_finished || propagator()->_abortRequested.fetchAndAddRelaxed(0))
+        return;
+
+    const int httpCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (job->reply()->error() != QNetworkReply::NoError || httpCode != 201) {
+        // The source may have changed or gone away since the journal saw it
+        qCInfo(lcPropagateUpload) << "Server side copy of" << _item->_file << "failed with"
+                                  << httpCode << ", uploading it";
+        doStartUpload();
+        return;
+    }
+
+    // The copy has the modification time of the moment it was made, it gets
+    // the one of the local file like an uploaded file would
+    auto proppatch = new ProppatchJob(propagator()->account(), propagator()->_remoteFolder + _item->_file, this);
+    proppatch->setProperties({ { "lastmodified", QByteArray::number(qint64(_item->_modtime)) } });
+    _jobs.append(proppatch);
+    connect(proppatch, &ProppatchJob::success, this, &PropagateUploadFileCommon::slotCopyMtimeSet);
+    connect(proppatch, &ProppatchJob::finishedWithError, this, &PropagateUploadFileCommon::slotCopyVerifyFailed);
+    connect(proppatch, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    propagator()->_activeJobList.append(this);
+    proppatch->start();
+}
+
+void PropagateUploadFileCommon::slotCopyMtimeSet()
+{
+    propagator()->_activeJobList.removeOne(this);
+    slotJobDestroyed(sender()); // remove it from the _jobs list
+
+    if (_finished || propagator()->_abortRequested.fetchAndAddRelaxed(0))
+        return;
+
+    // Don't trust the copy blindly, it is only kept if it has the expected size
+    // and, when the server knows it, checksum. The etag is read after the
+    // PROPPATCH, which changes it.
+    auto propfind = new PropfindJob(propagator()->account(), propagator()->_remoteFolder + _item->_file, this);
+    propfind->setProperties({ "getetag", "getcontentlength", "http://owncloud.org/ns:id",
+        "http://owncloud.org/ns:checksums" });
+    _jobs.append(propfind);
+    connect(propfind, &PropfindJob::result, this, &PropagateUploadFileCommon::slotCopyVerified);
+    connect(propfind, &PropfindJob::finishedWithError, this, &PropagateUploadFileCommon::slotCopyVerifyFailed);
+    connect(propfind, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    propagator()->_activeJobList.append(this);
+    propfind->start();
+}
+
+void PropagateUploadFileCommon::slotCopyVerified(const QVariantMap &values)
+{
+    propagator()->_activeJobList.removeOne(this);
+    slotJobDestroyed(sender()); // remove it from the _jobs list
+
+    if (_finished || propagator()->_abortRequested.fetchAndAddRelaxed(0))
+        return;
+
+    bool checksumMatches = true;
+    const QByteArray checksumType = parseChecksumHeaderType(_item->_checksumHeader);
+    foreach (const QByteArray &checksum, values.value("checksums").toByteArray().split(' ')) {
+        if (parseChecksumHeaderType(checksum) == checksumType)
+            checksumMatches = checksum.toLower() == _item->_checksumHeader.toLower();
+    }
+
+    const QByteArray etag = parseEtag(values.value("getetag").toByteArray());
+    const QByteArray fileId = values.value("id").toByteArray();
+    if (!checksumMatches || values.value("getcontentlength").toULongLong() != _fileToUpload._size
+        || etag.isEmpty() || fileId.isEmpty()) {
+        qCWarning(lcPropagateUpload) << "Server side copy of" << _item->_file
+                                     << "is not the expected file, uploading it" << values;
+        doStartUpload();
+        return;
+    }
+
+    _item->_etag = etag;
+    _item->_fileId = fileId;
+    finalize();
+}
+
+void PropagateUploadFileCommon::slotCopyVerifyFailed()
+{
+    propagator()->_activeJobList.removeOne(this);
+    slotJobDestroyed(sender()); // remove it from the _jobs list
+
+    if (_finished || propagator()->_abortRequested.fetchAndAddRelaxed(0))
+        return;
+
+    qCWarning(lcPropagateUpload) << "Could not finish the server side copy of" << _item->_file << ", uploading it";
     doStartUpload();
 }
 
@@ -408,6 +541,20 @@ bool UploadDevice::prepareAndOpen(const QString &fileName, qint64 start, qint64
     return QIODevice::open(QIODevice::ReadOnly);
 }
 
+bool UploadDevice::prepareAndOpen(PropagateUploadEncrypted *encryptedFile, qint64 start, qint64 size)
+{
+    _data.clear();
+    _read = 0;
+
+    QString error;
+    if (!encryptedFile->readEncrypted(start, size, &_data, &error)) {
+        setErrorString(error);
+        return false;
+    }
+
+    return QIODevice::open(QIODevice::ReadOnly);
+}
+
 
 qint64 UploadDevice::writeData(const char *, qint64)
 {
@@ -506,6 +653,13 @@ void UploadDevice::setChoked(bool b)
     }
 }
 
+bool PropagateUploadFileCommon::prepareUploadDevice(UploadDevice *device, quint64 start, quint64 size)
+{
+    if (_uploadingEncrypted)
+        return device->prepareAndOpen(_uploadEncryptedHelper, start, size);
+    return device->prepareAndOpen(_fileToUpload._path, start, size);
+}
+
 void PropagateUploadFileCommon::startPollJob(const QString &path)
 {
     PollJob *job = new PollJob(propagator()->account(), path, _item,
@@ -539,6 +693,8 @@ void PropagateUploadFileCommon::slotPollFinished()
 void PropagateUploadFileCommon::done(SyncFileItem::Status status, const QString &errorString)
 {
     _finished = true;
+    if (_uploadEncryptedHelper)
+        _uploadEncryptedHelper->release();
     PropagateItemJob::done(status, errorString);
 }
 
@@ -649,7 +805,8 @@ QMap<QByteArray, QByteArray> PropagateUploadFileCommon::headers()
     if (!_item->_etag.isEmpty() && _item->_etag != "empty_etag"
         && _item->_instruction != CSYNC_INSTRUCTION_NEW // On new files never send a If-Match
         && _item->_instruction != CSYNC_INSTRUCTION_TYPE_CHANGE
-        && !_deleteExisting) {
+        && !_deleteExisting
+        && !_uploadingEncrypted) { // Encrypted files are uploaded under a new name
         // We add quotes because the owncloud server always adds quotes around the etag, and
         //  csync_owncloud.c's owncloud_file_id always strips the quotes.
         headers["If-Match"] = '"' + _item->_etag + '"';
@@ -672,6 +829,13 @@ QMap<QByteArray, QByteArray> PropagateUploadFileCommon::headers()
 
 void PropagateUploadFileCommon::finalize()
 {
+    // The metadata of an encrypted folder is sent once for all its uploads,
+    // the file can only be decrypted after that
+    if (_uploadingEncrypted && !_encryptedMetadataCommitted) {
+        _uploadEncryptedHelper->commitMetadata();
+        return;
+    }
+
     // Update the quota, if known
     auto quotaIt = propagator()->_folderQuota.find(QFileInfo(_item->_file).path());
     if (quotaIt != propagator()->_folderQuota.end())
@@ -689,9 +853,6 @@ void PropagateUploadFileCommon::finalize()
     propagator()->_journal->setUploadInfo(_item->_file, SyncJournalDb::UploadInfo());
     propagator()->_journal->commit("upload file start");
 
-    if (_uploadingEncrypted) {
-      _uploadEncryptedHelper->unlockFolder();
-    }
     done(SyncFileItem::Success);
 }
 
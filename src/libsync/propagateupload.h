@@ -15,10 +15,12 @@
 
 #include "owncloudpropagator.h"
 #include "networkjobs.h"
+#include "common/contentchunker.h"
 
 #include <QBuffer>
 #include <QFile>
 #include <QElapsedTimer>
+#include <QFutureWatcher>
 
 
 namespace OCC {
@@ -27,6 +29,7 @@ Q_DECLARE_LOGGING_CATEGORY(lcPutJob)
 Q_DECLARE_LOGGING_CATEGORY(lcPropagateUpload)
 
 class BandwidthManager;
+class PropagateUploadEncrypted;
 
 /**
  * @brief The UploadDevice class
@@ -42,6 +45,9 @@ public:
     /** Reads the data from the file and opens the device */
     bool prepareAndOpen(const QString &fileName, qint64 start, qint64 size);
 
+    /** Encrypts the data of an end to end encrypted upload and opens the device */
+    bool prepareAndOpen(PropagateUploadEncrypted *encryptedFile, qint64 start, qint64 size);
+
     qint64 writeData(const char *, qint64) Q_DECL_OVERRIDE;
     qint64 readData(char *data, qint64 maxlen) Q_DECL_OVERRIDE;
     bool atEnd() const Q_DECL_OVERRIDE;
@@ -181,8 +187,6 @@ signals:
     void finishedSignal();
 };
 
-class PropagateUploadEncrypted;
-
 /**
  * @brief The PropagateUploadFileCommon class is the code common between all chunking algorithms
  * @ingroup libsync
@@ -198,10 +202,21 @@ class PropagateUploadEncrypted;
  *         |
  *         v
  *    slotStartUpload()  -> doStartUpload()
- *                                  .
- *                                  .
- *                                  v
- *        finalize() or abortWithError()  or startPollJob()
+ *         |                        .
+ *         v                        .
+ *    startServerCopy()             v
+ *         |     finalize() or abortWithError()  or startPollJob()
+ *         v                        ^
+ *    slotCopyFinished()            |
+ *         |                        |
+ *         v                        |
+ *    slotCopyMtimeSet()            |
+ *         |                        |
+ *         v                        |
+ *    slotCopyVerified() -----------+
+ *
+ * When the copy, setting its modification time or its verification fails,
+ * the file is uploaded with doStartUpload() instead.
  */
 class PropagateUploadFileCommon : public PropagateItemJob
 {
@@ -234,6 +249,7 @@ public:
         , _deleteExisting(false)
         , _uploadEncryptedHelper(0)
         , _uploadingEncrypted(false)
+        , _encryptedMetadataCommitted(false)
     {
     }
 
@@ -250,7 +266,6 @@ public:
     void setupEncryptedFile(const QString& path, const QString& filename, quint64 size);
     void setupUnencryptedFile();
     void startUploadFile();
-    void callUnlockFolder();
     bool isLikelyFinishedQuickly() Q_DECL_OVERRIDE { return _item->_size < propagator()->smallFileSize(); }
 
 private slots:
@@ -259,6 +274,11 @@ private slots:
     void slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum);
     // transmission checksum computed, prepare the upload
     void slotStartUpload(const QByteArray &transmissionChecksumType, const QByteArray &transmissionChecksum);
+    // the server side copy is done, check what it created
+    void slotCopyFinished();
+    void slotCopyMtimeSet();
+    void slotCopyVerified(const QVariantMap &values);
+    void slotCopyVerifyFailed();
 
 public:
     virtual void doStartUpload() = 0;
@@ -309,9 +329,25 @@ protected:
 
     // Bases headers that need to be sent with every chunk
     QMap<QByteArray, QByteArray> headers();
+
+    /** Encrypted uploads get a new key every time, they can't be resumed */
+    bool isUploadingEncrypted() const { return _uploadingEncrypted; }
+
+    /** Opens @a device on the @a size bytes of the file to upload that start at @a start */
+    bool prepareUploadDevice(UploadDevice *device, quint64 start, quint64 size);
 private:
+    /**
+     * Creates a new file with a server side COPY of a synced file with the
+     * same content, see OwncloudPropagator::serverCopySource().
+     *
+     * Returns false if there is no such file.
+     */
+    bool startServerCopy();
+
+
   PropagateUploadEncrypted *_uploadEncryptedHelper;
   bool _uploadingEncrypted;
+  bool _encryptedMetadataCommitted;
 };
 
 /**
@@ -366,6 +402,13 @@ private slots:
  *
  * Propagation job, impementing the new chunking agorithm
  *
+ * With SyncOptions::_deltaUploads and a server that announces chunkingDelta,
+ * the file is cut into content-defined chunks first. If the journal has the
+ * chunks of the version the server has, only the changed ones are uploaded,
+ * named by their offset. A .manifest in the upload folder then tells the
+ * server in which order to assemble them with the ranges of the existing
+ * file. Its lines are either "chunk <name>" or "base <offset> <size>".
+ *
  */
 class PropagateUploadFileNG : public PropagateUploadFileCommon
 {
@@ -385,6 +428,22 @@ private:
         QString originalName;
     };
     QMap<int, ServerChunkInfo> _serverChunks;
+    QMap<QString, quint64> _serverDeltaChunks; /// by name, for delta uploads
+    QStringList _staleServerChunks; /// to delete before resuming
+
+    /// A part of the file for a delta upload
+    struct DeltaSegment
+    {
+        quint64 offset;
+        quint64 size;
+        qint64 baseOffset; /// in the file on the server, -1 if it is uploaded
+        bool onServer; /// uploaded already
+    };
+    QVector<DeltaSegment> _deltaSegments; /// empty if the whole file is uploaded
+    int _currentSegment = 0; /// the next segment to look at in startNextChunk()
+    bool _manifestSent = false;
+    QVector<ContentChunk> _contentChunks; /// of the uploaded file, for the journal
+    QFutureWatcher<QVector<ContentChunk>> _contentChunksWatcher;
 
     /**
      * Return the URL of a chunk.
@@ -392,6 +451,12 @@ private:
      */
     QUrl chunkUrl(int chunk = -1);
 
+    /// Whether the file may be chunked for a delta upload
+    bool deltaUploadPossible();
+    /// Fills _deltaSegments if the server has the base the journal knows the chunks of
+    void planDeltaUpload();
+    static QString deltaChunkName(const DeltaSegment &segment);
+
 public:
     PropagateUploadFileNG(OwncloudPropagator *propagator, const SyncFileItemPtr &item)
         : PropagateUploadFileCommon(propagator, item)
@@ -401,11 +466,15 @@ public:
     void doStartUpload() Q_DECL_OVERRIDE;
 
 private:
+    void startUpload();
     void startNewUpload();
     void startNextChunk();
+    void startManifestUpload();
 public slots:
     void abort(AbortType abortType) Q_DECL_OVERRIDE;
 private slots:
+    void slotContentChunksComputed();
+    void slotManifestPutFinished();
     void slotPropfindFinished();
     void slotPropfindFinishedWithError();
     void slotPropfindIterate(const QString &name, const QMap<QString, QString> &properties);
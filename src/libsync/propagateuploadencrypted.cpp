@@ -3,6 +3,8 @@
 #include "networkjobs.h"
 #include "clientsideencryption.h"
 #include "account.h"
+#include "filesystem.h"
+#include "propagateremotedelete.h"
 
 #include <QFileInfo>
 #include <QDir>
@@ -12,17 +14,24 @@
 #include <QLoggingCategory>
 #include <QMimeDatabase>
 
+#include <cstring>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagateUploadEncrypted, "nextcloud.sync.propagator.upload.encrypted", QtInfoMsg)
 
-PropagateUploadEncrypted::PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item)
-: _propagator(propagator),
- _item(item),
- _metadata(nullptr)
+PropagateUploadEncrypted::PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item, QObject *parent)
+: QObject(parent),
+ _propagator(propagator),
+ _item(item)
 {
 }
 
+PropagateUploadEncrypted::~PropagateUploadEncrypted()
+{
+    release();
+}
+
 void PropagateUploadEncrypted::start()
 {
   /* If the file is in a encrypted-enabled nextcloud instance, we need to
@@ -30,246 +39,489 @@ void PropagateUploadEncrypted::start()
       * if it's encrypted, find the ID of the folder.
       * lock the folder using it's id.
       * download the metadata
-      * update the metadata
-      * upload the file
+      * upload the file, encrypting it on the way
       * upload the metadata
       * unlock the folder.
       *
+      * Everything but encrypting and uploading the file is done once for
+      * all uploads into the folder, by the EncryptedFolderBatch.
+      *
       * If the folder is unencrypted we just follow the old way.
       */
       qCDebug(lcPropagateUploadEncrypted) << "Starting to send an encrypted file!";
-      QFileInfo info(_item->_file);
-      auto getEncryptedStatus = new GetFolderEncryptStatusJob(_propagator->account(),
-                                                           info.path());
-
-      connect(getEncryptedStatus, &GetFolderEncryptStatusJob::encryptStatusFolderReceived,
-              this, &PropagateUploadEncrypted::slotFolderEncryptedStatusFetched);
-      connect(getEncryptedStatus, &GetFolderEncryptStatusJob::encryptStatusError,
-             this, &PropagateUploadEncrypted::slotFolderEncryptedStatusError);
-      getEncryptedStatus->start();
+      _batch = _propagator->encryptedFolderBatch(QFileInfo(_item->_file).path());
+      _batch->addFile(this);
+}
+
+void PropagateUploadEncrypted::setupEncryption(const FolderMetadata &metadata)
+{
+  QFileInfo info(_propagator->_localDir + QDir::separator() + _item->_file);
+  const QString fileName = info.fileName();
+  const QString folderPath = _item->_file.section(QLatin1Char('/'), 0, -2);
+
+  // Every upload gets a new name, key and iv. An overwrite must not reuse
+  // the key and iv of the previous version with different content, and the
+  // previous version stays intact until the metadata no longer lists it.
+  EncryptedFile encryptedFile;
+  encryptedFile.encryptionKey = EncryptionHelper::generateRandom(16);
+  encryptedFile.encryptedFilename = EncryptionHelper::generateRandomFilename();
+  encryptedFile.initializationVector = EncryptionHelper::generateRandom(16);
+  encryptedFile.fileVersion = 1;
+  encryptedFile.metadataKey = 1;
+  encryptedFile.originalFilename = fileName;
+
+  QMimeDatabase mdb;
+  encryptedFile.mimetype = mdb.mimeTypeForFile(info).name().toLocal8Bit();
+
+  _replacedFile.clear();
+  const QVector<EncryptedFile> files = metadata.files();
+  for(const EncryptedFile &file : files) {
+    if (file.originalFilename == fileName) {
+      _replacedFile = folderPath + QLatin1Char('/') + file.encryptedFilename;
+    }
+  }
+
+  _item->_encryptedFileName = folderPath + QLatin1Char('/') + encryptedFile.encryptedFilename;
+  _encryptedFile = encryptedFile;
+  _encryptor.reset();
+  _input.setFileName(info.absoluteFilePath());
+  _plainSize = info.size();
+  _plainModtime = FileSystem::getModTime(info.absoluteFilePath());
+
+  qCDebug(lcPropagateUploadEncrypted) << "Finalizing the upload part, now the actuall uploader will take over";
+  emit finalized(info.absoluteFilePath(),
+                 _item->_encryptedFileName,
+                 info.size() + EncryptionHelper::fileTagLength);
+}
+
+bool PropagateUploadEncrypted::readEncrypted(qint64 start, qint64 size, QByteArray *data, QString *error)
+{
+    // GCM only goes forward, data that is sent again is encrypted again
+    // from the start. The same key and iv give the same result.
+    if (!_encryptor || start < _encryptedPos) {
+        // Encrypting other contents with the same key and iv would reveal
+        // both and allow forging the tag, the upload has to start over
+        // with a new key
+        if (FileSystem::getSize(_input.fileName()) != _plainSize
+            || FileSystem::getModTime(_input.fileName()) != _plainModtime) {
+            *error = tr("Local file changed during sync.");
+            return false;
+        }
+        _input.close();
+        if (!FileSystem::openAndSeekFileSharedRead(&_input, error, 0)) {
+            return false;
+        }
+        _encryptor.reset(new StreamingEncryptor(_encryptedFile.encryptionKey, _encryptedFile.initializationVector));
+        _encryptedPos = 0;
+        _encryptedFile.authenticationTag.clear();
+        if (!_encryptor->isValid()) {
+            *error = tr("Could not encrypt the file");
+            return false;
+        }
+    }
+
+    const qint64 plainSize = _input.size();
+    size = qBound(0ll, size, plainSize + EncryptionHelper::fileTagLength - start);
+    data->resize(size);
+
+    // Encrypt what comes before the requested part, it was sent already
+    while (_encryptedPos < qMin(start, plainSize)) {
+        QByteArray skipped = _input.read(qMin<qint64>(qMin(start, plainSize) - _encryptedPos, 1024 * 1024));
+        if (skipped.isEmpty() || !_encryptor->update(skipped.data(), skipped.size())) {
+            *error = tr("Could not encrypt the file");
+            return false;
+        }
+        _encryptedPos += skipped.size();
+    }
+
+    const qint64 plainEnd = qMin(start + size, plainSize);
+    if (_encryptedPos < plainEnd) {
+        const qint64 length = plainEnd - _encryptedPos;
+        char *out = data->data() + (_encryptedPos - start);
+        if (_input.read(out, length) != length || !_encryptor->update(out, length)) {
+            *error = tr("Could not encrypt the file");
+            return false;
+        }
+        _encryptedPos = plainEnd;
+    }
+
+    if (_encryptedPos == plainSize && _encryptedFile.authenticationTag.isEmpty()) {
+        _encryptedFile.authenticationTag = _encryptor->finalize();
+        if (_encryptedFile.authenticationTag.isEmpty()) {
+            *error = tr("Could not encrypt the file");
+            return false;
+        }
+    }
+
+    // The tag follows the contents
+    if (start + size > plainSize) {
+        const qint64 tagStart = qMax(start, plainSize);
+        std::memcpy(data->data() + (tagStart - start),
+            _encryptedFile.authenticationTag.constData() + (tagStart - plainSize),
+            start + size - tagStart);
+    }
+    return true;
+}
+
+void PropagateUploadEncrypted::commitMetadata()
+{
+    if (_encryptedFile.authenticationTag.isEmpty()) {
+        emit error(tr("The file was not encrypted completely"));
+        return;
+    }
+    if (!_batch) {
+        emit error(tr("The encrypted folder was released before the upload finished"));
+        return;
+    }
+    _batch->fileUploaded(this);
+}
+
+void PropagateUploadEncrypted::release()
+{
+    if (_batch) {
+        _batch->removeFile(this);
+        _batch.clear();
+    }
+    _input.close();
+    _encryptor.reset();
+}
+
+EncryptedFolderBatch::EncryptedFolderBatch(OwncloudPropagator *propagator, const QString &folder)
+    : QObject(propagator)
+    , _propagator(propagator)
+    , _account(propagator->account())
+    , _folder(folder)
+    , _expectedFiles(propagator->uploadCount(folder))
+{
+}
+
+EncryptedFolderBatch::~EncryptedFolderBatch()
+{
+    // Aborted uploads must not leave the folder locked
+    unlock();
+}
+
+void EncryptedFolderBatch::addFile(PropagateUploadEncrypted *file)
+{
+    ++_addedFiles;
+    switch (_state) {
+    case NotEncrypted:
+        // Only the first file of a folder asks the server
+        emit file->folerNotEncrypted();
+        return;
+    case Ready:
+        _waiting.append(file);
+        startNextFiles();
+        return;
+    case Preparing:
+    case Committing:
+        _waiting.append(file);
+        return;
+    case Idle:
+        break;
+    }
+
+    _waiting.append(file);
+    startSetup();
 }
 
-void PropagateUploadEncrypted::slotFolderEncryptedStatusFetched(const QString &folder, bool isEncrypted)
+void EncryptedFolderBatch::startSetup()
+{
+    _state = Preparing;
+
+    // The id is still known from an earlier lock of this sync
+    if (!_folderId.isEmpty()) {
+        _folderLockFirstTry.start();
+        slotTryLock();
+        return;
+    }
+
+    qCDebug(lcPropagateUploadEncrypted) << "Fetching the encryption status of" << _folder;
+    auto getEncryptedStatus = new GetFolderEncryptStatusJob(_account, _folder, this);
+    connect(getEncryptedStatus, &GetFolderEncryptStatusJob::encryptStatusFolderReceived,
+            this, &EncryptedFolderBatch::slotFolderEncryptedStatusFetched);
+    connect(getEncryptedStatus, &GetFolderEncryptStatusJob::encryptStatusError,
+           this, &EncryptedFolderBatch::slotFolderEncryptedStatusError);
+    getEncryptedStatus->start();
+}
+
+void EncryptedFolderBatch::fileUploaded(PropagateUploadEncrypted *file)
+{
+    _uploading.removeAll(file);
+    _uploaded.append(file);
+    startNextFiles();
+}
+
+void EncryptedFolderBatch::removeFile(PropagateUploadEncrypted *file)
+{
+    _waiting.removeAll(file);
+    _uploading.removeAll(file);
+    _uploaded.removeAll(file);
+    _committing.removeAll(file);
+    maybeCommit();
+}
+
+void EncryptedFolderBatch::slotFolderEncryptedStatusFetched(const QString &folder, bool isEncrypted)
 {
   qCDebug(lcPropagateUploadEncrypted) << "Encrypted Status Fetched" << folder << isEncrypted;
 
   /* We are inside an encrypted folder, we need to find it's Id. */
   if (isEncrypted) {
       qCDebug(lcPropagateUploadEncrypted) << "Folder is encrypted, let's get the Id from it.";
-      auto job = new LsColJob(_propagator->account(), folder, this);
+      auto job = new LsColJob(_account, folder, this);
       job->setProperties({"resourcetype", "http://owncloud.org/ns:fileid"});
-      connect(job, &LsColJob::directoryListingSubfolders, this, &PropagateUploadEncrypted::slotFolderEncryptedIdReceived);
-      connect(job, &LsColJob::finishedWithError, this, &PropagateUploadEncrypted::slotFolderEncryptedIdError);
+      connect(job, &LsColJob::directoryListingSubfolders, this, &EncryptedFolderBatch::slotFolderEncryptedIdReceived);
+      connect(job, &LsColJob::finishedWithError, this, &EncryptedFolderBatch::slotFolderEncryptedIdError);
       job->start();
   } else {
     qCDebug(lcPropagateUploadEncrypted) << "Folder is not encrypted, getting back to default.";
-    emit folerNotEncrypted();
+    _state = NotEncrypted;
+    FileList files;
+    files.swap(_waiting);
+    for (const auto &file : files) {
+        if (file)
+            emit file->folerNotEncrypted();
+    }
   }
 }
 
+void EncryptedFolderBatch::slotFolderEncryptedStatusError(int error)
+{
+    qCDebug(lcPropagateUploadEncrypted) << "Failed to retrieve the status of the folders." << error;
+    _state = Idle;
+    failFiles(_waiting, tr("Could not fetch the encryption status of the folder %1").arg(_folder));
+}
 
-
-/* We try to lock a folder, if it's locked we try again in one second.
- * if it's still locked we try again in one second. looping untill one minute.
- *                                                                      -> fail.
+/* We try to lock a folder, if it's locked we try again in five seconds,
+ * looping until five minutes passed.                                   -> fail.
  * the 'loop':                                                         /
  *    slotFolderEncryptedIdReceived -> slotTryLock -> lockError -> stillTime? -> slotTryLock
  *                                        \
  *                                         -> success.
  */
 
-void PropagateUploadEncrypted::slotFolderEncryptedIdReceived(const QStringList &list)
+void EncryptedFolderBatch::slotFolderEncryptedIdReceived(const QStringList &list)
 {
-  qCDebug(lcPropagateUploadEncrypted) << "Received id of folder, trying to lock it so we can prepare the metadata";
   auto job = qobject_cast<LsColJob *>(sender());
-  const auto& folderInfo = job->_folderInfos.value(list.first());
+  if (list.isEmpty()) {
+      slotFolderEncryptedIdError(job->reply());
+      return;
+  }
+  qCDebug(lcPropagateUploadEncrypted) << "Received id of folder, trying to lock it so we can prepare the metadata";
+  _folderId = job->_folderInfos.value(list.first()).fileId;
   _folderLockFirstTry.start();
-  slotTryLock(folderInfo.fileId);
+  slotTryLock();
 }
 
-void PropagateUploadEncrypted::slotTryLock(const QByteArray& fileId)
+void EncryptedFolderBatch::slotFolderEncryptedIdError(QNetworkReply *r)
 {
-  auto *lockJob = new LockEncryptFolderApiJob(_propagator->account(), fileId, this);
-  connect(lockJob, &LockEncryptFolderApiJob::success, this, &PropagateUploadEncrypted::slotFolderLockedSuccessfully);
-  connect(lockJob, &LockEncryptFolderApiJob::error, this, &PropagateUploadEncrypted::slotFolderLockedError);
+    Q_UNUSED(r);
+    qCDebug(lcPropagateUploadEncrypted) << "Error retrieving the Id of the encrypted folder.";
+    _state = Idle;
+    failFiles(_waiting, tr("Could not fetch the id of the encrypted folder %1").arg(_folder));
+}
+
+void EncryptedFolderBatch::slotTryLock()
+{
+  // All files that needed the lock went away in the meantime
+  if (_waiting.isEmpty()) {
+      _state = Idle;
+      return;
+  }
+
+  auto *lockJob = new LockEncryptFolderApiJob(_account, _folderId, this);
+  connect(lockJob, &LockEncryptFolderApiJob::success, this, &EncryptedFolderBatch::slotFolderLockedSuccessfully);
+  connect(lockJob, &LockEncryptFolderApiJob::error, this, &EncryptedFolderBatch::slotFolderLockedError);
   lockJob->start();
 }
 
-void PropagateUploadEncrypted::slotFolderLockedSuccessfully(const QByteArray& fileId, const QByteArray& token)
+void EncryptedFolderBatch::slotFolderLockedSuccessfully(const QByteArray& fileId, const QByteArray& token)
 {
   qCDebug(lcPropagateUploadEncrypted) << "Folder" << fileId << "Locked Successfully for Upload, Fetching Metadata";
-  // Should I use a mutex here?
-  _currentLockingInProgress = true;
+  _locked = true;
   _folderToken = token;
-  _folderId = fileId;
 
-  auto job = new GetMetadataApiJob(_propagator->account(), _folderId);
+  auto job = new GetMetadataApiJob(_account, _folderId, this);
   connect(job, &GetMetadataApiJob::jsonReceived,
-          this, &PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived);
+          this, &EncryptedFolderBatch::slotFolderEncryptedMetadataReceived);
   connect(job, &GetMetadataApiJob::error,
-          this, &PropagateUploadEncrypted::slotFolderEncryptedMetadataError);
-
+          this, &EncryptedFolderBatch::slotFolderEncryptedMetadataError);
   job->start();
 }
 
-void PropagateUploadEncrypted::slotFolderEncryptedMetadataError(const QByteArray& fileId, int httpReturnCode)
+void EncryptedFolderBatch::slotFolderLockedError(const QByteArray& fileId, int httpErrorCode)
 {
-    Q_UNUSED(fileId);
-    Q_UNUSED(httpReturnCode);
-    qCDebug(lcPropagateUploadEncrypted()) << "Error Getting the encrypted metadata. unlock the folder.";
-    unlockFolder();
+    qCDebug(lcPropagateUploadEncrypted) << "Folder" << fileId << "Coundn't be locked." << httpErrorCode;
+
+    /* try to call the lock from 5 to 5 seconds
+     * and fail if it's more than 5 minutes. */
+    if (_folderLockFirstTry.elapsed() > /* five minutes */ 1000 * 60 * 5) {
+        qCDebug(lcPropagateUploadEncrypted) << "Five minutes passed, ignoring more attemps to lock the folder.";
+        _state = Idle;
+        failFiles(_waiting, tr("The encrypted folder %1 is locked").arg(_folder));
+        return;
+    }
+    QTimer::singleShot(5000, this, &EncryptedFolderBatch::slotTryLock);
 }
 
-void PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode)
+void EncryptedFolderBatch::slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode)
 {
-  qCDebug(lcPropagateUploadEncrypted) << "Metadata Received, Preparing it for the new file." << json.toVariant();
-
-  // Encrypt File!
-  _metadata = new FolderMetadata(_propagator->account(), json.toJson(QJsonDocument::Compact), statusCode);
+  qCDebug(lcPropagateUploadEncrypted) << "Metadata Received, Preparing it for the new files." << json.toVariant();
 
-  QFileInfo info(_propagator->_localDir + QDir::separator() + _item->_file);
-  const QString fileName = info.fileName();
+  _metadata.reset(new FolderMetadata(_account, json.toJson(QJsonDocument::Compact), statusCode));
+  _metadataExists = statusCode != 404;
+  _state = Ready;
+  startNextFiles();
+}
 
-  // Find existing metadata for this file
-  bool found = false;
-  EncryptedFile encryptedFile;
-  const QVector<EncryptedFile> files = _metadata->files();
+void EncryptedFolderBatch::slotFolderEncryptedMetadataError(const QByteArray& fileId, int httpReturnCode)
+{
+    qCDebug(lcPropagateUploadEncrypted()) << "Error Getting the encrypted metadata of" << fileId << httpReturnCode << ". unlock the folder.";
+    unlock();
+    failFiles(_waiting, tr("Could not fetch the metadata of the encrypted folder %1").arg(_folder));
+}
 
-  for(const EncryptedFile &file : files) {
-    if (file.originalFilename == fileName) {
-      encryptedFile = file;
-      found = true;
+void EncryptedFolderBatch::startNextFiles()
+{
+    // Files wait for the lock in one place, but don't take more of
+    // them at once than uploads can run in parallel
+    while (_state == Ready && !_waiting.isEmpty()
+        && _uploading.size() < _propagator->hardMaximumActiveJob()) {
+        QPointer<PropagateUploadEncrypted> file = _waiting.takeFirst();
+        if (!file)
+            continue;
+        _uploading.append(file);
+        file->setupEncryption(*_metadata);
     }
-  }
-
-
-
-  // New encrypted file so set it all up!
-  if (!found) {
-      encryptedFile.encryptionKey = EncryptionHelper::generateRandom(16);
-      encryptedFile.encryptedFilename = EncryptionHelper::generateRandomFilename();
-      encryptedFile.initializationVector = EncryptionHelper::generateRandom(16);
-      encryptedFile.fileVersion = 1;
-      encryptedFile.metadataKey = 1;
-      encryptedFile.originalFilename = fileName;
-
-      QMimeDatabase mdb;
-      encryptedFile.mimetype = mdb.mimeTypeForFile(info).name().toLocal8Bit();
-  }
-
-  _item->_encryptedFileName = _item->_file.section(QLatin1Char('/'), 0, -2)
-          + QLatin1Char('/') + encryptedFile.encryptedFilename;
-
-  qCDebug(lcPropagateUploadEncrypted) << "Creating the encrypted file.";
-
-  QFile input(info.absoluteFilePath());
-  QFile output(QDir::tempPath() + QDir::separator() + encryptedFile.encryptedFilename);
-
-  QByteArray tag;
-  bool encryptionResult = EncryptionHelper::fileEncryption(
-    encryptedFile.encryptionKey,
-    encryptedFile.initializationVector,
-    &input, &output, tag);
-
-  if (!encryptionResult) {
-    qCDebug(lcPropagateUploadEncrypted()) << "There was an error encrypting the file, aborting upload.";
-    unlockFolder();
-    return;
-  }
-
-  _completeFileName = output.fileName();
-
-  qCDebug(lcPropagateUploadEncrypted) << "Creating the metadata for the encrypted file.";
-
-  encryptedFile.authenticationTag = tag;
+    maybeCommit();
+}
 
-  _metadata->addEncryptedFile(encryptedFile);
-  _encryptedFile = encryptedFile;
+void EncryptedFolderBatch::maybeCommit()
+{
+    if (_state != Ready || !_waiting.isEmpty() || !_uploading.isEmpty())
+        return;
+    // Uploads of the folder that didn't start yet join this round,
+    // failed ones are left out
+    if (_addedFiles < _expectedFiles)
+        return;
 
-  qCDebug(lcPropagateUploadEncrypted) << "Metadata created, sending to the server.";
+    if (_uploaded.isEmpty()) {
+        unlock();
+        return;
+    }
 
-  if (statusCode == 404) {
-    auto job = new StoreMetaDataApiJob(_propagator->account(),
-                                       _folderId,
-                                       _metadata->encryptedMetadata());
-    connect(job, &StoreMetaDataApiJob::success, this, &PropagateUploadEncrypted::slotUpdateMetadataSuccess);
-    connect(job, &StoreMetaDataApiJob::error, this, &PropagateUploadEncrypted::slotUpdateMetadataError);
-    job->start();
-  } else {
-    auto job = new UpdateMetadataApiJob(_propagator->account(),
-                                      _folderId,
-                                      _metadata->encryptedMetadata(),
-                                      _folderToken);
-
-    connect(job, &UpdateMetadataApiJob::success, this, &PropagateUploadEncrypted::slotUpdateMetadataSuccess);
-    connect(job, &UpdateMetadataApiJob::error, this, &PropagateUploadEncrypted::slotUpdateMetadataError);
-    job->start();
-  }
+    // Only files that are on the server get into the metadata
+    _committing.swap(_uploaded);
+    for (const auto &file : _committing) {
+        if (file)
+            _metadata->addEncryptedFile(file->_encryptedFile);
+    }
+    _state = Committing;
+
+    qCDebug(lcPropagateUploadEncrypted) << "Sending the metadata of" << _committing.size() << "files in" << _folder;
+    if (!_metadataExists) {
+        auto job = new StoreMetaDataApiJob(_account,
+                                           _folderId,
+                                           _metadata->encryptedMetadata(),
+                                           this);
+        connect(job, &StoreMetaDataApiJob::success, this, &EncryptedFolderBatch::slotUpdateMetadataSuccess);
+        connect(job, &StoreMetaDataApiJob::error, this, &EncryptedFolderBatch::slotUpdateMetadataError);
+        job->start();
+    } else {
+        auto job = new UpdateMetadataApiJob(_account,
+                                            _folderId,
+                                            _metadata->encryptedMetadata(),
+                                            _folderToken,
+                                            this);
+        connect(job, &UpdateMetadataApiJob::success, this, &EncryptedFolderBatch::slotUpdateMetadataSuccess);
+        connect(job, &UpdateMetadataApiJob::error, this, &EncryptedFolderBatch::slotUpdateMetadataError);
+        job->start();
+    }
 }
 
-void PropagateUploadEncrypted::slotUpdateMetadataSuccess(const QByteArray& fileId)
+void EncryptedFolderBatch::slotUpdateMetadataSuccess(const QByteArray& fileId)
 {
-    Q_UNUSED(fileId);
-    qCDebug(lcPropagateUploadEncrypted) << "Uploading of the metadata success, Encrypting the file";
-    QFileInfo outputInfo(_completeFileName);
-
-    qCDebug(lcPropagateUploadEncrypted) << "Encrypted Info:" << outputInfo.path() << outputInfo.fileName() << outputInfo.size();
-    qCDebug(lcPropagateUploadEncrypted) << "Finalizing the upload part, now the actuall uploader will take over";
-    emit finalized(outputInfo.path() + QLatin1Char('/') + outputInfo.fileName(),
-                   _item->_file.section(QLatin1Char('/'), 0, -2) + QLatin1Char('/') + outputInfo.fileName(),
-                   outputInfo.size());
+    qCDebug(lcPropagateUploadEncrypted) << "Uploading of the metadata of" << fileId << "success";
+    _metadataExists = true;
+    _state = Ready;
+
+    // The previous versions of overwritten files are not referenced anymore
+    FileList committed;
+    committed.swap(_committing);
+    QStringList replaced;
+    for (const auto &file : committed) {
+        if (file && !file->_replacedFile.isEmpty())
+            replaced.append(file->_replacedFile);
+    }
+    removeEncryptedFiles(replaced);
+
+    for (const auto &file : committed) {
+        if (file)
+            emit file->metadataCommitted();
+    }
+
+    // More files may have arrived while the metadata was sent
+    startNextFiles();
 }
 
-void PropagateUploadEncrypted::slotUpdateMetadataError(const QByteArray& fileId, int httpErrorResponse)
+void EncryptedFolderBatch::slotUpdateMetadataError(const QByteArray& fileId, int httpErrorResponse)
 {
   qCDebug(lcPropagateUploadEncrypted) << "Update metadata error for folder" << fileId << "with error" << httpErrorResponse;
   qCDebug(lcPropagateUploadEncrypted()) << "Unlocking the folder.";
-  unlockFolder();
-}
-
-void PropagateUploadEncrypted::slotFolderLockedError(const QByteArray& fileId, int httpErrorCode)
-{
-    Q_UNUSED(httpErrorCode);
-    /* try to call the lock from 5 to 5 seconds
-     * and fail if it's more than 5 minutes. */
-    QTimer::singleShot(5000, this, [this, fileId]{
-        if (!_currentLockingInProgress) {
-            qCDebug(lcPropagateUploadEncrypted) << "Error locking the folder while no other update is locking it up.";
-            qCDebug(lcPropagateUploadEncrypted) << "Perhaps another client locked it.";
-            qCDebug(lcPropagateUploadEncrypted) << "Abort";
-        return;
-        }
 
-        // Perhaps I should remove the elapsed timer if the lock is from this client?
-        if (_folderLockFirstTry.elapsed() > /* five minutes */ 1000 * 60 * 5 ) {
-            qCDebug(lcPropagateUploadEncrypted) << "One minute passed, ignoring more attemps to lock the folder.";
-        return;
-        }
-        slotTryLock(fileId);
-    });
+  // The metadata on the server is unchanged, so the uploaded files
+  // can't be decrypted and count as failed. The versions they would
+  // have replaced are still listed and stay.
+  unlock();
+  QStringList uploaded;
+  for (const auto &file : _committing) {
+      if (file)
+          uploaded.append(file->_item->_encryptedFileName);
+  }
+  removeEncryptedFiles(uploaded);
+  failFiles(_committing, tr("Could not update the metadata of the encrypted folder %1").arg(_folder));
 
-    qCDebug(lcPropagateUploadEncrypted) << "Folder" << fileId << "Coundn't be locked.";
+  // Files that arrived during the request were not part of it, they
+  // start over with a new lock
+  if (!_waiting.isEmpty())
+      startSetup();
 }
 
-void PropagateUploadEncrypted::slotFolderEncryptedIdError(QNetworkReply *r)
+void EncryptedFolderBatch::failFiles(FileList &files, const QString &message)
 {
-    Q_UNUSED(r);
-    qCDebug(lcPropagateUploadEncrypted) << "Error retrieving the Id of the encrypted folder.";
+    FileList failed;
+    failed.swap(files);
+    for (const auto &file : failed) {
+        if (file)
+            emit file->error(message);
+    }
 }
 
-void PropagateUploadEncrypted::slotFolderEncryptedStatusError(int error)
+void EncryptedFolderBatch::removeEncryptedFiles(const QStringList &files)
 {
-    qCDebug(lcPropagateUploadEncrypted) << "Failed to retrieve the status of the folders." << error;
+    for (const auto &file : files) {
+        qCDebug(lcPropagateUploadEncrypted) << "Removing the unreferenced encrypted file" << file;
+        // Not parented, like the unlock
+        auto *job = new DeleteJob(_account, _propagator->_remoteFolder + file);
+        connect(job, &DeleteJob::finishedSignal, [file]{ qCDebug(lcPropagateUploadEncrypted) << "Removed" << file; });
+        job->start();
+    }
 }
 
-void PropagateUploadEncrypted::unlockFolder()
+void EncryptedFolderBatch::unlock()
 {
-    qDebug() << "Calling Unlock";
-    auto *unlockJob = new UnlockEncryptFolderApiJob(_propagator->account(),
-        _folderId, _folderToken, this);
+    if (_state != NotEncrypted)
+        _state = Idle;
+    _metadata.reset();
+    if (!_locked)
+        return;
+    _locked = false;
 
-    connect(unlockJob, &UnlockEncryptFolderApiJob::success, []{ qDebug() << "Successfully Unlocked"; });
-    connect(unlockJob, &UnlockEncryptFolderApiJob::error, []{ qDebug() << "Unlock Error"; });
+    qCDebug(lcPropagateUploadEncrypted) << "Calling Unlock" << _folder;
+    // Not parented, the unlock has to happen even if the batch goes away
+    auto *unlockJob = new UnlockEncryptFolderApiJob(_account, _folderId, _folderToken);
+    connect(unlockJob, &UnlockEncryptFolderApiJob::success, []{ qCDebug(lcPropagateUploadEncrypted) << "Successfully Unlocked"; });
+    connect(unlockJob, &UnlockEncryptFolderApiJob::error, []{ qCDebug(lcPropagateUploadEncrypted) << "Unlock Error"; });
     unlockJob->start();
 }
 
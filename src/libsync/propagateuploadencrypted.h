@@ -9,22 +9,30 @@
 #include <QNetworkReply>
 #include <QFile>
 #include <QTemporaryFile>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QScopedPointer>
 
 #include "owncloudpropagator.h"
 #include "clientsideencryption.h"
 
 namespace OCC {
 class FolderMetadata;
+class EncryptedFolderBatch;
 
   /* This class is used if the server supports end to end encryption.
  * It will fire for *any* folder, encrypted or not, because when the
  * client starts the upload request we don't know if the folder is
  * encrypted on the server.
  *
+ * The folder status, lock and metadata are shared with the other uploads
+ * into the same folder, see EncryptedFolderBatch.
+ *
  * emits:
  * finalized() if the encrypted file is ready to be uploaded
  * error() if there was an error with the encryption
  * folerNotEncrypted() if the file is within a folder that's not encrypted.
+ * metadataCommitted() once the metadata lists the uploaded file, see commitMetadata()
  *
  */
 
@@ -32,50 +40,136 @@ class PropagateUploadEncrypted : public QObject
 {
   Q_OBJECT
 public:
-    PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item);
+    PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item, QObject *parent = nullptr);
+    ~PropagateUploadEncrypted();
     void start();
 
-    /* unlocks the current folder that holds this file */
-    void unlockFolder();
-  // Used by propagateupload
-  QByteArray _folderToken;
-  QByteArray _folderId;
+    /* To be called once the encrypted file was uploaded. The folder
+     * metadata is stored when all uploads into the folder are done. */
+    void commitMetadata();
+
+    /* Leaves the folder batch, called when the upload is done,
+     * successful or not. */
+    void release();
+
+    /* Reads @a size bytes of the encrypted file starting at @a start
+     * into @a data. The file is encrypted while it is read, the tag
+     * follows the contents. */
+    bool readEncrypted(qint64 start, qint64 size, QByteArray *data, QString *error);
+
+signals:
+    // Emmited when everything is setup, the file is encrypted while it is uploaded.
+    void finalized(const QString& path, const QString& filename, quint64 size);
+    void error(const QString &message);
+
+    // Emited if the file is not in a encrypted folder.
+    void folerNotEncrypted();
+
+    // Emitted when the folder metadata with this file was stored on the server.
+    void metadataCommitted();
+
+private:
+  friend class EncryptedFolderBatch;
+
+  /* Sets up a new name, key and iv for the file and emits finalized().
+   * The version of the file listed in @a metadata is replaced once the
+   * metadata is committed. */
+  void setupEncryption(const FolderMetadata &metadata);
+
+  OwncloudPropagator *_propagator;
+  SyncFileItemPtr _item;
+  QPointer<EncryptedFolderBatch> _batch;
+
+  EncryptedFile _encryptedFile;
+  QString _replacedFile; // the encrypted previous version, removed after the commit
+
+  QFile _input;
+  QScopedPointer<StreamingEncryptor> _encryptor;
+  qint64 _encryptedPos = 0; // the amount of _input that went through _encryptor
+  // size and modification time of the file the key and iv were made for
+  qint64 _plainSize = 0;
+  time_t _plainModtime = 0;
+};
+
+/* The end to end encryption state shared by the uploads into one folder.
+ *
+ * Instead of every file locking the folder and storing the metadata on
+ * its own, the first file fetches the encryption status and locks the
+ * folder, then all files of the folder are encrypted and uploaded in
+ * parallel. Once the last upload the propagator counted for the folder
+ * is done, see OwncloudPropagator::uploadCount(), the metadata is stored
+ * for all of them with a single request and the folder is unlocked.
+ *
+ * The metadata only ever lists files that were uploaded, a failed upload
+ * is left out and a failed metadata request fails all its files. Files
+ * that arrive while the metadata is sent wait for the next round, with a
+ * new lock if the request failed. Uploads never overwrite an encrypted
+ * file, the previous version is removed once the metadata is stored.
+ *
+ * Created and owned by the OwncloudPropagator, see encryptedFolderBatch().
+ */
+class EncryptedFolderBatch : public QObject
+{
+  Q_OBJECT
+public:
+    EncryptedFolderBatch(OwncloudPropagator *propagator, const QString &folder);
+    ~EncryptedFolderBatch();
+
+    void addFile(PropagateUploadEncrypted *file);
+    void fileUploaded(PropagateUploadEncrypted *file);
+    void removeFile(PropagateUploadEncrypted *file);
 
 private slots:
     void slotFolderEncryptedStatusFetched(const QString &folder, bool isEncrypted);
     void slotFolderEncryptedStatusError(int error);
     void slotFolderEncryptedIdReceived(const QStringList &list);
     void slotFolderEncryptedIdError(QNetworkReply *r);
+    void slotTryLock();
     void slotFolderLockedSuccessfully(const QByteArray& fileId, const QByteArray& token);
     void slotFolderLockedError(const QByteArray& fileId, int httpErrorCode);
-    void slotTryLock(const QByteArray& fileId);
     void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode);
     void slotFolderEncryptedMetadataError(const QByteArray& fileId, int httpReturnCode);
     void slotUpdateMetadataSuccess(const QByteArray& fileId);
     void slotUpdateMetadataError(const QByteArray& fileId, int httpReturnCode);
+    void maybeCommit();
 
-signals:
-    // Emmited after the file is encrypted and everythign is setup.
-    void finalized(const QString& path, const QString& filename, quint64 size);
-    void error();
+private:
+    enum State {
+        Idle, // no lock, the next file starts the setup
+        Preparing, // status, id, lock or metadata requests running
+        Ready, // locked with metadata, files get encrypted and uploaded
+        Committing, // the metadata request is running
+        NotEncrypted
+    };
 
-    // Emited if the file is not in a encrypted folder.
-    void folerNotEncrypted();
+    typedef QList<QPointer<PropagateUploadEncrypted>> FileList;
 
-private:
-  OwncloudPropagator *_propagator;
-  SyncFileItemPtr _item;
+    void startSetup();
+    void startNextFiles();
+    void failFiles(FileList &files, const QString &message);
+    void removeEncryptedFiles(const QStringList &files);
+    void unlock();
 
-  QElapsedTimer _folderLockFirstTry;
-  bool _currentLockingInProgress = false;
+    OwncloudPropagator *_propagator;
+    AccountPtr _account;
+    QString _folder;
+    State _state = Idle;
 
-  QByteArray _generatedKey;
-  QByteArray _generatedIv;
-  FolderMetadata *_metadata;
-  EncryptedFile _encryptedFile;
-  QString _completeFileName;
-};
+    QByteArray _folderId;
+    QByteArray _folderToken;
+    bool _locked = false;
+    QElapsedTimer _folderLockFirstTry;
+    QScopedPointer<FolderMetadata> _metadata;
+    bool _metadataExists = false;
 
+    FileList _waiting; // waiting for the lock
+    FileList _uploading; // being uploaded
+    FileList _uploaded; // uploaded, waiting for the metadata request
+    FileList _committing; // part of the running metadata request
+
+    int _expectedFiles; // the uploads into the folder in this sync
+    int _addedFiles = 0;
+};
 
 }
 #endif
@@ -30,11 +30,14 @@
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+#include <qtconcurrentrun.h>
 #include <cmath>
 #include <cstring>
 
 namespace OCC {
 
+static const char manifestNameC[] = ".manifest";
+
 QUrl PropagateUploadFileNG::chunkUrl(int chunk)
 {
     QString path = QLatin1String("remote.php/dav/uploads/")
@@ -47,6 +50,12 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
     return Utility::concatUrlPath(propagator()->account()->url(), path);
 }
 
+QString PropagateUploadFileNG::deltaChunkName(const DeltaSegment &segment)
+{
+    // Longer than the names of numbered chunks, but also in the order of the file
+    return QString::number(segment.offset).rightJustified(16, '0');
+}
+
 /*
   State machine:
 
@@ -75,6 +84,9 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
     |
     +-> MOVE ------> moveJobFinished() ---> finalize()
 
+  For delta uploads, doStartUpload() chunks the file on a thread first and
+  continues with startUpload(). startNextChunk() only sends the segments
+  that are not on the server and puts the .manifest before the MOVE.
 
  */
 
@@ -82,8 +94,93 @@ void PropagateUploadFileNG::doStartUpload()
 {
     propagator()->_activeJobList.append(this);
 
+    if (deltaUploadPossible()) {
+        connect(&_contentChunksWatcher, &QFutureWatcherBase::finished,
+            this, &PropagateUploadFileNG::slotContentChunksComputed);
+        const QString path = _fileToUpload._path;
+        _contentChunksWatcher.setFuture(QtConcurrent::run([path]() {
+            QVector<ContentChunk> chunks;
+            if (!ContentChunker::chunkFile(path, &chunks))
+                chunks.clear();
+            return chunks;
+        }));
+        return;
+    }
+
+    startUpload();
+}
+
+bool PropagateUploadFileNG::deltaUploadPossible()
+{
+    // The content of encrypted files changes completely anyway, they are
+    // encrypted with a new key for every upload
+    return propagator()->syncOptions()._deltaUploads
+        && propagator()->account()->capabilities().chunkingDelta()
+        && !isUploadingEncrypted();
+}
+
+void PropagateUploadFileNG::slotContentChunksComputed()
+{
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0))
+        return;
+
+    _contentChunks = _contentChunksWatcher.result();
+    if (_contentChunks.isEmpty()) {
+        qCWarning(lcPropagateUpload) << "Could not chunk" << _fileToUpload._path << ", uploading all of it";
+    } else {
+        planDeltaUpload();
+    }
+    startUpload();
+}
+
+void PropagateUploadFileNG::planDeltaUpload()
+{
+    // The server takes the unchanged parts from the file it has. The chunks
+    // in the journal must be of that version, and the If header of the
+    // MOVE makes sure it is still there.
+    const auto info = propagator()->_journal->getContentChunks(_item->_file);
+    QVector<ContentChunk> baseChunks;
+    if (!info._valid || info._etag != _item->_etag || !headers().contains("If-Match")
+        || !ContentChunker::deserialize(info._chunks, &baseChunks)) {
+        return;
+    }
+
+    QHash<QByteArray, qint64> baseOffsets;
+    baseOffsets.reserve(baseChunks.size());
+    for (const auto &chunk : baseChunks)
+        baseOffsets.insert(chunk.hash, chunk.offset);
+
+    // Neighbouring chunks are merged: changed ones up to the chunk size,
+    // unchanged ones if they also follow each other in the base
+    quint64 reused = 0;
+    for (const auto &chunk : _contentChunks) {
+        const qint64 baseOffset = baseOffsets.value(chunk.hash, -1);
+        if (baseOffset >= 0)
+            reused += chunk.size;
+        if (!_deltaSegments.isEmpty()) {
+            auto &last = _deltaSegments.last();
+            if ((baseOffset < 0 && last.baseOffset < 0 && last.size + chunk.size <= propagator()->_chunkSize)
+                || (baseOffset >= 0 && last.baseOffset >= 0 && quint64(last.baseOffset) + last.size == quint64(baseOffset))) {
+                last.size += chunk.size;
+                continue;
+            }
+        }
+        _deltaSegments.append({ quint64(chunk.offset), quint64(chunk.size), baseOffset, false });
+    }
+
+    if (reused == 0) {
+        _deltaSegments.clear();
+        return;
+    }
+    qCInfo(lcPropagateUpload) << "Delta upload of" << _item->_file << ":" << reused << "of"
+                              << _fileToUpload._size << "bytes are on the server already";
+}
+
+void PropagateUploadFileNG::startUpload()
+{
     const SyncJournalDb::UploadInfo progressInfo = propagator()->_journal->getUploadInfo(_item->_file);
-    if (progressInfo._valid && progressInfo.isChunked() && progressInfo._modtime == _item->_modtime) {
+    if (progressInfo._valid && progressInfo.isChunked() && progressInfo._modtime == _item->_modtime
+        && !isUploadingEncrypted()) {
         _transferId = progressInfo._transferid;
         auto url = chunkUrl();
         auto job = new LsColJob(propagator()->account(), url, this);
@@ -116,10 +213,24 @@ void PropagateUploadFileNG::slotPropfindIterate(const QString &name, const QMap<
     }
     bool ok = false;
     QString chunkName = name.mid(name.lastIndexOf('/') + 1);
-    auto chunkId = chunkName.toUInt(&ok);
-    if (ok) {
-        ServerChunkInfo chunkinfo = { properties["getcontentlength"].toULongLong(), chunkName };
-        _serverChunks[chunkId] = chunkinfo;
+    const quint64 size = properties["getcontentlength"].toULongLong();
+    if (chunkName == QLatin1String(manifestNameC)) {
+        // A delta upload writes it again, others must not leave it there
+        if (_deltaSegments.isEmpty())
+            _staleServerChunks.append(chunkName);
+        return;
+    }
+    chunkName.toULongLong(&ok);
+    if (!ok)
+        return;
+    if (!_deltaSegments.isEmpty()) {
+        _serverDeltaChunks[chunkName] = size;
+    } else if (chunkName.size() == 8) {
+        ServerChunkInfo chunkinfo = { size, chunkName };
+        _serverChunks[chunkName.toUInt()] = chunkinfo;
+    } else {
+        // left by a delta upload
+        _staleServerChunks.append(chunkName);
     }
 }
 
@@ -131,6 +242,21 @@ void PropagateUploadFileNG::slotPropfindFinished()
 
     _currentChunk = 0;
     _sent = 0;
+    if (!_deltaSegments.isEmpty()) {
+        // The chunks that are there with the right size are kept
+        for (auto &segment : _deltaSegments) {
+            if (segment.baseOffset < 0) {
+                auto it = _serverDeltaChunks.find(deltaChunkName(segment));
+                if (it == _serverDeltaChunks.end() || it.value() != segment.size)
+                    continue;
+                segment.onServer = true;
+                _serverDeltaChunks.erase(it);
+            }
+            _sent += segment.size;
+        }
+        _staleServerChunks += _serverDeltaChunks.keys();
+        _serverDeltaChunks.clear();
+    }
     while (_serverChunks.contains(_currentChunk)) {
         _sent += _serverChunks[_currentChunk].size;
         _serverChunks.remove(_currentChunk);
@@ -149,21 +275,25 @@ void PropagateUploadFileNG::slotPropfindFinished()
 
     qCInfo(lcPropagateUpload) << "Resuming " << _item->_file << " from chunk " << _currentChunk << "; sent =" << _sent;
 
-    if (!_serverChunks.isEmpty()) {
-        qCInfo(lcPropagateUpload) << "To Delete" << _serverChunks.keys();
+    // Make sure that if there is a "hole" and then a few more chunks, on the server
+    // we should remove the later chunks. Otherwise when we do dynamic chunk sizing, we may end up
+    // with corruptions if there are too many chunks, or if we abort and there are still stale chunks.
+    for (auto it = _serverChunks.begin(); it != _serverChunks.end(); ++it)
+        _staleServerChunks.append(it->originalName);
+    _serverChunks.clear();
+
+    if (!_staleServerChunks.isEmpty()) {
+        qCInfo(lcPropagateUpload) << "To Delete" << _staleServerChunks;
         propagator()->_activeJobList.append(this);
         _removeJobError = false;
 
-        // Make sure that if there is a "hole" and then a few more chunks, on the server
-        // we should remove the later chunks. Otherwise when we do dynamic chunk sizing, we may end up
-        // with corruptions if there are too many chunks, or if we abort and there are still stale chunks.
-        for (auto it = _serverChunks.begin(); it != _serverChunks.end(); ++it) {
-            auto job = new DeleteJob(propagator()->account(), Utility::concatUrlPath(chunkUrl(), it->originalName), this);
+        for (const auto &name : _staleServerChunks) {
+            auto job = new DeleteJob(propagator()->account(), Utility::concatUrlPath(chunkUrl(), name), this);
             QObject::connect(job, &DeleteJob::finishedSignal, this, &PropagateUploadFileNG::slotDeleteJobFinished);
             _jobs.append(job);
             job->start();
         }
-        _serverChunks.clear();
+        _staleServerChunks.clear();
         return;
     }
 
@@ -174,6 +304,10 @@ void PropagateUploadFileNG::slotPropfindFinishedWithError()
 {
     auto job = qobject_cast<LsColJob *>(sender());
     slotJobDestroyed(job); // remove it from the _jobs list
+    // entries are reported while the reply is received, forget the ones before the error
+    _serverChunks.clear();
+    _serverDeltaChunks.clear();
+    _staleServerChunks.clear();
     QNetworkReply::NetworkError err = job->reply()->error();
     auto httpErrorCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     auto status = classifyError(err, httpErrorCode, &propagator()->_anotherSyncNeeded);
@@ -223,8 +357,15 @@ void PropagateUploadFileNG::startNewUpload()
     _transferId = qrand() ^ _item->_modtime ^ (_fileToUpload._size << 16) ^ qHash(_fileToUpload._file);
     _sent = 0;
     _currentChunk = 0;
+    _currentSegment = 0;
+    _manifestSent = false;
+    for (auto &segment : _deltaSegments) {
+        segment.onServer = false;
+        if (segment.baseOffset >= 0)
+            _sent += segment.size;
+    }
 
-    propagator()->reportProgress(*_item, 0);
+    propagator()->reportProgress(*_item, _sent);
 
     SyncJournalDb::UploadInfo pi;
     pi._valid = true;
@@ -272,6 +413,27 @@ void PropagateUploadFileNG::startNextChunk()
 
     // prevent situation that chunk size is bigger then required one to send
     _currentChunkSize = qMin(propagator()->_chunkSize, fileSize - _sent);
+    quint64 chunkOffset = _sent;
+    QUrl url = chunkUrl(_currentChunk);
+
+    if (!_deltaSegments.isEmpty()) {
+        // The next segment that is not on the server yet
+        while (_currentSegment < _deltaSegments.size()
+            && (_deltaSegments[_currentSegment].baseOffset >= 0 || _deltaSegments[_currentSegment].onServer)) {
+            ++_currentSegment;
+        }
+        if (_currentSegment < _deltaSegments.size()) {
+            const auto &segment = _deltaSegments[_currentSegment];
+            _currentChunkSize = segment.size;
+            chunkOffset = segment.offset;
+            url = Utility::concatUrlPath(chunkUrl(), deltaChunkName(segment));
+        } else if (!_manifestSent) {
+            startManifestUpload();
+            return;
+        } else {
+            _currentChunkSize = 0;
+        }
+    }
 
     if (_currentChunkSize == 0) {
         Q_ASSERT(_jobs.isEmpty()); // There should be no running job anymore
@@ -308,7 +470,7 @@ void PropagateUploadFileNG::startNextChunk()
     auto device = new UploadDevice(&propagator()->_bandwidthManager);
     const QString fileName = _fileToUpload._path;
 
-    if (!device->prepareAndOpen(fileName, _sent, _currentChunkSize)) {
+    if (!prepareUploadDevice(device, chunkOffset, _currentChunkSize)) {
         qCWarning(lcPropagateUpload) << "Could not prepare upload device: " << device->errorString();
 
         // If the file is currently locked, we want to retry the sync
@@ -322,10 +484,9 @@ void PropagateUploadFileNG::startNextChunk()
     }
 
     QMap<QByteArray, QByteArray> headers;
-    headers["OC-Chunk-Offset"] = QByteArray::number(_sent);
+    headers["OC-Chunk-Offset"] = QByteArray::number(chunkOffset);
 
     _sent += _currentChunkSize;
-    QUrl url = chunkUrl(_currentChunk);
 
     // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
     PUTFileJob *job = new PUTFileJob(propagator()->account(), url, device, headers, _currentChunk, this);
@@ -338,7 +499,51 @@ void PropagateUploadFileNG::startNextChunk()
     connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
     job->start();
     propagator()->_activeJobList.append(this);
-    _currentChunk++;
+    if (_deltaSegments.isEmpty())
+        _currentChunk++;
+    else
+        _currentSegment++;
+}
+
+void PropagateUploadFileNG::startManifestUpload()
+{
+    QByteArray manifest;
+    for (const auto &segment : _deltaSegments) {
+        if (segment.baseOffset >= 0) {
+            manifest += "base " + QByteArray::number(segment.baseOffset) + ' ' + QByteArray::number(segment.size) + '\n';
+        } else {
+            manifest += "chunk " + deltaChunkName(segment).toLatin1() + '\n';
+        }
+    }
+    auto buffer = new QBuffer;
+    buffer->setData(manifest);
+    buffer->open(QIODevice::ReadOnly);
+
+    QMap<QByteArray, QByteArray> headers;
+    headers["Content-Type"] = "text/plain";
+    auto job = new PUTFileJob(propagator()->account(), Utility::concatUrlPath(chunkUrl(), manifestNameC),
+        buffer, headers, -1, this);
+    _jobs.append(job);
+    connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileNG::slotManifestPutFinished);
+    connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    propagator()->_activeJobList.append(this);
+    job->start();
+}
+
+void PropagateUploadFileNG::slotManifestPutFinished()
+{
+    auto job = qobject_cast<PUTFileJob *>(sender());
+    ASSERT(job);
+    slotJobDestroyed(job); // remove it from the _jobs list
+    propagator()->_activeJobList.removeOne(this);
+
+    if (job->reply()->error() != QNetworkReply::NoError) {
+        _item->_httpErrorCode = job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        commonErrorHandling(job);
+        return;
+    }
+    _manifestSent = true;
+    startNextChunk();
 }
 
 void PropagateUploadFileNG::slotPutFinished()
@@ -470,6 +675,15 @@ void PropagateUploadFileNG::slotMoveJobFinished()
         return;
     }
     _item->_responseTimeStamp = job->responseTimestamp();
+
+    // The next delta upload starts from this version
+    if (!_contentChunks.isEmpty()) {
+        SyncJournalDb::ContentChunksInfo info;
+        info._etag = _item->_etag;
+        info._chunks = ContentChunker::serialize(_contentChunks);
+        info._valid = true;
+        propagator()->_journal->setContentChunks(_item->_file, info);
+    }
     finalize();
 }
 
@@ -23,7 +23,6 @@
 #include "filesystem.h"
 #include <qfile.h>
 #include <qdir.h>
-#include <qdiriterator.h>
 #include <qtemporaryfile.h>
 #include <qsavefile.h>
 #include <QDateTime>
@@ -45,65 +44,32 @@ QByteArray localFileIdFromFullId(const QByteArray &id)
 }
 
 /**
- * Code inspired from Qt5's QDir::removeRecursively
+ * Removes the folder of the item with everything in it.
  * The code will update the database in case of error.
  * If everything goes well (no error, returns true), the caller is responsible for removing the entries
  * in the database.  But in case of error, we need to remove the entries from the database of the files
- * that were deleted.
- *
- * \a path is relative to propagator()->_localDir + _item->_file and should start with a slash
+ * that were deleted. A subfolder that is gone completely is removed from the database at once.
  */
-bool PropagateLocalRemove::removeRecursively(const QString &path)
+bool PropagateLocalRemove::removeRecursively()
 {
-    bool success = true;
-    QString absolute = propagator()->_localDir + _item->_file + path;
-    QDirIterator di(absolute, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
-
+    const QString absolute = propagator()->_localDir + _item->_file;
     QVector<QPair<QString, bool>> deleted;
 
-    while (di.hasNext()) {
-        di.next();
-        const QFileInfo &fi = di.fileInfo();
-        bool ok;
-        // The use of isSymLink here is okay:
-        // we never want to go into this branch for .lnk files
-        bool isDir = fi.isDir() && !fi.isSymLink() && !FileSystem::isJunction(fi.absoluteFilePath());
-        if (isDir) {
-            ok = removeRecursively(path + QLatin1Char('/') + di.fileName()); // recursive
-        } else {
-            QString removeError;
-            ok = FileSystem::remove(di.filePath(), &removeError);
-            if (!ok) {
-                _error += PropagateLocalRemove::tr("Error removing '%1': %2;").arg(QDir::toNativeSeparators(di.filePath()), removeError) + " ";
-                qCWarning(lcPropagateLocalRemove) << "Error removing " << di.filePath() << ':' << removeError;
-            }
-        }
-        if (success && !ok) {
-            // We need to delete the entries from the database now from the deleted vector
-            foreach (const auto &it, deleted) {
-                propagator()->_journal->deleteFileRecord(_item->_originalFile + path + QLatin1Char('/') + it.first,
-                    it.second);
+    bool success = FileSystem::removeRecursively(absolute,
+        [&deleted](const QString &path, bool isDir) {
+            deleted.append(qMakePair(path, isDir));
+        },
+        [this, &absolute](const QString &path, bool isDir, const QString &error) {
+            const QString nativePath = QDir::toNativeSeparators(path.isEmpty() ? absolute : absolute + QLatin1Char('/') + path);
+            if (isDir) {
+                _error += PropagateLocalRemove::tr("Could not remove folder '%1'").arg(nativePath) + " ";
+            } else {
+                _error += PropagateLocalRemove::tr("Error removing '%1': %2;").arg(nativePath, error) + " ";
             }
-            success = false;
-            deleted.clear();
-        }
-        if (success) {
-            deleted.append(qMakePair(di.fileName(), isDir));
-        }
-        if (!success && ok) {
-            // This succeeded, so we need to delete it from the database now because the caller won't
-            propagator()->_journal->deleteFileRecord(_item->_originalFile + path + QLatin1Char('/') + di.fileName(),
-                isDir);
-        }
-    }
-    if (success) {
-        success = QDir().rmdir(absolute);
-        if (!success) {
-            _error += PropagateLocalRemove::tr("Could not remove folder '%1'")
-                          .arg(QDir::toNativeSeparators(absolute))
-                + " ";
-            qCWarning(lcPropagateLocalRemove) << "Error removing folder" << absolute;
-        }
+        });
+
+    foreach (const auto &it, deleted) {
+        propagator()->_journal->deleteFileRecord(_item->_originalFile + QLatin1Char('/') + it.first, it.second);
     }
     return success;
 }
@@ -133,7 +99,7 @@ void PropagateLocalRemove::start()
         }
     } else {
         if (_item->isDirectory()) {
-            if (QDir(filename).exists() && !removeRecursively(QString())) {
+            if (QDir(filename).exists() && !removeRecursively()) {
                 done(SyncFileItem::NormalError, _error);
                 return;
             }
@@ -42,7 +42,7 @@ public:
     void start() Q_DECL_OVERRIDE;
 
 private:
-    bool removeRecursively(const QString &path);
+    bool removeRecursively();
     QString _error;
     bool _moveToTrash;
 };
@@ -56,9 +56,9 @@ namespace OCC {
 Q_LOGGING_CATEGORY(lcEngine, "nextcloud.sync.engine", QtInfoMsg)
 
 static const int s_touchedFilesMaxAgeMs = 15 * 1000;
-bool SyncEngine::s_anySyncRunning = false;
 
 qint64 SyncEngine::minimumFileAgeForUpload = 2000;
+int SyncEngine::progressUpdateInterval = 100;
 
 SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
     const QString &remotePath, OCC::SyncJournalDb *journal)
@@ -75,6 +75,7 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
     , _backInTimeFiles(0)
     , _uploadLimit(0)
     , _downloadLimit(0)
+    , _maximumActiveJobs(0)
     , _anotherSyncNeeded(NoFollowUpSync)
 {
     qRegisterMetaType<SyncFileItem>("SyncFileItem");
@@ -83,6 +84,7 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
     qRegisterMetaType<SyncFileStatus>("SyncFileStatus");
     qRegisterMetaType<SyncFileItemVector>("SyncFileItemVector");
     qRegisterMetaType<SyncFileItem::Direction>("SyncFileItem::Direction");
+    qRegisterMetaType<ErrorCategory>("ErrorCategory");
 
     // Everything in the SyncEngine expects a trailing slash for the localPath.
     ASSERT(localPath.endsWith(QLatin1Char('/')));
@@ -98,7 +100,17 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
     _clearTouchedFilesTimer.setInterval(30 * 1000);
     connect(&_clearTouchedFilesTimer, &QTimer::timeout, this, &SyncEngine::slotClearTouchedFiles);
 
+    _progressUpdateTimer.setSingleShot(true);
+    connect(&_progressUpdateTimer, &QTimer::timeout, this, [this] {
+        emit transmissionProgress(*_progressInfo);
+    });
+
     _thread.setObjectName("SyncEngine_Thread");
+
+    // Children move along when the engine is moved to a worker thread
+    _progressInfo->setParent(this);
+    _clearTouchedFilesTimer.setParent(this);
+    _progressUpdateTimer.setParent(this);
 }
 
 SyncEngine::~SyncEngine()
@@ -329,7 +341,7 @@ void SyncEngine::conflictRecordMaintenance()
     // Remove stale conflict entries from the database
     // by checking which files still exist and removing the
     // missing ones.
-    auto conflictRecordPaths = _journal->conflictRecordPaths();
+    const auto conflictRecordPaths = _journal->conflictRecordPaths().toSet();
     for (const auto &path : conflictRecordPaths) {
         auto fsPath = _propagator->getFilePath(QString::fromUtf8(path));
         if (!QFileInfo(fsPath).exists()) {
@@ -768,12 +780,11 @@ void SyncEngine::startSync()
         }
     }
 
-    if (s_anySyncRunning || _syncRunning) {
+    if (_syncRunning) {
         ASSERT(false);
         return;
     }
 
-    s_anySyncRunning = true;
     _syncRunning = true;
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
@@ -842,10 +853,15 @@ void SyncEngine::startSync()
     // undo the filter to allow this sync to retrieve and store the correct etags.
     _journal->clearEtagStorageFilter();
 
+    // The blacklist and the conflict records are looked up for many items,
+    // keep them in memory until the journal is closed at the end of the sync.
+    _journal->preloadErrorBlacklistAndConflicts();
+
     _csync_ctx->upload_conflict_files = _account->capabilities().uploadConflictFiles();
     _excludedFiles->setExcludeConflictFiles(!_account->capabilities().uploadConflictFiles());
 
     _csync_ctx->read_remote_from_db = true;
+    _csync_ctx->local_discovery_threads = _syncOptions._discoveryThreads;
 
     _lastLocalDiscoveryStyle = _localDiscoveryStyle;
     _csync_ctx->should_discover_locally_fn = [this](const QByteArray &path) {
@@ -885,6 +901,14 @@ void SyncEngine::startSync()
     _discoveryMainThread = new DiscoveryMainThread(account());
     _discoveryMainThread->setParent(this);
     connect(this, &SyncEngine::finished, _discoveryMainThread.data(), &QObject::deleteLater);
+    // When every remote folder has to be listed anyway, a single recursive
+    // listing saves one round-trip per folder. It would mostly list excluded
+    // folders with selective sync.
+    if (_syncOptions._bulkRemoteListing && selectiveSyncBlackList.isEmpty()
+        && _journal->remoteFolderEtagsInvalidated()) {
+        qCInfo(lcEngine) << "Listing the whole remote tree at once";
+        _discoveryMainThread->setBulkListing(true);
+    }
     qCInfo(lcEngine) << "Server" << account()->serverVersion()
                      << (account()->isHttp2Supported() ? "Using HTTP/2" : "");
     if (account()->rootEtagChangesNotOnlySubFolderEtags()) {
@@ -1116,6 +1140,7 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
 
     // apply the network limits to the propagator
     setNetworkLimits(_uploadLimit, _downloadLimit);
+    setMaximumActiveJobs(_maximumActiveJobs);
 
     deleteStaleDownloadInfos(syncItems);
     deleteStaleUploadInfos(syncItems);
@@ -1156,6 +1181,18 @@ void SyncEngine::setNetworkLimits(int upload, int download)
     }
 }
 
+void SyncEngine::setMaximumActiveJobs(int jobs)
+{
+    _maximumActiveJobs = jobs;
+
+    if (!_propagator)
+        return;
+
+    _propagator->_maximumActiveJobs = jobs;
+    if (jobs != 0)
+        qCInfo(lcEngine) << "Maximum active jobs" << jobs;
+}
+
 void SyncEngine::slotItemCompleted(const SyncFileItemPtr &item)
 {
     _progressInfo->setProgressComplete(*item);
@@ -1164,6 +1201,7 @@ void SyncEngine::slotItemCompleted(const SyncFileItemPtr &item)
         csyncError(item->_errorString);
     }
 
+    _progressUpdateTimer.stop();
     emit transmissionProgress(*_progressInfo);
     emit itemCompleted(item);
 }
@@ -1186,6 +1224,10 @@ void SyncEngine::slotFinished(bool success)
 
     _journal->commit("All Finished.", false);
 
+    // Move the changes of the sync into the database file while the engine
+    // cleans up
+    _journal->walCheckpoint();
+
     // Send final progress information even if no
     // files needed propagation, but clear the lastCompletedItem
     // so we don't count this twice (like Recent Files)
@@ -1198,6 +1240,7 @@ void SyncEngine::slotFinished(bool success)
 
 void SyncEngine::finalize(bool success)
 {
+    _progressUpdateTimer.stop();
     _thread.quit();
     _thread.wait();
 
@@ -1207,7 +1250,6 @@ void SyncEngine::finalize(bool success)
     qCInfo(lcEngine) << "CSync run took " << _stopWatch.addLapTime(QLatin1String("Sync Finished")) << "ms";
     _stopWatch.stop();
 
-    s_anySyncRunning = false;
     _syncRunning = false;
     emit finished(success);
 
@@ -1226,7 +1268,14 @@ void SyncEngine::finalize(bool success)
 void SyncEngine::slotProgress(const SyncFileItem &item, quint64 current)
 {
     _progressInfo->setProgressItem(item, current);
-    emit transmissionProgress(*_progressInfo);
+
+    // With many parallel transfers this is called thousands of times per
+    // second, the gui only needs to see the progress a few times per second.
+    if (progressUpdateInterval <= 0) {
+        emit transmissionProgress(*_progressInfo);
+    } else if (!_progressUpdateTimer.isActive()) {
+        _progressUpdateTimer.start(progressUpdateInterval);
+    }
 }
 
 
@@ -1584,6 +1633,7 @@ void SyncEngine::slotAddTouchedFile(const QString &fn)
     now.start();
     QString file = QDir::cleanPath(fn);
 
+    QMutexLocker locker(&_touchedFilesMutex);
     // Iterate from the oldest and remove anything older than 15 seconds.
     while (true) {
         auto first = _touchedFiles.begin();
@@ -1605,12 +1655,14 @@ void SyncEngine::slotAddTouchedFile(const QString &fn)
 
 void SyncEngine::slotClearTouchedFiles()
 {
+    QMutexLocker locker(&_touchedFilesMutex);
     _touchedFiles.clear();
 }
 
 bool SyncEngine::wasFileTouched(const QString &fn) const
 {
     // Start from the end (most recent) and look for our path. Check the time just in case.
+    QMutexLocker locker(&_touchedFilesMutex);
     auto begin = _touchedFiles.constBegin();
     for (auto it = _touchedFiles.constEnd(); it != begin; --it) {
         if ((it-1).value() == fn)
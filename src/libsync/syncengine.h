@@ -26,6 +26,7 @@
 #include <QStringList>
 #include <QSharedPointer>
 #include <set>
+#include <atomic>
 
 #include <csync.h>
 
@@ -69,10 +70,12 @@ public:
     static QString csyncErrorToString(CSYNC_STATUS);
 
     Q_INVOKABLE void startSync();
-    void setNetworkLimits(int upload, int download);
+    Q_INVOKABLE void setNetworkLimits(int upload, int download);
+    /* Limits the parallel network jobs of the sync, 0 for no limit besides the account's */
+    Q_INVOKABLE void setMaximumActiveJobs(int jobs);
 
     /* Abort the sync.  Called from the main thread */
-    void abort();
+    Q_INVOKABLE void abort();
 
     bool isSyncRunning() const { return _syncRunning; }
 
@@ -99,6 +102,8 @@ public:
      * too young and possibly still changing
      */
     static qint64 minimumFileAgeForUpload; // in ms
+    /** How often transfer progress is passed on, in ms. 0 passes on every update. */
+    static int progressUpdateInterval;
 
     /**
      * Control whether local discovery should read from filesystem or db.
@@ -222,15 +227,13 @@ private:
     // cleanup and emit the finished signal
     void finalize(bool success);
 
-    static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
-
     // Must only be acessed during update and reconcile
     QMap<QString, SyncFileItemPtr> _syncItemMap;
 
     AccountPtr _account;
     QScopedPointer<CSYNC> _csync_ctx;
     bool _needsUpdate;
-    bool _syncRunning;
+    std::atomic<bool> _syncRunning; // read from the gui thread when the engine runs in a worker thread
     QString _localPath;
     QString _remotePath;
     QString _remoteRootEtag;
@@ -291,6 +294,7 @@ private:
 
     int _uploadLimit;
     int _downloadLimit;
+    int _maximumActiveJobs;
     SyncOptions _syncOptions;
 
     /// Hook for computing checksums from csync_update
@@ -300,10 +304,14 @@ private:
 
     /** Stores the time since a job touched a file. */
     QMultiMap<QElapsedTimer, QString> _touchedFiles;
+    mutable QMutex _touchedFilesMutex;
 
     /** For clearing the _touchedFiles variable after sync finished */
     QTimer _clearTouchedFilesTimer;
 
+    /** Coalesces the transmissionProgress() of transfer progress */
+    QTimer _progressUpdateTimer;
+
     /** List of unique errors that occurred in a sync run. */
     QSet<QString> _uniqueErrors;
 
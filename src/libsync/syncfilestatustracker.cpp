@@ -111,8 +111,20 @@ static inline bool showWarningInSocketApi(const SyncFileItem &item)
 SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
     : _syncEngine(syncEngine)
 {
-    connect(syncEngine, &SyncEngine::aboutToPropagate,
-        this, &SyncFileStatusTracker::slotAboutToPropagate);
+    // The signal passes a reference and can't be queued. When the engine
+    // runs in another thread, pass copies of the items it keeps changing.
+    connect(syncEngine, &SyncEngine::aboutToPropagate, this, [this](SyncFileItemVector &items) {
+        if (QThread::currentThread() == thread()) {
+            slotAboutToPropagate(items);
+            return;
+        }
+        SyncFileItemVector copies;
+        copies.reserve(items.size());
+        for (const auto &item : items)
+            copies.append(SyncFileItemPtr(new SyncFileItem(*item)));
+        QMetaObject::invokeMethod(this, "slotAboutToPropagate", Qt::QueuedConnection,
+            Q_ARG(SyncFileItemVector, copies));
+    }, Qt::DirectConnection);
     connect(syncEngine, &SyncEngine::itemCompleted,
         this, &SyncFileStatusTracker::slotItemCompleted);
     connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncFinished);
@@ -208,7 +220,7 @@ void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &rela
     }
 }
 
-void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
+void SyncFileStatusTracker::slotAboutToPropagate(const SyncFileItemVector &items)
 {
     ASSERT(_syncCount.isEmpty());
 
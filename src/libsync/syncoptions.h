@@ -59,6 +59,28 @@ struct SyncOptions
 
     /** Whether parallel network jobs are allowed. */
     bool _parallelNetworkJobs = true;
+
+    /** Whether a sync that has to list every remote folder, like the first one,
+     * tries to get the whole remote tree with a single Depth: infinity PROPFIND.
+     *
+     * Falls back to listing folder by folder if the server refuses.
+     */
+    bool _bulkRemoteListing = false;
+
+    /** Whether chunked uploads only send the parts of a file that changed
+     * since it was last uploaded, if the server supports it.
+     */
+    bool _deltaUploads = false;
+
+    /** Whether new files whose content the server already has in another
+     * file are created with a server side COPY instead of an upload.
+     */
+    bool _serverSideCopies = false;
+
+    /** The number of threads that list local directories ahead of the
+     * discovery, 0 for one per core.
+     */
+    int _discoveryThreads = 0;
 };
 
 
@@ -0,0 +1,103 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+using namespace OCC;
+
+// fill_tree_from_db() calls getFilesBelowPath() for every directory whose
+// etag did not change. Measures that per-directory cost on a journal with
+// 1000 top level folders of 10 subfolders with 99 files each, about 1M rows.
+class BenchJournalSubtree : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _tempDir;
+    QScopedPointer<SyncJournalDb> _db;
+
+    enum {
+        topLevelDirs = 1000,
+        subDirs = 10,
+        filesPerDir = 99
+    };
+
+    static QByteArray topLevelDir(int i) { return "dir" + QByteArray::number(i); }
+    static QByteArray subDir(int i, int j) { return topLevelDir(i) + "/sub" + QByteArray::number(j); }
+
+    int readBelow(const QByteArray &path)
+    {
+        int rows = 0;
+        _db->getFilesBelowPath(path, [&](const SyncJournalFileRecord &) { ++rows; });
+        return rows;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        // one log line per inserted record would dominate the setup
+        QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.sync.database.info=false"));
+
+        _db.reset(new SyncJournalDb(_tempDir.path() + "/bench.db"));
+        SyncJournalFileRecord record;
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions("RDNVCKW");
+        int id = 0;
+        auto add = [&](const QByteArray &path, ItemType type) {
+            record._path = path;
+            record._type = type;
+            record._fileId = QByteArray::number(++id);
+            record._inode = id;
+            QVERIFY(_db->setFileRecord(record));
+        };
+        for (int i = 0; i < topLevelDirs; ++i) {
+            add(topLevelDir(i), ItemTypeDirectory);
+            for (int j = 0; j < subDirs; ++j) {
+                add(subDir(i, j), ItemTypeDirectory);
+                for (int k = 0; k < filesPerDir; ++k)
+                    add(subDir(i, j) + "/file" + QByteArray::number(k), ItemTypeFile);
+            }
+        }
+        _db->commit("bench");
+        QCOMPARE(_db->getFileRecordCount(), int(topLevelDirs * (1 + subDirs * (1 + filesPerDir))));
+    }
+
+    // A leaf directory, the common case
+    void benchLeafDirectory()
+    {
+        int i = 0;
+        QBENCHMARK {
+            QCOMPARE(readBelow(subDir(i % topLevelDirs, i % subDirs)), int(filesPerDir));
+            ++i;
+        }
+    }
+
+    // A directory with about 1000 entries below it
+    void benchSubtree()
+    {
+        int i = 0;
+        QBENCHMARK {
+            QCOMPARE(readBelow(topLevelDir(i % topLevelDirs)), int(subDirs * (1 + filesPerDir)));
+            ++i;
+        }
+    }
+
+    // A directory without entries, only the lookup cost remains
+    void benchEmptyDirectory()
+    {
+        int i = 0;
+        QBENCHMARK {
+            QCOMPARE(readBelow(subDir(i % topLevelDirs, i % subDirs) + "/file0"), 0);
+            ++i;
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(BenchJournalSubtree)
+#include "benchjournalsubtree.moc"
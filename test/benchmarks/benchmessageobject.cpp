@@ -0,0 +1,100 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <messages/messageobject.h>
+
+using namespace OCC;
+
+// Measures MessageObject::setJson() on messages with all vital data and a
+// few medications. To compare two implementations, run the benchmark on both
+// revisions, e.g. with -median 5 -csv.
+class BenchMessageObject : public QObject
+{
+    Q_OBJECT
+
+    QJsonObject _seed;
+    QVector<QByteArray> _payloads;
+
+    /** makes the seed look like a real message with all vital data and a few medications */
+    static QJsonObject realisticPayload(QJsonObject json, int n)
+    {
+        QJsonObject payload = json["payload"].toObject();
+        QJsonArray observations;
+        for (const QJsonValue &v : payload["observations"].toArray()) {
+            QJsonObject observation = v.toObject();
+            QJsonObject quantity = observation["valueQuantity"].toObject();
+            quantity["value"] = 60 + n % 40;
+            observation["valueQuantity"] = quantity;
+            observation["effectiveDateTime"] = QDateTime(QDate(2018, 10, 17), QTime(0, 0)).addSecs(n * 3600).toString("yyyy-MM-ddThh:mm:ss");
+            observations.append(observation);
+        }
+        payload["observations"] = observations;
+
+        QJsonArray medications;
+        for (int i = 0; i < 5; ++i) {
+            QJsonObject ingredient { { "itemCodeableConcept", "Ibuprofen" }, { "amount", "400 mg" } };
+            QJsonObject medication { { "ingredient", ingredient }, { "manufacturer", "Brand" }, { "form", "Tablet" } };
+            QJsonArray dosage { QJsonObject { { "sequence", 1 }, { "doseQuantity", 1 } }, QJsonObject { { "sequence", 3 }, { "doseQuantity", 2 } } };
+            medications.append(QJsonObject { { "medication", medication }, { "dosageInstruction", dosage }, { "unit", "Stk" } });
+        }
+        payload["medicationRequests"] = medications;
+        json["payload"] = payload;
+        json["id"] = QUuid::createUuid().toString();
+        return json;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QFile file(QFINDTESTDATA("../testmessageobject.json"));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        _seed = QJsonDocument::fromJson(file.readAll()).object();
+        QVERIFY(!_seed.isEmpty());
+
+        for (int i = 0; i < 1000; ++i)
+            _payloads.append(QJsonDocument(realisticPayload(_seed, i)).toJson());
+    }
+
+    void testPayloadIsParsed()
+    {
+        const QJsonObject json = realisticPayload(_seed, 7);
+        MessageObject obj;
+        obj.setJson(json);
+
+        QCOMPARE(obj.messageId, QUuid(json["id"].toString()));
+        QVERIFY(obj.authoredOn.isValid());
+        QCOMPARE(obj.medicationList.size(), 5);
+    }
+
+    void benchSetJson()
+    {
+        const QJsonObject json = realisticPayload(_seed, 0);
+        QBENCHMARK {
+            MessageObject obj;
+            obj.setJson(json);
+        }
+    }
+
+    // complete import as done by MessageModel::addMessages, including the JSON parsing
+    void benchBulkImport()
+    {
+        QBENCHMARK {
+            for (const QByteArray &data : _payloads) {
+                MessageObject obj;
+                obj.setJson(QJsonDocument::fromJson(data).object());
+            }
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(BenchMessageObject)
+#include "benchmessageobject.moc"
@@ -0,0 +1,143 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+using namespace OCC;
+
+// Compares journal lookups with the database file checked before every query,
+// which costs one stat() per query, to the periodic check.
+//
+// Also measures lookups and the end of a sync on a journal with the size of a
+// large account, 1M rows or BENCH_JOURNAL_ROWS.
+class BenchSyncJournalDB : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _tempDir;
+    QScopedPointer<SyncJournalDb> _db;
+    QVector<QByteArray> _paths;
+    QScopedPointer<SyncJournalDb> _largeDb;
+    QVector<QByteArray> _largePaths;
+
+    static SyncJournalFileRecord makeRecord(int i)
+    {
+        SyncJournalFileRecord record;
+        record._path = "dir" + QByteArray::number(i % 1000) + "/file" + QByteArray::number(i);
+        record._type = ItemTypeFile;
+        record._etag = QByteArray::number(i);
+        record._fileId = "id" + QByteArray::number(i);
+        record._modtime = i;
+        return record;
+    }
+
+    void createLargeJournal()
+    {
+        if (_largeDb)
+            return;
+        int rows = qEnvironmentVariableIntValue("BENCH_JOURNAL_ROWS");
+        if (rows <= 0)
+            rows = 1000000;
+        _largeDb.reset(new SyncJournalDb(_tempDir.path() + "/large.db"));
+        for (int i = 0; i < rows; ++i) {
+            const auto record = makeRecord(i);
+            QVERIFY(_largeDb->setFileRecord(record));
+            if (i % 1000 == 0)
+                _largePaths.append(record._path);
+        }
+        _largeDb->commit("bench");
+        _largeDb->close();
+    }
+
+    void lookupAll()
+    {
+        SyncJournalFileRecord record;
+        for (const QByteArray &path : _paths) {
+            _db->getFileRecord(path, &record);
+            Q_ASSERT(record.isValid());
+        }
+    }
+
+private slots:
+    void initTestCase()
+    {
+        _db.reset(new SyncJournalDb(_tempDir.path() + "/bench.db"));
+        for (int i = 0; i < 10000; ++i) {
+            SyncJournalFileRecord record;
+            record._path = "dir" + QByteArray::number(i % 100) + "/file" + QByteArray::number(i);
+            record._type = ItemTypeFile;
+            record._etag = QByteArray::number(i);
+            record._fileId = "id" + QByteArray::number(i);
+            record._modtime = i;
+            QVERIFY(_db->setFileRecord(record));
+            _paths.append(record._path);
+        }
+        _db->commit("bench");
+    }
+
+    void benchStatEveryQuery()
+    {
+        const int oldInterval = SyncJournalDb::fileExistenceCheckInterval;
+        SyncJournalDb::fileExistenceCheckInterval = 0;
+        QBENCHMARK {
+            lookupAll();
+        }
+        SyncJournalDb::fileExistenceCheckInterval = oldInterval;
+    }
+
+    void benchPeriodicCheck()
+    {
+        QBENCHMARK {
+            lookupAll();
+        }
+    }
+
+    void benchLargeJournalLookups()
+    {
+        createLargeJournal();
+        SyncJournalFileRecord record;
+        const int lookups = 100000;
+        QElapsedTimer timer;
+        timer.start();
+        QBENCHMARK_ONCE {
+            for (int i = 0; i < lookups; ++i) {
+                _largeDb->getFileRecord(_largePaths[i % _largePaths.size()], &record);
+                Q_ASSERT(record.isValid());
+            }
+        }
+        qInfo() << "lookups per second:" << lookups * 1000.0 / qMax<qint64>(1, timer.elapsed());
+    }
+
+    // What the engine does to the journal once the propagation is done
+    void benchLargeJournalSyncEnd()
+    {
+        createLargeJournal();
+        QSet<QString> prefixesToKeep;
+        for (int i = 0; i < 1000; ++i)
+            prefixesToKeep.insert(QString("dir%1/").arg(i));
+
+        // a sync that changed 10k files
+        for (int i = 0; i < 10000; ++i) {
+            auto record = makeRecord(i * 97);
+            record._etag += "-changed";
+            QVERIFY(_largeDb->setFileRecord(record));
+        }
+
+        QBENCHMARK_ONCE {
+            QVERIFY(_largeDb->postSyncCleanup(QSet<QString>(), prefixesToKeep));
+            _largeDb->commit("All Finished.", false);
+            _largeDb->walCheckpoint();
+            _largeDb->close();
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(BenchSyncJournalDB)
+#include "benchsyncjournaldb.moc"
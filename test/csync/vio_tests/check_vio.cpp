@@ -26,6 +26,7 @@
 #include "csync_private.h"
 #include "std/c_utf8.h"
 #include "vio/csync_vio.h"
+#include "vio/csync_vio_local.h"
 
 #include "torture.h"
 
@@ -139,12 +140,51 @@ static void check_csync_vio_closedir_null(void **state)
     assert_int_equal(rc, -1);
 }
 
+static void list_tree(const QByteArray &path, csync_vio_local_read_ahead_t *read_ahead, QByteArrayList *result)
+{
+    csync_vio_handle_t *dh = csync_vio_local_opendir(path.constData(), read_ahead);
+    assert_non_null(dh);
+
+    while (auto file_stat = csync_vio_local_readdir(dh)) {
+        const QByteArray child = path + '/' + file_stat->path;
+        result->append(child + ' ' + QByteArray::number(file_stat->type) + ' ' + QByteArray::number(file_stat->size));
+        if (file_stat->type == ItemTypeDirectory)
+            list_tree(child, read_ahead, result);
+    }
+
+    assert_int_equal(csync_vio_local_closedir(dh), 0);
+}
+
+static void check_csync_vio_read_ahead(void **state)
+{
+    (void) state; /* unused */
+    int rc;
+
+    rc = system("mkdir -p /tmp/csync_test/a/b/c /tmp/csync_test/a/d /tmp/csync_test/e /tmp/csync_test/skipped/f"
+                " && echo x > /tmp/csync_test/a/b/file && echo yy > /tmp/csync_test/e/file");
+    assert_int_equal(rc, 0);
+
+    QByteArrayList expected;
+    list_tree("/tmp/csync_test", nullptr, &expected);
+    assert_int_equal(expected.size(), 9);
+
+    auto read_ahead = csync_vio_local_read_ahead_create([](const QByteArray &path) {
+        return !path.endsWith("/skipped");
+    });
+    QByteArrayList listed;
+    list_tree("/tmp/csync_test", read_ahead, &listed);
+    csync_vio_local_read_ahead_free(read_ahead);
+
+    assert_true(listed == expected);
+}
+
 int torture_run_tests(void)
 {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup_teardown(check_csync_vio_opendir, setup_dir, teardown),
         cmocka_unit_test_setup_teardown(check_csync_vio_opendir_perm, setup, teardown),
         cmocka_unit_test(check_csync_vio_closedir_null),
+        cmocka_unit_test_setup_teardown(check_csync_vio_read_ahead, setup_dir, teardown),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,681 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "davhandler.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocale>
+#include <QRegularExpression>
+#include <QUrl>
+#include <QUuid>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const QString davUri = QStringLiteral("DAV:");
+const QString ocUri = QStringLiteral("http://owncloud.org/ns");
+
+QString httpDate(const QDateTime &dateTime)
+{
+    return QLocale::c().toString(dateTime.toUTC(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
+}
+
+QStringList pathParts(const QString &path)
+{
+    return path.split(QLatin1Char('/'), QString::SkipEmptyParts);
+}
+
+QByteArray unquote(QByteArray etag)
+{
+    etag = etag.trimmed();
+    if (etag.startsWith("W/"))
+        etag.remove(0, 2);
+    if (etag.size() >= 2 && etag.startsWith('"') && etag.endsWith('"'))
+        etag = etag.mid(1, etag.size() - 2);
+    return etag;
+}
+
+// Matches "/prefix" and "/prefix/..." and returns the part after the prefix
+bool stripPrefix(const QString &path, const QString &prefix, QString *rest)
+{
+    if (path != prefix && !path.startsWith(prefix + QLatin1Char('/')))
+        return false;
+    *rest = path.mid(prefix.size());
+    return true;
+}
+
+} // anonymous namespace
+
+QString DavHandler::Node::path() const
+{
+    QStringList parts;
+    for (auto node = this; node->parent; node = node->parent)
+        parts.prepend(node->name);
+    return parts.join(QLatin1Char('/'));
+}
+
+qint64 DavHandler::Node::size() const
+{
+    if (!isDir)
+        return content.size();
+    qint64 total = 0;
+    for (const auto &child : children)
+        total += child.second->size();
+    return total;
+}
+
+DavHandler::DavHandler(const QString &user)
+    : _user(user)
+    // Like the instance id of a real server, so that file ids of two mock
+    // server runs never collide in a client's journal
+    , _instanceId("oc" + QUuid::createUuid().toRfc4122().toHex().left(10))
+{
+    _files.isDir = true;
+    _uploads.isDir = true;
+    _files.fileId = newFileId();
+    _uploads.fileId = newFileId();
+    touch(&_files);
+    touch(&_uploads);
+}
+
+QByteArray DavHandler::newFileId()
+{
+    return QByteArray::number(++_lastFileId).rightJustified(8, '0') + _instanceId;
+}
+
+HttpResponse DavHandler::handle(const HttpRequest &request)
+{
+    QString rest;
+    if (request.path == QLatin1String("/status.php")) {
+        HttpResponse response(200, "{\"installed\":true,\"maintenance\":false,\"needsDbUpgrade\":false,"
+                                   "\"version\":\"14.0.0.0\",\"versionstring\":\"14.0.0\",\"edition\":\"\","
+                                   "\"productname\":\"Nextcloud\"}");
+        response.setHeader("Content-Type", "application/json");
+        return response;
+    }
+    if (stripPrefix(request.path, QStringLiteral("/ocs/v1.php"), &rest)
+        || stripPrefix(request.path, QStringLiteral("/ocs/v2.php"), &rest)) {
+        if (rest == QLatin1String("/cloud/capabilities"))
+            return capabilities();
+        if (rest == QLatin1String("/cloud/user")) {
+            QJsonObject user;
+            user.insert("id", _user);
+            user.insert("display-name", _user);
+            user.insert("email", QString());
+            return ocsResponse(QJsonDocument(user).toJson(QJsonDocument::Compact));
+        }
+        if (rest == QLatin1String("/config")) {
+            return ocsResponse("{\"version\":\"1.7\",\"website\":\"Nextcloud\",\"host\":\"localhost\","
+                                        "\"contact\":\"\",\"ssl\":\"false\"}");
+        }
+        return HttpResponse(404);
+    }
+
+    const QString filesPrefix = QStringLiteral("/remote.php/dav/files/") + _user;
+    const QString uploadsPrefix = QStringLiteral("/remote.php/dav/uploads/") + _user;
+    if (stripPrefix(request.path, QStringLiteral("/remote.php/webdav"), &rest))
+        return handleDav(request, Tree::Files, rest, QStringLiteral("/remote.php/webdav"));
+    if (stripPrefix(request.path, filesPrefix, &rest))
+        return handleDav(request, Tree::Files, rest, filesPrefix);
+    if (stripPrefix(request.path, uploadsPrefix, &rest))
+        return handleDav(request, Tree::Uploads, rest, uploadsPrefix);
+    return HttpResponse(404);
+}
+
+bool DavHandler::populate(const QString &localPath)
+{
+    QDir base(localPath);
+    if (!base.exists())
+        return false;
+    QDirIterator it(localPath, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    QList<QPair<Node *, QDateTime>> dirTimes;
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        bool created = false;
+        // QDirIterator lists parents before their children
+        Node *node = create(&_files, base.relativeFilePath(info.filePath()), info.isDir(), &created);
+        if (!node)
+            return false;
+        if (!info.isDir()) {
+            QFile file(info.filePath());
+            if (!file.open(QIODevice::ReadOnly))
+                return false;
+            node->content = file.readAll();
+        }
+        node->lastModified = info.lastModified();
+        if (info.isDir())
+            dirTimes.append(qMakePair(node, info.lastModified()));
+    }
+    // Adding the children touched the folders
+    for (const auto &dirTime : dirTimes)
+        dirTime.first->lastModified = dirTime.second;
+    return true;
+}
+
+HttpResponse DavHandler::handleDav(const HttpRequest &request, Tree tree, const QString &path, const QString &prefix)
+{
+    Node *root = tree == Tree::Files ? &_files : &_uploads;
+    const QByteArray &method = request.method;
+
+    if (method == "PUT")
+        return put(request, root, path);
+    if (method == "MKCOL")
+        return mkcol(root, path);
+    if (method == "MOVE" || method == "COPY")
+        return moveOrCopy(request, tree, path);
+
+    Node *node = find(root, path);
+    if (!node)
+        return HttpResponse(404);
+    if (method == "PROPFIND")
+        return propfind(request, node, prefix);
+    if (method == "GET" || method == "HEAD")
+        return get(request, node);
+    if (method == "DELETE")
+        return remove(node);
+    if (method == "PROPPATCH")
+        return proppatch(request, node, prefix);
+    return HttpResponse(405);
+}
+
+HttpResponse DavHandler::proppatch(const HttpRequest &request, Node *node, const QString &prefix)
+{
+    // Only the modification time is stored, other properties are accepted and dropped
+    QStringList properties;
+    QXmlStreamReader reader(request.body);
+    int depth = 0;
+    while (!reader.atEnd()) {
+        const QXmlStreamReader::TokenType type = reader.readNext();
+        if (type == QXmlStreamReader::EndElement) {
+            --depth;
+            continue;
+        }
+        if (type != QXmlStreamReader::StartElement)
+            continue;
+        // propertyupdate, set, prop and the properties below it
+        if (++depth != 4)
+            continue;
+        const QString name = reader.name().toString();
+        properties.append(name);
+        if (name == QLatin1String("lastmodified")) {
+            bool ok = false;
+            const qint64 mtime = reader.readElementText().toLongLong(&ok);
+            --depth;
+            if (!ok)
+                return HttpResponse(400);
+            node->lastModified = QDateTime::fromMSecsSinceEpoch(mtime * 1000, Qt::UTC);
+            touch(node);
+        }
+    }
+    if (reader.hasError())
+        return HttpResponse(400);
+
+    QByteArray payload;
+    QBuffer buffer(&payload);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter xml(&buffer);
+    xml.writeNamespace(davUri, "d");
+    xml.writeStartDocument();
+    xml.writeStartElement(davUri, QStringLiteral("multistatus"));
+    xml.writeStartElement(davUri, QStringLiteral("response"));
+    xml.writeTextElement(davUri, QStringLiteral("href"),
+        QString::fromLatin1(QUrl::toPercentEncoding(prefix + QLatin1Char('/') + node->path(), "/")));
+    xml.writeStartElement(davUri, QStringLiteral("propstat"));
+    xml.writeStartElement(davUri, QStringLiteral("prop"));
+    for (const auto &property : properties)
+        xml.writeEmptyElement(property);
+    xml.writeEndElement(); // prop
+    xml.writeTextElement(davUri, QStringLiteral("status"), QStringLiteral("HTTP/1.1 200 OK"));
+    xml.writeEndElement(); // propstat
+    xml.writeEndElement(); // response
+    xml.writeEndElement(); // multistatus
+    xml.writeEndDocument();
+
+    HttpResponse response(207, payload);
+    response.setHeader("Content-Type", "application/xml; charset=utf-8");
+    return response;
+}
+
+HttpResponse DavHandler::propfind(const HttpRequest &request, Node *node, const QString &prefix)
+{
+    // All properties are returned, whatever was requested
+    QByteArray payload;
+    QBuffer buffer(&payload);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter xml(&buffer);
+    xml.writeNamespace(davUri, "d");
+    xml.writeNamespace(ocUri, "oc");
+    xml.writeStartDocument();
+    xml.writeStartElement(davUri, QStringLiteral("multistatus"));
+
+    auto writeResponse = [&](const Node &info) {
+        QString href = prefix + QLatin1Char('/') + info.path();
+        if (info.isDir && !href.endsWith(QLatin1Char('/')))
+            href += QLatin1Char('/');
+
+        xml.writeStartElement(davUri, QStringLiteral("response"));
+        xml.writeTextElement(davUri, QStringLiteral("href"), QString::fromLatin1(QUrl::toPercentEncoding(href, "/")));
+        xml.writeStartElement(davUri, QStringLiteral("propstat"));
+        xml.writeStartElement(davUri, QStringLiteral("prop"));
+        if (info.isDir) {
+            xml.writeStartElement(davUri, QStringLiteral("resourcetype"));
+            xml.writeEmptyElement(davUri, QStringLiteral("collection"));
+            xml.writeEndElement(); // resourcetype
+            xml.writeTextElement(davUri, QStringLiteral("quota-available-bytes"), QStringLiteral("-3"));
+            xml.writeTextElement(davUri, QStringLiteral("quota-used-bytes"), QString::number(info.size()));
+        } else {
+            xml.writeEmptyElement(davUri, QStringLiteral("resourcetype"));
+            xml.writeTextElement(davUri, QStringLiteral("getcontentlength"), QString::number(info.size()));
+        }
+        xml.writeTextElement(davUri, QStringLiteral("getlastmodified"), httpDate(info.lastModified));
+        xml.writeTextElement(davUri, QStringLiteral("getetag"), QLatin1Char('"') + QString::fromLatin1(info.etag) + QLatin1Char('"'));
+        xml.writeTextElement(ocUri, QStringLiteral("size"), QString::number(info.size()));
+        xml.writeTextElement(ocUri, QStringLiteral("permissions"), info.isDir ? QStringLiteral("RDNVCK") : QStringLiteral("RDNVW"));
+        xml.writeTextElement(ocUri, QStringLiteral("id"), QString::fromLatin1(info.fileId));
+        xml.writeTextElement(ocUri, QStringLiteral("fileid"), QString::number(info.fileId.left(8).toULongLong()));
+        if (!info.checksums.isEmpty())
+            xml.writeTextElement(ocUri, QStringLiteral("checksums"), QString::fromLatin1(info.checksums));
+        xml.writeEndElement(); // prop
+        xml.writeTextElement(davUri, QStringLiteral("status"), QStringLiteral("HTTP/1.1 200 OK"));
+        xml.writeEndElement(); // propstat
+        xml.writeEndElement(); // response
+    };
+
+    const QByteArray depth = request.header("Depth");
+    std::function<void(const Node &)> writeChildren = [&](const Node &dir) {
+        for (const auto &child : dir.children) {
+            writeResponse(*child.second);
+            if (depth != "1" && child.second->isDir)
+                writeChildren(*child.second);
+        }
+    };
+
+    writeResponse(*node);
+    if (depth != "0" && node->isDir)
+        writeChildren(*node);
+    xml.writeEndElement(); // multistatus
+    xml.writeEndDocument();
+
+    HttpResponse response(207, payload);
+    response.setHeader("Content-Type", "application/xml; charset=utf-8");
+    return response;
+}
+
+HttpResponse DavHandler::get(const HttpRequest &request, Node *node)
+{
+    if (node->isDir)
+        return HttpResponse(405);
+
+    const qint64 size = node->content.size();
+    HttpResponse response(200, node->content);
+    const QByteArray range = request.header("Range");
+    if (range.startsWith("bytes=") && !range.contains(',')) {
+        const QByteArray spec = range.mid(6);
+        const int dash = spec.indexOf('-');
+        qint64 start = spec.left(dash).toLongLong();
+        qint64 end = size - 1;
+        if (dash == 0) {
+            // the last N bytes
+            start = qMax<qint64>(0, size - spec.mid(1).toLongLong());
+        } else if (dash + 1 < spec.size()) {
+            end = qMin(end, spec.mid(dash + 1).toLongLong());
+        }
+        if (dash < 0 || start >= size || start > end) {
+            HttpResponse error(416);
+            error.setHeader("Content-Range", "bytes */" + QByteArray::number(size));
+            return error;
+        }
+        response.status = 206;
+        response.body = node->content.mid(start, end - start + 1);
+        response.setHeader("Content-Range", "bytes " + QByteArray::number(start) + '-' + QByteArray::number(end) + '/' + QByteArray::number(size));
+    }
+    response.setHeader("Content-Type", "application/octet-stream");
+    response.setHeader("Accept-Ranges", "bytes");
+    response.setHeader("Last-Modified", httpDate(node->lastModified).toLatin1());
+    setFileHeaders(&response, *node);
+    if (!node->checksums.isEmpty())
+        response.setHeader("OC-Checksum", node->checksums);
+    return response;
+}
+
+HttpResponse DavHandler::put(const HttpRequest &request, Node *root, const QString &path)
+{
+    Node *existing = find(root, path);
+    if (existing && existing->isDir)
+        return HttpResponse(409);
+    const QByteArray ifMatch = request.header("If-Match");
+    if (!ifMatch.isEmpty() && (!existing || unquote(ifMatch) != existing->etag))
+        return HttpResponse(412);
+
+    bool created = false;
+    Node *node = create(root, path, false, &created);
+    if (!node)
+        return HttpResponse(409);
+    node->content = request.body;
+    node->checksums = request.header("OC-Checksum");
+
+    HttpResponse response(created ? 201 : 204);
+    const QByteArray mtime = request.header("X-OC-Mtime");
+    if (!mtime.isEmpty()) {
+        node->lastModified = QDateTime::fromTime_t(mtime.toUInt());
+        response.setHeader("X-OC-MTime", "accepted");
+    } else {
+        node->lastModified = QDateTime::currentDateTimeUtc();
+    }
+    touch(node);
+    setFileHeaders(&response, *node);
+    return response;
+}
+
+HttpResponse DavHandler::mkcol(Node *root, const QString &path)
+{
+    if (find(root, path))
+        return HttpResponse(405);
+    bool created = false;
+    Node *node = create(root, path, true, &created);
+    if (!node)
+        return HttpResponse(409);
+    HttpResponse response(201);
+    response.setHeader("OC-FileId", node->fileId);
+    return response;
+}
+
+HttpResponse DavHandler::moveOrCopy(const HttpRequest &request, Tree tree, const QString &path)
+{
+    QString destination;
+    if (!destinationPath(request.header("Destination"), &destination))
+        return HttpResponse(502);
+
+    if (tree == Tree::Uploads) {
+        // Finishing a chunked upload: MOVE <transfer>/.file to the destination
+        if (request.method != "MOVE" || !path.endsWith(QLatin1String("/.file")))
+            return HttpResponse(403);
+        Node *uploadDir = find(&_uploads, path.left(path.size() - 6));
+        if (!uploadDir || !uploadDir->isDir)
+            return HttpResponse(404);
+        return assembleChunks(request, uploadDir, destination);
+    }
+
+    Node *source = find(&_files, path);
+    if (!source)
+        return HttpResponse(404);
+    if (!source->parent)
+        return HttpResponse(403);
+    const QByteArray ifMatch = request.header("If-Match");
+    if (!ifMatch.isEmpty() && unquote(ifMatch) != source->etag)
+        return HttpResponse(412);
+    const QString sourcePath = source->path();
+    const QStringList destParts = pathParts(destination);
+    if (destParts.isEmpty() || destParts.join(QLatin1Char('/')) == sourcePath)
+        return HttpResponse(403);
+    if (destParts.join(QLatin1Char('/')).startsWith(sourcePath + QLatin1Char('/'))
+        || sourcePath.startsWith(destParts.join(QLatin1Char('/')) + QLatin1Char('/')))
+        return HttpResponse(409);
+
+    Node *target = find(&_files, destination);
+    if (target && request.header("Overwrite").toUpper() == "F")
+        return HttpResponse(412);
+    Node *destParent = find(&_files, QStringList(destParts.mid(0, destParts.size() - 1)).join(QLatin1Char('/')));
+    if (!destParent || !destParent->isDir)
+        return HttpResponse(409);
+
+    const bool existed = target != nullptr;
+    if (target)
+        remove(target);
+
+    const QString name = destParts.last();
+    Node *result = nullptr;
+    if (request.method == "MOVE") {
+        Node *sourceParent = source->parent;
+        auto it = sourceParent->children.find(source->name);
+        std::unique_ptr<Node> moved = std::move(it->second);
+        sourceParent->children.erase(it);
+        touch(sourceParent);
+        moved->name = name;
+        moved->parent = destParent;
+        result = moved.get();
+        destParent->children[name] = std::move(moved);
+    } else {
+        std::unique_ptr<Node> copy(new Node);
+        copy->name = name;
+        copy->parent = destParent;
+        copyTree(*source, copy.get());
+        result = copy.get();
+        destParent->children[name] = std::move(copy);
+    }
+    touch(result);
+
+    HttpResponse response(existed ? 204 : 201);
+    setFileHeaders(&response, *result);
+    return response;
+}
+
+HttpResponse DavHandler::remove(Node *node)
+{
+    Node *parent = node->parent;
+    if (!parent)
+        return HttpResponse(403);
+    parent->children.erase(node->name);
+    touch(parent);
+    return HttpResponse(204);
+}
+
+HttpResponse DavHandler::assembleChunks(const HttpRequest &request, Node *uploadDir, const QString &destination)
+{
+    Node *existing = find(&_files, destination);
+    if (existing && existing->isDir)
+        return HttpResponse(409);
+
+    // If: <destination> (["etag"])
+    const QByteArray ifHeader = request.header("If");
+    if (!ifHeader.isEmpty()) {
+        const QRegularExpression etagPattern(QStringLiteral("\\(\\[(.*)\\]\\)"));
+        const auto match = etagPattern.match(QString::fromLatin1(ifHeader));
+        if (!existing || !match.hasMatch() || unquote(match.captured(1).toLatin1()) != existing->etag)
+            return HttpResponse(412);
+    }
+
+    QByteArray content;
+    auto manifest = uploadDir->children.find(QStringLiteral(".manifest"));
+    if (manifest != uploadDir->children.end()) {
+        // Delta upload: the manifest lists the uploaded chunks and the ranges
+        // of the existing file, in order. The base must be pinned by an If.
+        for (const QByteArray &line : manifest->second->content.split('\n')) {
+            const QList<QByteArray> parts = line.split(' ');
+            if (parts.size() == 2 && parts[0] == "chunk") {
+                auto chunk = uploadDir->children.find(QString::fromLatin1(parts[1]));
+                if (chunk == uploadDir->children.end())
+                    return HttpResponse(400);
+                content += chunk->second->content;
+            } else if (parts.size() == 3 && parts[0] == "base") {
+                const qint64 offset = parts[1].toLongLong();
+                const qint64 size = parts[2].toLongLong();
+                if (!existing || ifHeader.isEmpty() || offset < 0 || size <= 0
+                    || offset + size > existing->content.size())
+                    return HttpResponse(400);
+                content += existing->content.mid(offset, size);
+            } else if (!line.isEmpty()) {
+                return HttpResponse(400);
+            }
+        }
+    } else {
+        // The chunks are named by their number or offset
+        std::vector<const Node *> chunks;
+        for (const auto &child : uploadDir->children)
+            chunks.push_back(child.second.get());
+        std::sort(chunks.begin(), chunks.end(), [](const Node *a, const Node *b) {
+            const qulonglong na = a->name.toULongLong();
+            const qulonglong nb = b->name.toULongLong();
+            return na != nb ? na < nb : a->name < b->name;
+        });
+        for (auto chunk : chunks)
+            content += chunk->content;
+    }
+
+    const QByteArray totalLength = request.header("OC-Total-Length");
+    if (!totalLength.isEmpty() && totalLength.toLongLong() != content.size())
+        return HttpResponse(400);
+
+    bool created = false;
+    Node *node = create(&_files, destination, false, &created);
+    if (!node)
+        return HttpResponse(409);
+    node->content = content;
+    node->checksums = request.header("OC-Checksum");
+    remove(uploadDir);
+
+    HttpResponse response(created ? 201 : 204);
+    const QByteArray mtime = request.header("X-OC-Mtime");
+    if (!mtime.isEmpty()) {
+        node->lastModified = QDateTime::fromTime_t(mtime.toUInt());
+        response.setHeader("X-OC-MTime", "accepted");
+    } else {
+        node->lastModified = QDateTime::currentDateTimeUtc();
+    }
+    touch(node);
+    setFileHeaders(&response, *node);
+    return response;
+}
+
+HttpResponse DavHandler::capabilities() const
+{
+    QJsonObject version;
+    version.insert("major", 14);
+    version.insert("minor", 0);
+    version.insert("micro", 0);
+    version.insert("string", QStringLiteral("14.0.0"));
+    version.insert("edition", QString());
+
+    QJsonObject core;
+    core.insert("pollinterval", 60);
+    core.insert("webdav-root", QStringLiteral("remote.php/webdav"));
+
+    QJsonObject checksums;
+    checksums.insert("supportedTypes", QJsonArray::fromStringList({ QStringLiteral("SHA1") }));
+    checksums.insert("preferredUploadType", QStringLiteral("SHA1"));
+
+    QJsonObject files;
+    files.insert("bigfilechunking", true);
+    files.insert("undelete", false);
+    files.insert("versioning", false);
+
+    QJsonObject capabilities;
+    capabilities.insert("core", core);
+    capabilities.insert("checksums", checksums);
+    capabilities.insert("files", files);
+    if (_chunkingNg) {
+        QJsonObject dav;
+        dav.insert("chunking", QStringLiteral("1.0"));
+        dav.insert("chunkingDelta", _chunkingDelta);
+        capabilities.insert("dav", dav);
+    }
+
+    QJsonObject data;
+    data.insert("version", version);
+    data.insert("capabilities", capabilities);
+    return ocsResponse(QJsonDocument(data).toJson(QJsonDocument::Compact));
+}
+
+HttpResponse DavHandler::ocsResponse(const QByteArray &data) const
+{
+    // Written by hand: JsonApiJob looks for "statuscode":100, followed by a comma
+    HttpResponse response(200, "{\"ocs\":{\"meta\":{\"status\":\"ok\",\"statuscode\":100,\"message\":\"OK\"},\"data\":" + data + "}}");
+    response.setHeader("Content-Type", "application/json; charset=utf-8");
+    return response;
+}
+
+DavHandler::Node *DavHandler::find(Node *root, const QString &path) const
+{
+    Node *node = root;
+    for (const auto &part : pathParts(path)) {
+        auto it = node->children.find(part);
+        if (it == node->children.end())
+            return nullptr;
+        node = it->second.get();
+    }
+    return node;
+}
+
+DavHandler::Node *DavHandler::create(Node *root, const QString &path, bool isDir, bool *created)
+{
+    const QStringList parts = pathParts(path);
+    if (parts.isEmpty())
+        return nullptr;
+    Node *parent = find(root, QStringList(parts.mid(0, parts.size() - 1)).join(QLatin1Char('/')));
+    if (!parent || !parent->isDir)
+        return nullptr;
+
+    auto &slot = parent->children[parts.last()];
+    *created = !slot;
+    if (!slot) {
+        slot.reset(new Node);
+        slot->name = parts.last();
+        slot->isDir = isDir;
+        slot->parent = parent;
+        slot->fileId = newFileId();
+        slot->lastModified = QDateTime::currentDateTimeUtc();
+    }
+    touch(slot.get());
+    return slot.get();
+}
+
+void DavHandler::touch(Node *node)
+{
+    // A change gives the node and all its parents a new etag, parent
+    // folders also get a new modification time
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    for (Node *n = node; n; n = n->parent) {
+        n->etag = QByteArray::number(++_lastEtag, 16).rightJustified(13, '0');
+        if (n != node || n->lastModified.isNull())
+            n->lastModified = now;
+    }
+}
+
+void DavHandler::copyTree(const Node &source, Node *target)
+{
+    target->isDir = source.isDir;
+    target->content = source.content;
+    target->checksums = source.checksums;
+    target->lastModified = source.lastModified;
+    target->fileId = newFileId();
+    target->etag = QByteArray::number(++_lastEtag, 16).rightJustified(13, '0');
+    for (const auto &child : source.children) {
+        std::unique_ptr<Node> copy(new Node);
+        copy->name = child.first;
+        copy->parent = target;
+        copyTree(*child.second, copy.get());
+        target->children[child.first] = std::move(copy);
+    }
+}
+
+bool DavHandler::destinationPath(const QByteArray &destination, QString *path) const
+{
+    QString decoded = QUrl::fromPercentEncoding(destination);
+    if (decoded.startsWith(QLatin1String("http://")) || decoded.startsWith(QLatin1String("https://")))
+        decoded = QUrl(decoded).path();
+    return stripPrefix(decoded, QStringLiteral("/remote.php/webdav"), path)
+        || stripPrefix(decoded, QStringLiteral("/remote.php/dav/files/") + _user, path);
+}
+
+void DavHandler::setFileHeaders(HttpResponse *response, const Node &node)
+{
+    const QByteArray etag = '"' + node.etag + '"';
+    response->setHeader("ETag", etag);
+    response->setHeader("OC-ETag", etag);
+    response->setHeader("OC-FileId", node.fileId);
+}
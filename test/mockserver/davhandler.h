@@ -0,0 +1,101 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#ifndef MOCKSERVER_DAVHANDLER_H
+#define MOCKSERVER_DAVHANDLER_H
+
+#include "httpserver.h"
+
+#include <QDateTime>
+#include <QString>
+
+#include <map>
+#include <memory>
+
+/**
+ * An in-memory Nextcloud server for the sync client.
+ *
+ * Serves status.php, the capabilities, and the WebDAV endpoints below
+ * /remote.php/webdav and /remote.php/dav/files/<user> with PROPFIND, GET
+ * (with ranges), PUT, MKCOL, MOVE, COPY, DELETE and PROPPATCH, which only
+ * stores the modification time. Chunked uploads are supported through
+ * /remote.php/dav/uploads/<user>, also delta uploads that take parts of
+ * the existing file as described by a .manifest.
+ *
+ * Any credentials are accepted.
+ */
+class DavHandler
+{
+public:
+    explicit DavHandler(const QString &user);
+
+    HttpResponse handle(const HttpRequest &request);
+
+    /// Whether the capabilities announce chunked uploads and the new dav path
+    void setChunkingNg(bool enabled) { _chunkingNg = enabled; }
+
+    /// Whether the capabilities announce delta uploads, with chunking only
+    void setChunkingDelta(bool enabled) { _chunkingDelta = enabled; }
+
+    /// Copies a local directory into the file tree
+    bool populate(const QString &localPath);
+
+private:
+    struct Node
+    {
+        QString name;
+        bool isDir = false;
+        QByteArray content;
+        QDateTime lastModified;
+        QByteArray etag;
+        QByteArray fileId;
+        QByteArray checksums;
+        Node *parent = nullptr;
+        std::map<QString, std::unique_ptr<Node>> children;
+
+        QString path() const;
+        qint64 size() const;
+    };
+
+    enum class Tree {
+        Files,
+        Uploads
+    };
+
+    HttpResponse handleDav(const HttpRequest &request, Tree tree, const QString &path, const QString &prefix);
+    HttpResponse propfind(const HttpRequest &request, Node *node, const QString &prefix);
+    HttpResponse proppatch(const HttpRequest &request, Node *node, const QString &prefix);
+    HttpResponse get(const HttpRequest &request, Node *node);
+    HttpResponse put(const HttpRequest &request, Node *root, const QString &path);
+    HttpResponse mkcol(Node *root, const QString &path);
+    HttpResponse moveOrCopy(const HttpRequest &request, Tree tree, const QString &path);
+    HttpResponse remove(Node *node);
+    HttpResponse assembleChunks(const HttpRequest &request, Node *uploadDir, const QString &destination);
+
+    HttpResponse capabilities() const;
+    HttpResponse ocsResponse(const QByteArray &data) const;
+
+    QByteArray newFileId();
+    Node *find(Node *root, const QString &path) const;
+    Node *create(Node *root, const QString &path, bool isDir, bool *created);
+    void touch(Node *node);
+    void copyTree(const Node &source, Node *target);
+    /// Maps a Destination header to a path in the file tree
+    bool destinationPath(const QByteArray &destination, QString *path) const;
+    static void setFileHeaders(HttpResponse *response, const Node &node);
+
+    QString _user;
+    QByteArray _instanceId;
+    bool _chunkingNg = true;
+    bool _chunkingDelta = true;
+    Node _files;
+    Node _uploads;
+    quint64 _lastFileId = 0;
+    quint64 _lastEtag = 0;
+};
+
+#endif
@@ -14,51 +14,324 @@
 
 #include "httpserver.h"
 
-HttpServer::HttpServer(quint16 port, QObject* parent)
-    : QTcpServer(parent)
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocale>
+#include <QSslSocket>
+#include <QTimer>
+#include <QUrl>
+
+namespace {
+
+// Bandwidth limits are applied in slices of this length
+const int paceInterval = 50;
+
+// Requests whose headers don't fit are refused
+const int maxHeaderSize = 64 * 1024;
+
+QByteArray reasonPhrase(int status)
 {
-    listen(QHostAddress::Any, port);
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 207: return "Multi-Status";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 412: return "Precondition Failed";
+    case 416: return "Range Not Satisfiable";
+    case 423: return "Locked";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 507: return "Insufficient Storage";
+    default: return "Unknown";
+    }
 }
 
-void HttpServer::readClient()
+/*
+ * One client connection. Requests are answered in order; the next request
+ * is only parsed once the response to the previous one was written.
+ */
+class HttpConnection : public QObject
 {
-    QTcpSocket* socket = (QTcpSocket*)sender();
-    if (socket->canReadLine()) {
-        QStringList tokens = QString(socket->readLine()).split(QRegExp("[ \r\n][ \r\n]*"));
-        if (tokens[0] == "GET") {
-            QTextStream os(socket);
-            os.setAutoDetectUnicode(true);
-            os << "HTTP/1.0 200 Ok\r\n"
-                "Content-Type: text/html; charset=\"utf-8\"\r\n"
-                "\r\n"
-                "<h1>Nothing to see here</h1>\n"
-                << QDateTime::currentDateTimeUtc().toString() << "\n";
-            socket->close();
-
-            QtServiceBase::instance()->logMessage("Wrote to client");
-
-            if (socket->state() == QTcpSocket::UnconnectedState) {
-                delete socket;
-                QtServiceBase::instance()->logMessage("Connection closed");
+public:
+    HttpConnection(HttpServer *server, QTcpSocket *socket)
+        : QObject(server)
+        , _server(server)
+        , _socket(socket)
+    {
+        _socket->setParent(this);
+        connect(_socket, &QTcpSocket::disconnected, this, &QObject::deleteLater);
+        connect(_socket, &QIODevice::bytesWritten, this, [this] { writePending(); });
+
+        if (_server->bandwidthLimit() > 0) {
+            // Keep the socket from reading ahead so that tcp flow control
+            // slows down the client
+            _socket->setReadBufferSize(sliceSize());
+            _pace.setInterval(paceInterval);
+            connect(&_pace, &QTimer::timeout, this, [this] {
+                readAvailable();
+                writePending();
+            });
+            _pace.start();
+        } else {
+            connect(_socket, &QIODevice::readyRead, this, [this] { readAvailable(); });
+        }
+    }
+
+private:
+    qint64 sliceSize() const
+    {
+        return qMax<qint64>(1, _server->bandwidthLimit() * paceInterval / 1000);
+    }
+
+    void readAvailable()
+    {
+        QByteArray data = _server->bandwidthLimit() > 0 ? _socket->read(sliceSize()) : _socket->readAll();
+        if (data.isEmpty())
+            return;
+        _server->countBytesReceived(data.size());
+        _input.append(data);
+        processInput();
+    }
+
+    void processInput()
+    {
+        if (_busy)
+            return;
+
+        int headerEnd = _input.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (_input.size() > maxHeaderSize) {
+                _closeAfterResponse = true;
+                respond(HttpResponse(431), false);
+            }
+            return;
+        }
+
+        HttpRequest request;
+        const QList<QByteArray> lines = _input.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        if (requestLine.size() != 3) {
+            _closeAfterResponse = true;
+            respond(HttpResponse(400), false);
+            return;
+        }
+        request.method = requestLine[0];
+        const QByteArray target = requestLine[1];
+        const int queryStart = target.indexOf('?');
+        request.path = QUrl::fromPercentEncoding(target.left(queryStart));
+        if (queryStart >= 0)
+            request.query = target.mid(queryStart + 1);
+        for (int i = 1; i < lines.size(); ++i) {
+            const int colon = lines[i].indexOf(':');
+            if (colon <= 0)
+                continue;
+            request.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+        }
+
+        const bool http10 = requestLine[2] == "HTTP/1.0";
+        const QByteArray connection = request.header("Connection").toLower();
+        _closeAfterResponse = connection == "close" || (http10 && connection != "keep-alive");
+
+        if (request.header("Transfer-Encoding").toLower().contains("chunked")) {
+            _closeAfterResponse = true;
+            respond(HttpResponse(411), false);
+            return;
+        }
+
+        const qint64 bodySize = request.header("Content-Length").toLongLong();
+        const qint64 bodyStart = headerEnd + 4;
+        if (_input.size() < bodyStart + bodySize)
+            return;
+        request.body = _input.mid(bodyStart, bodySize);
+        _input.remove(0, bodyStart + bodySize);
+
+        _busy = true;
+        const HttpResponse response = _server->handle(request);
+        const bool withBody = request.method != "HEAD";
+        if (_server->latency() > 0) {
+            QTimer::singleShot(_server->latency(), this, [this, response, withBody] { respond(response, withBody); });
+        } else {
+            respond(response, withBody);
+        }
+    }
+
+    void respond(const HttpResponse &response, bool withBody)
+    {
+        _busy = true;
+        QByteArray data = "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reasonPhrase(response.status) + "\r\n";
+        data += "Date: " + QLocale::c().toString(QDateTime::currentDateTimeUtc(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'").toLatin1() + "\r\n";
+        data += "Server: mockserver\r\n";
+        for (const auto &header : response.headers)
+            data += header.first + ": " + header.second + "\r\n";
+        data += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n";
+        data += _closeAfterResponse ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+        data += "\r\n";
+        if (withBody)
+            data += response.body;
+
+        _output = data;
+        _outputPos = 0;
+        writePending();
+    }
+
+    void writePending()
+    {
+        if (_outputPos < _output.size()) {
+            qint64 size = _output.size() - _outputPos;
+            if (_server->bandwidthLimit() > 0) {
+                // Only queue the next slice once the previous one left
+                if (_socket->bytesToWrite() > 0)
+                    return;
+                size = qMin(size, sliceSize());
+            }
+            const qint64 written = _socket->write(_output.constData() + _outputPos, size);
+            if (written < 0) {
+                _socket->abort();
+                return;
             }
+            _outputPos += written;
+            _server->countBytesSent(written);
+            if (_outputPos < _output.size())
+                return;
+        }
+        if (!_busy || _socket->bytesToWrite() > 0 || _outputPos < _output.size())
+            return;
+
+        _output.clear();
+        _outputPos = 0;
+        _busy = false;
+        if (_closeAfterResponse) {
+            _socket->disconnectFromHost();
+            return;
         }
+        processInput();
+    }
+
+    HttpServer *_server;
+    QTcpSocket *_socket;
+    QTimer _pace;
+    QByteArray _input;
+    QByteArray _output;
+    qint64 _outputPos = 0;
+    bool _busy = false;
+    bool _closeAfterResponse = false;
+};
+
+} // anonymous namespace
+
+HttpServer::HttpServer(const Handler &handler, QObject *parent)
+    : QTcpServer(parent)
+    , _handler(handler)
+    , _random(std::random_device()())
+{
+}
+
+void HttpServer::addErrorRule(const QByteArray &method, const QRegularExpression &path, int status)
+{
+    _errorRules.append({ method.toUpper(), path, status });
+}
+
+void HttpServer::setTls(const QSslCertificate &certificate, const QSslKey &key)
+{
+    _certificate = certificate;
+    _key = key;
+}
+
+int HttpServer::injectedError(const HttpRequest &request)
+{
+    for (const auto &rule : _errorRules) {
+        if ((rule.method.isEmpty() || rule.method == request.method) && rule.path.match(request.path).hasMatch())
+            return rule.status;
+    }
+    if (_errorRate > 0 && std::uniform_real_distribution<double>(0, 1)(_random) < _errorRate)
+        return 503;
+    return 0;
+}
+
+HttpResponse HttpServer::handle(const HttpRequest &request)
+{
+    if (request.path == QLatin1String("/mockserver/stats")) {
+        HttpResponse response(200, statistics());
+        response.setHeader("Content-Type", "application/json");
+        return response;
+    }
+    if (request.path == QLatin1String("/mockserver/reset") && request.method == "POST") {
+        resetStatistics();
+        return HttpResponse(204);
     }
+
+    ++_requestCounts[request.method];
+    HttpResponse response;
+    if (int status = injectedError(request)) {
+        ++_injectedErrors;
+        response = HttpResponse(status);
+    } else {
+        response = _handler(request);
+    }
+    ++_statusCounts[response.status];
+    return response;
 }
-void HttpServer::discardClient()
+
+QByteArray HttpServer::statistics() const
 {
-    QTcpSocket* socket = (QTcpSocket*)sender();
-    socket->deleteLater();
+    QJsonObject requests;
+    qint64 total = 0;
+    for (auto it = _requestCounts.constBegin(); it != _requestCounts.constEnd(); ++it) {
+        requests.insert(QString::fromLatin1(it.key()), it.value());
+        total += it.value();
+    }
+    QJsonObject statuses;
+    for (auto it = _statusCounts.constBegin(); it != _statusCounts.constEnd(); ++it)
+        statuses.insert(QString::number(it.key()), it.value());
 
-    QtServiceBase::instance()->logMessage("Connection closed");
+    QJsonObject stats;
+    stats.insert("requests", requests);
+    stats.insert("total", total);
+    stats.insert("statuses", statuses);
+    stats.insert("injectedErrors", _injectedErrors);
+    stats.insert("bytesReceived", _bytesReceived);
+    stats.insert("bytesSent", _bytesSent);
+    return QJsonDocument(stats).toJson();
 }
 
+void HttpServer::resetStatistics()
+{
+    _requestCounts.clear();
+    _statusCounts.clear();
+    _injectedErrors = 0;
+    _bytesReceived = 0;
+    _bytesSent = 0;
+}
 
-void HttpServer::incomingConnection(int socket)
+void HttpServer::incomingConnection(qintptr socketDescriptor)
 {
-    if (disabled)
+    QTcpSocket *socket = nullptr;
+    if (!_certificate.isNull()) {
+        auto sslSocket = new QSslSocket;
+        sslSocket->setLocalCertificate(_certificate);
+        sslSocket->setPrivateKey(_key);
+        sslSocket->setPeerVerifyMode(QSslSocket::VerifyNone);
+        socket = sslSocket;
+    } else {
+        socket = new QTcpSocket;
+    }
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
         return;
-    QTcpSocket* s = new QTcpSocket(this);
-    connect(s, SIGNAL(readyRead()), this, SLOT(readClient()));
-    connect(s, SIGNAL(disconnected()), this, SLOT(discardClient()));
-    s->setSocketDescriptor(socket);
+    }
+    new HttpConnection(this, socket);
+    if (auto sslSocket = qobject_cast<QSslSocket *>(socket))
+        sslSocket->startServerEncryption();
 }
@@ -12,16 +12,123 @@
  * for more details.
  */
 
+#ifndef MOCKSERVER_HTTPSERVER_H
+#define MOCKSERVER_HTTPSERVER_H
+
 #include <QTcpServer>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QRegularExpression>
+#include <QSslCertificate>
+#include <QSslKey>
+
+#include <functional>
+#include <random>
+
+struct HttpRequest
+{
+    QByteArray method;
+    /// The percent decoded path, without the query
+    QString path;
+    QByteArray query;
+    /// Header names are lower case
+    QMap<QByteArray, QByteArray> headers;
+    QByteArray body;
+
+    QByteArray header(const QByteArray &name) const { return headers.value(name.toLower()); }
+};
+
+struct HttpResponse
+{
+    int status = 200;
+    QList<QPair<QByteArray, QByteArray>> headers;
+    QByteArray body;
+
+    HttpResponse(int status = 200, const QByteArray &body = QByteArray())
+        : status(status)
+        , body(body)
+    {
+    }
+
+    void setHeader(const QByteArray &name, const QByteArray &value) { headers.append(qMakePair(name, value)); }
+};
 
+/**
+ * A small HTTP/1.1 server that passes every request to a handler function.
+ *
+ * It emulates the network conditions of a real server: a fixed latency per
+ * request, a bandwidth limit per connection, and injected errors. The
+ * requests are counted per method; GET /mockserver/stats returns the counters
+ * as JSON and POST /mockserver/reset clears them.
+ *
+ * Request bodies must have a Content-Length, chunked transfer encoding is
+ * not supported.
+ */
 class HttpServer : public QTcpServer
- {
-     Q_OBJECT
- public:
-    HttpServer(qint16 port, QObject* parent = 0);
-    void incomingConnection(int socket);
-
- private slots:
-     void readClient();
-     void discardClient();
- };
+{
+    Q_OBJECT
+public:
+    typedef std::function<HttpResponse(const HttpRequest &)> Handler;
+
+    explicit HttpServer(const Handler &handler, QObject *parent = 0);
+
+    /// Delay before every response is sent, in milliseconds
+    void setLatency(int msec) { _latency = msec; }
+    int latency() const { return _latency; }
+
+    /// Bytes per second in each direction on each connection, 0 means no limit
+    void setBandwidthLimit(qint64 bytesPerSecond) { _bandwidthLimit = bytesPerSecond; }
+    qint64 bandwidthLimit() const { return _bandwidthLimit; }
+
+    /// Fraction of requests that fail with a 503, between 0 and 1
+    void setErrorRate(double rate) { _errorRate = rate; }
+
+    /// Requests with this method whose path matches the pattern fail with the status.
+    /// An empty method matches all methods.
+    void addErrorRule(const QByteArray &method, const QRegularExpression &path, int status);
+
+    /// Serve https with this certificate instead of plain http
+    void setTls(const QSslCertificate &certificate, const QSslKey &key);
+
+    /// Returns the status injected for this request, or 0 if it should be handled
+    int injectedError(const HttpRequest &request);
+
+    /// Called by the connections when a request was fully received
+    HttpResponse handle(const HttpRequest &request);
+    void countBytesReceived(qint64 bytes) { _bytesReceived += bytes; }
+    void countBytesSent(qint64 bytes) { _bytesSent += bytes; }
+
+    QByteArray statistics() const;
+    void resetStatistics();
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    struct ErrorRule
+    {
+        QByteArray method;
+        QRegularExpression path;
+        int status;
+    };
+
+    Handler _handler;
+    int _latency = 0;
+    qint64 _bandwidthLimit = 0;
+    double _errorRate = 0;
+    QList<ErrorRule> _errorRules;
+    std::mt19937 _random;
+
+    QSslCertificate _certificate;
+    QSslKey _key;
+
+    QMap<QByteArray, qint64> _requestCounts;
+    QMap<int, qint64> _statusCounts;
+    qint64 _injectedErrors = 0;
+    qint64 _bytesReceived = 0;
+    qint64 _bytesSent = 0;
+};
+
+#endif
@@ -12,13 +12,85 @@
  * for more details.
  */
 
+#include <QCommandLineParser>
 #include <QCoreApplication>
+#include <QFile>
+#include <QTextStream>
 
+#include "davhandler.h"
 #include "httpserver.h"
 
-int main(int argc, char* argv[])
+/*
+ * A local stand-in for a Nextcloud server, to run nextcloudcmd and the
+ * client against under reproducible network conditions:
+ *
+ *   mockserver --port 8080 --latency 50 --bandwidth 1000000 --populate ~/testdata
+ *   nextcloudcmd -u admin -p admin ~/sync http://localhost:8080
+ *   curl http://localhost:8080/mockserver/stats
+ *
+ * run-sync.sh next to this file does these steps and times the syncs.
+ */
+int main(int argc, char *argv[])
 {
-  QCoreApplication app(argc, argv);
-  HttpServer server;
-  return app.exec();
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("In-memory WebDAV server that behaves like Nextcloud for the sync client.");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "Port to listen on.", "port", "8080");
+    QCommandLineOption userOption("user", "User name in the dav paths.", "user", "admin");
+    QCommandLineOption latencyOption("latency", "Delay of every response in milliseconds.", "msec", "0");
+    QCommandLineOption bandwidthOption("bandwidth", "Bytes per second in each direction per connection, 0 for no limit.", "bytes", "0");
+    QCommandLineOption errorRateOption("error-rate", "Fraction of requests that fail with 503.", "rate", "0");
+    QCommandLineOption failOption("fail", "Fail requests: METHOD:REGEX:STATUS, an empty METHOD matches all. Can be repeated.", "rule");
+    QCommandLineOption populateOption("populate", "Start with a copy of this local directory.", "dir");
+    QCommandLineOption noChunkingOption("no-chunking", "Don't announce chunked uploads, the client uses single PUTs.");
+    QCommandLineOption noDeltaOption("no-delta", "Don't announce delta uploads.");
+    QCommandLineOption certOption("tls-cert", "PEM certificate, serves https together with --tls-key.", "file");
+    QCommandLineOption keyOption("tls-key", "PEM private key for --tls-cert.", "file");
+    parser.addOptions({ portOption, userOption, latencyOption, bandwidthOption, errorRateOption, failOption,
+        populateOption, noChunkingOption, noDeltaOption, certOption, keyOption });
+    parser.process(app);
+
+    DavHandler dav(parser.value(userOption));
+    dav.setChunkingNg(!parser.isSet(noChunkingOption));
+    dav.setChunkingDelta(!parser.isSet(noDeltaOption));
+    if (parser.isSet(populateOption) && !dav.populate(parser.value(populateOption))) {
+        err << "Could not read " << parser.value(populateOption) << endl;
+        return 1;
+    }
+
+    HttpServer server([&dav](const HttpRequest &request) { return dav.handle(request); });
+    server.setLatency(parser.value(latencyOption).toInt());
+    server.setBandwidthLimit(parser.value(bandwidthOption).toLongLong());
+    server.setErrorRate(parser.value(errorRateOption).toDouble());
+    for (const auto &rule : parser.values(failOption)) {
+        // the regular expression may contain colons
+        const int first = rule.indexOf(QLatin1Char(':'));
+        const int last = rule.lastIndexOf(QLatin1Char(':'));
+        bool ok = false;
+        const int status = rule.mid(last + 1).toInt(&ok);
+        if (first < 0 || first == last || !ok) {
+            err << "Invalid rule " << rule << endl;
+            return 1;
+        }
+        server.addErrorRule(rule.left(first).toLatin1(), QRegularExpression(rule.mid(first + 1, last - first - 1)), status);
+    }
+
+    if (parser.isSet(certOption)) {
+        QFile certFile(parser.value(certOption));
+        QFile keyFile(parser.value(keyOption));
+        if (!certFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly)) {
+            err << "Could not read the certificate or key" << endl;
+            return 1;
+        }
+        server.setTls(QSslCertificate(&certFile), QSslKey(&keyFile, QSsl::Rsa));
+    }
+
+    if (!server.listen(QHostAddress::LocalHost, parser.value(portOption).toUShort())) {
+        err << "Could not listen: " << server.errorString() << endl;
+        return 1;
+    }
+    return app.exec();
 }
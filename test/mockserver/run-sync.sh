@@ -0,0 +1,96 @@
+#!/bin/sh
+#
+# Starts the mock server with the given network conditions, syncs a folder
+# with nextcloudcmd against it and prints the time of every sync and the
+# request statistics of the server.
+#
+#   test/mockserver/run-sync.sh [-b bindir] [-n runs] [-p port] [-u user] localdir [mockserver options]
+#
+# The first sync uploads localdir, or downloads the --populate directory into
+# it; the following runs measure syncs without changes. Example:
+#
+#   test/mockserver/run-sync.sh -b build/bin -n 3 /tmp/sync --latency 50 --bandwidth 1000000
+#
+# Options after localdir are passed to the mock server. Extra nextcloudcmd
+# options can be set in NEXTCLOUDCMD_OPTIONS, e.g. "--delta-uploads".
+
+BINDIR=bin
+RUNS=2
+PORT=8080
+DAVUSER=admin
+
+usage() {
+    sed -n '3,16s/^# \{0,1\}//p' "$0" >&2
+    exit 1
+}
+
+while getopts "b:n:p:u:h" opt; do
+    case $opt in
+        b) BINDIR=$OPTARG ;;
+        n) RUNS=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        u) DAVUSER=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -ge 1 ] || usage
+# The logs go next to the folder, not into it
+LOCALDIR=${1%/}
+shift
+
+MOCKSERVER=${MOCKSERVER:-$BINDIR/mockserver}
+NEXTCLOUDCMD=${NEXTCLOUDCMD:-$BINDIR/nextcloudcmd}
+URL=http://localhost:$PORT
+
+for exe in "$MOCKSERVER" "$NEXTCLOUDCMD"; do
+    if [ ! -x "$exe" ]; then
+        echo "$exe not found, use -b or set MOCKSERVER and NEXTCLOUDCMD" >&2
+        exit 1
+    fi
+done
+mkdir -p "$LOCALDIR" || exit 1
+
+"$MOCKSERVER" --port "$PORT" --user "$DAVUSER" "$@" &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+
+# Wait until the server answers, or give up after 10 seconds
+tries=0
+until curl -sf "$URL/status.php" >/dev/null; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ] || ! kill -0 $SERVER_PID 2>/dev/null; then
+        echo "The mock server did not start" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+now_ms() {
+    # %N is not portable, fall back to whole seconds
+    ms=$(date +%s%3N)
+    case $ms in
+        *N) echo $(($(date +%s) * 1000)) ;;
+        *) echo "$ms" ;;
+    esac
+}
+
+status=0
+run=1
+while [ $run -le "$RUNS" ]; do
+    curl -sf -X POST "$URL/mockserver/reset" >/dev/null
+    start=$(now_ms)
+    # shellcheck disable=SC2086
+    "$NEXTCLOUDCMD" --silent --non-interactive -u "$DAVUSER" -p "$DAVUSER" $NEXTCLOUDCMD_OPTIONS \
+        "$LOCALDIR" "$URL" >"$LOCALDIR.run$run.log" 2>&1
+    result=$?
+    end=$(now_ms)
+
+    echo "Run $run: exit code $result after $((end - start)) ms, log in $LOCALDIR.run$run.log"
+    curl -sf "$URL/mockserver/stats"
+    echo
+    [ $result -eq 0 ] || status=1
+    run=$((run + 1))
+done
+
+exit $status
@@ -3,5 +3,6 @@
 OCC::AccountManager *OCC::AccountManager::instance() { return static_cast<AccountManager *>(new QObject); }
 void OCC::AccountManager::saveAccountState(AccountState *) { }
 void OCC::AccountManager::save(bool saveCredentials) { Q_UNUSED(saveCredentials); }
+OCC::AccountStatePtr OCC::AccountManager::account(const QString &) { return AccountStatePtr(); }
 void OCC::AccountManager::accountRemoved(OCC::AccountState*) { }
 const QMetaObject OCC::AccountManager::staticMetaObject = QObject::staticMetaObject;
@@ -18,6 +18,8 @@
 #include <QMap>
 #include <QtTest>
 
+#include <cstring>
+
 /*
  * TODO: In theory we should use QVERIFY instead of Q_ASSERT for testing, but this
  * only works when directly called from a QTest :-(
@@ -296,6 +298,8 @@ public:
     QByteArray extraDavProperties;
     qint64 size = 0;
     char contentChar = 'W';
+    // Only kept for the .manifest of delta uploads, files are a size and a character
+    QByteArray content;
 
     // Sorted by name to be able to compare trees
     QMap<QString, FileInfo> children;
@@ -364,6 +368,7 @@ public:
             xml.writeTextElement(davUri, QStringLiteral("getetag"), fileInfo.etag);
             xml.writeTextElement(ocUri, QStringLiteral("permissions"), fileInfo.isShared ? QStringLiteral("SRDNVCKW") : QStringLiteral("RDNVCKW"));
             xml.writeTextElement(ocUri, QStringLiteral("id"), fileInfo.fileId);
+            xml.writeTextElement(ocUri, QStringLiteral("fileid"), fileInfo.fileId);
             xml.writeTextElement(ocUri, QStringLiteral("checksums"), fileInfo.checksums);
             buffer.write(fileInfo.extraDavProperties);
             xml.writeEndElement(); // prop
@@ -372,9 +377,18 @@ public:
             xml.writeEndElement(); // response
         };
 
+        const QByteArray depth = request.rawHeader("Depth");
+        std::function<void(const FileInfo &)> writeChildren = [&](const FileInfo &dirInfo) {
+            foreach(const FileInfo &childFileInfo, dirInfo.children) {
+                writeFileResponse(childFileInfo);
+                if (depth == "infinity" && childFileInfo.isDir)
+                    writeChildren(childFileInfo);
+            }
+        };
+
         writeFileResponse(*fileInfo);
-        foreach(const FileInfo &childFileInfo, fileInfo->children)
-           writeFileResponse(childFileInfo);
+        if (depth != "0")
+            writeChildren(*fileInfo);
         xml.writeEndElement(); // multistatus
         xml.writeEndDocument();
 
@@ -436,6 +450,8 @@ public:
             abort();
             return;
         }
+        if (fileInfo->name == QLatin1String(".manifest"))
+            fileInfo->content = putPayload;
         fileInfo->lastModified = OCC::Utility::qDateTimeFromTime_t(request.rawHeader("X-OC-Mtime").toLongLong());
         remoteRootFileInfo.find(fileName, /*invalidate_etags=*/true);
         QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
@@ -550,6 +566,97 @@ public:
     qint64 readData(char *, qint64) override { return 0; }
 };
 
+class FakeCopyReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    int _httpCode = 201;
+
+    FakeCopyReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        QString fileName = getFilePathFromUrl(request.url());
+        Q_ASSERT(!fileName.isEmpty());
+        QString dest = getFilePathFromUrl(QUrl::fromEncoded(request.rawHeader("Destination")));
+        Q_ASSERT(!dest.isEmpty());
+        const FileInfo *source = remoteRootFileInfo.find(fileName);
+        const QByteArray ifMatch = request.rawHeader("If-Match");
+        if (!source) {
+            _httpCode = 404;
+        } else if (!ifMatch.isEmpty() && ifMatch != '"' + source->etag.toUtf8() + '"') {
+            _httpCode = 412;
+        } else if (remoteRootFileInfo.find(dest) && request.rawHeader("Overwrite") == "F") {
+            _httpCode = 412;
+        } else {
+            Q_ASSERT(!source->isDir);
+            const FileInfo original = *source;
+            FileInfo *copy = remoteRootFileInfo.create(dest, original.size, original.contentChar);
+            // The copy gets the time it was made, not the one of the source
+            copy->lastModified = QDateTime::currentDateTimeUtc();
+            copy->checksums = original.checksums;
+        }
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond() {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, _httpCode);
+        if (_httpCode != 201)
+            setError(ContentOperationNotPermittedError, "Copy failed");
+        emit metaDataChanged();
+        emit finished();
+    }
+
+    void abort() override { }
+    qint64 readData(char *, qint64) override { return 0; }
+};
+
+class FakeProppatchReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    int _httpCode = 207;
+
+    FakeProppatchReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &body, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        QString fileName = getFilePathFromUrl(request.url());
+        Q_ASSERT(!fileName.isEmpty());
+        FileInfo *fileInfo = remoteRootFileInfo.find(fileName);
+        if (!fileInfo) {
+            _httpCode = 404;
+        } else {
+            // Only the modification time can be set
+            QXmlStreamReader xml(body);
+            while (!xml.atEnd()) {
+                if (xml.readNext() == QXmlStreamReader::StartElement && xml.name() == QLatin1String("lastmodified")) {
+                    fileInfo->lastModified = OCC::Utility::qDateTimeFromTime_t(xml.readElementText().toLongLong());
+                    fileInfo->etag = generateEtag();
+                }
+            }
+        }
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond() {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, _httpCode);
+        if (_httpCode != 207)
+            setError(ContentNotFoundError, "Not Found");
+        emit metaDataChanged();
+        emit finished();
+    }
+
+    void abort() override { }
+    qint64 readData(char *, qint64) override { return 0; }
+};
+
 class FakeGetReply : public QNetworkReply
 {
     Q_OBJECT
@@ -572,7 +679,7 @@ public:
         QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
     }
 
-    Q_INVOKABLE void respond() {
+    Q_INVOKABLE virtual void respond() {
         if (aborted) {
             setError(OperationCanceledError, "Operation Canceled");
             emit metaDataChanged();
@@ -581,8 +688,19 @@ public:
         }
         payload = fileInfo->contentChar;
         size = fileInfo->size;
+        int status = 200;
+        // Resumed downloads ask for the rest of the file
+        const QByteArray range = request().rawHeader("Range");
+        if (range.startsWith("bytes=") && range.endsWith('-')) {
+            const int start = range.mid(6, range.size() - 7).toInt();
+            if (start > 0 && start < size) {
+                setRawHeader("Content-Range", QString("bytes %1-%2/%3").arg(start).arg(size - 1).arg(size).toLatin1());
+                size -= start;
+                status = 206;
+            }
+        }
         setHeader(QNetworkRequest::ContentLengthHeader, size);
-        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
         setRawHeader("OC-ETag", fileInfo->etag.toLatin1());
         setRawHeader("ETag", fileInfo->etag.toLatin1());
         setRawHeader("OC-FileId", fileInfo->fileId);
@@ -635,40 +753,76 @@ public:
         auto sourceFolder = uploadsFileInfo.find(source);
         Q_ASSERT(sourceFolder);
         Q_ASSERT(sourceFolder->isDir);
-        int count = 0;
-        int size = 0;
-        char payload = '\0';
-
-        do {
-            QString chunkName = QString::number(count).rightJustified(8, '0');
-            if (!sourceFolder->children.contains(chunkName))
-                break;
-            auto &x = sourceFolder->children[chunkName];
-            Q_ASSERT(!x.isDir);
-            Q_ASSERT(x.size > 0); // There should not be empty chunks
-            size += x.size;
-            Q_ASSERT(!payload || payload == x.contentChar);
-            payload = x.contentChar;
-            ++count;
-        } while(true);
-
-        Q_ASSERT(count > 1); // There should be at least two chunks, otherwise why would we use chunking?
-        QCOMPARE(sourceFolder->children.count(), count); // There should not be holes or extra files
 
         QString fileName = getFilePathFromUrl(QUrl::fromEncoded(request.rawHeader("Destination")));
         Q_ASSERT(!fileName.isEmpty());
 
-        if ((fileInfo = remoteRootFileInfo.find(fileName))) {
+        FileInfo *existing = remoteRootFileInfo.find(fileName);
+        if (existing) {
             QVERIFY(request.hasRawHeader("If")); // The client should put this header
             if (request.rawHeader("If") != QByteArray("<" + request.rawHeader("Destination") +
-                                                "> ([\"" + fileInfo->etag.toLatin1() + "\"])")) {
+                                                "> ([\"" + existing->etag.toLatin1() + "\"])")) {
                 QMetaObject::invokeMethod(this, "respondPreconditionFailed", Qt::QueuedConnection);
                 return;
             }
+        } else {
+            Q_ASSERT(!request.hasRawHeader("If"));
+        }
+
+        qint64 size = 0;
+        char payload = '\0';
+
+        if (sourceFolder->children.contains(".manifest")) {
+            // A delta upload: the manifest lists the new chunks and the ranges
+            // of the existing file that make up the new content
+            Q_ASSERT(existing);
+            int count = 0;
+            foreach (const QByteArray &line, sourceFolder->children[".manifest"].content.split('\n')) {
+                if (line.isEmpty())
+                    continue;
+                const QList<QByteArray> parts = line.split(' ');
+                char partPayload;
+                if (parts[0] == "base") {
+                    Q_ASSERT(parts.size() == 3);
+                    Q_ASSERT(parts[1].toLongLong() + parts[2].toLongLong() <= existing->size);
+                    size += parts[2].toLongLong();
+                    partPayload = existing->contentChar;
+                } else {
+                    Q_ASSERT(parts[0] == "chunk" && parts.size() == 2);
+                    auto chunk = sourceFolder->children.constFind(QString::fromLatin1(parts[1]));
+                    Q_ASSERT(chunk != sourceFolder->children.constEnd());
+                    Q_ASSERT(chunk->size > 0);
+                    size += chunk->size;
+                    partPayload = chunk->contentChar;
+                    ++count;
+                }
+                Q_ASSERT(!payload || payload == partPayload);
+                payload = partPayload;
+            }
+            QCOMPARE(sourceFolder->children.count(), count + 1); // There should not be unused chunks
+        } else {
+            int count = 0;
+            do {
+                QString chunkName = QString::number(count).rightJustified(8, '0');
+                if (!sourceFolder->children.contains(chunkName))
+                    break;
+                auto &x = sourceFolder->children[chunkName];
+                Q_ASSERT(!x.isDir);
+                Q_ASSERT(x.size > 0); // There should not be empty chunks
+                size += x.size;
+                Q_ASSERT(!payload || payload == x.contentChar);
+                payload = x.contentChar;
+                ++count;
+            } while(true);
+
+            Q_ASSERT(count > 1); // There should be at least two chunks, otherwise why would we use chunking?
+            QCOMPARE(sourceFolder->children.count(), count); // There should not be holes or extra files
+        }
+
+        if ((fileInfo = existing)) {
             fileInfo->size = size;
             fileInfo->contentChar = payload;
         } else {
-            Q_ASSERT(!request.hasRawHeader("If"));
             // Assume that the file is filled with the same character
             fileInfo = remoteRootFileInfo.create(fileName, size, payload);
         }
@@ -710,6 +864,51 @@ public:
 };
 
 
+// A reply with a fixed body, for the requests that are not about files
+class FakePayloadReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    FakePayloadReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+        const QByteArray &body, QObject *parent, int httpStatus = 200,
+        const QByteArray &contentType = "application/json; charset=utf-8")
+        : QNetworkReply{ parent }
+        , _body(body)
+        , _httpStatus(httpStatus)
+        , _contentType(contentType)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond() {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, _httpStatus);
+        setHeader(QNetworkRequest::ContentLengthHeader, _body.size());
+        setHeader(QNetworkRequest::ContentTypeHeader, _contentType);
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        setFinished(true);
+        emit finished();
+    }
+
+    void abort() override { }
+    qint64 bytesAvailable() const override { return _body.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 len = std::min(qint64{_body.size()}, maxlen);
+        std::memcpy(data, _body.constData(), len);
+        _body.remove(0, len);
+        return len;
+    }
+
+    QByteArray _body;
+    int _httpStatus;
+    QByteArray _contentType;
+};
+
 class FakeErrorReply : public QNetworkReply
 {
     Q_OBJECT
@@ -839,6 +1038,10 @@ protected:
             return new FakeMoveReply{info, op, request, this};
         else if (verb == QLatin1String("MOVE") && isUpload)
             return new FakeChunkMoveReply{ info, _remoteRootFileInfo, op, request, this };
+        else if (verb == QLatin1String("COPY") && !isUpload)
+            return new FakeCopyReply{info, op, request, this};
+        else if (verb == QLatin1String("PROPPATCH") && !isUpload)
+            return new FakeProppatchReply{info, op, request, outgoingData->readAll(), this};
         else {
             qDebug() << verb << outgoingData;
             Q_UNREACHABLE();
@@ -879,6 +1082,8 @@ public:
     {
         // Needs to be done once
         OCC::SyncEngine::minimumFileAgeForUpload = 0;
+        // The tests react to the progress of individual chunks
+        OCC::SyncEngine::progressUpdateInterval = 0;
         OCC::Logger::instance()->setLogFile("-");
 
         QDir rootDir{_tempDir.path()};
@@ -900,6 +1105,7 @@ public:
         syncOnce();
     }
 
+    OCC::AccountPtr account() const { return _account; }
     OCC::SyncEngine &syncEngine() const { return *_syncEngine; }
     OCC::SyncJournalDb &syncJournal() const { return *_journalDb; }
 
@@ -914,6 +1120,12 @@ public:
     }
 
     FileInfo currentRemoteState() { return _fakeQnam->currentRemoteState(); }
+
+    /// Runs the engine and the fake server in @a thread, like Folder does with syncInWorkerThread
+    void moveToThread(QThread *thread) {
+        _syncEngine->moveToThread(thread);
+        _fakeQnam->moveToThread(thread);
+    }
     FileInfo &uploadState() { return _fakeQnam->uploadState(); }
 
     struct ErrorList {
@@ -0,0 +1,138 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "activitylistmodel.h"
+
+using namespace OCC;
+
+static Activity makeActivity(Activity::Type type, const QString &file, const QDateTime &dateTime, qlonglong id = 0)
+{
+    Activity activity;
+    activity._type = type;
+    activity._id = id;
+    activity._status = 0;
+    activity._accName = QStringLiteral("user@localhost");
+    activity._file = file;
+    activity._dateTime = dateTime;
+    return activity;
+}
+
+class TestActivityListModel : public QObject
+{
+    Q_OBJECT
+
+    const QDateTime _now = QDateTime::currentDateTime();
+
+private slots:
+    void testSyncFileItemsAreTrimmed()
+    {
+        ActivityListModel model(nullptr);
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+        QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+
+        for (int i = 0; i < 1200; ++i)
+            model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, QString("file%1").arg(i), _now.addMSecs(i)));
+        // Nothing is inserted before the batch is flushed
+        QCOMPARE(model.rowCount(), 0);
+        QVERIFY(inserted.wait());
+
+        // The whole batch goes in as one range, the oldest ones are dropped
+        QCOMPARE(inserted.count(), 1);
+        QCOMPARE(inserted.first().at(1).toInt(), 0);
+        QCOMPARE(inserted.first().at(2).toInt(), 1199);
+        QCOMPARE(removed.count(), 1);
+        QCOMPARE(removed.first().at(1).toInt(), 1000);
+        QCOMPARE(removed.first().at(2).toInt(), 1199);
+
+        const ActivityList list = model.activityList();
+        QCOMPARE(model.rowCount(), 1000);
+        QCOMPARE(list.count(), 1000);
+        QCOMPARE(list.first()._file, QString("file1199"));
+        QCOMPARE(list.last()._file, QString("file200"));
+    }
+
+    void testNewItemsWithTheSameTimeAreKept()
+    {
+        ActivityListModel model(nullptr);
+        for (int i = 0; i < 1000; ++i)
+            model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, QString("old%1").arg(i), _now));
+        QCOMPARE(model.activityList().count(), 1000);
+        QCOMPARE(model.activityList().first()._file, QString("old999"));
+
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+        QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "new1", _now));
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "new2", _now));
+        const ActivityList list = model.activityList();
+
+        // The new items go in front of the existing ones, the oldest existing ones are dropped
+        QCOMPARE(inserted.count(), 1);
+        QCOMPARE(inserted.first().at(1).toInt(), 0);
+        QCOMPARE(inserted.first().at(2).toInt(), 1);
+        QCOMPARE(removed.count(), 1);
+        QCOMPARE(removed.first().at(1).toInt(), 1000);
+        QCOMPARE(removed.first().at(2).toInt(), 1001);
+        QCOMPARE(list.count(), 1000);
+        QCOMPARE(list.at(0)._file, QString("new2"));
+        QCOMPARE(list.at(1)._file, QString("new1"));
+        QCOMPARE(list.at(2)._file, QString("old999"));
+        QCOMPARE(list.last()._file, QString("old2"));
+    }
+
+    void testInterleavedItemsAreInsertedInRanges()
+    {
+        ActivityListModel model(nullptr);
+        for (int i = 0; i < 4; ++i)
+            model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, QString("even%1").arg(i), _now.addSecs(2 * i)));
+        model.activityList();
+
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "odd0", _now.addSecs(1)));
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "odd3", _now.addSecs(7)));
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "odd2", _now.addSecs(5)));
+        const ActivityList list = model.activityList();
+
+        QStringList files;
+        for (const auto &activity : list)
+            files << activity._file;
+        QCOMPARE(files, QStringList({ "odd3", "even3", "odd2", "even2", "even1", "odd0", "even0" }));
+        QCOMPARE(inserted.count(), 3);
+        QCOMPARE(inserted.at(0).at(1).toInt(), 0);
+        QCOMPARE(inserted.at(1).at(1).toInt(), 2);
+        QCOMPARE(inserted.at(2).at(1).toInt(), 5);
+    }
+
+    void testQueriesFlushOnlyWhatTheyNeed()
+    {
+        ActivityListModel model(nullptr);
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "synced", _now));
+        model.addErrorToActivityList(makeActivity(Activity::SyncResultType, "error", _now));
+        model.addNotificationToActivityList(makeActivity(Activity::NotificationType, "notification", _now, 42));
+
+        // Only the errors are inserted
+        QCOMPARE(model.errorsList().count(), 1);
+        QCOMPARE(model.rowCount(), 1);
+
+        // A pending activity is dismissed without ever being shown
+        QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+        QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+        model.removeActivityFromActivityList(makeActivity(Activity::NotificationType, "notification", _now, 42));
+        QCOMPARE(model.rowCount(), 1);
+        QCOMPARE(removed.count(), 0);
+
+        QVERIFY(inserted.wait());
+        QCOMPARE(model.rowCount(), 2);
+        const ActivityList list = model.activityList();
+        QCOMPARE(list.at(0)._file, QString("error"));
+        QCOMPARE(list.at(1)._file, QString("synced"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestActivityListModel)
+#include "testactivitylistmodel.moc"
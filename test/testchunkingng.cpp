@@ -40,6 +40,23 @@ static void partialUpload(FakeFolder &fakeFolder, const QString &name, int size)
                                             [](int s, const FileInfo &i) { return s + i.size; }));
 }
 
+/* Turns on delta uploads and uploads a file of given size, with a size
+ * that makes all its content defined chunks but the last one the same. */
+static void setupDeltaUpload(FakeFolder &fakeFolder, const QString &name, qint64 size)
+{
+    fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "chunking", "1.0" }, { "chunkingDelta", true } } } });
+    SyncOptions options;
+    options._deltaUploads = true;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
+    fakeFolder.localModifier().insert(name, size);
+    QVERIFY(fakeFolder.syncOnce());
+    QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+}
+
+// Files are filled with one character, they are cut into chunks of the maximum size
+static const qint64 deltaFileSize = 5 * 4 * 1024 * 1024 + 1000;
+
 
 class TestChunkingNG : public QObject
 {
@@ -425,6 +442,140 @@ private slots:
         QVERIFY(fakeFolder.syncOnce());
         QCOMPARE(nGET, 0);
     }
+
+    void testDeltaUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        setupDeltaUpload(fakeFolder, "A/a0", deltaFileSize);
+
+        qint64 putSize = 0;
+        int nManifest = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                putSize += outgoingData->size();
+                if (request.url().path().endsWith("/.manifest"))
+                    ++nManifest;
+            }
+            return nullptr;
+        });
+
+        // Only the end of the file changed, the rest is taken from the file on the server
+        fakeFolder.localModifier().appendByte("A/a0");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, deltaFileSize + 1);
+        QCOMPARE(nManifest, 1);
+        QVERIFY(putSize > 0);
+        QVERIFY(putSize < deltaFileSize / 100);
+
+        // The uploaded version is the base of the next delta upload
+        putSize = 0;
+        fakeFolder.localModifier().appendByte("A/a0");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, deltaFileSize + 2);
+        QCOMPARE(nManifest, 2);
+        QVERIFY(putSize < deltaFileSize / 100);
+    }
+
+    void testDeltaUploadResume()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        setupDeltaUpload(fakeFolder, "A/a0", deltaFileSize);
+
+        // The manifest fails once, the changed chunk is on the server then
+        bool failManifest = true;
+        int nChunkPUT = 0;
+        QString transferId;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation || !request.url().path().contains("/uploads/"))
+                return nullptr;
+            if (request.url().path().endsWith("/.manifest")) {
+                if (failManifest) {
+                    failManifest = false;
+                    return new FakeErrorReply(op, request, this, 423);
+                }
+            } else {
+                ++nChunkPUT;
+                transferId = getFilePathFromUrl(request.url()).section('/', 0, 0);
+            }
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().appendByte("A/a0");
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(nChunkPUT, 1);
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, deltaFileSize);
+
+        // Add a fake chunk to make sure it gets deleted
+        auto transfer = fakeFolder.uploadState().find(transferId);
+        QVERIFY(transfer);
+        QCOMPARE(transfer->children.count(), 1);
+        transfer->insert("0000000000000042", 100);
+
+        // The chunk that is there is not sent again
+        nChunkPUT = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nChunkPUT, 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, deltaFileSize + 1);
+        QVERIFY(!transfer->children.contains("0000000000000042"));
+    }
+
+    void testDeltaUploadServerChanged()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        setupDeltaUpload(fakeFolder, "A/a0", deltaFileSize);
+
+        qint64 putSize = 0;
+        int nManifest = 0;
+        bool changeRemote = false;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                putSize += outgoingData->size();
+                if (request.url().path().endsWith("/.manifest")) {
+                    ++nManifest;
+                    if (changeRemote) {
+                        fakeFolder.remoteModifier().setContents("A/a0", 'C');
+                        changeRemote = false;
+                    }
+                }
+            }
+            return nullptr;
+        });
+
+        // The file changed on the server since it was uploaded: the chunks
+        // the client knows are not the ones of the server, all is uploaded
+        fakeFolder.remoteModifier().appendByte("A/a0");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        fakeFolder.localModifier().appendByte("A/a0");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nManifest, 0);
+        QVERIFY(putSize >= deltaFileSize + 2);
+
+        // The file changes on the server during a delta upload: the server
+        // must not assemble it from the new version
+        changeRemote = true;
+        fakeFolder.localModifier().appendByte("A/a0");
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(nManifest, 1);
+        QCOMPARE(fakeFolder.syncEngine().isAnotherSyncNeeded(), ImmediateFollowUp);
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, deltaFileSize + 2);
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->contentChar, 'C');
+
+        // The next sync makes a conflict
+        QVERIFY(fakeFolder.syncOnce());
+        auto localState = fakeFolder.currentLocalState();
+        QCOMPARE(localState.find("A/a0")->contentChar, 'C');
+        auto conflict = findConflict(localState, "A/a0");
+        QVERIFY(conflict);
+        QCOMPARE(conflict->contentChar, 'W');
+        QCOMPARE(conflict->size, deltaFileSize + 3);
+        fakeFolder.localModifier().remove("A/" + conflict->name);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestChunkingNG)
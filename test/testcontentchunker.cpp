@@ -0,0 +1,111 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QBuffer>
+
+#include "common/contentchunker.h"
+
+using namespace OCC;
+
+static QByteArray randomData(int size, quint32 seed)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    quint32 state = seed;
+    for (int i = 0; i < size; ++i) {
+        state = state * 1664525u + 1013904223u;
+        data[i] = char(state >> 24);
+    }
+    return data;
+}
+
+static QVector<ContentChunk> chunk(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QVector<ContentChunk> chunks;
+    if (!ContentChunker::chunkDevice(&buffer, &chunks))
+        return QVector<ContentChunk>();
+    return chunks;
+}
+
+static QSet<QByteArray> hashes(const QVector<ContentChunk> &chunks)
+{
+    QSet<QByteArray> result;
+    for (const auto &c : chunks)
+        result.insert(c.hash);
+    return result;
+}
+
+class TestContentChunker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCoversTheContent()
+    {
+        const QByteArray data = randomData(20 * 1024 * 1024 + 12345, 1);
+        const auto chunks = chunk(data);
+        QVERIFY(chunks.size() > 5);
+
+        qint64 offset = 0;
+        for (int i = 0; i < chunks.size(); ++i) {
+            const auto &c = chunks[i];
+            QCOMPARE(c.offset, offset);
+            QVERIFY(c.size <= contentChunkMaxSize);
+            if (i != chunks.size() - 1)
+                QVERIFY(c.size >= contentChunkMinSize);
+            QCOMPARE(c.hash, QCryptographicHash::hash(data.mid(c.offset, c.size), QCryptographicHash::Sha1));
+            offset += c.size;
+        }
+        QCOMPARE(offset, qint64(data.size()));
+
+        // The same content gives the same chunks
+        const auto again = chunk(data);
+        QCOMPARE(again.size(), chunks.size());
+        QCOMPARE(hashes(again), hashes(chunks));
+    }
+
+    void testInsertionOnlyChangesNearbyChunks()
+    {
+        const QByteArray data = randomData(32 * 1024 * 1024, 2);
+        QByteArray changed = data;
+        changed.insert(10 * 1024 * 1024, "a few inserted bytes");
+        changed.remove(25 * 1024 * 1024, 100);
+
+        const auto before = hashes(chunk(data));
+        const auto after = chunk(changed);
+        int unchanged = 0;
+        for (const auto &c : after) {
+            if (before.contains(c.hash))
+                ++unchanged;
+        }
+        // Each edit changes one or two chunks
+        QVERIFY(after.size() - unchanged <= 4);
+    }
+
+    void testSerialize()
+    {
+        const auto chunks = chunk(randomData(8 * 1024 * 1024, 3));
+        const QByteArray data = ContentChunker::serialize(chunks);
+
+        QVector<ContentChunk> parsed;
+        QVERIFY(ContentChunker::deserialize(data, &parsed));
+        QCOMPARE(parsed.size(), chunks.size());
+        for (int i = 0; i < chunks.size(); ++i) {
+            QCOMPARE(parsed[i].offset, chunks[i].offset);
+            QCOMPARE(parsed[i].size, chunks[i].size);
+            QCOMPARE(parsed[i].hash, chunks[i].hash);
+        }
+
+        QVERIFY(!ContentChunker::deserialize(data.left(data.size() - 1), &parsed));
+    }
+};
+
+QTEST_APPLESS_MAIN(TestContentChunker)
+#include "testcontentchunker.moc"
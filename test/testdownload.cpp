@@ -0,0 +1,184 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+/* A GET reply that sends the first @a sent bytes of the file, then breaks off or,
+ * with @a hang, waits to be aborted */
+class BrokenFakeGetReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    const FileInfo *fileInfo;
+    QByteArray payload;
+    bool hang;
+
+    BrokenFakeGetReply(FileInfo &remoteRootFileInfo, qint64 sent, bool hang,
+        QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+        : QNetworkReply{ parent }
+        , hang(hang)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        fileInfo = remoteRootFileInfo.find(getFilePathFromUrl(request.url()));
+        payload.fill(fileInfo->contentChar, sent);
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond()
+    {
+        setHeader(QNetworkRequest::ContentLengthHeader, fileInfo->size);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setRawHeader("OC-ETag", fileInfo->etag.toLatin1());
+        setRawHeader("ETag", fileInfo->etag.toLatin1());
+        setRawHeader("OC-FileId", fileInfo->fileId);
+        emit metaDataChanged();
+        emit readyRead();
+        if (!hang) {
+            setError(RemoteHostClosedError, "Remote host closed the connection");
+            emit finished();
+        }
+    }
+
+    void abort() override
+    {
+        setError(OperationCanceledError, "Operation Canceled");
+        emit finished();
+    }
+
+    qint64 bytesAvailable() const override
+    {
+        return payload.size() + QIODevice::bytesAvailable();
+    }
+
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        qint64 len = std::min(qint64{ payload.size() }, maxlen);
+        std::copy(payload.cbegin(), payload.cbegin() + len, data);
+        payload.remove(0, int(len));
+        return len;
+    }
+};
+
+static bool isGetOf(QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QString &path)
+{
+    return op == QNetworkAccessManager::GetOperation && getFilePathFromUrl(request.url()) == path;
+}
+
+class TestDownload : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testLargeDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        // Neither a multiple of the write buffer nor of the write blocks
+        const int size = 3 * 1024 * 1024 + 12345;
+        fakeFolder.remoteModifier().insert("A/big", size, 'L');
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QFile file(fakeFolder.localPath() + "A/big");
+        QVERIFY(file.open(QFile::ReadOnly));
+        QCOMPARE(file.readAll(), QByteArray(size, 'L'));
+    }
+
+    void testInterruptedDownloadKeepsReceivedData_data()
+    {
+        QTest::addColumn<bool>("abortSync");
+
+        QTest::newRow("broken connection") << false;
+        QTest::newRow("aborted sync") << true;
+    }
+
+    void testInterruptedDownloadKeepsReceivedData()
+    {
+        QFETCH(bool, abortSync);
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().insert("A/big", 3 * 1024 * 1024, 'I');
+        // Less than the write buffer: nothing is written before the download stops
+        const qint64 sent = 300 * 1000;
+        QPointer<BrokenFakeGetReply> brokenReply;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (!isGetOf(op, request, "A/big"))
+                return nullptr;
+            brokenReply = new BrokenFakeGetReply(fakeFolder.remoteModifier(), sent, abortSync, op, request, this);
+            return brokenReply;
+        });
+
+        if (abortSync) {
+            QSignalSpy finished(&fakeFolder.syncEngine(), &SyncEngine::finished);
+            fakeFolder.scheduleSync();
+            QTRY_VERIFY(brokenReply && brokenReply->bytesAvailable() == 0);
+            fakeFolder.syncEngine().abort();
+            QVERIFY(finished.count() == 1 || finished.wait());
+            QVERIFY(!finished.first().first().toBool());
+        } else {
+            QVERIFY(!fakeFolder.syncOnce());
+        }
+
+        // What was received is in the temporary file, to be resumed
+        const auto info = fakeFolder.syncJournal().getDownloadInfo("A/big");
+        QVERIFY(info._valid);
+        QFile tmpFile(fakeFolder.localPath() + info._tmpfile);
+        QCOMPARE(tmpFile.size(), sent);
+        QVERIFY(tmpFile.open(QFile::ReadOnly));
+        QCOMPARE(tmpFile.readAll(), QByteArray(int(sent), 'I'));
+        QVERIFY(!QFile::exists(fakeFolder.localPath() + "A/big"));
+    }
+
+    void testResumeWithPreallocation()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        const int size = 3 * 1024 * 1024 + 100;
+        fakeFolder.remoteModifier().insert("A/big", size, 'R');
+        // More than the write buffer: a part is written while downloading, the rest when it breaks off
+        const qint64 sent = 1536 * 1024 + 77;
+
+        bool breakDownload = true;
+        QByteArray range;
+        qint64 tmpSizeAtResume = -1;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (!isGetOf(op, request, "A/big"))
+                return nullptr;
+            if (breakDownload)
+                return new BrokenFakeGetReply(fakeFolder.remoteModifier(), sent, false, op, request, this);
+            // The space for the whole file is reserved by now
+            range = request.rawHeader("Range");
+            const auto info = fakeFolder.syncJournal().getDownloadInfo("A/big");
+            tmpSizeAtResume = QFileInfo(fakeFolder.localPath() + info._tmpfile).size();
+            return nullptr;
+        });
+
+        QVERIFY(!fakeFolder.syncOnce());
+        // Retry right away instead of waiting for the blacklist
+        fakeFolder.syncJournal().wipeErrorBlacklist();
+        breakDownload = false;
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The reserved space is not mistaken for received data
+        QCOMPARE(tmpSizeAtResume, sent);
+        QCOMPARE(range, "bytes=" + QByteArray::number(sent) + "-");
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QFile file(fakeFolder.localPath() + "A/big");
+        QVERIFY(file.open(QFile::ReadOnly));
+        QCOMPARE(file.readAll(), QByteArray(size, 'R'));
+        QVERIFY(!fakeFolder.syncJournal().getDownloadInfo("A/big")._valid);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestDownload)
+#include "testdownload.moc"
@@ -0,0 +1,259 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "clientsideencryption.h"
+#include "owncloudpropagator.h"
+#include "propagateuploadencrypted.h"
+
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+
+using namespace OCC;
+
+/* The folder metadata is encrypted with the key pair of the account */
+static void setupKeyPair(const AccountPtr &account)
+{
+    EVP_PKEY *keyPair = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    QVERIFY(EVP_PKEY_keygen_init(ctx) > 0);
+    QVERIFY(EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) > 0);
+    QVERIFY(EVP_PKEY_keygen(ctx, &keyPair) > 0);
+    EVP_PKEY_CTX_free(ctx);
+
+    const auto toPem = [keyPair](bool privateKey) {
+        BIO *bio = BIO_new(BIO_s_mem());
+        if (privateKey)
+            PEM_write_bio_PrivateKey(bio, keyPair, nullptr, nullptr, 0, nullptr, nullptr);
+        else
+            PEM_write_bio_PUBKEY(bio, keyPair);
+        char *data = nullptr;
+        const long size = BIO_get_mem_data(bio, &data);
+        QByteArray pem(data, size);
+        BIO_free(bio);
+        return pem;
+    };
+    account->e2e()->_privateKey = toPem(true);
+    account->e2e()->_publicKey = QSslKey(toPem(false), QSsl::Rsa, QSsl::Pem, QSsl::PublicKey);
+    EVP_PKEY_free(keyPair);
+}
+
+static QByteArray verbOf(QNetworkAccessManager::Operation op, const QNetworkRequest &request)
+{
+    switch (op) {
+    case QNetworkAccessManager::GetOperation:
+        return "GET";
+    case QNetworkAccessManager::PostOperation:
+        return "POST";
+    case QNetworkAccessManager::PutOperation:
+        return "PUT";
+    case QNetworkAccessManager::DeleteOperation:
+        return "DELETE";
+    default:
+        return request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+    }
+}
+
+/* The end to end encryption API of the server, all folders are encrypted */
+class FakeEncryptionServer : public QObject
+{
+public:
+    AccountPtr _account;
+    QByteArray _metadata; // as the server stores it
+    QStringList _requests; // in the order they arrived
+    QStringList _uploads; // the encrypted files that were stored
+    int _uploadAttempts = 0;
+    int _failingUpload = -1; // the number of the upload attempt that fails
+
+    explicit FakeEncryptionServer(const AccountPtr &account)
+        : _account(account)
+    {
+        _metadata = FolderMetadata(account).encryptedMetadata();
+    }
+
+    QVector<EncryptedFile> files() const { return FolderMetadata(_account, wrapped(), 200).files(); }
+
+    QNetworkReply *handle(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+    {
+        const QByteArray verb = verbOf(op, request);
+        const QString path = request.url().path();
+
+        if (verb == "PROPFIND" && request.rawHeader("OCS-APIREQUEST") == "true") {
+            _requests.append("STATUS");
+            const QString href = path.endsWith('/') ? path : path + '/';
+            const QByteArray body = "<?xml version=\"1.0\"?>"
+                "<d:multistatus xmlns:d=\"DAV:\" xmlns:nc=\"http://nextcloud.org/ns\"><d:response>"
+                "<d:href>" + href.toUtf8() + "</d:href>"
+                "<d:propstat><d:prop><nc:is-encrypted>1</nc:is-encrypted></d:prop>"
+                "<d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+                "</d:response></d:multistatus>";
+            return new FakePayloadReply(op, request, body, this, 207, "application/xml; charset=utf-8");
+        }
+        if (!path.contains(QLatin1String("/end_to_end_encryption/api/v1/"))) {
+            // The FakeFolder stores the encrypted files
+            if (verb == "PUT") {
+                if (_uploadAttempts++ == _failingUpload)
+                    return new FakeErrorReply(op, request, this, 500);
+                _uploads.append(getFilePathFromUrl(request.url()));
+                return nullptr;
+            }
+            if (verb == "DELETE") {
+                _requests.append("DELETE " + getFilePathFromUrl(request.url()));
+                return new FakePayloadReply(op, request, QByteArray(), this, 204);
+            }
+            return nullptr;
+        }
+
+        const bool lock = path.contains(QLatin1String("/lock/"));
+        if (lock && verb == "POST") {
+            _requests.append("LOCK");
+            return new FakePayloadReply(op, request, "{\"ocs\":{\"data\":{\"token\":\"fake-token\"}}}", this);
+        }
+        if (lock && verb == "DELETE") {
+            _requests.append("UNLOCK");
+            return new FakePayloadReply(op, request, "{}", this);
+        }
+        if (verb == "GET") {
+            _requests.append("GET");
+            return new FakePayloadReply(op, request, wrapped(), this);
+        }
+        if (verb == "PUT") {
+            _requests.append("PUT");
+            // metaData=<percent encoded metadata>&token=<token>
+            auto buffer = qobject_cast<QBuffer *>(outgoingData);
+            const QByteArray body = buffer ? buffer->data() : outgoingData->readAll();
+            QByteArray metadata = QUrlQuery(QString::fromUtf8(body))
+                                      .queryItemValue(QStringLiteral("metaData"), QUrl::FullyDecoded)
+                                      .toUtf8();
+            if (!metadata.startsWith('{'))
+                metadata = QByteArray::fromPercentEncoding(metadata);
+            _metadata = metadata;
+            return new FakePayloadReply(op, request, "{}", this);
+        }
+        return new FakeErrorReply(op, request, this, 400);
+    }
+
+private:
+    QByteArray wrapped() const
+    {
+        const QJsonObject data{ { "meta-data", QString::fromUtf8(_metadata) } };
+        return QJsonDocument(QJsonObject{ { "ocs", QJsonObject{ { "data", data } } } }).toJson();
+    }
+};
+
+/* Uploads of @a fakeFolder go into encrypted folders of @a server */
+static void setupEncryption(FakeFolder &fakeFolder, FakeEncryptionServer &server)
+{
+    fakeFolder.account()->setCapabilities({ { "end-to-end-encryption", QVariantMap{ { "enabled", true } } } });
+    fakeFolder.setServerOverride([&server](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) {
+        return server.handle(op, request, outgoingData);
+    });
+}
+
+class TestEncryptedFolderBatch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testOneLockAndCommitPerFolder()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        setupKeyPair(fakeFolder.account());
+        FakeEncryptionServer server(fakeFolder.account());
+        setupEncryption(fakeFolder, server);
+        // More files than uploads run in parallel
+        const int count = 30;
+        for (int i = 0; i < count; ++i)
+            fakeFolder.localModifier().insert(QString("A/new%1").arg(i), 100 + i);
+
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The status, lock and metadata requests are shared by all files of the folder
+        QCOMPARE(server._requests, QStringList({ "STATUS", "LOCK", "GET", "PUT", "UNLOCK" }));
+        QCOMPARE(server._uploads.size(), count);
+        const auto files = server.files();
+        QCOMPARE(files.size(), count);
+        QSet<QString> names;
+        for (const auto &file : files) {
+            QVERIFY(server._uploads.contains("A/" + file.encryptedFilename));
+            QCOMPARE(file.authenticationTag.size(), int(EncryptionHelper::fileTagLength));
+            names.insert(file.originalFilename);
+        }
+        QCOMPARE(names.size(), count);
+        for (int i = 0; i < count; ++i)
+            QVERIFY(names.contains(QString("new%1").arg(i)));
+    }
+
+    void testFailedUploadIsLeftOut()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        setupKeyPair(fakeFolder.account());
+        FakeEncryptionServer server(fakeFolder.account());
+        setupEncryption(fakeFolder, server);
+        const int count = 5;
+        for (int i = 0; i < count; ++i)
+            fakeFolder.localModifier().insert(QString("A/new%1").arg(i), 100 + i);
+        server._failingUpload = 2;
+
+        QVERIFY(!fakeFolder.syncOnce());
+
+        // The other files are still committed together
+        QCOMPARE(server._requests, QStringList({ "STATUS", "LOCK", "GET", "PUT", "UNLOCK" }));
+        QCOMPARE(server._uploadAttempts, count);
+        QCOMPARE(server._uploads.size(), count - 1);
+
+        // and the metadata only lists the files that are on the server
+        const auto files = server.files();
+        QCOMPARE(files.size(), count - 1);
+        QSet<QString> names;
+        for (const auto &file : files) {
+            QVERIFY(server._uploads.contains("A/" + file.encryptedFilename));
+            QVERIFY(file.originalFilename.startsWith("new"));
+            names.insert(file.originalFilename);
+        }
+        QCOMPARE(names.size(), count - 1);
+    }
+
+    void testResendOfChangedFileFails()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        setupKeyPair(fakeFolder.account());
+        FakeEncryptionServer server(fakeFolder.account());
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) {
+            return server.handle(op, request, outgoingData);
+        });
+
+        OwncloudPropagator propagator(fakeFolder.account(), fakeFolder.localPath(), "", &fakeFolder.syncJournal());
+        SyncFileItemPtr item(new SyncFileItem);
+        item->_file = "A/a1";
+        auto upload = new PropagateUploadEncrypted(&propagator, item, &propagator);
+        quint64 size = 0;
+        QObject::connect(upload, &PropagateUploadEncrypted::finalized, upload,
+            [&size](const QString &, const QString &, quint64 encryptedSize) { size = encryptedSize; });
+        upload->start();
+        QTRY_VERIFY(size > 0);
+
+        QByteArray data;
+        QString error;
+        QVERIFY(upload->readEncrypted(0, size, &data, &error));
+
+        // Sending a part again encrypts the unchanged file again with the same result
+        QByteArray resent;
+        QVERIFY(upload->readEncrypted(10, 20, &resent, &error));
+        QCOMPARE(resent, data.mid(10, 20));
+
+        // Other contents must not be encrypted with the same key and iv
+        fakeFolder.localModifier().appendByte("A/a1");
+        QVERIFY(!upload->readEncrypted(10, 20, &resent, &error));
+        QVERIFY(!error.isEmpty());
+        upload->release();
+    }
+};
+
+QTEST_GUILESS_MAIN(TestEncryptedFolderBatch)
+#include "testencryptedfolderbatch.moc"
@@ -0,0 +1,113 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <networkjobs.h>
+
+using namespace OCC;
+
+class TestEtagPolling : public QObject
+{
+    Q_OBJECT
+
+    static QString singleEtag(FakeFolder &fakeFolder, const QString &path)
+    {
+        auto job = new RequestEtagJob(fakeFolder.account(), path, fakeFolder.account().data());
+        QSignalSpy spy(job, &RequestEtagJob::etagRetreived);
+        job->start();
+        if (!spy.wait())
+            return QString();
+        return spy.first().first().toString();
+    }
+
+    static QHash<QString, QString> batchEtags(FakeFolder &fakeFolder, const QStringList &paths)
+    {
+        auto job = new BatchEtagJob(fakeFolder.account(), paths, fakeFolder.account().data());
+        QSignalSpy spy(job, &BatchEtagJob::etagsRetreived);
+        job->start();
+        if (!spy.wait())
+            return QHash<QString, QString>();
+        return spy.first().first().value<QHash<QString, QString>>();
+    }
+
+private slots:
+    void initTestCase()
+    {
+        qRegisterMetaType<QHash<QString, QString>>();
+    }
+
+    void testParentPath()
+    {
+        QCOMPARE(BatchEtagJob::parentPath("/A"), QString());
+        QCOMPARE(BatchEtagJob::parentPath("A/"), QString());
+        QCOMPARE(BatchEtagJob::parentPath("/P/x"), QString("P"));
+        QCOMPARE(BatchEtagJob::parentPath("/P/x/y/"), QString("P/x"));
+    }
+
+    void testBatchMatchesSingleRequests()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        // etags of the root only reflect its contents since 8.1
+        fakeFolder.account()->setServerVersion("10.0.0");
+        fakeFolder.remoteModifier().mkdir("P");
+        fakeFolder.remoteModifier().mkdir("P/x");
+        fakeFolder.remoteModifier().mkdir("P/y");
+        fakeFolder.remoteModifier().insert("P/y/file");
+
+        int propfinds = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                ++propfinds;
+            return nullptr;
+        });
+
+        const QStringList rootFolders = { "/A", "/B", "C" };
+        QHash<QString, QString> expected;
+        for (const auto &path : rootFolders)
+            expected.insert(path, singleEtag(fakeFolder, path));
+        QCOMPARE(propfinds, rootFolders.size());
+        QVERIFY(!expected.value("/A").isEmpty());
+
+        propfinds = 0;
+        QCOMPARE(batchEtags(fakeFolder, rootFolders), expected);
+        QCOMPARE(propfinds, 1);
+
+        // a folder below the root, missing folders are not reported
+        propfinds = 0;
+        auto etags = batchEtags(fakeFolder, { "/P/x", "/P/y", "/P/missing" });
+        QCOMPARE(propfinds, 1);
+        QCOMPARE(etags.size(), 2);
+        QCOMPARE(etags.value("/P/x"), singleEtag(fakeFolder, "/P/x"));
+        QCOMPARE(etags.value("/P/y"), singleEtag(fakeFolder, "/P/y"));
+
+        // a change shows up in the batched etag
+        const QString oldEtag = etags.value("/P/y");
+        fakeFolder.remoteModifier().appendByte("P/y/file");
+        etags = batchEtags(fakeFolder, { "/P/x", "/P/y" });
+        QVERIFY(etags.value("/P/y") != oldEtag);
+        QCOMPARE(etags.value("/P/y"), singleEtag(fakeFolder, "/P/y"));
+    }
+
+    void testBatchError()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.serverErrorPaths().append("P", 403);
+        fakeFolder.remoteModifier().mkdir("P");
+        fakeFolder.remoteModifier().mkdir("P/x");
+
+        auto job = new BatchEtagJob(fakeFolder.account(), { "/P/x" }, fakeFolder.account().data());
+        QSignalSpy etagSpy(job, &BatchEtagJob::etagsRetreived);
+        QSignalSpy errorSpy(job, &BatchEtagJob::finishedWithError);
+        job->start();
+        QVERIFY(errorSpy.wait());
+        QCOMPARE(etagSpy.count(), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestEtagPolling)
+#include "testetagpolling.moc"
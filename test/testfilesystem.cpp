@@ -70,6 +70,105 @@ private slots:
         QCOMPARE(sSum, sum);
     }
 
+    void testRemoveRecursively()
+    {
+        QString root = _root.path() + "/remove";
+        for (int i = 0; i < 20; ++i) {
+            QString dir = root + QString("/dir%1/sub/subsub").arg(i);
+            QVERIFY(QDir().mkpath(dir));
+            QVERIFY(writeRandomFile(dir + "/file"));
+            QVERIFY(writeRandomFile(root + QString("/dir%1/file").arg(i)));
+        }
+        QVERIFY(writeRandomFile(root + "/file"));
+        QVERIFY(QFile::link(root + "/dir0", root + "/link"));
+
+        QStringList deleted;
+        QStringList errors;
+        bool ok = removeRecursively(root,
+            [&](const QString &path, bool) { deleted.append(path); },
+            [&](const QString &path, bool, const QString &) { errors.append(path); });
+        QVERIFY(ok);
+        QVERIFY(deleted.isEmpty());
+        QVERIFY(errors.isEmpty());
+        QVERIFY(!QFileInfo::exists(root));
+    }
+
+    void testRemoveRecursivelyPartially()
+    {
+#ifdef Q_OS_UNIX
+        QString root = _root.path() + "/removepartially";
+        QVERIFY(QDir().mkpath(root + "/a"));
+        QVERIFY(QDir().mkpath(root + "/b/locked"));
+        QVERIFY(writeRandomFile(root + "/a/file"));
+        QVERIFY(writeRandomFile(root + "/b/locked/file"));
+        QVERIFY(writeRandomFile(root + "/c"));
+        QFile::setPermissions(root + "/b/locked", QFile::ReadOwner | QFile::ExeOwner);
+        QFile probe(root + "/b/locked/probe");
+        if (probe.open(QIODevice::WriteOnly)) {
+            probe.remove();
+            QFile::setPermissions(root + "/b/locked", QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+            QSKIP("Permissions are not enforced for this user");
+        }
+
+        QStringList deleted;
+        QStringList errors;
+        bool ok = removeRecursively(root,
+            [&](const QString &path, bool) { deleted.append(path); },
+            [&](const QString &path, bool, const QString &) { errors.append(path); });
+        QFile::setPermissions(root + "/b/locked", QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+        QVERIFY(!ok);
+        deleted.sort();
+        QCOMPARE(deleted, QStringList() << "a" << "c");
+        QCOMPARE(errors, QStringList() << "b/locked/file");
+        QVERIFY(QFileInfo::exists(root + "/b/locked/file"));
+        QVERIFY(!QFileInfo::exists(root + "/a"));
+#else
+        QSKIP("Uses unix permissions");
+#endif
+    }
+
+    void testPreallocate()
+    {
+        QFile file(_root.path() + "/preallocated");
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Unbuffered));
+        QCOMPARE(file.write(QByteArray(100, 'a')), qint64(100));
+
+        // The size stays what was written, appending fills the reserved space
+        const qint64 size = 4 * 1024 * 1024;
+        preallocate(file, size);
+        QCOMPARE(file.size(), qint64(100));
+        QCOMPARE(QFileInfo(file.fileName()).size(), qint64(100));
+        QCOMPARE(file.write(QByteArray(1000, 'b')), qint64(1000));
+        QCOMPARE(file.size(), qint64(1100));
+
+        // A smaller size or a closed file are ignored
+        preallocate(file, 10);
+        QCOMPARE(file.size(), qint64(1100));
+        file.close();
+        preallocate(file, size);
+
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), QByteArray(100, 'a') + QByteArray(1000, 'b'));
+    }
+
+    void testStartWriteBack()
+    {
+        QFile file(_root.path() + "/writeback");
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Unbuffered));
+        const QByteArray data(3 * 1024 * 1024, 'w');
+        QCOMPARE(file.write(data), qint64(data.size()));
+
+        // Only starts writing, the data stays readable and the file writable
+        startWriteBack(file, 0, data.size());
+        startWriteBack(file, 1024 * 1024, 64 * 1024);
+        QCOMPARE(file.write("end"), qint64(3));
+        file.close();
+        startWriteBack(file, 0, data.size());
+
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), data + "end");
+    }
 };
 
 QTEST_APPLESS_MAIN(TestFileSystem)
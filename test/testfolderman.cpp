@@ -6,8 +6,10 @@
  */
 
 #include <qglobal.h>
+#include <QSslError>
 #include <QTemporaryDir>
 #include <QtTest>
+#include <functional>
 
 #include "common/utility.h"
 #include "folderman.h"
@@ -15,6 +17,7 @@
 #include "accountstate.h"
 #include "configfile.h"
 #include "creds/httpcredentials.h"
+#include "syncenginetestutils.h"
 
 using namespace OCC;
 
@@ -27,6 +30,21 @@ public:
     void askFromUser() Q_DECL_OVERRIDE {
 
     }
+
+    void setPassword(const QString &password)
+    {
+        _password = password;
+        emit fetched();
+    }
+};
+
+/* Runs a function in the thread it was moved to */
+class ThreadRunner : public QObject
+{
+    Q_OBJECT
+public:
+    std::function<void()> function;
+    Q_INVOKABLE void run() { function(); }
 };
 
 static FolderDefinition folderDefinition(const QString &path) {
@@ -37,6 +55,20 @@ static FolderDefinition folderDefinition(const QString &path) {
     return d;
 }
 
+/* An account state that is connected without asking the server */
+static AccountStatePtr connectedAccountState(const AccountPtr &account)
+{
+    AccountStatePtr accountState(new AccountState(account));
+    QMetaObject::invokeMethod(accountState.data(), "slotConnectionValidatorResult", Qt::DirectConnection,
+        Q_ARG(ConnectionValidator::Status, ConnectionValidator::Connected), Q_ARG(QStringList, QStringList()));
+    return accountState;
+}
+
+// Folders are only polled once the poll interval passed since their last sync
+static void waitForPollInterval()
+{
+    QTest::qWait(5100);
+}
 
 class TestFolderMan: public QObject
 {
@@ -44,7 +76,62 @@ class TestFolderMan: public QObject
 
     FolderMan _fm;
 
+    struct EtagPolls
+    {
+        int single = 0;
+        int batch = 0;
+        int running = 0;
+        int maxRunning = 0;
+    };
+
+    /* Counts the etag queries: a Depth 0 PROPFIND of a folder or a listing of one of @a parents */
+    void countEtagPolls(FakeFolder &fakeFolder, EtagPolls &polls, const QStringList &parents, bool failBatches = false)
+    {
+        fakeFolder.setServerOverride([this, &fakeFolder, &polls, parents, failBatches](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) != "PROPFIND")
+                return nullptr;
+            if (request.rawHeader("Depth") == "0") {
+                ++polls.single;
+                return nullptr;
+            }
+            if (!parents.contains(getFilePathFromUrl(request.url())))
+                return nullptr;
+
+            ++polls.batch;
+            QNetworkReply *reply;
+            if (failBatches)
+                reply = new FakeErrorReply(op, request, this, 500);
+            else
+                reply = new FakePropfindReply(fakeFolder.remoteModifier(), op, request, this);
+            polls.maxRunning = qMax(polls.maxRunning, ++polls.running);
+            connect(reply, &QNetworkReply::finished, this, [&polls] { --polls.running; });
+            return reply;
+        });
+    }
+
+    /* Adds a folder for each of @a remotePaths, synced to the same path below @a localDir */
+    QList<Folder *> addFolders(AccountState *accountState, const QString &localDir, const QStringList &remotePaths,
+        QHash<Folder *, int> &syncs)
+    {
+        QList<Folder *> folders;
+        for (const auto &remotePath : remotePaths) {
+            const QString localPath = localDir + remotePath;
+            QDir().mkpath(localPath);
+            FolderDefinition definition = folderDefinition(localPath);
+            definition.targetPath = remotePath;
+            Folder *folder = _fm.addFolder(accountState, definition);
+            connect(folder, &Folder::syncFinished, this, [&syncs, folder] { ++syncs[folder]; });
+            folders.append(folder);
+        }
+        return folders;
+    }
+
 private slots:
+    void cleanup()
+    {
+        _fm.unloadAndDeleteAllFolders();
+    }
+
     void testCheckPathValidityForNewFolder()
     {
         QTemporaryDir dir;
@@ -206,7 +293,306 @@ private slots:
         QCOMPARE(folderman->findGoodPathForNewSyncFolder(dirPath + "/ownCloud2", url),
             QString(dirPath + "/ownCloud22"));
     }
+
+    void testEtagPollingBatchesSiblings()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+        ConfigFile().setRemotePollInterval(std::chrono::seconds(5));
+        _fm._etagPollTimer.stop();
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        // Only the folder etags of servers >= 8.1 reflect their contents
+        fakeFolder.account()->setServerVersion("10.0.0");
+        EtagPolls polls;
+        countEtagPolls(fakeFolder, polls, { QString() });
+
+        AccountStatePtr accountState = connectedAccountState(fakeFolder.account());
+        QHash<Folder *, int> syncs;
+        const auto folders = addFolders(accountState.data(), dir.path() + "/local", { "/A", "/B", "/C" }, syncs);
+
+        // The folders never synced, so their etags changed
+        waitForPollInterval();
+        _fm.slotEtagPollTimerTimeout();
+        for (auto folder : folders)
+            QTRY_COMPARE(syncs.value(folder), 1);
+        QCOMPARE(polls.batch, 1);
+        QCOMPARE(polls.single, 0);
+        QVERIFY(QFile::exists(dir.path() + "/local/B/b1"));
+
+        // Only the changed folder syncs again
+        fakeFolder.remoteModifier().appendByte("B/b1");
+        polls = EtagPolls();
+        waitForPollInterval();
+        _fm.slotEtagPollTimerTimeout();
+        QTRY_COMPARE(syncs.value(folders[1]), 2);
+        QCOMPARE(polls.batch, 1);
+        QCOMPARE(polls.single, 0);
+        QCOMPARE(syncs.value(folders[0]), 1);
+        QCOMPARE(syncs.value(folders[2]), 1);
+        QVERIFY(_fm.scheduleQueue().isEmpty());
+        QCOMPARE(QFileInfo(dir.path() + "/local/B/b1").size(), fakeFolder.currentRemoteState().find("B/b1")->size);
+    }
+
+    void testEtagPollingFallsBackToSingleJobs_data()
+    {
+        QTest::addColumn<QString>("serverVersion");
+        QTest::addColumn<bool>("failBatches");
+
+        QTest::newRow("old server") << "8.0.0" << false;
+        QTest::newRow("failing listing") << "10.0.0" << true;
+    }
+
+    void testEtagPollingFallsBackToSingleJobs()
+    {
+        QFETCH(QString, serverVersion);
+        QFETCH(bool, failBatches);
+
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+        ConfigFile().setRemotePollInterval(std::chrono::seconds(5));
+        _fm._etagPollTimer.stop();
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.account()->setServerVersion(serverVersion);
+        EtagPolls polls;
+        countEtagPolls(fakeFolder, polls, { QString() }, failBatches);
+
+        AccountStatePtr accountState = connectedAccountState(fakeFolder.account());
+        QHash<Folder *, int> syncs;
+        const auto folders = addFolders(accountState.data(), dir.path() + "/local", { "/A", "/B", "/C" }, syncs);
+
+        waitForPollInterval();
+        _fm.slotEtagPollTimerTimeout();
+        for (auto folder : folders)
+            QTRY_COMPARE(syncs.value(folder), 1);
+        QCOMPARE(polls.batch, failBatches ? 1 : 0);
+        QCOMPARE(polls.single, 3);
+    }
+
+    void testBatchEtagJobsShareTheLimit()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+        ConfigFile().setRemotePollInterval(std::chrono::seconds(5));
+        _fm._etagPollTimer.stop();
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.account()->setServerVersion("10.0.0");
+        QStringList parents;
+        QStringList remotePaths;
+        for (int i = 0; i < 7; ++i) {
+            const QString parent = QString("P%1").arg(i);
+            fakeFolder.remoteModifier().mkdir(parent);
+            fakeFolder.remoteModifier().mkdir(parent + "/x");
+            fakeFolder.remoteModifier().mkdir(parent + "/y");
+            parents << parent;
+            remotePaths << "/" + parent + "/x" << "/" + parent + "/y";
+        }
+        EtagPolls polls;
+        countEtagPolls(fakeFolder, polls, parents);
+
+        AccountStatePtr accountState = connectedAccountState(fakeFolder.account());
+        QHash<Folder *, int> syncs;
+        const auto folders = addFolders(accountState.data(), dir.path() + "/local", remotePaths, syncs);
+
+        waitForPollInterval();
+        _fm.slotEtagPollTimerTimeout();
+        for (auto folder : folders)
+            QTRY_COMPARE_WITH_TIMEOUT(syncs.value(folder), 1, 20000);
+        // One listing per parent, but no more queries at once than the account allows
+        QCOMPARE(polls.batch, 7);
+        QCOMPARE(polls.maxRunning, 6);
+        QCOMPARE(polls.single, 0);
+    }
+
+    void testWorkerThreadSendsCurrentCredentials()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+        ConfigFile().setSyncInWorkerThread(true);
+
+        AccountPtr account = Account::create();
+        auto cred = new HttpCredentialsTest("testuser", "secret");
+        account->setCredentials(cred);
+        account->setUrl(QUrl("http://localhost:1"));
+        AccountStatePtr accountState = connectedAccountState(account);
+        QDir().mkpath(dir.path() + "/local");
+        Folder *folder = _fm.addFolder(accountState.data(), folderDefinition(dir.path() + "/local"));
+        QVERIFY(folder);
+        QThread *engineThread = folder->syncEngine().thread();
+        QVERIFY(engineThread != QThread::currentThread());
+
+        // The requests of the engine thread go through its own QNAM
+        auto runner = new ThreadRunner;
+        runner->moveToThread(engineThread);
+        QByteArray authorization;
+        bool ownAccessManager = false;
+        runner->function = [&] {
+            QNetworkReply *reply = account->sendRawRequest("GET", account->url());
+            authorization = reply->request().rawHeader("Authorization");
+            ownAccessManager = reply->manager() != nullptr && reply->manager()->thread() == QThread::currentThread();
+            reply->abort();
+            reply->deleteLater();
+        };
+        QMetaObject::invokeMethod(runner, "run", Qt::BlockingQueuedConnection);
+        QVERIFY(ownAccessManager);
+        QCOMPARE(authorization, "Basic " + QByteArray("testuser:secret").toBase64());
+
+        // and see the credentials as they change in the main thread
+        cred->setPassword("changed");
+        QMetaObject::invokeMethod(runner, "run", Qt::BlockingQueuedConnection);
+        QCOMPARE(authorization, "Basic " + QByteArray("testuser:changed").toBase64());
+
+        runner->deleteLater();
+        _fm.unloadAndDeleteAllFolders();
+    }
+
+    void testFolderDeletionAnswersTheEngineThread_data()
+    {
+        QTest::addColumn<bool>("sslErrors");
+
+        QTest::newRow("ssl errors") << true;
+        QTest::newRow("removing all files") << false;
+    }
+
+    void testFolderDeletionAnswersTheEngineThread()
+    {
+        QFETCH(bool, sslErrors);
+
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+        ConfigFile().setSyncInWorkerThread(true);
+
+        AccountPtr account = Account::create();
+        account->setCredentials(new HttpCredentialsTest("testuser", "secret"));
+        account->setUrl(QUrl("http://localhost:1"));
+        AccountStatePtr accountState = connectedAccountState(account);
+        QDir().mkpath(dir.path() + "/local");
+        Folder *folder = _fm.addFolder(accountState.data(), folderDefinition(dir.path() + "/local"));
+        QVERIFY(folder);
+        SyncEngine *engine = &folder->syncEngine();
+
+        // The engine thread waits for the main thread, like for a question to the user
+        auto runner = new ThreadRunner;
+        runner->moveToThread(engine->thread());
+        QAtomicInt waiting;
+        QAtomicInt answered;
+        bool cancel = false;
+        runner->function = [&] {
+            waiting = 1;
+            if (sslErrors) {
+                QNetworkReply *reply = account->sendRawRequest("GET", account->url());
+                emit reply->manager()->sslErrors(reply, { QSslError(QSslError::SelfSignedCertificate) });
+                reply->abort();
+                reply->deleteLater();
+            } else {
+                emit engine->aboutToRemoveAllFiles(SyncFileItem::Down, &cancel);
+            }
+            answered = 1;
+        };
+        QMetaObject::invokeMethod(runner, "run", Qt::QueuedConnection);
+
+        // Without running the event loop, which would answer right away
+        while (!waiting.load())
+            QThread::msleep(1);
+        QThread::msleep(50);
+        QVERIFY(!answered.load());
+
+        // Deleting the folder must not wait for an answer forever
+        _fm.unloadAndDeleteAllFolders();
+        QVERIFY(answered.load());
+        // The files are kept when nobody could be asked
+        QCOMPARE(cancel, !sslErrors);
+        delete runner;
+    }
+
+    void testScheduledFoldersAreFair()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+
+        FakeFolder fakeFolderA{ FileInfo::A12_B12_C12_S12() };
+        FakeFolder fakeFolderB{ FileInfo::A12_B12_C12_S12() };
+        AccountStatePtr accountStateA = connectedAccountState(fakeFolderA.account());
+        AccountStatePtr accountStateB = connectedAccountState(fakeFolderB.account());
+        QHash<Folder *, int> syncs;
+        const auto foldersA = addFolders(accountStateA.data(), dir.path() + "/a", { "/A", "/B", "/C" }, syncs);
+        const auto foldersB = addFolders(accountStateB.data(), dir.path() + "/b", { "/A", "/B" }, syncs);
+
+        // The file watcher saw a change in the last folder of the first account
+        foldersA[2]->slotWatchedPathChanged(foldersA[2]->path() + "new");
+        QVERIFY(foldersA[2]->hasPendingLocalChanges());
+        QVERIFY(!foldersA[1]->hasPendingLocalChanges());
+
+        // A folder of the first account is running already
+        _fm._currentSyncFolders = { foldersA[0] };
+        _fm._scheduledFolders.clear();
+        _fm._scheduledFolders << foldersA[1] << foldersA[2] << foldersB[0] << foldersB[1];
+
+        // The other account goes first, then they take turns and
+        // the folder with local changes is preferred within its account
+        const QList<Folder *> expected = { foldersB[0], foldersA[2], foldersB[1], foldersA[1] };
+        for (auto folder : expected) {
+            QCOMPARE(_fm.takeNextScheduledFolder(), folder);
+            _fm._currentSyncFolders.append(folder);
+        }
+        QVERIFY(_fm._scheduledFolders.isEmpty());
+        QVERIFY(!_fm.takeNextScheduledFolder());
+        _fm._currentSyncFolders.clear();
+    }
+
+    void testScheduledFoldersShareTheBudget()
+    {
+        QTemporaryDir dir;
+        ConfigFile::setConfDir(dir.path());
+        QScopedValueRollback<int> maxConcurrentSyncs(_fm._maxConcurrentSyncs, 3);
+        QScopedValueRollback<int> maxNetworkJobs(_fm._maxNetworkJobs, 3);
+        QScopedValueRollback<int> maxDiscoveryThreads(_fm._maxDiscoveryThreads, 6);
+
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        int runningGets = 0;
+        int maxRunningGets = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::GetOperation)
+                return nullptr;
+            auto reply = new DelayedReply<FakeGetReply>(50, fakeFolder.remoteModifier(), op, request, this);
+            maxRunningGets = qMax(maxRunningGets, ++runningGets);
+            connect(reply, &QNetworkReply::finished, this, [&runningGets] { --runningGets; });
+            return reply;
+        });
+
+        AccountStatePtr accountState = connectedAccountState(fakeFolder.account());
+        QHash<Folder *, int> syncs;
+        const auto folders = addFolders(accountState.data(), dir.path() + "/local", { "/A", "/B", "/C", "/S" }, syncs);
+        int lastShare = 0;
+        int runningAtLastStart = 0;
+        connect(folders[3], &Folder::syncStarted, this, [&] {
+            lastShare = folders[3]->maximumActiveJobs();
+            runningAtLastStart = _fm._currentSyncFolders.size();
+        });
+
+        _fm._scheduledFolders.clear();
+        _fm._scheduledFolders << folders[0] << folders[1] << folders[2] << folders[3];
+        _fm.slotStartScheduledFolderSync();
+
+        // No more folders than allowed run at once, each with its share of the budgets
+        QCOMPARE(_fm._currentSyncFolders, folders.mid(0, 3));
+        QCOMPARE(_fm._scheduledFolders.size(), 1);
+        for (int i = 0; i < 3; ++i) {
+            QCOMPARE(folders[i]->maximumActiveJobs(), 1);
+            QCOMPARE(folders[i]->discoveryThreads(), 2);
+        }
+
+        // The last folder starts once another one finished
+        for (auto folder : folders)
+            QTRY_COMPARE(syncs.value(folder), 1);
+        QVERIFY(runningAtLastStart >= 1 && runningAtLastStart <= 3);
+        QCOMPARE(lastShare, 3 / runningAtLastStart);
+        QVERIFY(maxRunningGets >= 1 && maxRunningGets <= 3);
+        QVERIFY(QFile::exists(dir.path() + "/local/S/s1"));
+    }
 };
 
-QTEST_APPLESS_MAIN(TestFolderMan)
+QTEST_GUILESS_MAIN(TestFolderMan)
 #include "testfolderman.moc"
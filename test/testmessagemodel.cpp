@@ -5,8 +5,10 @@
 */
 
 #include <QtTest>
+#include <qtconcurrentrun.h>
 
 #include <common/utility.h>
+#include <messages/attachmentingestjob.h>
 #include <messages/messagemodel.h>
 
 using namespace OCC;
@@ -63,6 +65,112 @@ private slots:
         QCOMPARE(model->columnCount(), 4);
         QAbstractItemModelTester tester(model);
     }
+
+    void testAttachmentIngestion()
+    {
+        QTemporaryDir dir;
+        QDir(dir.path()).mkpath("assets");
+        QDir(dir.path()).mkpath("source");
+        const QString assetsPath = dir.path() + "/assets";
+        const auto writeFile = [](const QString &path, const QByteArray &content) {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(content);
+        };
+        writeFile(assetsPath + "/scan.jpg", "scan content");
+        writeFile(dir.path() + "/source/copy.jpg", "scan content");
+        writeFile(dir.path() + "/source/scan.jpg", "other content");
+        writeFile(dir.path() + "/source/report.pdf", "report content");
+
+        MessageObject msg;
+        msg.newImagesList.append({ "copy.jpg", dir.path() + "/source/copy.jpg", "myself" });
+        msg.newImagesList.append({ "scan.jpg", dir.path() + "/source/scan.jpg", "myself" });
+        msg.newDocumentsList.append({ "report.pdf", dir.path() + "/source/report.pdf", "myself" });
+
+        auto result = AttachmentIngestJob::ingestNow(msg, assetsPath, false, nullptr);
+        QVERIFY(result.errorString.isEmpty());
+        QVERIFY(result.message.newImagesList.isEmpty());
+        QVERIFY(result.message.newDocumentsList.isEmpty());
+        QCOMPARE(result.message.imagesList.size(), 2);
+        QCOMPARE(result.message.documentsList.size(), 1);
+
+        // identical content gets a file of its own that shares the data
+        const QString copyPath = result.message.imagesList.at(0).path;
+        QVERIFY(result.message.imagesList.at(0).name.endsWith("copy.jpg"));
+        QCOMPARE(copyPath, assetsPath + "/" + result.message.imagesList.at(0).name);
+        // a different file with the same name gets a unique name
+        QVERIFY(result.message.imagesList.at(1).name != "scan.jpg");
+        QVERIFY(result.message.imagesList.at(1).name.endsWith("scan.jpg"));
+        QCOMPARE(result.message.documentsList.at(0).path, assetsPath + "/report.pdf");
+        QCOMPARE(QDir(assetsPath).entryList(QDir::Files).size(), 4);
+
+        // removing the asset of one message keeps the other one intact
+        QVERIFY(QFile::remove(assetsPath + "/scan.jpg"));
+        QFile copy(copyPath);
+        QVERIFY(copy.open(QIODevice::ReadOnly));
+        QCOMPARE(copy.readAll(), QByteArray("scan content"));
+        copy.close();
+
+        // moving removes the sources
+        MessageObject draft;
+        draft.newDocumentsList.append({ "report.pdf", dir.path() + "/source/report.pdf", "myself" });
+        result = AttachmentIngestJob::ingestNow(draft, assetsPath, true, nullptr);
+        QVERIFY(result.errorString.isEmpty());
+        QVERIFY(result.message.documentsList.at(0).name.endsWith("report.pdf"));
+        QVERIFY(QFileInfo::exists(result.message.documentsList.at(0).path));
+        QVERIFY(!QFileInfo::exists(dir.path() + "/source/report.pdf"));
+
+        // missing sources are reported
+        MessageObject broken;
+        broken.newImagesList.append({ "missing.jpg", dir.path() + "/source/missing.jpg", "myself" });
+        result = AttachmentIngestJob::ingestNow(broken, assetsPath, false, nullptr);
+        QVERIFY(!result.errorString.isEmpty());
+        // the reserved name is given back
+        QVERIFY(!QFileInfo::exists(assetsPath + "/missing.jpg"));
+    }
+
+    void testConcurrentAttachmentIngestion()
+    {
+        QTemporaryDir dir;
+        QDir(dir.path()).mkpath("assets");
+        QDir(dir.path()).mkpath("first");
+        QDir(dir.path()).mkpath("second");
+        const QString assetsPath = dir.path() + "/assets";
+
+        // both messages have attachments with the same names but other content
+        const int count = 50;
+        MessageObject first, second;
+        for (int i = 0; i < count; ++i) {
+            const QString name = QString("file%1.txt").arg(i);
+            for (auto message : { qMakePair(&first, QString("first")), qMakePair(&second, QString("second")) }) {
+                const QString source = dir.path() + "/" + message.second + "/" + name;
+                QFile file(source);
+                QVERIFY(file.open(QIODevice::WriteOnly));
+                file.write((message.second + name).toUtf8());
+                message.first->newDocumentsList.append({ name, source, "myself" });
+            }
+        }
+
+        auto firstResult = QtConcurrent::run(&AttachmentIngestJob::ingestNow, first, assetsPath, false, nullptr);
+        auto secondResult = QtConcurrent::run(&AttachmentIngestJob::ingestNow, second, assetsPath, false, nullptr);
+        QVERIFY(firstResult.result().errorString.isEmpty());
+        QVERIFY(secondResult.result().errorString.isEmpty());
+
+        // every attachment got a file of its own with its content
+        QSet<QString> paths;
+        for (const auto &result : { qMakePair(firstResult.result(), QString("first")), qMakePair(secondResult.result(), QString("second")) }) {
+            const auto &documents = result.first.message.documentsList;
+            QCOMPARE(documents.size(), count);
+            for (int i = 0; i < count; ++i) {
+                paths.insert(documents.at(i).path);
+                QFile file(documents.at(i).path);
+                QVERIFY(file.open(QIODevice::ReadOnly));
+                QCOMPARE(file.readAll(), (result.second + QString("file%1.txt").arg(i)).toUtf8());
+            }
+        }
+        QCOMPARE(paths.size(), 2 * count);
+        QCOMPARE(QDir(assetsPath).entryList(QDir::Files).size(), 2 * count);
+    }
 };
 
 QTEST_MAIN(TestMessageModel)
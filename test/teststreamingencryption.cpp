@@ -0,0 +1,171 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QBuffer>
+
+#include "clientsideencryption.h"
+
+using namespace OCC;
+
+static QByteArray randomData(int size, quint32 seed)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    quint32 state = seed;
+    for (int i = 0; i < size; ++i) {
+        state = state * 1664525u + 1013904223u;
+        data[i] = char(state >> 24);
+    }
+    return data;
+}
+
+static const QByteArray key = randomData(16, 1);
+static const QByteArray iv = randomData(16, 2);
+
+/* Encrypts @a data with pieces of @a pieceSize bytes, returns the
+ * encrypted data followed by the tag */
+static QByteArray encrypt(QByteArray data, int pieceSize)
+{
+    StreamingEncryptor encryptor(key, iv);
+    if (!encryptor.isValid())
+        return QByteArray();
+    for (int pos = 0; pos < data.size(); pos += pieceSize) {
+        if (!encryptor.update(data.data() + pos, qMin(pieceSize, data.size() - pos)))
+            return QByteArray();
+    }
+    const QByteArray tag = encryptor.finalize();
+    if (tag.size() != EncryptionHelper::fileTagLength)
+        return QByteArray();
+    return data + tag;
+}
+
+/* Passes @a input to a decryptor in pieces of the given sizes, the
+ * last size is repeated. Returns false if the decryption failed. */
+static bool decrypt(const QByteArray &input, const QVector<int> &pieceSizes, QByteArray *output)
+{
+    StreamingDecryptor decryptor(key, iv);
+    if (!decryptor.isValid())
+        return false;
+
+    QBuffer buffer(output);
+    buffer.open(QIODevice::WriteOnly);
+    int pos = 0;
+    for (int i = 0; pos < input.size(); ++i) {
+        const int size = qMin(pieceSizes.value(i, pieceSizes.last()), input.size() - pos);
+        if (!decryptor.update(input.constData() + pos, size, &buffer))
+            return false;
+        pos += size;
+    }
+    if (decryptor.received() != input.size())
+        return false;
+    return decryptor.finalize();
+}
+
+class TestStreamingEncryption : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRoundTrip_data()
+    {
+        QTest::addColumn<int>("size");
+        QTest::addColumn<int>("pieceSize");
+
+        QTest::newRow("empty") << 0 << 7;
+        QTest::newRow("one byte") << 1 << 1;
+        QTest::newRow("shorter than a tag") << 15 << 1;
+        QTest::newRow("as long as a tag") << 16 << 3;
+        QTest::newRow("odd pieces") << 100003 << 4099;
+        QTest::newRow("bigger than the buffer") << 2 * 1024 * 1024 + 7 << 1024 * 1024 + 1;
+        QTest::newRow("all at once") << 333333 << 333333;
+    }
+
+    void testRoundTrip()
+    {
+        QFETCH(int, size);
+        QFETCH(int, pieceSize);
+        const QByteArray data = randomData(size, 3);
+
+        const QByteArray encrypted = encrypt(data, pieceSize);
+        QCOMPARE(encrypted.size(), size + EncryptionHelper::fileTagLength);
+        // The pieces don't change the result
+        QCOMPARE(encrypted, encrypt(data, qMax(size, 1)));
+        if (size > 0)
+            QVERIFY(encrypted.left(size) != data);
+
+        QByteArray decrypted;
+        QVERIFY(decrypt(encrypted, { pieceSize }, &decrypted));
+        QCOMPARE(decrypted, data);
+
+        // Decrypting doesn't depend on how the encrypted data was cut
+        decrypted.clear();
+        QVERIFY(decrypt(encrypted, { 5, 11, pieceSize + 13 }, &decrypted));
+        QCOMPARE(decrypted, data);
+    }
+
+    void testTagSplitAcrossUpdates_data()
+    {
+        QTest::addColumn<QVector<int>>("pieceSizes");
+
+        // 100 bytes of data and 16 bytes of tag
+        QTest::newRow("tag in two pieces") << QVector<int>{ 110, 6 };
+        QTest::newRow("data and tag in one piece") << QVector<int>{ 90, 26 };
+        QTest::newRow("tag in its own piece") << QVector<int>{ 100, 16 };
+        QTest::newRow("byte by byte") << QVector<int>{ 1 };
+        QTest::newRow("tag in three pieces") << QVector<int>{ 95, 9, 3, 9 };
+    }
+
+    void testTagSplitAcrossUpdates()
+    {
+        QFETCH(QVector<int>, pieceSizes);
+        const QByteArray data = randomData(100, 4);
+
+        QByteArray decrypted;
+        QVERIFY(decrypt(encrypt(data, 100), pieceSizes, &decrypted));
+        QCOMPARE(decrypted, data);
+    }
+
+    void testTruncatedStream()
+    {
+        const QByteArray data = randomData(1000, 5);
+        const QByteArray encrypted = encrypt(data, 1000);
+        QByteArray decrypted;
+
+        // A byte of the tag is missing
+        QVERIFY(!decrypt(encrypted.left(encrypted.size() - 1), { 100 }, &decrypted));
+        // The tag is missing, the end of the data is taken as the tag
+        QVERIFY(!decrypt(encrypted.left(data.size()), { 100 }, &decrypted));
+        // Not even a tag
+        QVERIFY(!decrypt(encrypted.left(EncryptionHelper::fileTagLength - 1), { 100 }, &decrypted));
+        QVERIFY(!decrypt(QByteArray(), { 100 }, &decrypted));
+    }
+
+    void testTamperedStream()
+    {
+        const QByteArray data = randomData(1000, 6);
+        const QByteArray encrypted = encrypt(data, 1000);
+        QByteArray decrypted;
+
+        QByteArray tamperedTag = encrypted;
+        tamperedTag[tamperedTag.size() - 1] = char(tamperedTag.at(tamperedTag.size() - 1) ^ 0x01);
+        QVERIFY(!decrypt(tamperedTag, { 100 }, &decrypted));
+
+        QByteArray tamperedData = encrypted;
+        tamperedData[500] = char(tamperedData.at(500) ^ 0x80);
+        QVERIFY(!decrypt(tamperedData, { 100 }, &decrypted));
+
+        // With another iv the tag doesn't match either
+        StreamingDecryptor decryptor(key, randomData(16, 7));
+        QBuffer buffer(&decrypted);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(decryptor.update(encrypted.constData(), encrypted.size(), &buffer));
+        QVERIFY(!decryptor.finalize());
+    }
+};
+
+QTEST_APPLESS_MAIN(TestStreamingEncryption)
+#include "teststreamingencryption.moc"
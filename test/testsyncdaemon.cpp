@@ -0,0 +1,169 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+
+#include "syncenginetestutils.h"
+#include "cmd/syncdaemon.h"
+
+using namespace OCC;
+
+/* Reads the status the daemon serves on @a socketName */
+static QJsonObject daemonStatus(const QString &socketName)
+{
+    QLocalSocket socket;
+    QSignalSpy disconnected(&socket, &QLocalSocket::disconnected);
+    socket.connectToServer(socketName);
+    // The server answers from this thread's event loop
+    if (!disconnected.wait())
+        return QJsonObject();
+    return QJsonDocument::fromJson(socket.readAll()).object();
+}
+
+class TestSyncDaemon : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _socketDir;
+
+    QString socketName() const { return _socketDir.path() + "/status"; }
+
+private slots:
+    void testRemoteChangesArePolled()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        // The etag of the root only reflects its contents since 8.1
+        fakeFolder.account()->setServerVersion("10.0.0");
+
+        int etagPolls = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND" && request.rawHeader("Depth") == "0")
+                ++etagPolls;
+            return nullptr;
+        });
+
+        SyncDaemon daemon(&fakeFolder.syncEngine(), &fakeFolder.syncJournal(), fakeFolder.account(),
+            fakeFolder.localPath(), "/");
+        daemon.setPollInterval(1);
+        QVERIFY(daemon.setStatusSocket(socketName()));
+        QSignalSpy finished(&fakeFolder.syncEngine(), &SyncEngine::finished);
+        daemon.start();
+        QVERIFY(finished.wait());
+        QVERIFY(finished.last().first().toBool());
+
+        // The engine of the fake folder synced before and doesn't report the
+        // root etag again, so the first poll looks like a remote change
+        QVERIFY(finished.wait());
+        QCOMPARE(etagPolls, 1);
+
+        // Without changes the etag is polled but nothing is synced
+        QTRY_VERIFY(etagPolls >= 3);
+        QCOMPARE(finished.size(), 2);
+
+        fakeFolder.remoteModifier().insert("A/remote");
+        fakeFolder.remoteModifier().setContents("B/b1", 'x');
+        QVERIFY(finished.wait());
+        QVERIFY(finished.last().first().toBool());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        const QJsonObject status = daemonStatus(socketName());
+        QCOMPARE(status.value("state").toString(), QStringLiteral("idle"));
+        QCOMPARE(status.value("syncs").toInt(), 3);
+        QCOMPARE(status.value("failedSyncs").toInt(), 0);
+        QCOMPARE(status.value("remoteChanges").toInt(), 2);
+        QCOMPARE(status.value("downloads").toInt(), 2);
+        QCOMPARE(status.value("uploads").toInt(), 0);
+        QCOMPARE(status.value("lastSyncSuccess").toBool(), true);
+        QCOMPARE(status.value("lastEtag").toString(), fakeFolder.currentRemoteState().etag);
+    }
+
+    void testLocalChangesAreWatched()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.account()->setServerVersion("10.0.0");
+        QScopedValueRollback<qint64> minimumAge(SyncEngine::minimumFileAgeForUpload, 0);
+
+        SyncDaemon daemon(&fakeFolder.syncEngine(), &fakeFolder.syncJournal(), fakeFolder.account(),
+            fakeFolder.localPath(), "/");
+        // Only the folder watcher starts syncs in this test
+        daemon.setPollInterval(3600);
+        QVERIFY(daemon.setStatusSocket(socketName()));
+        QSignalSpy finished(&fakeFolder.syncEngine(), &SyncEngine::finished);
+        daemon.start();
+        QVERIFY(finished.wait());
+        QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), LocalDiscoveryStyle::FilesystemOnly);
+        QVERIFY(daemonStatus(socketName()).value("watcherReliable").toBool());
+
+        fakeFolder.localModifier().insert("A/local");
+        fakeFolder.localModifier().appendByte("B/b1");
+        // The notifications may come in more than one batch and start more than one sync
+        QTRY_COMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QTRY_COMPARE(daemonStatus(socketName()).value("state").toString(), QStringLiteral("idle"));
+        // Only the changed paths were looked at
+        QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), LocalDiscoveryStyle::DatabaseAndFilesystem);
+
+        const QJsonObject status = daemonStatus(socketName());
+        QCOMPARE(status.value("failedSyncs").toInt(), 0);
+        QCOMPARE(status.value("uploads").toInt(), 2);
+        QVERIFY(status.value("localChanges").toInt() >= 2);
+        QCOMPARE(status.value("remoteChanges").toInt(), 0);
+        QCOMPARE(status.value("pendingLocalChanges").toInt(), 0);
+    }
+
+    void testFailingPollsBackOff()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.account()->setServerVersion("10.0.0");
+
+        bool failPolls = true;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (failPolls && request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND" && request.rawHeader("Depth") == "0")
+                return new FakeErrorReply(op, request, this, 500);
+            return nullptr;
+        });
+
+        SyncDaemon daemon(&fakeFolder.syncEngine(), &fakeFolder.syncJournal(), fakeFolder.account(),
+            fakeFolder.localPath(), "/");
+        daemon.setPollInterval(1);
+        QVERIFY(daemon.setStatusSocket(socketName()));
+        QSignalSpy finished(&fakeFolder.syncEngine(), &SyncEngine::finished);
+        daemon.start();
+        QVERIFY(finished.wait());
+        QCOMPARE(daemonStatus(socketName()).value("pollIntervalMs").toInt(), 1000);
+
+        // Every failing poll doubles the interval
+        QTRY_COMPARE(daemonStatus(socketName()).value("pollIntervalMs").toInt(), 2000);
+        QTRY_COMPARE_WITH_TIMEOUT(daemonStatus(socketName()).value("pollIntervalMs").toInt(), 4000, 6000);
+        QCOMPARE(finished.size(), 1);
+
+        // The first successful poll resets it
+        failPolls = false;
+        QVERIFY(finished.wait(10000));
+        QCOMPARE(daemonStatus(socketName()).value("pollIntervalMs").toInt(), 1000);
+    }
+
+    void testHugePollInterval()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+
+        SyncDaemon daemon(&fakeFolder.syncEngine(), &fakeFolder.syncJournal(), fakeFolder.account(),
+            fakeFolder.localPath(), "/");
+        // Ten years don't fit into a timer in ms
+        daemon.setPollInterval(10 * 365 * 24 * 3600);
+        QVERIFY(daemon.setStatusSocket(socketName()));
+        QSignalSpy finished(&fakeFolder.syncEngine(), &SyncEngine::finished);
+        daemon.start();
+        QVERIFY(finished.wait());
+        QCOMPARE(daemonStatus(socketName()).value("pollIntervalMs").toInt(), 24 * 3600 * 1000);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncDaemon)
+#include "testsyncdaemon.moc"
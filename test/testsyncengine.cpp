@@ -715,6 +715,327 @@ private slots:
         QTextCodec::setCodecForLocale(utf8Locale);
 #endif
     }
+
+    /**
+     * A full remote discovery lists the whole tree with one request,
+     * unless the server refuses or ignores Depth: infinity.
+     */
+    void testBulkRemoteListing()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().mkdir("A/deep");
+        fakeFolder.remoteModifier().mkdir("A/deep/er");
+        fakeFolder.remoteModifier().insert("A/deep/er/file");
+        fakeFolder.remoteModifier().mkdir("A/empty");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // the root, A, B, C, S, A/deep, A/deep/er and A/empty
+        const int directoryCount = 8;
+
+        enum { Honor, Refuse, Ignore } recursiveMode = Honor;
+        int propfinds = 0, recursivePropfinds = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) != "PROPFIND")
+                return nullptr;
+            ++propfinds;
+            if (request.rawHeader("Depth") != "infinity")
+                return nullptr;
+            ++recursivePropfinds;
+            if (recursiveMode == Refuse)
+                return new FakeErrorReply(op, request, this, 403);
+            if (recursiveMode == Ignore) {
+                QNetworkRequest depthOne = request;
+                depthOne.setRawHeader("Depth", "1");
+                return new FakePropfindReply(fakeFolder.remoteModifier(), op, depthOne, this);
+            }
+            return nullptr;
+        });
+
+        // Without the option, every directory is listed on its own
+        fakeFolder.syncJournal().forceRemoteDiscoveryNextSync();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(propfinds, directoryCount);
+        QCOMPARE(recursivePropfinds, 0);
+
+        SyncOptions syncOptions;
+        syncOptions._bulkRemoteListing = true;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        // Not used when the etags of the folders are known
+        propfinds = 0;
+        fakeFolder.remoteModifier().insert("B/new");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(recursivePropfinds, 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        propfinds = 0;
+        fakeFolder.remoteModifier().insert("A/deep/er/file2");
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        fakeFolder.syncJournal().forceRemoteDiscoveryNextSync();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(propfinds, 1);
+        QCOMPARE(recursivePropfinds, 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // The server refuses: the root is listed again, and everything else too
+        recursiveMode = Refuse;
+        propfinds = recursivePropfinds = 0;
+        fakeFolder.remoteModifier().insert("C/new");
+        fakeFolder.syncJournal().forceRemoteDiscoveryNextSync();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(recursivePropfinds, 1);
+        QCOMPARE(propfinds, directoryCount + 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // The server treats it like Depth: 1, subdirectories must not appear empty
+        recursiveMode = Ignore;
+        propfinds = recursivePropfinds = 0;
+        fakeFolder.remoteModifier().insert("A/empty/new");
+        fakeFolder.syncJournal().forceRemoteDiscoveryNextSync();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(recursivePropfinds, 1);
+        QCOMPARE(propfinds, directoryCount);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentLocalState().find("A/deep/er/file2"));
+    }
+
+    void testBulkRemoteListingFirstSync()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/B");
+        fakeFolder.remoteModifier().mkdir("A/B/C");
+        fakeFolder.remoteModifier().insert("A/B/C/file");
+        fakeFolder.remoteModifier().insert("A/file");
+        fakeFolder.remoteModifier().mkdir("D");
+
+        SyncOptions syncOptions;
+        syncOptions._bulkRemoteListing = true;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        int propfinds = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND")
+                ++propfinds;
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(propfinds, 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testConcurrentSyncs()
+    {
+        // FolderMan runs the engines of several folders at the same time
+        FakeFolder fakeFolder1{ FileInfo::A12_B12_C12_S12() };
+        FakeFolder fakeFolder2{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder1.localModifier().insert("A/new1");
+        fakeFolder1.remoteModifier().insert("B/new1");
+        fakeFolder2.localModifier().insert("A/new2");
+        fakeFolder2.remoteModifier().insert("B/new2");
+
+        QSignalSpy finished1(&fakeFolder1.syncEngine(), SIGNAL(finished(bool)));
+        QSignalSpy finished2(&fakeFolder2.syncEngine(), SIGNAL(finished(bool)));
+        fakeFolder1.scheduleSync();
+        fakeFolder2.scheduleSync();
+
+        // Both are running before either can finish
+        QCoreApplication::processEvents();
+        QVERIFY(fakeFolder1.syncEngine().isSyncRunning());
+        QVERIFY(fakeFolder2.syncEngine().isSyncRunning());
+
+        for (int i = 0; i < 100 && (finished1.isEmpty() || finished2.isEmpty()); ++i)
+            QTest::qWait(50);
+        QCOMPARE(finished1.count(), 1);
+        QCOMPARE(finished2.count(), 1);
+        QVERIFY(finished1[0][0].toBool());
+        QVERIFY(finished2[0][0].toBool());
+        QVERIFY(!fakeFolder1.syncEngine().isSyncRunning());
+        QVERIFY(!fakeFolder2.syncEngine().isSyncRunning());
+        QCOMPARE(fakeFolder1.currentLocalState(), fakeFolder1.currentRemoteState());
+        QCOMPARE(fakeFolder2.currentLocalState(), fakeFolder2.currentRemoteState());
+
+        // And they can sync again
+        fakeFolder2.localModifier().insert("C/again");
+        QVERIFY(fakeFolder2.syncOnce());
+        QCOMPARE(fakeFolder2.currentLocalState(), fakeFolder2.currentRemoteState());
+    }
+
+    void testConcurrentSyncsInWorkerThreads()
+    {
+        FakeFolder fakeFolder1{ FileInfo::A12_B12_C12_S12() };
+        FakeFolder fakeFolder2{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder1.localModifier().insert("A/new1");
+        fakeFolder1.remoteModifier().insert("B/new1");
+        fakeFolder2.localModifier().insert("A/new2");
+        fakeFolder2.remoteModifier().insert("B/new2");
+
+        QThread thread1;
+        QThread thread2;
+        fakeFolder1.moveToThread(&thread1);
+        fakeFolder2.moveToThread(&thread2);
+        thread1.start();
+        thread2.start();
+
+        // Delivered in this thread
+        QObject receiver;
+        int finished = 0;
+        bool success = true;
+        for (auto engine : { &fakeFolder1.syncEngine(), &fakeFolder2.syncEngine() }) {
+            connect(engine, &SyncEngine::finished, &receiver, [&](bool ok) {
+                ++finished;
+                success = success && ok;
+            });
+        }
+        fakeFolder1.scheduleSync();
+        fakeFolder2.scheduleSync();
+        for (int i = 0; i < 200 && finished < 2; ++i)
+            QTest::qWait(50);
+
+        thread1.quit();
+        thread2.quit();
+        thread1.wait();
+        thread2.wait();
+        QCOMPARE(finished, 2);
+        QVERIFY(success);
+        QCOMPARE(fakeFolder1.currentLocalState(), fakeFolder1.currentRemoteState());
+        QCOMPARE(fakeFolder2.currentLocalState(), fakeFolder2.currentRemoteState());
+    }
+
+    void testServerSideCopy()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions syncOptions;
+        syncOptions._serverSideCopies = true;
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+
+        int nPUT = 0;
+        int nCOPY = 0;
+        bool failCopy = false;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation)
+                ++nPUT;
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "COPY") {
+                ++nCOPY;
+                if (failCopy)
+                    return new FakeErrorReply(op, request, this, 412);
+            }
+            return nullptr;
+        });
+
+        // Bigger than OwncloudPropagator::smallFileSize()
+        const int size = 200 * 1000;
+        fakeFolder.localModifier().insert("A/big", size, 'B');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nPUT, 1);
+        QCOMPARE(nCOPY, 0);
+
+        // Copies are made on the server
+        fakeFolder.localModifier().insert("B/big", size, 'B');
+        fakeFolder.localModifier().mkdir("D");
+        fakeFolder.localModifier().insert("D/big", size, 'B');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 1);
+        QCOMPARE(nCOPY, 2);
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("D/big"), &record));
+        QCOMPARE(record._fileId, fakeFolder.currentRemoteState().find("D/big")->fileId);
+        QCOMPARE(record._etag, fakeFolder.currentRemoteState().find("D/big")->etag.toUtf8());
+        // The copies get the modification time of the local files
+        for (const QString &path : { QStringLiteral("B/big"), QStringLiteral("D/big") }) {
+            QCOMPARE(Utility::qDateTimeToTime_t(fakeFolder.currentRemoteState().find(path)->lastModified),
+                Utility::qDateTimeToTime_t(QFileInfo(fakeFolder.localPath() + path).lastModified()));
+        }
+
+        // Other content and small files are uploaded
+        fakeFolder.localModifier().insert("C/big", size, 'C');
+        fakeFolder.localModifier().insert("A/small", 100, 'B');
+        fakeFolder.localModifier().insert("B/small", 100, 'B');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 4);
+        QCOMPARE(nCOPY, 2);
+
+        // A failing copy falls back to an upload
+        failCopy = true;
+        fakeFolder.localModifier().insert("C/big2", size, 'B');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 5);
+        QCOMPARE(nCOPY, 3);
+    }
+
+    // The progress of transfers is only emitted every progressUpdateInterval
+    void testProgressCoalescing()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        // FakeFolder emits every progress step
+        QScopedValueRollback<int> setInterval(SyncEngine::progressUpdateInterval, 200);
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "chunking", "1.0" } } } });
+
+        // Many small chunks that take some time
+        SyncOptions syncOptions;
+        syncOptions._initialChunkSize = 1000;
+        syncOptions._targetChunkUploadDuration = std::chrono::milliseconds(0);
+        fakeFolder.syncEngine().setSyncOptions(syncOptions);
+        int nChunkPUT = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation && request.url().path().contains("/uploads/")) {
+                ++nChunkPUT;
+                return new DelayedReply<FakePutReply>(20, fakeFolder.uploadState(), op, request, outgoingData->readAll(), this);
+            }
+            return nullptr;
+        });
+
+        // The sizes of the finished files, they are part of the completed size
+        QSet<QString> completedFiles;
+        quint64 completedFilesSize = 0;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, [&](const SyncFileItemPtr &item) {
+            if (!completedFiles.contains(item->_file)) {
+                completedFiles.insert(item->_file);
+                if (ProgressInfo::isSizeDependent(*item))
+                    completedFilesSize += item->_size;
+            }
+        });
+
+        int nTransferEmissions = 0;
+        quint64 lastCompletedSize = 0;
+        quint64 lastTotalSize = 0;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress, [&](const ProgressInfo &progress) {
+            // itemCompleted() follows the emission for a finished file
+            quint64 expected = completedFilesSize;
+            const SyncFileItem &last = progress._lastCompletedItem;
+            const bool itemCompletion = !last.isEmpty() && !completedFiles.contains(last._file);
+            if (itemCompletion && ProgressInfo::isSizeDependent(last))
+                expected += last._size;
+            for (const auto &current : progress._currentItems) {
+                if (ProgressInfo::isSizeDependent(current._item))
+                    expected += current._progress._completed;
+            }
+            QCOMPARE(progress.completedSize(), expected);
+            QVERIFY(progress.completedSize() >= lastCompletedSize);
+
+            if (!itemCompletion && !progress._currentItems.isEmpty())
+                ++nTransferEmissions;
+            lastCompletedSize = progress.completedSize();
+            lastTotalSize = progress.totalSize();
+        });
+
+        const int size = 50 * 1000;
+        fakeFolder.localModifier().insert("A/big1", size);
+        fakeFolder.localModifier().insert("A/big2", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QCOMPARE(nChunkPUT, 100);
+        QCOMPARE(completedFilesSize, quint64(2 * size));
+        QCOMPARE(lastTotalSize, quint64(2 * size));
+        QCOMPARE(lastCompletedSize, lastTotalSize);
+        // Every chunk reports progress, the timer emits a few of them
+        QVERIFY(nTransferEmissions >= 1);
+        QVERIFY(nTransferEmissions < nChunkPUT / 4);
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
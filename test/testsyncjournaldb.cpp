@@ -205,6 +205,55 @@ private slots:
         QVERIFY(!_db.conflictRecord(record.path).isValid());
     }
 
+    void testPreloadErrorBlacklistAndConflicts()
+    {
+        auto makeEntry = [](const QString &file, int retryCount) {
+            SyncJournalErrorBlacklistRecord entry;
+            entry._file = file;
+            entry._lastTryEtag = "etag";
+            entry._lastTryTime = 1000;
+            entry._retryCount = retryCount;
+            return entry;
+        };
+        _db.setErrorBlacklistEntry(makeEntry("preload/kept", 1));
+        _db.setErrorBlacklistEntry(makeEntry("preload/stale", 1));
+        _db.setErrorBlacklistEntry(makeEntry("preload/wiped", 1));
+        ConflictRecord conflict;
+        conflict.path = "preload/conflict";
+        conflict.baseFileId = "id";
+        _db.setConflictRecord(conflict);
+
+        QVERIFY(_db.preloadErrorBlacklistAndConflicts());
+        QCOMPARE(_db.errorBlacklistEntry("preload/kept")._retryCount, 1);
+        QVERIFY(_db.conflictRecord(conflict.path).isValid());
+
+        _db.setErrorBlacklistEntry(makeEntry("preload/kept", 2));
+        _db.setErrorBlacklistEntry(makeEntry("preload/new", 1));
+        _db.wipeErrorBlacklistEntry("preload/wiped");
+        _db.deleteStaleErrorBlacklistEntries(QSet<QString>() << "preload/kept" << "preload/new" << "preload/wiped");
+        _db.deleteConflictRecord(conflict.path);
+        ConflictRecord newConflict;
+        newConflict.path = "preload/newconflict";
+        _db.setConflictRecord(newConflict);
+
+        QCOMPARE(_db.errorBlacklistEntry("preload/kept")._retryCount, 2);
+        QVERIFY(!_db.errorBlacklistEntry("preload/stale").isValid());
+        QVERIFY(!_db.errorBlacklistEntry("preload/wiped").isValid());
+        QVERIFY(!_db.conflictRecord(conflict.path).isValid());
+
+        // The changes are in the database after the flush
+        _db.flushErrorBlacklistAndConflicts();
+        QCOMPARE(_db.errorBlacklistEntry("preload/kept")._retryCount, 2);
+        QVERIFY(_db.errorBlacklistEntry("preload/new").isValid());
+        QVERIFY(!_db.errorBlacklistEntry("preload/stale").isValid());
+        QVERIFY(!_db.errorBlacklistEntry("preload/wiped").isValid());
+        QVERIFY(!_db.conflictRecord(conflict.path).isValid());
+        QVERIFY(_db.conflictRecord(newConflict.path).isValid());
+
+        _db.wipeErrorBlacklist();
+        _db.deleteConflictRecord(newConflict.path);
+    }
+
     void testAvoidReadFromDbOnNextSync()
     {
         auto invalidEtag = QByteArray("_invalid_");
@@ -320,6 +369,137 @@ private slots:
         QVERIFY(checkElements());
     }
 
+    void testFilesBelowPath()
+    {
+        SyncJournalDb db(_tempDir.path() + "/below.db");
+        QByteArrayList elements;
+        elements
+            << "fo"
+            << "foo"
+            << "foo-2"
+            << "foo-2/file"
+            << "foo/file"
+            << "foo/sub"
+            << "foo/sub/x";
+        for (const auto &elem : elements) {
+            SyncJournalFileRecord record;
+            record._path = elem;
+            QVERIFY(db.setFileRecord(record));
+        }
+
+        auto filesBelow = [&](const QByteArray &path) {
+            QByteArrayList result;
+            db.getFilesBelowPath(path, [&](const SyncJournalFileRecord &rec) { result << rec._path; });
+            return result;
+        };
+
+        // the contents of a directory directly follow the directory itself
+        QCOMPARE(filesBelow("foo"), QByteArrayList({ "foo/file", "foo/sub", "foo/sub/x" }));
+        QCOMPARE(filesBelow("foo/sub"), QByteArrayList({ "foo/sub/x" }));
+        QCOMPARE(filesBelow("foo/file"), QByteArrayList());
+        QCOMPARE(filesBelow(""), QByteArrayList({ "fo", "foo-2", "foo-2/file", "foo", "foo/file", "foo/sub", "foo/sub/x" }));
+
+        // Records written by older clients don't have a sort key, it is
+        // filled in when the database is opened
+        db.close();
+        sqlite3 *sqlDb = nullptr;
+        QCOMPARE(sqlite3_open(QFile::encodeName(db.databaseFilePath()).constData(), &sqlDb), SQLITE_OK);
+        QCOMPARE(sqlite3_exec(sqlDb, "UPDATE metadata SET pathSortKey = NULL WHERE path = 'foo/sub';", nullptr, nullptr, nullptr), SQLITE_OK);
+        sqlite3_close(sqlDb);
+        QCOMPARE(filesBelow("foo"), QByteArrayList({ "foo/file", "foo/sub", "foo/sub/x" }));
+    }
+
+    void testCloseReleasesTheFile()
+    {
+        const QString dbFile = _tempDir.path() + "/checkpoint.db";
+        {
+            SyncJournalDb db(dbFile);
+            SyncJournalFileRecord record;
+            record._path = "file";
+            QVERIFY(db.setFileRecord(record));
+            db.commit("test");
+            db.walCheckpoint();
+            // Like Folder::wipe(): the files are removed right after close()
+            db.close();
+            for (const QString &suffix : { "", "-wal", "-shm" }) {
+                if (QFileInfo::exists(dbFile + suffix))
+                    QVERIFY(QFile::remove(dbFile + suffix));
+            }
+        }
+        QVERIFY(!QFileInfo::exists(dbFile));
+        QVERIFY(!QFileInfo::exists(dbFile + "-wal"));
+        QVERIFY(!QFileInfo::exists(dbFile + "-shm"));
+    }
+
+    void testPostSyncCleanup()
+    {
+        SyncJournalDb db(_tempDir.path() + "/cleanup.db");
+        QByteArrayList elements;
+        elements
+            << "keep"
+            << "gone"
+            << "dir"
+            << "dir/gone"
+            << "dir/keep"
+            << "unavailable"
+            << "unavailable/file"
+            << "unavailable-too"
+            << "unavailablx"
+            << "t\xc3\xb6st";
+        for (const auto &elem : elements) {
+            SyncJournalFileRecord record;
+            record._path = elem;
+            QVERIFY(db.setFileRecord(record));
+        }
+
+        QSet<QString> seen = { "keep", "dir", "dir/keep", QString::fromUtf8("t\xc3\xb6st"), "not/in/db" };
+        QSet<QString> unavailable = { "unavailable", "a/b" };
+        QVERIFY(db.postSyncCleanup(seen, unavailable));
+
+        auto exists = [&](const QByteArray &path) {
+            SyncJournalFileRecord record;
+            return db.getFileRecord(path, &record) && record.isValid();
+        };
+        QVERIFY(exists("keep"));
+        QVERIFY(!exists("gone"));
+        QVERIFY(exists("dir"));
+        QVERIFY(!exists("dir/gone"));
+        QVERIFY(exists("dir/keep"));
+        QVERIFY(exists("t\xc3\xb6st"));
+        // prefixes are kept as is, like QString::startsWith()
+        QVERIFY(exists("unavailable"));
+        QVERIFY(exists("unavailable/file"));
+        QVERIFY(exists("unavailable-too"));
+        QVERIFY(!exists("unavailablx"));
+        QCOMPARE(db.getFileRecordCount(), 7);
+    }
+
+    void testDatabaseFileRemoved()
+    {
+#ifdef Q_OS_WIN
+        QSKIP("An open database can't be removed on Windows");
+#endif
+        const int oldInterval = SyncJournalDb::fileExistenceCheckInterval;
+        SyncJournalDb::fileExistenceCheckInterval = 50;
+
+        SyncJournalDb db(_tempDir.path() + "/removed.db");
+        SyncJournalFileRecord record;
+        record._path = "foo";
+        record._type = ItemTypeFile;
+        record._etag = "123";
+        record._fileId = "abc";
+        QVERIFY(db.setFileRecord(record));
+        QVERIFY(db.getFileRecord(QByteArrayLiteral("foo"), &record));
+        QVERIFY(record.isValid());
+
+        // the removal is noticed once the check interval passed, see #6049
+        QVERIFY(QFile::remove(db.databaseFilePath()));
+        QThread::msleep(100);
+        QVERIFY(!db.getFileRecord(QByteArrayLiteral("foo"), &record));
+
+        SyncJournalDb::fileExistenceCheckInterval = oldInterval;
+    }
+
 private:
     SyncJournalDb _db;
 };
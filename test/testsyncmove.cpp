@@ -231,6 +231,59 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), remoteInfo);
     }
 
+    void testLocalMoveDetectionByContent()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+
+        int nPUT = 0;
+        int nDELETE = 0;
+        int nMOVE = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &req, QIODevice *) {
+            if (op == QNetworkAccessManager::PutOperation)
+                ++nPUT;
+            if (op == QNetworkAccessManager::DeleteOperation)
+                ++nDELETE;
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "MOVE")
+                ++nMOVE;
+            return nullptr;
+        });
+
+        // Uploaded files have a checksum in the db
+        fakeFolder.localModifier().insert("A/a3", 100, 'N');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 1);
+
+        // Written again elsewhere: same content and mtime, but a new inode
+        auto mtime = fakeFolder.remoteModifier().find("A/a3")->lastModified;
+        fakeFolder.localModifier().insert("B/b3", 100, 'N');
+        fakeFolder.localModifier().setModTime("B/b3", mtime);
+        fakeFolder.localModifier().remove("A/a3");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 1);
+        QCOMPARE(nDELETE, 0);
+        QCOMPARE(nMOVE, 1);
+
+        // A copy is not a move
+        fakeFolder.localModifier().insert("C/c3", 100, 'N');
+        fakeFolder.localModifier().setModTime("C/c3", mtime);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 2);
+        QCOMPARE(nMOVE, 1);
+
+        // Same size and mtime but a different content
+        fakeFolder.localModifier().insert("A/a4", 100, 'O');
+        fakeFolder.localModifier().setModTime("A/a4", mtime);
+        fakeFolder.localModifier().remove("C/c3");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nPUT, 3);
+        QCOMPARE(nDELETE, 1);
+        QCOMPARE(nMOVE, 1);
+    }
+
     void testDuplicateFileId_data()
     {
         QTest::addColumn<QString>("prefix");
@@ -0,0 +1,104 @@
+/*
+   This software is in the public domain, furnished "as is", without technical
+   support, and with no warranty, express or implied, as to its usefulness for
+   any purpose.
+*/
+
+#include <QtTest>
+
+#include <messages/messageobject.h>
+#include <messages/vitalsignsindex.h>
+
+using namespace OCC;
+
+static MessageObject makeMessage(const QString &patient, const QDateTime &time, int pulse, double weight)
+{
+    MessageObject msg;
+    msg.patientName = patient;
+    msg.birthday = QDate(1940, 1, 1);
+    msg.pulse = pulse;
+    msg.dtPulse = time;
+    msg.weight = weight;
+    msg.dtWeight = time;
+    return msg;
+}
+
+class TestVitalSignsIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRangeQuery()
+    {
+        VitalSignsIndex index;
+        const QDateTime base(QDate(2018, 10, 1), QTime(8, 0));
+
+        // added out of order, the series must still be sorted
+        MessageObject late = makeMessage("Anna", base.addDays(2), 80, 70.5);
+        MessageObject early = makeMessage("Anna", base, 60, 71);
+        MessageObject middle = makeMessage("Anna", base.addDays(1), 70, qQNaN());
+        MessageObject other = makeMessage("Bert", base, 100, 90);
+        index.addMessage(late);
+        index.addMessage(early);
+        index.addMessage(middle);
+        index.addMessage(other);
+
+        const QString anna = early.patientKey();
+        auto pulse = index.range(anna, VitalSignsIndex::Pulse);
+        QCOMPARE(pulse.size(), 3);
+        QCOMPARE(pulse.value(0), 60.);
+        QCOMPARE(pulse.value(1), 70.);
+        QCOMPARE(pulse.value(2), 80.);
+        QCOMPARE(pulse.time(2), base.addDays(2));
+
+        // unset values are not indexed
+        QCOMPARE(index.range(anna, VitalSignsIndex::BodyWeight).size(), 2);
+        QCOMPARE(index.range(anna, VitalSignsIndex::BloodSugar).size(), 0);
+
+        auto window = index.range(anna, VitalSignsIndex::Pulse, base.addSecs(60), base.addDays(1));
+        QCOMPARE(window.size(), 1);
+        QCOMPARE(window.value(0), 70.);
+
+        auto summary = VitalSignsIndex::summarize(pulse);
+        QCOMPARE(summary.count, 3);
+        QCOMPARE(summary.min, 60.);
+        QCOMPARE(summary.max, 80.);
+        QCOMPARE(summary.mean, 70.);
+        QCOMPARE(summary.last, 80.);
+
+        QCOMPARE(index.range(other.patientKey(), VitalSignsIndex::Pulse).size(), 1);
+        QVERIFY(index.range("nobody", VitalSignsIndex::Pulse).isEmpty());
+    }
+
+    void testReplaceAndRemove()
+    {
+        VitalSignsIndex index;
+        const QDateTime base(QDate(2018, 10, 1), QTime(8, 0));
+        MessageObject first = makeMessage("Anna", base, 60, 71);
+        MessageObject second = makeMessage("Anna", base.addDays(1), 70, 72);
+        index.addMessage(first);
+        index.addMessage(second);
+
+        // adding a message again replaces its observations
+        second.pulse = 75;
+        index.addMessage(second);
+        auto pulse = index.range(first.patientKey(), VitalSignsIndex::Pulse);
+        QCOMPARE(pulse.size(), 2);
+        QCOMPARE(pulse.value(1), 75.);
+
+        index.removeMessage(first.messageId);
+        pulse = index.range(first.patientKey(), VitalSignsIndex::Pulse);
+        QCOMPARE(pulse.size(), 1);
+        QCOMPARE(pulse.value(0), 75.);
+
+        QVERIFY(index.trendSummaryHtml(first.patientKey()).isEmpty());
+        index.addMessage(first);
+        QVERIFY(!index.trendSummaryHtml(first.patientKey()).isEmpty());
+
+        index.clear();
+        QVERIFY(index.range(first.patientKey(), VitalSignsIndex::Pulse).isEmpty());
+    }
+};
+
+QTEST_APPLESS_MAIN(TestVitalSignsIndex)
+#include "testvitalsignsindex.moc"
@@ -473,6 +473,109 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+
+    void testParserIncremental() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:permissions>RDNVCK</oc:permissions>"
+              "<oc:data-fingerprint></oc:data-fingerprint>"
+              "<d:getetag>\"5527beb0400b0\"</d:getetag>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/quitte%20&amp;.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<oc:permissions>RDNVW</oc:permissions>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<d:resourcetype/>"
+              "<d:getlastmodified>Fri, 06 Feb 2015 13:49:55 GMT</d:getlastmodified>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "<oc:checksums><oc:checksum>SHA1:abc MD5:def</oc:checksum></oc:checksums>"
+              "<oc:share-types><oc:share-type>0</oc:share-type></oc:share-types>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:downloadURL/>"
+              "<oc:dDC/>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 404 Not Found</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+        QVector<LsColEntry> entries;
+        connect(&parser, &LsColXMLParser::directoryListingEntry, this, [&](const LsColEntry &entry) {
+            entries.append(entry);
+        });
+        connect( &parser, SIGNAL(directoryListingSubfolders(const QStringList&)),
+                 this, SLOT(slotDirectoryListingSubFolders(const QStringList&)) );
+        connect( &parser, SIGNAL(finishedWithoutError()),
+                 this, SLOT(slotFinishedSuccessfully()) );
+
+        // the reply arrives in tiny pieces, the entries are emitted as soon as they are complete
+        parser.start(nullptr, "/oc/remote.php/webdav/sharefolder");
+        for (int i = 0; i < testXml.size(); i += 7) {
+            QVERIFY(parser.addData(testXml.mid(i, 7)));
+            if (i + 7 < testXml.indexOf("</d:response>"))
+                QCOMPARE(entries.size(), 0);
+        }
+        QCOMPARE(entries.size(), 2);
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+        QVERIFY(_success);
+        QCOMPARE(_subdirs, QStringList("/oc/remote.php/webdav/sharefolder/"));
+
+        const LsColEntry &dir = entries.at(0);
+        QCOMPARE(dir.href, QString("/oc/remote.php/webdav/sharefolder"));
+        QVERIFY(dir.hasResourceType);
+        QVERIFY(dir.isCollection);
+        QCOMPARE(dir.contentLength, qint64(-1));
+        QCOMPARE(dir.etag, QByteArray("\"5527beb0400b0\""));
+        QCOMPARE(dir.remotePerm, RemotePermissions("RDNVCK"));
+        QVERIFY(dir.hasDataFingerprint);
+        QVERIFY(dir.dataFingerprint.isEmpty());
+
+        const LsColEntry &file = entries.at(1);
+        QCOMPARE(file.href, QString("/oc/remote.php/webdav/sharefolder/quitte &.pdf"));
+        QVERIFY(file.hasResourceType);
+        QVERIFY(!file.isCollection);
+        QCOMPARE(file.contentLength, qint64(121780));
+        QCOMPARE(file.lastModified, time_t(1423230595));
+        QCOMPARE(file.fileId, QByteArray("00004215ocobzus5kn6s"));
+        QCOMPARE(file.checksums, QByteArray("<checksum>SHA1:abc MD5:def</checksum>"));
+        QVERIFY(file.isShared);
+        // properties with a 404 status are not set
+        QVERIFY(file.directDownloadUrl.isEmpty());
+        QVERIFY(!file.hasDataFingerprint);
+    }
+
+    void testParserTruncated() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>";
+
+        LsColXMLParser parser;
+        parser.start(nullptr, "/oc/remote.php/webdav/sharefolder");
+        // more data could follow
+        QVERIFY(parser.addData(testXml));
+        QVERIFY(!parser.finish());
+    }
 };
 
     QTEST_GUILESS_MAIN(TestXmlParse)